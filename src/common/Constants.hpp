@@ -6,14 +6,25 @@
 namespace bb {
 
     // IPC configuration
+    // On the SOCK_SEQPACKET endpoint this is also the largest accepted packet
     inline constexpr std::size_t MAX_MESSAGE_SIZE       = 64 * 1024; // 64 KiB
     inline constexpr int         IPC_CONNECT_TIMEOUT_MS = 1000;
     inline constexpr int         IPC_READ_TIMEOUT_MS    = 1000;
     inline constexpr int         IPC_WRITE_TIMEOUT_MS   = 1000;
+    // Room a connection's receive buffer starts with; a pooled block in the secure
+    // arena. It only grows for a line (or packet) longer than this.
+    inline constexpr std::size_t IPC_READ_CHUNK = 2048;
+
+    // Most events one `next` batch returns (the event queue's capacity)
+    inline constexpr int NEXT_BATCH_MAX = 256;
+
+    // Most requests one `batch` message may carry
+    inline constexpr int MAX_BATCH_REQUESTS = 32;
 
     // Pinentry timeouts
     inline constexpr int PINENTRY_REQUEST_TIMEOUT_MS = 5 * 60 * 1000;  // 5 minutes
     inline constexpr int PINENTRY_RESULT_TIMEOUT_MS  = 10 * 1000;       // wait for terminal result after submit
+    inline constexpr int PINENTRY_RETRY_TIMEOUT_MS   = 10 * 1000;       // wait for the next request after a reported retry
 
     // Authentication
     inline constexpr int MAX_AUTH_RETRIES = 3;
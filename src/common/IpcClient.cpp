@@ -1,46 +1,144 @@
 #include "IpcClient.hpp"
 #include "Constants.hpp"
+#include "Paths.hpp"
 
+#include <QElapsedTimer>
+#include <QFile>
 #include <QJsonDocument>
 #include <QLocalSocket>
 
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
 namespace bb {
 
-    IpcClient::IpcClient(const QString& socketPath) : m_socketPath(socketPath) {}
+    namespace {
 
-    std::optional<QJsonObject> IpcClient::sendRequest(const QJsonObject& request, int timeoutMs) {
-        QLocalSocket socket;
-        socket.connectToServer(m_socketPath);
+        bool waitForFd(int fd, short events, int timeoutMs) {
+            pollfd pfd{fd, events, 0};
+            int    rc;
+            do {
+                rc = ::poll(&pfd, 1, timeoutMs);
+            } while (rc == -1 && errno == EINTR);
+            return rc > 0 && (pfd.revents & events);
+        }
 
-        if (!socket.waitForConnected(IPC_CONNECT_TIMEOUT_MS))
-            return std::nullopt;
+        // nullopt unless the line is one JSON object; callers skip such lines
+        std::optional<QJsonObject> parseReply(QByteArrayView line) {
+            QJsonParseError parseError;
+            const auto      doc = QJsonDocument::fromJson(QByteArray::fromRawData(line.data(), line.size()), &parseError);
+            if (parseError.error != QJsonParseError::NoError || !doc.isObject())
+                return std::nullopt;
+            return doc.object();
+        }
 
-        QByteArray data = QJsonDocument(request).toJson(QJsonDocument::Compact);
-        data.append('\n');
+        // Blocking connect to an AF_UNIX endpoint; -1 if it is unreachable
+        int connectUnix(const QString& socketPath, int type) {
+            const QByteArray path = QFile::encodeName(socketPath);
 
-        if (socket.write(data) == -1 || !socket.waitForBytesWritten(IPC_WRITE_TIMEOUT_MS))
-            return std::nullopt;
+            sockaddr_un      addr{};
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= static_cast<qsizetype>(sizeof(addr.sun_path)))
+                return -1;
+            std::memcpy(addr.sun_path, path.constData(), static_cast<std::size_t>(path.size()));
 
-        if (!socket.waitForReadyRead(timeoutMs))
-            return std::nullopt;
+            const int fd = ::socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+            if (fd == -1)
+                return -1;
+
+            if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+                ::close(fd);
+                return -1;
+            }
+            return fd;
+        }
+
+        // Request/reply over the SOCK_SEQPACKET endpoint: one send(), one recv(),
+        // no line reassembly. Returns false only if the endpoint is unreachable so
+        // the caller can fall back to the stream socket; once connected the
+        // request has been delivered and an empty reply means failure.
+        bool exchangePacket(const QString& socketPath, const QByteArray& request, int timeoutMs, SecretString& reply) {
+            const int fd = connectUnix(socketPath, SOCK_SEQPACKET);
+            if (fd == -1)
+                return false;
+
+            reply.clear();
+            if (request.size() <= static_cast<qsizetype>(MAX_MESSAGE_SIZE) && waitForFd(fd, POLLOUT, IPC_WRITE_TIMEOUT_MS) &&
+                ::send(fd, request.constData(), static_cast<std::size_t>(request.size()), MSG_NOSIGNAL | MSG_DONTWAIT) == request.size()) {
+                // The daemon sends each reply as one packet; keep reading only in
+                // case it was a batch split across several. Each packet's length is
+                // peeked first and it is received straight into the arena reply.
+                while (!reply.view().endsWith('\n') && waitForFd(fd, POLLIN, timeoutMs)) {
+                    const auto length = ::recv(fd, nullptr, 0, MSG_PEEK | MSG_TRUNC);
+                    if (length <= 0 || reply.size() + static_cast<std::size_t>(length) > MAX_MESSAGE_SIZE) {
+                        reply.clear();
+                        break;
+                    }
+                    const auto received = ::recv(fd, reply.spare(static_cast<std::size_t>(length)), static_cast<std::size_t>(length), 0);
+                    if (received != length) {
+                        reply.clear();
+                        break;
+                    }
+                    reply.commit(static_cast<std::size_t>(received));
+                }
+                if (!reply.view().endsWith('\n'))
+                    reply.clear();
+            }
+
+            ::close(fd);
+            return true;
+        }
+
+        QByteArray exchangeStream(const QString& socketPath, const QByteArray& request, int timeoutMs) {
+            QLocalSocket socket;
+            socket.connectToServer(socketPath);
+
+            if (!socket.waitForConnected(IPC_CONNECT_TIMEOUT_MS))
+                return {};
+
+            if (socket.write(request) == -1 || !socket.waitForBytesWritten(IPC_WRITE_TIMEOUT_MS))
+                return {};
 
-        // Read until we get a complete line
-        while (!socket.canReadLine()) {
             if (!socket.waitForReadyRead(timeoutMs))
-                return std::nullopt;
+                return {};
+
+            // Read until we get a complete line
+            while (!socket.canReadLine()) {
+                if (!socket.waitForReadyRead(timeoutMs))
+                    return {};
+            }
+
+            return socket.readLine();
         }
 
-        const QByteArray replyLine = socket.readLine().trimmed();
-        if (replyLine.isEmpty())
-            return std::nullopt;
+    } // namespace
+
+    IpcClient::IpcClient(const QString& socketPath) : m_socketPath(socketPath) {}
 
-        QJsonParseError parseError;
-        const auto      doc = QJsonDocument::fromJson(replyLine, &parseError);
+    std::optional<QJsonObject> IpcClient::sendRequest(const QJsonObject& request, int timeoutMs) {
+        // Either side may carry a password (session.respond, pinentry/keyring replies)
+        QByteArray data = QJsonDocument(request).toJson(QJsonDocument::Compact);
+        ScopedWipe wipeRequest(data);
+        data.append('\n');
+
+        // The reply line stays in the arena and is parsed in place
+        SecretString reply;
+        if (!exchangePacket(packetSocketPath(m_socketPath), data, timeoutMs, reply)) {
+            QByteArray streamed = exchangeStream(m_socketPath, data, timeoutMs);
+            reply               = SecretString::fromUtf8(streamed);
+            secureZero(streamed);
+        }
 
-        if (parseError.error != QJsonParseError::NoError || !doc.isObject())
+        const QByteArrayView replyLine = reply.view().trimmed();
+        if (replyLine.isEmpty())
             return std::nullopt;
 
-        return doc.object();
+        return parseReply(replyLine);
     }
 
     bool IpcClient::ping() {
@@ -48,4 +146,150 @@ namespace bb {
         return response && response->value("type").toString() == "pong";
     }
 
+    IpcConnection::IpcConnection(const QString& socketPath) : m_socketPath(socketPath) {}
+
+    IpcConnection::~IpcConnection() {
+        close();
+    }
+
+    bool IpcConnection::open() {
+        if (m_fd != -1)
+            return true;
+
+        m_fd     = connectUnix(packetSocketPath(m_socketPath), SOCK_SEQPACKET);
+        m_packet = m_fd != -1;
+        if (m_fd == -1)
+            m_fd = connectUnix(m_socketPath, SOCK_STREAM);
+        if (m_fd == -1)
+            return false;
+
+        fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+        return true;
+    }
+
+    void IpcConnection::close() {
+        if (m_fd != -1) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+        m_buffer.clear();
+    }
+
+    bool IpcConnection::send(const QJsonObject& request) {
+        if (!open())
+            return false;
+
+        QByteArray data = QJsonDocument(request).toJson(QJsonDocument::Compact);
+        ScopedWipe wipeRequest(data);
+        data.append('\n');
+        if (data.size() > static_cast<qsizetype>(MAX_MESSAGE_SIZE)) {
+            return false;
+        }
+
+        // Requests are small enough for a single write on either socket type;
+        // a full buffer only means waiting for the daemon to catch up
+        qsizetype written = 0;
+        while (written < data.size()) {
+            const auto sent = ::send(m_fd, data.constData() + written, static_cast<std::size_t>(data.size() - written), MSG_NOSIGNAL);
+            if (sent > 0) {
+                written += sent;
+                continue;
+            }
+            if (sent == -1 && errno == EINTR)
+                continue;
+            if (sent == -1 && errno == EAGAIN && waitForFd(m_fd, POLLOUT, IPC_WRITE_TIMEOUT_MS))
+                continue;
+
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool IpcConnection::readAvailable() {
+        if (m_fd == -1)
+            return false;
+
+        for (;;) {
+            // recv() lands straight in the arena, a pooled IPC_READ_CHUNK at a time. A
+            // packet must be taken whole, so its length is peeked first and only a
+            // reply longer than the chunk grows the buffer past its pooled block.
+            std::size_t room = IPC_READ_CHUNK;
+            if (m_packet) {
+                const auto length = ::recv(m_fd, nullptr, 0, MSG_PEEK | MSG_TRUNC);
+                if (length > static_cast<ssize_t>(MAX_MESSAGE_SIZE)) {
+                    close();
+                    return false;
+                }
+                if (length > 0)
+                    room = static_cast<std::size_t>(length);
+            }
+
+            const auto received = ::recv(m_fd, m_buffer.spare(room), room, 0);
+            if (received > 0) {
+                m_buffer.commit(static_cast<std::size_t>(received));
+                if (m_buffer.size() > MAX_MESSAGE_SIZE * 2) {
+                    close();
+                    return false;
+                }
+                continue;
+            }
+            if (received == -1 && errno == EINTR)
+                continue;
+            if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return true;
+
+            // EOF or error; replies already buffered stay readable
+            ::close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+    }
+
+    std::optional<SecretString> IpcConnection::takeLine() {
+        for (qsizetype newline = m_buffer.view().indexOf('\n'); newline != -1; newline = m_buffer.view().indexOf('\n')) {
+            // Copied arena to arena; the consumed line is wiped as it is dropped
+            const QByteArrayView        line = m_buffer.view().first(newline).trimmed();
+            std::optional<SecretString> taken;
+            if (!line.isEmpty())
+                taken = SecretString::fromUtf8(line);
+            m_buffer.removePrefix(static_cast<std::size_t>(newline + 1));
+            if (taken)
+                return taken;
+        }
+        return std::nullopt;
+    }
+
+    std::optional<QJsonObject> IpcConnection::takeReply() {
+        while (const auto line = takeLine()) {
+            if (auto reply = parseReply(line->view()))
+                return reply;
+        }
+        return std::nullopt;
+    }
+
+    std::optional<SecretString> IpcConnection::waitLine(int timeoutMs) {
+        QElapsedTimer timer;
+        timer.start();
+        for (;;) {
+            if (auto line = takeLine())
+                return line;
+
+            const qint64 remaining = timeoutMs - timer.elapsed();
+            if (m_fd == -1 || remaining <= 0 || !waitForFd(m_fd, POLLIN, static_cast<int>(remaining)))
+                return std::nullopt;
+            readAvailable();
+        }
+    }
+
+    std::optional<QJsonObject> IpcConnection::waitReply(int timeoutMs) {
+        QElapsedTimer timer;
+        timer.start();
+        while (const auto line = waitLine(static_cast<int>(timeoutMs - timer.elapsed()))) {
+            if (auto reply = parseReply(line->view()))
+                return reply;
+        }
+        return std::nullopt;
+    }
+
 } // namespace bb
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "SecureMemory.hpp"
+
+#include <QByteArray>
 #include <QJsonObject>
 #include <QString>
 
@@ -12,7 +15,8 @@ namespace bb {
       public:
         explicit IpcClient(const QString& socketPath);
 
-        // Send a JSON request and wait for response
+        // Send a JSON request and wait for response. Prefers the SOCK_SEQPACKET
+        // endpoint next to socketPath and falls back to the stream socket.
         // Returns std::nullopt on connection/timeout/parse failure
         std::optional<QJsonObject> sendRequest(const QJsonObject& request,
                                                int                timeoutMs = 5 * 60 * 1000 // Default 5 minutes for pinentry
@@ -25,4 +29,53 @@ namespace bb {
         QString m_socketPath;
     };
 
+    // Persistent, non-blocking connection for callers that wait on the daemon
+    // together with their own fds in one poll(): send(), poll fd() for POLLIN,
+    // readAvailable(), then takeReply() until it runs dry. Several requests may
+    // be in flight; replies arrive in request order. Closing the connection is
+    // how the daemon learns that a pending request was abandoned.
+    class IpcConnection {
+      public:
+        explicit IpcConnection(const QString& socketPath);
+        ~IpcConnection();
+
+        IpcConnection(const IpcConnection&)            = delete;
+        IpcConnection& operator=(const IpcConnection&) = delete;
+
+        // Connects if not connected yet. Prefers the SOCK_SEQPACKET endpoint.
+        bool open();
+        void close();
+
+        bool isOpen() const {
+            return m_fd != -1;
+        }
+
+        int fd() const {
+            return m_fd;
+        }
+
+        // Writes one request; false (and closed) if the daemon is gone
+        bool send(const QJsonObject& request);
+
+        // Drains whatever the socket holds without blocking; false (and closed) on EOF or error
+        bool readAvailable();
+
+        // Next complete reply received so far
+        std::optional<QJsonObject> takeReply();
+
+        // Blocks up to timeoutMs for the next reply; for callers with nothing else to watch
+        std::optional<QJsonObject> waitReply(int timeoutMs);
+
+        // The same, as the raw line kept in the arena, for replies that carry a passphrase
+        // and must not pass through QJsonObject; parse it with JsonMessage
+        std::optional<SecretString> takeLine();
+        std::optional<SecretString> waitLine(int timeoutMs);
+
+      private:
+        QString      m_socketPath;
+        int          m_fd     = -1;
+        bool         m_packet = false; // connected to the SOCK_SEQPACKET endpoint
+        SecretString m_buffer; // received, not yet taken; replies may carry a passphrase
+    };
+
 } // namespace bb
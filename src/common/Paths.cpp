@@ -9,4 +9,13 @@ namespace bb {
         return runtimeDir + QStringLiteral("/bb-auth.sock");
     }
 
+    QString packetSocketPath(const QString& streamSocketPath) {
+        static const QString suffix = QStringLiteral(".sock");
+        if (streamSocketPath.endsWith(suffix)) {
+            return streamSocketPath.chopped(suffix.size()) + QStringLiteral(".seqpacket.sock");
+        }
+
+        return streamSocketPath + QStringLiteral(".seqpacket");
+    }
+
 } // namespace bb
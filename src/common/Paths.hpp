@@ -7,4 +7,8 @@ namespace bb {
     // Returns the default socket path: $XDG_RUNTIME_DIR/bb-auth.sock
     QString socketPath();
 
+    // Returns the SOCK_SEQPACKET endpoint paired with a stream socket path:
+    // bb-auth.sock -> bb-auth.seqpacket.sock
+    QString packetSocketPath(const QString& streamSocketPath);
+
 } // namespace bb
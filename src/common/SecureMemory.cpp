@@ -0,0 +1,250 @@
+#include "SecureMemory.hpp"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <new>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+
+namespace bb {
+
+    namespace {
+
+        std::size_t pageSize() {
+            static const std::size_t size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+            return size;
+        }
+
+        // Anonymous, kept out of core dumps and (if the limit allows) out of swap
+        std::byte* mapProtected(std::size_t size, bool& locked) {
+            void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mapping == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+
+            ::madvise(mapping, size, MADV_DONTDUMP);
+            locked = ::mlock(mapping, size) == 0;
+            return static_cast<std::byte*>(mapping);
+        }
+
+    } // namespace
+
+    void secureZero(void* data, std::size_t size) {
+        if (data && size > 0) {
+            ::explicit_bzero(data, size);
+            // explicit_bzero is opaque to the optimizer; the barrier keeps the wipe
+            // in place should it ever be expanded inline as a builtin
+            asm volatile("" : : "r"(data) : "memory");
+        }
+    }
+
+    void secureZero(QString& text) {
+        if (!text.isEmpty()) {
+            secureZero(text.data(), static_cast<std::size_t>(text.size()) * sizeof(QChar));
+        }
+        text.clear();
+    }
+
+    void secureZero(QByteArray& bytes) {
+        if (!bytes.isEmpty()) {
+            secureZero(bytes.data(), static_cast<std::size_t>(bytes.size()));
+        }
+        bytes.clear();
+    }
+
+    SecureArena& SecureArena::instance() {
+        // Never destroyed: secrets held by other statics may be released during exit
+        static auto* arena = new SecureArena();
+        return *arena;
+    }
+
+    bool SecureArena::inPool(const void* block) const {
+        const auto* byte = static_cast<const std::byte*>(block);
+        return m_pool && byte >= m_pool && byte < m_pool + POOL_SIZE;
+    }
+
+    void* SecureArena::allocate(std::size_t size, std::size_t& capacity) {
+        std::lock_guard lock(m_mutex);
+
+        if (size <= MAX_BLOCK) {
+            if (!m_pool) {
+                m_pool = mapProtected(POOL_SIZE, m_locked);
+                if (!m_locked) {
+                    qWarning() << "Secure arena could not be locked into memory; secrets may reach swap";
+                }
+            }
+
+            const std::size_t index = size <= MIN_BLOCK ? 0 : static_cast<std::size_t>(std::bit_width(size - 1) - std::countr_zero(MIN_BLOCK));
+            const std::size_t block = MIN_BLOCK << index;
+            if (FreeBlock* head = m_free[index]) {
+                m_free[index] = head->next;
+                head->next    = nullptr;
+                capacity      = block;
+                ++m_inUse;
+                return head;
+            }
+
+            // Blocks are carved in order of first use and never split or merged
+            if (m_poolUsed + block <= POOL_SIZE) {
+                std::byte* start = m_pool + m_poolUsed;
+                m_poolUsed += block;
+                capacity = block;
+                ++m_inUse;
+                return start;
+            }
+        }
+
+        bool locked = false;
+        capacity    = (size + pageSize() - 1) / pageSize() * pageSize();
+        void* start = mapProtected(capacity, locked);
+        ++m_inUse;
+        return start;
+    }
+
+    void SecureArena::release(void* block, std::size_t capacity) {
+        if (!block) {
+            return;
+        }
+
+        secureZero(block, capacity);
+
+        std::lock_guard lock(m_mutex);
+        --m_inUse;
+        if (!inPool(block)) {
+            ::munlock(block, capacity);
+            ::munmap(block, capacity);
+            return;
+        }
+
+        const std::size_t index = static_cast<std::size_t>(std::countr_zero(capacity / MIN_BLOCK));
+        auto*             head  = static_cast<FreeBlock*>(block);
+        head->next              = m_free[index];
+        m_free[index]           = head;
+    }
+
+    bool SecureArena::locked() const {
+        std::lock_guard lock(m_mutex);
+        return m_locked;
+    }
+
+    std::size_t SecureArena::blocksInUse() const {
+        std::lock_guard lock(m_mutex);
+        return m_inUse;
+    }
+
+    QByteArrayView SecureArena::pooled() const {
+        std::lock_guard lock(m_mutex);
+        return QByteArrayView(reinterpret_cast<const char*>(m_pool), static_cast<qsizetype>(m_poolUsed));
+    }
+
+    SecretString::~SecretString() {
+        release();
+    }
+
+    SecretString::SecretString(SecretString&& other) noexcept :
+        m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0)), m_capacity(std::exchange(other.m_capacity, 0)) {}
+
+    SecretString& SecretString::operator=(SecretString&& other) noexcept {
+        if (this != &other) {
+            release();
+            m_data     = std::exchange(other.m_data, nullptr);
+            m_size     = std::exchange(other.m_size, 0);
+            m_capacity = std::exchange(other.m_capacity, 0);
+        }
+        return *this;
+    }
+
+    SecretString SecretString::fromUtf8(QByteArrayView bytes) {
+        SecretString secret;
+        secret.append(bytes);
+        return secret;
+    }
+
+    SecretString SecretString::fromString(QStringView text) {
+        QByteArray   utf8   = text.toUtf8();
+        SecretString secret = fromUtf8(utf8);
+        secureZero(utf8.data(), static_cast<std::size_t>(utf8.size()));
+        return secret;
+    }
+
+    void SecretString::release() {
+        SecureArena::instance().release(m_data, m_capacity);
+        m_data     = nullptr;
+        m_size     = 0;
+        m_capacity = 0;
+    }
+
+    void SecretString::reserve(std::size_t capacity) {
+        if (capacity <= m_capacity) {
+            return;
+        }
+
+        // The old block is wiped as it goes back to the arena
+        std::size_t granted = 0;
+        auto*       grown   = static_cast<char*>(SecureArena::instance().allocate(capacity, granted));
+        if (m_size > 0) {
+            std::memcpy(grown, m_data, m_size);
+        }
+        SecureArena::instance().release(m_data, m_capacity);
+        m_data     = grown;
+        m_capacity = granted;
+    }
+
+    char* SecretString::extend(std::size_t count) {
+        char* start = spare(count);
+        m_size += count;
+        return start;
+    }
+
+    char* SecretString::spare(std::size_t count) {
+        if (m_size + count > m_capacity) {
+            reserve(std::max(m_size + count, m_capacity * 2));
+        }
+        return m_data + m_size;
+    }
+
+    void SecretString::commit(std::size_t count) {
+        m_size = std::min(m_size + count, m_capacity);
+    }
+
+    void SecretString::append(char byte) {
+        *extend(1) = byte;
+    }
+
+    void SecretString::append(QByteArrayView bytes) {
+        if (!bytes.isEmpty()) {
+            std::memcpy(extend(static_cast<std::size_t>(bytes.size())), bytes.data(), static_cast<std::size_t>(bytes.size()));
+        }
+    }
+
+    void SecretString::truncate(std::size_t size) {
+        if (size < m_size) {
+            secureZero(m_data + size, m_size - size);
+            m_size = size;
+        }
+    }
+
+    void SecretString::removePrefix(std::size_t count) {
+        if (count >= m_size) {
+            clear();
+            return;
+        }
+
+        std::memmove(m_data, m_data + count, m_size - count);
+        truncate(m_size - count);
+    }
+
+    void SecretString::clear() {
+        truncate(0);
+    }
+
+    QString SecretString::toString() const {
+        return QString::fromUtf8(m_data, static_cast<qsizetype>(m_size));
+    }
+
+} // namespace bb
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+#include <QStringView>
+
+#include <array>
+#include <cstddef>
+#include <mutex>
+
+namespace bb {
+
+    // Zeroes `size` bytes in one pass; neither the store nor later reads of the
+    // bytes can be optimized away
+    void secureZero(void* data, std::size_t size);
+
+    // Zero a transient Qt copy in place and empty it. The container must not be
+    // shared, or only the detached copy would be wiped.
+    void secureZero(QString& text);
+    void secureZero(QByteArray& bytes);
+
+    // Wipes a Qt copy of a secret when the scope ends: the serialized request or
+    // decoded reply an API hands back by value
+    template <typename T>
+    class ScopedWipe {
+      public:
+        explicit ScopedWipe(T& value) : m_value(value) {}
+        ~ScopedWipe() {
+            secureZero(m_value);
+        }
+
+        ScopedWipe(const ScopedWipe&)            = delete;
+        ScopedWipe& operator=(const ScopedWipe&) = delete;
+
+      private:
+        T& m_value;
+    };
+
+    // Process-wide pool for secret bytes. One mapping is mlock()ed, so it never
+    // reaches swap, and marked MADV_DONTDUMP, so it stays out of core dumps.
+    // Blocks come from power-of-two size classes with free lists and are zeroed
+    // on release. Larger requests, or ones arriving once the pool is exhausted,
+    // get a mapping of their own with the same protections. Locking is best
+    // effort: past RLIMIT_MEMLOCK the bytes are still wiped and kept out of dumps.
+    class SecureArena {
+      public:
+        static SecureArena& instance();
+
+        SecureArena(const SecureArena&)            = delete;
+        SecureArena& operator=(const SecureArena&) = delete;
+
+        // At least `size` bytes, zero-filled; `capacity` receives the block's real size
+        void* allocate(std::size_t size, std::size_t& capacity);
+
+        // Zeroes the block and returns it to the pool (or unmaps it)
+        void release(void* block, std::size_t capacity);
+
+        // Whether the pool is mlock()ed; false until the first allocation
+        bool locked() const;
+
+        // Blocks handed out and not yet released
+        std::size_t blocksInUse() const;
+
+        // The part of the pool carved into blocks so far. Released blocks stay mapped
+        // here, so tests can check that nothing was left behind in them.
+        QByteArrayView pooled() const;
+
+      private:
+        static constexpr std::size_t POOL_SIZE   = 64 * 1024;
+        static constexpr std::size_t MIN_BLOCK   = 32;
+        static constexpr std::size_t MAX_BLOCK   = 4096;
+        static constexpr std::size_t CLASS_COUNT = 8; // MIN_BLOCK .. MAX_BLOCK
+
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        SecureArena() = default;
+
+        bool                                inPool(const void* block) const;
+
+        mutable std::mutex                  m_mutex;
+        std::byte*                          m_pool     = nullptr;
+        std::size_t                         m_poolUsed = 0;
+        bool                                m_locked   = false;
+        std::array<FreeBlock*, CLASS_COUNT> m_free{};
+        std::size_t                         m_inUse = 0;
+    };
+
+    // Move-only UTF-8 bytes held in the SecureArena and wiped when released.
+    // Secrets stay in one of these from the socket read to the reply write, so
+    // the only copies outside the arena are those an external API insists on.
+    // Known ones, none of them wiped:
+    //  - QLocalSocket's read buffer on a stream connection, which Qt fills first
+    //  - QLocalSocket's write buffer when the kernel does not take a secret reply
+    //    at once (IpcServer::sendSecret); packet connections queue in the arena
+    //  - QJsonDocument's own copy of a parsed reply and the QJsonObject that
+    //    IpcClient::sendRequest returns
+    //  - whatever polkit-qt keeps of the response it is handed
+    class SecretString {
+      public:
+        SecretString() = default;
+        ~SecretString();
+
+        SecretString(SecretString&& other) noexcept;
+        SecretString& operator=(SecretString&& other) noexcept;
+
+        SecretString(const SecretString&)            = delete;
+        SecretString& operator=(const SecretString&) = delete;
+
+        static SecretString fromUtf8(QByteArrayView bytes);
+        static SecretString fromString(QStringView text);
+
+        void reserve(std::size_t capacity);
+        void append(char byte);
+        void append(QByteArrayView bytes);
+
+        // Grows by `count` zeroed bytes and returns where they start, for reading into
+        char* extend(std::size_t count);
+
+        // Room for at least `count` bytes past the end without growing; commit() what
+        // was written there. For reads whose length is only known afterwards.
+        char* spare(std::size_t count);
+        void  commit(std::size_t count);
+
+        // Shrinks to `size` bytes, wiping the rest
+        void truncate(std::size_t size);
+
+        // Drops the first `count` bytes, for consumed lines; the vacated tail is wiped
+        void removePrefix(std::size_t count);
+
+        // Wipes the contents; the block is kept for reuse
+        void clear();
+
+        [[nodiscard]] const char* data() const {
+            return m_data;
+        }
+        [[nodiscard]] std::size_t size() const {
+            return m_size;
+        }
+        [[nodiscard]] std::size_t capacity() const {
+            return m_capacity;
+        }
+        [[nodiscard]] bool isEmpty() const {
+            return m_size == 0;
+        }
+        [[nodiscard]] QByteArrayView view() const {
+            return QByteArrayView(m_data, static_cast<qsizetype>(m_size));
+        }
+
+        // Heap copy for APIs that only take a QString; wipe it with secureZero() after use
+        [[nodiscard]] QString toString() const;
+
+      private:
+        void        release();
+
+        char*       m_data     = nullptr;
+        std::size_t m_size     = 0;
+        std::size_t m_capacity = 0;
+    };
+
+} // namespace bb
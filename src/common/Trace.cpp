@@ -0,0 +1,194 @@
+#include "Trace.hpp"
+#include "TraceRing.hpp"
+
+#ifdef BB_AUTH_TRACE
+
+#include <QStringView>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <string_view>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bb::trace {
+
+    namespace {
+
+        // Rings of processes that have exited are kept this long so a flow can be dumped after the fact
+        inline constexpr time_t STALE_RING_AGE_S = 60 * 60;
+
+        std::atomic<RingHeader*> g_ring{nullptr};
+
+        Record* records(RingHeader* ring) {
+            return reinterpret_cast<Record*>(reinterpret_cast<char*>(ring) + sizeof(RingHeader));
+        }
+
+        std::uint32_t currentTid() {
+            thread_local const auto tid = static_cast<std::uint32_t>(gettid());
+            return tid;
+        }
+
+        void copyName(char (&out)[NAME_MAX_BYTES], const char* name) {
+            std::memset(out, 0, sizeof(out));
+            if (name) {
+                std::strncpy(out, name, sizeof(out) - 1);
+            }
+        }
+
+        // Claims the next slot; the caller fills it and then calls publish()
+        Record* claim(RingHeader* ring, std::uint64_t& index) {
+            index       = ring->head.fetch_add(1, std::memory_order_relaxed);
+            Record& rec = records(ring)[index % ring->capacity];
+            rec.sequence.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            return &rec;
+        }
+
+        void publish(Record* rec, std::uint64_t index) {
+            rec->sequence.store(index + 1, std::memory_order_release);
+        }
+
+        void fill(Record* rec, char phase, const char* name, std::uint64_t timestampNs, std::uint64_t durationNs, std::int64_t arg) {
+            rec->timestampNs = timestampNs;
+            rec->durationNs  = durationNs;
+            rec->arg         = arg;
+            rec->tid         = currentTid();
+            rec->phase       = phase;
+            copyName(rec->name, name);
+        }
+
+        void removeStaleRings(const std::string& dir) {
+            DIR* handle = opendir(dir.c_str());
+            if (!handle) {
+                return;
+            }
+
+            const time_t now = time(nullptr);
+            while (const dirent* entry = readdir(handle)) {
+                // <role>.<pid>.ring
+                const std::string_view file(entry->d_name);
+                if (!file.ends_with(".ring")) {
+                    continue;
+                }
+
+                const auto pidStart = file.rfind('.', file.size() - 6);
+                if (pidStart == std::string_view::npos) {
+                    continue;
+                }
+
+                const pid_t pid = static_cast<pid_t>(std::strtol(std::string(file.substr(pidStart + 1)).c_str(), nullptr, 10));
+                if (pid <= 0 || kill(pid, 0) == 0 || errno == EPERM) {
+                    continue; // still running
+                }
+
+                const std::string path = dir + "/" + std::string(file);
+                struct stat       st;
+                if (stat(path.c_str(), &st) == 0 && now - st.st_mtime > STALE_RING_AGE_S) {
+                    unlink(path.c_str());
+                }
+            }
+            closedir(handle);
+        }
+
+    } // namespace
+
+    void record(char phase, const char* name, QStringView cookie, uint64_t timestampNs, uint64_t durationNs, int64_t arg) {
+        RingHeader* ring = g_ring.load(std::memory_order_acquire);
+        if (!ring) {
+            return;
+        }
+
+        std::uint64_t index = 0;
+        Record*       rec   = claim(ring, index);
+        fill(rec, phase, name, timestampNs, durationNs, arg);
+
+        // Cookies are ASCII (UUIDs, polkit cookies); anything else is replaced rather than encoded
+        const auto length = std::min<qsizetype>(cookie.size(), COOKIE_MAX_BYTES - 1);
+        for (qsizetype i = 0; i < length; ++i) {
+            const char16_t ch = cookie[i].unicode();
+            rec->cookie[i]    = ch < 0x80 ? static_cast<char>(ch) : '?';
+        }
+        std::memset(rec->cookie + length, 0, COOKIE_MAX_BYTES - static_cast<std::size_t>(length));
+
+        publish(rec, index);
+    }
+
+} // namespace bb::trace
+
+using namespace bb::trace;
+
+extern "C" {
+
+void bb_trace_init(const char* role) {
+    if (g_ring.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    const std::string dir = ringDirectory();
+    if (dir.empty() || (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST)) {
+        return;
+    }
+    removeStaleRings(dir);
+
+    const std::string path = dir + "/" + role + "." + std::to_string(getpid()) + ".ring";
+    const int         fd   = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd < 0) {
+        return;
+    }
+
+    void* mapping = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(RING_BYTES)) == 0) {
+        mapping = mmap(nullptr, RING_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        unlink(path.c_str());
+        return;
+    }
+
+    // ftruncate zero-filled the file, so every record starts unpublished
+    auto* ring = static_cast<RingHeader*>(mapping);
+    std::memcpy(ring->magic, RING_MAGIC, sizeof(RING_MAGIC));
+    ring->version    = RING_VERSION;
+    ring->recordSize = sizeof(Record);
+    ring->capacity   = RING_CAPACITY;
+    ring->pid        = static_cast<std::int32_t>(getpid());
+    std::strncpy(ring->role, role, sizeof(ring->role) - 1);
+
+    g_ring.store(ring, std::memory_order_release);
+}
+
+uint64_t bb_trace_now(void) {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void bb_trace_emit(char phase, const char* name, const char* cookie, uint64_t timestamp_ns, uint64_t duration_ns, int64_t arg) {
+    RingHeader* ring = g_ring.load(std::memory_order_acquire);
+    if (!ring) {
+        return;
+    }
+
+    std::uint64_t index = 0;
+    Record*       rec   = claim(ring, index);
+    fill(rec, phase, name, timestamp_ns, duration_ns, arg);
+
+    std::memset(rec->cookie, 0, sizeof(rec->cookie));
+    if (cookie) {
+        std::strncpy(rec->cookie, cookie, sizeof(rec->cookie) - 1);
+    }
+
+    publish(rec, index);
+}
+
+} // extern "C"
+
+#endif // BB_AUTH_TRACE
@@ -0,0 +1,45 @@
+#pragma once
+
+/*
+ * Compile-time gated trace points, shared by every bb-auth process: daemon,
+ * pinentry, keyring prompter (C) and fallback UI.
+ *
+ * Configure with -DBB_AUTH_TRACING=ON to compile them in. Otherwise every macro
+ * expands to nothing and its arguments are never evaluated, so trace points
+ * cost nothing in release builds and never format prompt text.
+ *
+ * When enabled, each process appends fixed-size binary records to its own
+ * lock-free ring, a shared mapping under $XDG_RUNTIME_DIR/bb-auth-trace/.
+ * `bb-auth --trace-dump` merges all rings into one Chrome/Perfetto JSON trace.
+ * Records carry a static event name, the session cookie and one integer; never
+ * put prompt text, passwords or other user data into a trace point.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef BB_AUTH_TRACE
+/* Maps this process's ring; call once at startup, before any other thread emits */
+void     bb_trace_init(const char* role);
+/* CLOCK_MONOTONIC in nanoseconds, comparable across processes */
+uint64_t bb_trace_now(void);
+/* phase: 'i' instant, 'X' complete (timestamp_ns + duration_ns) */
+void     bb_trace_emit(char phase, const char* name, const char* cookie, uint64_t timestamp_ns, uint64_t duration_ns, int64_t arg);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef BB_AUTH_TRACE
+#define BB_TRACE_INIT(role)                          bb_trace_init(role)
+#define BB_TRACE_INSTANT_C(name, cookie)             bb_trace_emit('i', (name), (cookie), bb_trace_now(), 0, 0)
+#define BB_TRACE_INSTANT_C_ARG(name, cookie, arg)    bb_trace_emit('i', (name), (cookie), bb_trace_now(), 0, (int64_t)(arg))
+#else
+#define BB_TRACE_INIT(role)                          ((void)0)
+#define BB_TRACE_INSTANT_C(name, cookie)             ((void)0)
+#define BB_TRACE_INSTANT_C_ARG(name, cookie, arg)    ((void)0)
+#endif
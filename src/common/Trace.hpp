@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Trace.h"
+
+// C++ trace points keyed by a QString cookie. See Trace.h for how tracing is
+// enabled and where records go.
+//
+//   BB_TRACE_SCOPE("polkit.initiate", cookie);          // complete event over the enclosing scope
+//   BB_TRACE_EVENT("polkit.request", cookie);           // instant event
+//   BB_TRACE_EVENT_ARG("requestor.step", cookie, pid);  // instant event with one integer
+//   BB_TRACE_EVENT("ipc.subscribe", u"");               // not tied to a session
+
+#ifdef BB_AUTH_TRACE
+
+#include <QString>
+#include <QStringView>
+
+#include <utility>
+
+namespace bb::trace {
+
+    // Copies the cookie straight into the record; no allocation or UTF-8 encoding
+    void record(char phase, const char* name, QStringView cookie, uint64_t timestampNs, uint64_t durationNs, int64_t arg);
+
+    class Scope {
+      public:
+        Scope(const char* name, QString cookie) : m_name(name), m_cookie(std::move(cookie)), m_start(bb_trace_now()) {}
+        ~Scope() {
+            record('X', m_name, m_cookie, m_start, bb_trace_now() - m_start, 0);
+        }
+
+        Scope(const Scope&)            = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        const char* m_name;
+        QString     m_cookie;
+        uint64_t    m_start;
+    };
+
+} // namespace bb::trace
+
+#define BB_TRACE_CONCAT_INNER(a, b)             a##b
+#define BB_TRACE_CONCAT(a, b)                   BB_TRACE_CONCAT_INNER(a, b)
+#define BB_TRACE_SCOPE(name, cookie)            const bb::trace::Scope BB_TRACE_CONCAT(bbTraceScope, __LINE__)((name), cookie)
+#define BB_TRACE_EVENT(name, cookie)            bb::trace::record('i', (name), cookie, bb_trace_now(), 0, 0)
+#define BB_TRACE_EVENT_ARG(name, cookie, arg)   bb::trace::record('i', (name), cookie, bb_trace_now(), 0, static_cast<int64_t>(arg))
+
+#else
+
+#define BB_TRACE_SCOPE(name, cookie)            ((void)0)
+#define BB_TRACE_EVENT(name, cookie)            ((void)0)
+#define BB_TRACE_EVENT_ARG(name, cookie, arg)   ((void)0)
+
+#endif
@@ -0,0 +1,188 @@
+#include "TraceDump.hpp"
+#include "TraceRing.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+namespace bb::trace {
+
+    namespace {
+
+        struct RecordCopy {
+            std::uint64_t timestampNs = 0;
+            std::uint64_t durationNs  = 0;
+            std::int64_t  arg         = 0;
+            std::uint32_t tid         = 0;
+            char          phase       = 'i';
+            QString       name;
+            QString       cookie;
+        };
+
+        struct RingCopy {
+            std::int32_t            pid = 0;
+            QString                 role;
+            std::vector<RecordCopy> records;
+        };
+
+        QString fixedString(const char* data, std::size_t capacity) {
+            return QString::fromLatin1(data, static_cast<qsizetype>(strnlen(data, capacity)));
+        }
+
+        // Copies the published records out of a live (or abandoned) ring. Slots the
+        // writer is reusing while we read are detected by their sequence and skipped.
+        std::optional<RingCopy> readRing(const QString& path) {
+            QFile file(path);
+            if (!file.open(QIODevice::ReadOnly) || file.size() < static_cast<qint64>(sizeof(RingHeader))) {
+                return std::nullopt;
+            }
+
+            const uchar* mapping = file.map(0, file.size());
+            if (!mapping) {
+                return std::nullopt;
+            }
+
+            const auto* header = reinterpret_cast<const RingHeader*>(mapping);
+            if (std::memcmp(header->magic, RING_MAGIC, sizeof(RING_MAGIC)) != 0 || header->version != RING_VERSION || header->recordSize != sizeof(Record) ||
+                header->capacity == 0 || file.size() < static_cast<qint64>(sizeof(RingHeader) + std::size_t{header->capacity} * sizeof(Record))) {
+                return std::nullopt;
+            }
+
+            RingCopy ring;
+            ring.pid  = header->pid;
+            ring.role = fixedString(header->role, sizeof(header->role));
+
+            const auto*         records = reinterpret_cast<const Record*>(mapping + sizeof(RingHeader));
+            const std::uint64_t head    = header->head.load(std::memory_order_acquire);
+            const std::uint64_t first   = head > header->capacity ? head - header->capacity : 0;
+            ring.records.reserve(static_cast<std::size_t>(head - first));
+
+            for (std::uint64_t index = first; index < head; ++index) {
+                const Record&       rec      = records[index % header->capacity];
+                const std::uint64_t sequence = rec.sequence.load(std::memory_order_acquire);
+                if (sequence != index + 1) {
+                    continue;
+                }
+
+                RecordCopy copy;
+                copy.timestampNs = rec.timestampNs;
+                copy.durationNs  = rec.durationNs;
+                copy.arg         = rec.arg;
+                copy.tid         = rec.tid;
+                copy.phase       = rec.phase;
+                copy.name        = fixedString(rec.name, sizeof(rec.name));
+                copy.cookie      = fixedString(rec.cookie, sizeof(rec.cookie));
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (rec.sequence.load(std::memory_order_relaxed) != sequence) {
+                    continue;
+                }
+                ring.records.push_back(std::move(copy));
+            }
+
+            return ring;
+        }
+
+        struct FlowBounds {
+            std::uint64_t startNs = 0;
+            std::uint64_t endNs   = 0;
+            std::int32_t  pid     = 0;
+            std::uint32_t tid     = 0;
+        };
+
+    } // namespace
+
+    QJsonObject dumpChromeTrace(const QString& cookie, const QString& directory) {
+        const QString dirPath = directory.isEmpty() ? QString::fromStdString(ringDirectory()) : directory;
+
+        std::vector<RingCopy> rings;
+        if (!dirPath.isEmpty()) {
+            const QDir dir(dirPath);
+            for (const QString& entry : dir.entryList(QStringList{"*.ring"}, QDir::Files, QDir::Name)) {
+                if (auto ring = readRing(dir.filePath(entry))) {
+                    rings.push_back(std::move(*ring));
+                }
+            }
+        }
+
+        // Timestamps are CLOCK_MONOTONIC in every process; rebase them on the earliest record
+        std::uint64_t origin = UINT64_MAX;
+        for (const RingCopy& ring : rings) {
+            for (const RecordCopy& rec : ring.records) {
+                if (cookie.isEmpty() || rec.cookie == cookie) {
+                    origin = std::min(origin, rec.timestampNs);
+                }
+            }
+        }
+        const auto toMicros = [origin](std::uint64_t ns) { return static_cast<double>(ns - origin) / 1000.0; };
+
+        QJsonArray                 events;
+        QHash<QString, FlowBounds> flows;
+        for (const RingCopy& ring : rings) {
+            events.append(QJsonObject{{"ph", "M"}, {"name", "process_name"}, {"pid", ring.pid}, {"tid", 0}, {"args", QJsonObject{{"name", ring.role}}}});
+
+            for (const RecordCopy& rec : ring.records) {
+                if (!cookie.isEmpty() && rec.cookie != cookie) {
+                    continue;
+                }
+
+                QJsonObject args;
+                if (!rec.cookie.isEmpty()) {
+                    args["cookie"] = rec.cookie;
+                }
+                if (rec.arg != 0) {
+                    args["arg"] = static_cast<qint64>(rec.arg);
+                }
+
+                QJsonObject event{{"name", rec.name}, {"cat", "bb-auth"}, {"ts", toMicros(rec.timestampNs)}, {"pid", ring.pid}, {"tid", static_cast<qint64>(rec.tid)}};
+                if (rec.phase == 'X') {
+                    event["ph"]  = "X";
+                    event["dur"] = static_cast<double>(rec.durationNs) / 1000.0;
+                } else {
+                    event["ph"] = "i";
+                    event["s"]  = "t";
+                }
+                if (!args.isEmpty()) {
+                    event["args"] = args;
+                }
+                events.append(event);
+
+                if (rec.cookie.isEmpty()) {
+                    continue;
+                }
+
+                const std::uint64_t end  = rec.timestampNs + rec.durationNs;
+                auto                flow = flows.find(rec.cookie);
+                if (flow == flows.end()) {
+                    flows.insert(rec.cookie, FlowBounds{rec.timestampNs, end, ring.pid, rec.tid});
+                    continue;
+                }
+                if (rec.timestampNs < flow->startNs) {
+                    flow->startNs = rec.timestampNs;
+                    flow->pid     = ring.pid;
+                    flow->tid     = rec.tid;
+                }
+                flow->endNs = std::max(flow->endNs, end);
+            }
+        }
+
+        // One async span per cookie ties the processes' records for that flow together
+        for (auto it = flows.cbegin(); it != flows.cend(); ++it) {
+            const FlowBounds& flow = it.value();
+            const QJsonObject args{{"cookie", it.key()}};
+            events.append(QJsonObject{{"name", "auth flow"}, {"cat", "flow"}, {"ph", "b"}, {"id", it.key()}, {"ts", toMicros(flow.startNs)}, {"pid", flow.pid},
+                                      {"tid", static_cast<qint64>(flow.tid)}, {"args", args}});
+            events.append(QJsonObject{{"name", "auth flow"}, {"cat", "flow"}, {"ph", "e"}, {"id", it.key()}, {"ts", toMicros(flow.endNs)}, {"pid", flow.pid},
+                                      {"tid", static_cast<qint64>(flow.tid)}});
+        }
+
+        return QJsonObject{{"traceEvents", events}, {"displayTimeUnit", "ms"}};
+    }
+
+} // namespace bb::trace
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QString>
+
+namespace bb::trace {
+
+    // Reads every trace ring in `directory` (default: the rings of this user's
+    // bb-auth processes) and merges them into one Chrome trace-event document,
+    // loadable in ui.perfetto.dev or chrome://tracing. Each process becomes a
+    // track named after its role; each session cookie additionally gets an
+    // async "auth flow" span from its first to its last record. A non-empty
+    // `cookie` keeps only that flow. Works whether or not this build has trace
+    // points compiled in.
+    QJsonObject dumpChromeTrace(const QString& cookie = {}, const QString& directory = {});
+
+} // namespace bb::trace
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+// On-disk layout of a trace ring, shared by the writer (Trace.cpp) and the
+// reader behind `bb-auth --trace-dump` (TraceDump.cpp). Both sides map the
+// file; the writer never blocks and the reader skips records it catches mid-write.
+namespace bb::trace {
+
+    inline constexpr char          RING_MAGIC[8]    = {'B', 'B', 'T', 'R', 'A', 'C', 'E', '1'};
+    inline constexpr std::uint32_t RING_VERSION     = 1;
+    inline constexpr std::uint32_t RING_CAPACITY    = 2048; // records per process
+    inline constexpr std::size_t   NAME_MAX_BYTES   = 40;
+    inline constexpr std::size_t   COOKIE_MAX_BYTES = 80;
+    inline constexpr std::size_t   ROLE_MAX_BYTES   = 24;
+
+    struct RingHeader {
+        char                       magic[8];
+        std::uint32_t              version;
+        std::uint32_t              recordSize;
+        std::uint32_t              capacity;
+        std::int32_t               pid;
+        char                       role[ROLE_MAX_BYTES];
+        std::atomic<std::uint64_t> head; // records ever claimed; slot = index % capacity
+        std::uint64_t              reserved;
+    };
+
+    struct Record {
+        // 0 while the slot is being (re)written, otherwise claim index + 1
+        std::atomic<std::uint64_t> sequence;
+        std::uint64_t              timestampNs;
+        std::uint64_t              durationNs;
+        std::int64_t               arg;
+        std::uint32_t              tid;
+        char                       phase;
+        char                       reserved[3];
+        char                       name[NAME_MAX_BYTES];     // NUL-padded
+        char                       cookie[COOKIE_MAX_BYTES]; // NUL-padded, empty if not tied to a session
+    };
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "trace rings need lock-free 64-bit atomics in shared memory");
+    static_assert(sizeof(RingHeader) == 64);
+    static_assert(sizeof(Record) == 160);
+
+    inline constexpr std::size_t RING_BYTES = sizeof(RingHeader) + sizeof(Record) * RING_CAPACITY;
+
+    // $BB_AUTH_TRACE_DIR, else $XDG_RUNTIME_DIR/bb-auth-trace; empty if neither is set
+    inline std::string ringDirectory() {
+        if (const char* dir = std::getenv("BB_AUTH_TRACE_DIR"); dir && *dir) {
+            return dir;
+        }
+        if (const char* runtime = std::getenv("XDG_RUNTIME_DIR"); runtime && *runtime) {
+            return std::string(runtime) + "/bb-auth-trace";
+        }
+        return {};
+    }
+
+} // namespace bb::trace
@@ -1,5 +1,7 @@
 #include "Agent.hpp"
 #include "../common/Constants.hpp"
+#include "../common/Trace.hpp"
+#include "Metrics.hpp"
 #include "RequestContext.hpp"
 
 #include <QCoreApplication>
@@ -7,17 +9,16 @@
 #include <QDBusInterface>
 #include <QDBusMetaType>
 #include <QDBusReply>
-#include <QFile>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QProcess>
 #include <QSet>
-#include <QStandardPaths>
 #include <QUuid>
 #include <QFileInfo>
 
 #include <memory>
+#include <vector>
 #include <pwd.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -30,85 +31,69 @@ std::unique_ptr<CAgent> g_pAgent;
 
 namespace {
 
-    inline constexpr int    PROVIDER_MAINTENANCE_INTERVAL_MS = 5000;
-    inline constexpr qint64 FALLBACK_LAUNCH_COOLDOWN_MS      = 5000;
+    inline constexpr int    TIMER_WHEEL_TICK_MS         = 10;
+    inline constexpr int    FALLBACK_LAUNCH_COOLDOWN_MS = 5000;
+    inline constexpr int    FALLBACK_FAILED_BACKOFF_MS  = 1000; // a failed launch is retried sooner
 
-    QJsonObject             readBootstrapState() {
-        QJsonObject   bootstrap;
-
-        const QString stateRoot = QStandardPaths::writableLocation(QStandardPaths::GenericStateLocation);
-        if (stateRoot.isEmpty()) {
-            return bootstrap;
-        }
-
-        QFile stateFile(stateRoot + "/bb-auth/bootstrap-state.env");
-        if (!stateFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            return bootstrap;
-        }
-
-        while (!stateFile.atEnd()) {
-            const QString line = QString::fromUtf8(stateFile.readLine()).trimmed();
-            if (line.isEmpty() || line.startsWith('#')) {
-                continue;
-            }
-
-            const qsizetype delimiter = line.indexOf('=');
-            if (delimiter <= 0) {
-                continue;
-            }
-
-            const QString key   = line.left(delimiter).trimmed();
-            const QString value = line.mid(delimiter + 1).trimmed();
-            if (key.isEmpty()) {
-                continue;
-            }
-
-            if (key == "timestamp") {
-                bootstrap[key] = value.toLongLong();
-            } else {
-                bootstrap[key] = value;
-            }
-        }
-
-        const QByteArray modeOverride = qgetenv("BB_AUTH_CONFLICT_MODE");
-        if (!modeOverride.isEmpty()) {
-            bootstrap["mode"] = QString::fromLocal8Bit(modeOverride);
-        }
+} // namespace
 
-        return bootstrap;
-    }
+CAgent::CAgent(QObject* parent) : CAgent(new CPolkitListener, parent) {}
 
-} // namespace
+CAgent::CAgent(CPolkitListener* listener, QObject* parent) :
+    QObject(parent), m_timers(TIMER_WHEEL_TICK_MS), m_pinentryManager(m_timers), m_listener(listener), m_eventRouter(m_providerRegistry, m_eventQueue) {
+    using bb::agent::MessageType;
 
-CAgent::CAgent(QObject* parent) : QObject(parent), m_listener(new CPolkitListener(this)), m_eventRouter(m_providerRegistry, m_eventQueue) {
-    m_messageRouter.registerHandler("ping", [this](QLocalSocket* socket, const QJsonObject&) {
-        QJsonObject       pong{{"type", "pong"}, {"version", "2.0"}, {"capabilities", QJsonArray{"polkit", "keyring", "pinentry", "fingerprint", "fido2"}}};
+    m_listener->setParent(this);
 
-        const QJsonObject bootstrap = readBootstrapState();
-        if (!bootstrap.isEmpty()) {
-            pong["bootstrap"] = bootstrap;
+    m_fallbackCooldown.setCallback([this]() {
+        if (!hasActiveProvider() && !m_sessionStore.empty()) {
+            ensureFallbackUiRunning("cooldown-elapsed");
         }
+    });
 
-        if (hasActiveProvider()) {
-            if (const auto* provider = m_providerRegistry.activeProviderInfo()) {
-                QJsonObject providerObj{{"id", provider->id}, {"name", provider->name}, {"kind", provider->kind}, {"priority", provider->priority}};
-                pong["provider"] = providerObj;
+    m_bootstrapState.setOnChanged([this]() { m_encodedPong.clear(); });
+
+    // Liveness probes fire often; the reply is encoded once per provider or bootstrap change
+    m_messageRouter.registerHandler<MessageType::Ping>([this](QLocalSocket* socket, const EmptyRequest&) { m_ipcServer.sendEncoded(socket, encodedPong()); });
+
+    m_messageRouter.registerHandler<MessageType::Subscribe>([this](QLocalSocket* socket, const EmptyRequest&) { handleSubscribe(socket); });
+    m_messageRouter.registerHandler<MessageType::Next>([this](QLocalSocket* socket, const NextRequest& request) { handleNext(socket, request); });
+    m_messageRouter.registerHandler<MessageType::KeyringRequest>([this](QLocalSocket* socket, const KeyringRequest& request) { handleKeyringRequest(socket, request); });
+    m_messageRouter.registerHandler<MessageType::PinentryRequest>([this](QLocalSocket* socket, const PinentryRequest& request) { handlePinentryRequest(socket, request); });
+    m_messageRouter.registerHandler<MessageType::PinentryResult>([this](QLocalSocket* socket, const PinentryResultRequest& request) { handlePinentryResult(socket, request); });
+    m_messageRouter.registerHandler<MessageType::UiRegister>([this](QLocalSocket* socket, const QJsonObject& msg) { handleUIRegister(socket, msg); });
+    m_messageRouter.registerHandler<MessageType::UiHeartbeat>([this](QLocalSocket* socket, const EmptyRequest&) { handleUIHeartbeat(socket); });
+    m_messageRouter.registerHandler<MessageType::UiUnregister>([this](QLocalSocket* socket, const EmptyRequest&) { handleUIUnregister(socket); });
+
+    // Authorization runs before the payload is decoded, so other peers only ever see this error
+    m_messageRouter.registerHandler<MessageType::SessionRespond>(
+        [this](QLocalSocket* socket, const JsonMessage&, QString& error) {
+            if (isAuthorizedProviderSocket(socket)) {
+                return true;
             }
-        }
-
-        m_ipcServer.sendJson(socket, pong);
+            error = QStringLiteral("Not active UI provider");
+            return false;
+        },
+        [this](QLocalSocket* socket, const SessionRespondRequest& request) { handleRespond(socket, request); });
+    // The keyring prompter forwards gcr's cancellation for the requests it sent
+    m_messageRouter.registerHandler<MessageType::SessionCancel>(
+        [this](QLocalSocket* socket, const JsonMessage& msg, QString& error) {
+            if (m_keyringManager.getSocketForRequest(msg.string("id")) == socket || isAuthorizedProviderSocket(socket)) {
+                return true;
+            }
+            error = QStringLiteral("Not active UI provider");
+            return false;
+        },
+        [this](QLocalSocket* socket, const SessionCancelRequest& request) { handleCancel(socket, request); });
+
+    m_messageRouter.registerHandler<MessageType::Stats>([this](QLocalSocket* socket, const EmptyRequest&) {
+        QJsonObject stats = bb::metrics::snapshot();
+        stats["type"]     = "stats";
+        stats["sessions"] = static_cast<int>(m_sessionStore.size());
+        stats["tables"]   = tableSizes();
+        m_ipcServer.sendJson(socket, stats);
     });
-
-    m_messageRouter.registerHandler("subscribe", [this](QLocalSocket* socket, const QJsonObject&) { handleSubscribe(socket); });
-    m_messageRouter.registerHandler("next", [this](QLocalSocket* socket, const QJsonObject&) { handleNext(socket); });
-    m_messageRouter.registerHandler("keyring_request", [this](QLocalSocket* socket, const QJsonObject& msg) { handleKeyringRequest(socket, msg); });
-    m_messageRouter.registerHandler("pinentry_request", [this](QLocalSocket* socket, const QJsonObject& msg) { handlePinentryRequest(socket, msg); });
-    m_messageRouter.registerHandler("pinentry_result", [this](QLocalSocket* socket, const QJsonObject& msg) { handlePinentryResult(socket, msg); });
-    m_messageRouter.registerHandler("ui.register", [this](QLocalSocket* socket, const QJsonObject& msg) { handleUIRegister(socket, msg); });
-    m_messageRouter.registerHandler("ui.heartbeat", [this](QLocalSocket* socket, const QJsonObject& msg) { handleUIHeartbeat(socket, msg); });
-    m_messageRouter.registerHandler("ui.unregister", [this](QLocalSocket* socket, const QJsonObject& msg) { handleUIUnregister(socket, msg); });
-    m_messageRouter.registerHandler("session.respond", [this](QLocalSocket* socket, const QJsonObject& msg) { handleRespond(socket, msg); });
-    m_messageRouter.registerHandler("session.cancel", [this](QLocalSocket* socket, const QJsonObject& msg) { handleCancel(socket, msg); });
+    m_messageRouter.registerHandler<MessageType::Batch>([this](QLocalSocket* socket, const BatchRequest& request) { handleBatch(socket, request); });
 }
 
 CAgent::~CAgent() {}
@@ -116,8 +101,6 @@ CAgent::~CAgent() {}
 #include <PolkitQt1/Subject>
 
 bool CAgent::start(QCoreApplication& app, const QString& socketPath) {
-    m_socketPath = socketPath;
-
     PolkitQt1::UnixSessionSubject subject(getpid());
     if (!m_listener->registerListener(subject, "/org/kde/PolicyKit1/AuthenticationAgent")) {
         std::print(stderr, "Failed to register as Polkit agent listener\n");
@@ -126,41 +109,80 @@ bool CAgent::start(QCoreApplication& app, const QString& socketPath) {
 
     std::print("Polkit listener registered successfully\n");
 
+    if (!startIpc(socketPath)) {
+        return false;
+    }
+
+    std::print("Agent started on {}\n", socketPath.toStdString());
+    return app.exec() == 0;
+}
+
+bool CAgent::startIpc(const QString& socketPath) {
+    m_socketPath = socketPath;
+    bb::metrics::reset();
+
     // Connect Polkit signals
     connect(m_listener.data(), &CPolkitListener::completed, this, &CAgent::onPolkitCompleted);
 
+    connect(&m_pinentryManager, &bb::PinentryManager::deferredReply, this,
+            [this](QLocalSocket* socket, const QJsonObject& reply, const bb::SecretString* password) {
+                if (password) {
+                    m_ipcServer.sendSecret(socket, reply, "password", *password);
+                } else {
+                    m_ipcServer.sendJson(socket, reply);
+                }
+            });
+
     // Setup IPC server
-    m_ipcServer.setMessageHandler([this](QLocalSocket* socket, const QString& type, const QJsonObject& msg) { handleMessage(socket, type, msg); });
+    m_ipcServer.setMessageHandler([this](QLocalSocket* socket, const bb::JsonMessage& msg) { handleMessage(socket, msg); });
 
     QObject::connect(&m_ipcServer, &bb::IpcServer::clientDisconnected, [this](QLocalSocket* socket) { onClientDisconnected(socket); });
 
-    m_providerMaintenanceTimer.setInterval(PROVIDER_MAINTENANCE_INTERVAL_MS);
-    m_providerMaintenanceTimer.setSingleShot(false);
-    QObject::connect(&m_providerMaintenanceTimer, &QTimer::timeout, [this]() { pruneStaleProviders(); });
-    m_providerMaintenanceTimer.start();
+    m_bootstrapState.watch(bb::BootstrapState::defaultPath());
+
+    // Each provider's heartbeat deadline lives on the wheel; nothing is scanned until one lapses
+    m_providerRegistry.setLivenessTimers(m_timers, [this]() { pruneStaleProviders(); });
 
     if (!m_ipcServer.start(socketPath)) {
         std::print(stderr, "Failed to start IPC server on {}\n", socketPath.toStdString());
         return false;
     }
 
-    std::print("Agent started on {}\n", socketPath.toStdString());
-    return app.exec() == 0;
+    return true;
+}
+
+QJsonObject CAgent::tableSizes() const {
+    QJsonObject tables = m_sessionStore.tableSizes();
+    for (const QJsonObject& part : {m_keyringManager.tableSizes(), m_pinentryManager.tableSizes()}) {
+        for (auto it = part.constBegin(); it != part.constEnd(); ++it) {
+            tables.insert(it.key(), it.value());
+        }
+    }
+
+    tables["polkit_cookies"]  = static_cast<qint64>(m_listener->m_cookieToState.size());
+    tables["polkit_sessions"] = static_cast<qint64>(m_listener->m_sessionToState.size());
+    tables["event_queue"]     = m_eventQueue.size();
+    tables["next_waiters"]    = m_eventQueue.waiterCount();
+    tables["subscribers"]     = static_cast<qint64>(m_subscribers.size());
+    tables["providers"]       = static_cast<qint64>(m_providerRegistry.sockets().size());
+    tables["timers"]          = static_cast<qint64>(m_timers.armedCount()); // one per provider and waiting batch poll, plus the fallback cooldown
+    return tables;
 }
 
 void CAgent::onClientDisconnected(QLocalSocket* socket) {
     if (m_subscribers.removeOne(socket)) {
-        qDebug() << "Subscriber removed, remaining:" << m_subscribers.size();
+        BB_TRACE_EVENT_ARG("ipc.unsubscribe", u"", m_subscribers.size());
     }
 
     if (m_providerRegistry.removeSocket(socket)) {
-        qDebug() << "UI provider disconnected:" << socket;
+        BB_TRACE_EVENT("ui.provider_disconnected", u"");
         if (m_providerRegistry.recomputeActiveProvider()) {
             emitProviderStatus();
         }
     }
 
     m_eventQueue.removeWaiter(socket);
+    m_nextDeadlines.erase(socket);
     m_keyringManager.cleanupForSocket(socket);
     m_pinentryManager.cleanupForSocket(socket);
 
@@ -169,60 +191,128 @@ void CAgent::onClientDisconnected(QLocalSocket* socket) {
     }
 }
 
-void CAgent::handleMessage(QLocalSocket* socket, const QString& type, const QJsonObject& msg) {
-    if (!m_messageRouter.dispatch(socket, type, msg)) {
-        m_ipcServer.sendJson(socket, QJsonObject{{"type", "error"}, {"message", "Unknown type"}});
+void CAgent::handleMessage(QLocalSocket* socket, const JsonMessage& msg) {
+    QString error;
+    switch (m_messageRouter.dispatch(socket, msg, error)) {
+        case bb::agent::MessageRouter::DispatchStatus::Handled: break;
+        case bb::agent::MessageRouter::DispatchStatus::UnknownType:
+            bb::metrics::increment(bb::metrics::Counter::UnknownTypes);
+            m_ipcServer.sendJson(socket, QJsonObject{{"type", "error"}, {"message", "Unknown type"}});
+            break;
+        case bb::agent::MessageRouter::DispatchStatus::InvalidRequest:
+        case bb::agent::MessageRouter::DispatchStatus::Unauthorized: {
+            QJsonObject reply{{"type", "error"}, {"message", error}};
+            // The keyring prompter matches replies to its open requests by cookie
+            const QByteArrayView type = msg.type();
+            if (bb::agent::messageTypeFromName(std::string_view(type.data(), static_cast<std::size_t>(type.size()))) == bb::agent::MessageType::KeyringRequest &&
+                msg.kind("cookie") == bb::JsonMessage::Kind::String) {
+                reply["id"] = msg.string("cookie");
+            }
+            m_ipcServer.sendJson(socket, reply);
+            break;
+        }
+    }
+}
+
+// Every request is decoded before any runs, so a malformed entry rejects the batch
+// with nothing applied. They then run in order with nothing else in between, each
+// authorized just before its handler as if it had arrived on its own line, and
+// their replies come back as one line.
+void CAgent::handleBatch(QLocalSocket* socket, const BatchRequest& request) {
+    std::vector<bb::agent::MessageRouter::PreparedRequest> prepared;
+    QString                                                error;
+    if (!m_messageRouter.prepareAll(socket, request.requests, prepared, error)) {
+        m_ipcServer.sendJson(socket, QJsonObject{{"type", "error"}, {"message", error}});
+        return;
+    }
+
+    m_ipcServer.beginBatch(socket);
+    for (auto& run : prepared) {
+        if (!run(socket, error)) {
+            m_ipcServer.sendJson(socket, QJsonObject{{"type", "error"}, {"message", error}});
+        }
     }
+    m_ipcServer.endBatch();
 }
 
-void CAgent::handleNext(QLocalSocket* socket) {
-    if (m_eventQueue.isEmpty()) {
-        m_eventQueue.subscribeNext(socket);
+void CAgent::handleNext(QLocalSocket* socket, const NextRequest& request) {
+    // One poll per connection: a second would share its deadline and go unanswered
+    if (m_eventQueue.isWaiting(socket)) {
+        m_ipcServer.sendJson(socket, QJsonObject{{"type", "error"}, {"message", "next already pending"}});
+        return;
+    }
+
+    if (!m_eventQueue.isEmpty()) {
+        m_ipcServer.sendJson(socket, request.max > 0 ? m_eventQueue.takeBatch(request.max) : m_eventQueue.takeNext());
+        return;
+    }
+
+    if (request.max > 0 && request.waitMs == 0) {
+        m_ipcServer.sendJson(socket, m_eventQueue.takeBatch(0));
         return;
     }
 
-    m_ipcServer.sendJson(socket, m_eventQueue.takeNext());
+    m_eventQueue.subscribeNext(socket, request.max);
+    if (request.max > 0 && request.waitMs > 0) {
+        bb::TimerWheel::Entry& deadline = m_nextDeadlines[socket];
+        deadline.setCallback([this, socket]() { onNextDeadline(socket); });
+        m_timers.schedule(deadline, request.waitMs);
+    }
+}
+
+// Nothing arrived within wait_ms: the poll is answered with an empty batch
+void CAgent::onNextDeadline(QLocalSocket* socket) {
+    m_eventQueue.removeWaiter(socket);
+    m_nextDeadlines.erase(socket);
+    m_ipcServer.sendJson(socket, m_eventQueue.takeBatch(0));
 }
 
 void CAgent::handleSubscribe(QLocalSocket* socket) {
     if (!m_subscribers.contains(socket)) {
         m_subscribers.append(socket);
-        qDebug() << "Subscriber added, total:" << m_subscribers.size();
+        BB_TRACE_EVENT_ARG("ipc.subscribe", u"", m_subscribers.size());
     }
 
     const bool isRegisteredProvider        = m_providerRegistry.contains(socket);
     const bool isActiveProvider            = isRegisteredProvider && (socket == m_providerRegistry.activeProvider());
     const bool canReceiveInteractiveEvents = !isRegisteredProvider || isActiveProvider;
 
-    if (canReceiveInteractiveEvents) {
-        for (const auto& [cookie, session] : m_sessionStore.sessions()) {
-            m_ipcServer.sendJson(socket, session->toCreatedEvent());
-            m_ipcServer.sendJson(socket, session->toUpdatedEvent());
-        }
-    }
-
-    QJsonObject subscribedMsg{{"type", "subscribed"}, {"sessionCount", canReceiveInteractiveEvents ? static_cast<int>(m_sessionStore.size()) : 0}};
+    QJsonObject subscribedMsg{{"type", "subscribed"},
+                              {"sessionCount", canReceiveInteractiveEvents ? static_cast<int>(m_sessionStore.size()) : 0},
+                              {"seq", static_cast<qint64>(m_sessionStore.sequence())}};
 
     if (isRegisteredProvider) {
         subscribedMsg["active"] = isActiveProvider;
     }
 
+    if (!canReceiveInteractiveEvents || m_sessionStore.empty()) {
+        m_ipcServer.sendJson(socket, subscribedMsg);
+        return;
+    }
+
+    // Every open session, then the confirmation. The snapshot is made of session
+    // events, so inside a batch only the confirmation joins the replies.
+    m_ipcServer.sendEvent(socket, m_sessionStore.encodedSnapshot());
     m_ipcServer.sendJson(socket, subscribedMsg);
 }
 
-void CAgent::handleKeyringRequest(QLocalSocket* socket, const QJsonObject& msg) {
-    pid_t peerPid = bb::IpcServer::getPeerPid(socket);
-    m_keyringManager.handleRequest(msg, socket, peerPid);
+void CAgent::handleKeyringRequest(QLocalSocket* socket, KeyringRequest request) {
+    request.socket     = socket;
+    request.peerPid    = m_ipcServer.getPeerPid(socket);
+    request.receivedAt = bb::metrics::dispatchStart();
+    m_keyringManager.handleRequest(std::move(request));
 }
 
-void CAgent::handlePinentryRequest(QLocalSocket* socket, const QJsonObject& msg) {
-    pid_t peerPid = bb::IpcServer::getPeerPid(socket);
-    m_pinentryManager.handleRequest(msg, socket, peerPid);
+void CAgent::handlePinentryRequest(QLocalSocket* socket, PinentryRequest request) {
+    request.socket     = socket;
+    request.peerPid    = m_ipcServer.getPeerPid(socket);
+    request.receivedAt = bb::metrics::dispatchStart();
+    m_pinentryManager.handleRequest(std::move(request));
 }
 
-void CAgent::handlePinentryResult(QLocalSocket* socket, const QJsonObject& msg) {
-    pid_t       peerPid = bb::IpcServer::getPeerPid(socket);
-    QJsonObject result  = m_pinentryManager.handleResult(msg, peerPid);
+void CAgent::handlePinentryResult(QLocalSocket* socket, const PinentryResultRequest& request) {
+    pid_t       peerPid = m_ipcServer.getPeerPid(socket);
+    QJsonObject result  = m_pinentryManager.handleResult(request, peerPid);
     m_ipcServer.sendJson(socket, result);
 }
 
@@ -237,9 +327,7 @@ void CAgent::handleUIRegister(QLocalSocket* socket, const QJsonObject& msg) {
         emitProviderStatus();
     }
 }
-void CAgent::handleUIHeartbeat(QLocalSocket* socket, const QJsonObject& msg) {
-    Q_UNUSED(msg)
-
+void CAgent::handleUIHeartbeat(QLocalSocket* socket) {
     if (!m_providerRegistry.heartbeat(socket)) {
         m_ipcServer.sendJson(socket, QJsonObject{{"type", "error"}, {"message", "Provider not registered"}});
         return;
@@ -251,9 +339,7 @@ void CAgent::handleUIHeartbeat(QLocalSocket* socket, const QJsonObject& msg) {
 
     m_ipcServer.sendJson(socket, QJsonObject{{"type", "ok"}, {"active", socket == m_providerRegistry.activeProvider()}});
 }
-void CAgent::handleUIUnregister(QLocalSocket* socket, const QJsonObject& msg) {
-    Q_UNUSED(msg)
-
+void CAgent::handleUIUnregister(QLocalSocket* socket) {
     if (!m_providerRegistry.unregisterProvider(socket)) {
         m_ipcServer.sendJson(socket, QJsonObject{{"type", "error"}, {"message", "Provider not registered"}});
         return;
@@ -269,20 +355,15 @@ void CAgent::handleUIUnregister(QLocalSocket* socket, const QJsonObject& msg) {
     }
 }
 
-void CAgent::handleRespond(QLocalSocket* socket, const QJsonObject& msg) {
-    const QString cookie   = msg.value("id").toString();
-    const QString response = msg.value("response").toString();
-
-    if (!isAuthorizedProviderSocket(socket)) {
-        m_ipcServer.sendJson(socket, QJsonObject{{"type", "error"}, {"message", "Not active UI provider"}});
-        return;
-    }
+void CAgent::handleRespond(QLocalSocket* socket, const SessionRespondRequest& request) {
+    const QString&      cookie   = request.id;
+    const SecretString& response = request.response;
 
     if (m_keyringManager.hasPendingRequest(cookie)) {
         QLocalSocket* origSocket = m_keyringManager.getSocketForRequest(cookie);
-        QJsonObject   reply      = m_keyringManager.handleResponse(cookie, response);
+        QJsonObject   reply      = m_keyringManager.handleResponse(cookie);
         if (origSocket)
-            m_ipcServer.sendJson(origSocket, reply, true);
+            m_ipcServer.sendSecret(origSocket, reply, "password", response);
         m_ipcServer.sendJson(socket, QJsonObject{{"type", "ok"}});
         return;
     }
@@ -296,7 +377,11 @@ void CAgent::handleRespond(QLocalSocket* socket, const QJsonObject& msg) {
             return;
         }
 
-        m_ipcServer.sendJson(origSocket, result.socketResponse, true);
+        if (result.withPassword) {
+            m_ipcServer.sendSecret(origSocket, result.socketResponse, "password", response);
+        } else {
+            m_ipcServer.sendJson(origSocket, result.socketResponse);
+        }
         m_ipcServer.sendJson(socket, QJsonObject{{"type", "ok"}});
         return;
     }
@@ -317,17 +402,13 @@ void CAgent::handleRespond(QLocalSocket* socket, const QJsonObject& msg) {
         return;
     }
 
+    BB_TRACE_EVENT("agent.respond_polkit", cookie);
     m_listener->submitPassword(cookie, response);
     m_ipcServer.sendJson(socket, QJsonObject{{"type", "ok"}});
 }
 
-void CAgent::handleCancel(QLocalSocket* socket, const QJsonObject& msg) {
-    const QString cookie = msg.value("id").toString();
-
-    if (!isAuthorizedProviderSocket(socket)) {
-        m_ipcServer.sendJson(socket, QJsonObject{{"type", "error"}, {"message", "Not active UI provider"}});
-        return;
-    }
+void CAgent::handleCancel(QLocalSocket* socket, const SessionCancelRequest& request) {
+    const QString& cookie = request.id;
 
     if (m_keyringManager.hasPendingRequest(cookie)) {
         QLocalSocket* origSocket = m_keyringManager.getSocketForRequest(cookie);
@@ -369,12 +450,25 @@ void CAgent::handleCancel(QLocalSocket* socket, const QJsonObject& msg) {
 }
 
 void CAgent::emitSessionEvent(const QJsonObject& event) {
-    m_eventRouter.route(event, m_subscribers, [this](QLocalSocket* socket, const QJsonObject& routedEvent) { m_ipcServer.sendJson(socket, routedEvent); });
+    // Direct recipients all get `event` itself, so it is serialized at most once
+    QByteArray encoded;
+    m_eventRouter.route(
+        event, m_subscribers,
+        [this, &event, &encoded](QLocalSocket* socket, const QJsonObject&) {
+            if (encoded.isEmpty()) {
+                encoded = bb::IpcServer::encodeJson(event);
+            }
+            m_ipcServer.sendEvent(socket, encoded);
+        },
+        [this](QLocalSocket* socket, const QJsonObject& reply) {
+            m_nextDeadlines.erase(socket); // the poll is answered; its wait_ms no longer applies
+            m_ipcServer.sendEvent(socket, bb::IpcServer::encodeJson(reply));
+        });
 }
 
 void CAgent::onPolkitRequest(const QString& cookie, const QString& message, [[maybe_unused]] const QString& iconName, const QString& actionId, const QString& user,
                              const PolkitQt1::Details& details) {
-    qDebug() << "POLKIT REQUEST" << cookie;
+    BB_TRACE_SCOPE("agent.polkit_request", cookie);
 
     bb::Session::Context ctx;
     ctx.message  = message;
@@ -383,7 +477,8 @@ void CAgent::onPolkitRequest(const QString& cookie, const QString& message, [[ma
 
     auto pid = RequestContextHelper::extractSubjectPid(details);
     if (pid) {
-        auto proc = RequestContextHelper::readProc(*pid);
+        const bb::metrics::ScopedTimer timer(bb::metrics::Stage::RequestorResolve);
+        auto                           proc = RequestContextHelper::readProc(*pid);
         if (proc) {
             auto actor                   = RequestContextHelper::resolveRequestorFromSubject(*proc, getuid());
             ctx.requestor.name           = actor.displayName;
@@ -447,6 +542,7 @@ void CAgent::onSessionInfo(const QString& cookie, const QString& info) {
 void CAgent::onPolkitCompleted([[maybe_unused]] bool gainedAuthorization) {}
 // Centralized session management
 void CAgent::createSession(const QString& id, Session::Source source, Session::Context ctx) {
+    BB_TRACE_SCOPE("agent.create_session", id);
     const QJsonObject createdEvent = m_sessionStore.createSession(id, source, ctx);
     emitSessionEvent(createdEvent);
     if (!hasActiveProvider()) {
@@ -482,6 +578,7 @@ void CAgent::updateSessionPinentryRetry(const QString& id, int curRetry, int max
     }
 }
 QJsonObject CAgent::closeSession(const QString& id, Session::Result result, bool deferred) {
+    BB_TRACE_EVENT_ARG("agent.close_session", id, static_cast<int>(result));
     const auto closed = m_sessionStore.closeSession(id, result);
     if (!closed) {
         qWarning() << "closeSession: Session not found:" << id;
@@ -517,7 +614,29 @@ void CAgent::pruneStaleProviders() {
         ensureFallbackUiRunning("provider-prune");
     }
 }
+const QByteArray& CAgent::encodedPong() {
+    if (!m_encodedPong.isEmpty()) {
+        return m_encodedPong;
+    }
+
+    QJsonObject pong{{"type", "pong"}, {"version", "2.0"}, {"capabilities", QJsonArray{"polkit", "keyring", "pinentry", "fingerprint", "fido2"}}};
+
+    if (const QJsonObject& bootstrap = m_bootstrapState.snapshot(); !bootstrap.isEmpty()) {
+        pong["bootstrap"] = bootstrap;
+    }
+
+    if (const auto* provider = m_providerRegistry.activeProviderInfo()) {
+        QJsonObject providerObj{{"id", provider->id}, {"name", provider->name}, {"kind", provider->kind}, {"priority", provider->priority}};
+        pong["provider"] = providerObj;
+    }
+
+    m_encodedPong = bb::IpcServer::encodeJson(pong);
+    return m_encodedPong;
+}
+
 void CAgent::emitProviderStatus() {
+    m_encodedPong.clear();
+
     QJsonObject status{{"type", "ui.active"}, {"active", hasActiveProvider()}};
     if (const auto* provider = m_providerRegistry.activeProviderInfo()) {
         status["id"]       = provider->id;
@@ -526,23 +645,25 @@ void CAgent::emitProviderStatus() {
         status["priority"] = provider->priority;
     }
 
+    const QByteArray    encoded = bb::IpcServer::encodeJson(status);
     QSet<QLocalSocket*> sent;
 
     for (QLocalSocket* socket : m_providerRegistry.sockets()) {
         if (socket && socket->isValid()) {
-            m_ipcServer.sendJson(socket, status);
+            m_ipcServer.sendEvent(socket, encoded);
             sent.insert(socket);
         }
     }
     for (auto* subscriber : m_subscribers) {
         if (subscriber && subscriber->isValid() && !sent.contains(subscriber)) {
-            m_ipcServer.sendJson(subscriber, status);
+            m_ipcServer.sendEvent(subscriber, encoded);
         }
     }
 }
 
 void CAgent::ensureFallbackUiRunning(const QString& reason) {
-    if (hasActiveProvider()) {
+    // Within the cooldown nothing would launch; the entry re-checks once it lapses
+    if (hasActiveProvider() || m_fallbackCooldown.isArmed()) {
         return;
     }
 
@@ -550,15 +671,12 @@ void CAgent::ensureFallbackUiRunning(const QString& reason) {
         QProcess probe;
         probe.start("pgrep", QStringList{"-u", QString::number(getuid()), "-f", "bb-auth-fallback"});
         if (probe.waitForFinished(500) && probe.exitStatus() == QProcess::NormalExit && probe.exitCode() == 0) {
+            // Running but not registered (yet); look again later
+            m_timers.schedule(m_fallbackCooldown, FALLBACK_LAUNCH_COOLDOWN_MS);
             return;
         }
     }
 
-    const qint64 nowMs = QDateTime::currentMSecsSinceEpoch();
-    if ((nowMs - m_lastFallbackLaunchMs) < FALLBACK_LAUNCH_COOLDOWN_MS) {
-        return;
-    }
-
     QString fallbackPath = QString::fromLocal8Bit(qgetenv("BB_AUTH_FALLBACK_PATH"));
     if (fallbackPath.isEmpty()) {
         fallbackPath = QCoreApplication::applicationDirPath() + "/bb-auth-fallback";
@@ -577,9 +695,9 @@ void CAgent::ensureFallbackUiRunning(const QString& reason) {
 
     const bool launched = QProcess::startDetached(fallbackPath, args);
     if (launched) {
-        m_lastFallbackLaunchMs = nowMs;
         qInfo() << "Launched fallback UI due to" << reason;
     } else {
         qWarning() << "Failed to launch fallback UI:" << fallbackPath;
     }
+    m_timers.schedule(m_fallbackCooldown, launched ? FALLBACK_LAUNCH_COOLDOWN_MS : FALLBACK_FAILED_BACKOFF_MS);
 }
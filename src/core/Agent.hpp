@@ -2,12 +2,14 @@
 
 #include <QCoreApplication>
 #include <QSharedPointer>
-#include <QTimer>
 
 #include <memory>
+#include <unordered_map>
 
+#include "BootstrapState.hpp"
 #include "PolkitListener.hpp"
 #include "Session.hpp"
+#include "TimerWheel.hpp"
 #include "agent/EventQueue.hpp"
 #include "agent/EventRouter.hpp"
 #include "agent/ProviderRegistry.hpp"
@@ -24,29 +26,40 @@ namespace bb {
 
       public:
         explicit CAgent(QObject* parent = nullptr);
+        // Takes ownership of `listener`
+        explicit CAgent(CPolkitListener* listener, QObject* parent = nullptr);
         ~CAgent() override;
 
         bool start(QCoreApplication& app, const QString& socketPath);
+        // The IPC side of start(): no polkit registration and no event loop
+        bool startIpc(const QString& socketPath);
+
+        // Entry count of every per-session table (reported by `stats`; zero sessions should mean zero entries)
+        QJsonObject tableSizes() const;
 
       private:
         void onClientDisconnected(QLocalSocket* socket);
 
-        void handleMessage(QLocalSocket* socket, const QString& type, const QJsonObject& msg);
-        void handleNext(QLocalSocket* socket);
+        void handleMessage(QLocalSocket* socket, const JsonMessage& msg);
+        void handleBatch(QLocalSocket* socket, const BatchRequest& request);
+        void handleNext(QLocalSocket* socket, const NextRequest& request);
+        void onNextDeadline(QLocalSocket* socket);
         void handleSubscribe(QLocalSocket* socket);
-        void handleKeyringRequest(QLocalSocket* socket, const QJsonObject& msg);
-        void handlePinentryRequest(QLocalSocket* socket, const QJsonObject& msg);
-        void handlePinentryResult(QLocalSocket* socket, const QJsonObject& msg);
+        void handleKeyringRequest(QLocalSocket* socket, KeyringRequest request);
+        void handlePinentryRequest(QLocalSocket* socket, PinentryRequest request);
+        void handlePinentryResult(QLocalSocket* socket, const PinentryResultRequest& request);
         void handleUIRegister(QLocalSocket* socket, const QJsonObject& msg);
-        void handleUIHeartbeat(QLocalSocket* socket, const QJsonObject& msg);
-        void handleUIUnregister(QLocalSocket* socket, const QJsonObject& msg);
-        void handleRespond(QLocalSocket* socket, const QJsonObject& msg);
-        void handleCancel(QLocalSocket* socket, const QJsonObject& msg);
+        void handleUIHeartbeat(QLocalSocket* socket);
+        void handleUIUnregister(QLocalSocket* socket);
+        void handleRespond(QLocalSocket* socket, const SessionRespondRequest& request);
+        void handleCancel(QLocalSocket* socket, const SessionCancelRequest& request);
 
         bool isAuthorizedProviderSocket(QLocalSocket* socket) const;
         bool hasActiveProvider() const;
         void pruneStaleProviders();
         void emitProviderStatus();
+        // The whole `pong` line, rebuilt on the first ping after a provider or bootstrap change
+        const QByteArray& encodedPong();
         void ensureFallbackUiRunning(const QString& reason);
 
         void onPolkitCompleted(bool gainedAuthorization);
@@ -69,6 +82,8 @@ namespace bb {
         Session*    getSession(const QString& id);
 
       private:
+        // Every daemon timeout; declared first so it outlives the entries embedded below
+        bb::TimerWheel                  m_timers;
         bb::IpcServer                   m_ipcServer;
         bb::KeyringManager              m_keyringManager;
         bb::PinentryManager             m_pinentryManager;
@@ -80,9 +95,13 @@ namespace bb {
         bb::agent::SessionStore         m_sessionStore;
         bb::agent::MessageRouter        m_messageRouter;
         QList<QLocalSocket*>            m_subscribers;
-        QTimer                          m_providerMaintenanceTimer;
         QString                         m_socketPath;
-        qint64                          m_lastFallbackLaunchMs = 0;
+        bb::BootstrapState              m_bootstrapState;
+        QByteArray                      m_encodedPong;
+        bb::TimerWheel::Entry           m_fallbackCooldown; // armed after a launch attempt; re-checks when it lapses
+
+        // Batch polls parked with a wait_ms, answered empty when it runs out
+        std::unordered_map<QLocalSocket*, bb::TimerWheel::Entry> m_nextDeadlines;
     };
 
 } // namespace bb
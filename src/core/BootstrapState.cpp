@@ -0,0 +1,188 @@
+#include "BootstrapState.hpp"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QSocketNotifier>
+#include <QStandardPaths>
+
+#include <cerrno>
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace bb {
+
+    namespace {
+
+        // Rewritten in place (`cat >`), renamed over, or removed
+        inline constexpr quint32 FILE_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_MOVE_SELF;
+        // On an ancestor: a directory on the way to the file appeared
+        inline constexpr quint32 ANCESTOR_EVENTS = IN_CREATE | IN_MOVED_TO | IN_ONLYDIR | IN_MOVE_SELF;
+
+        QString nearestExistingDir(QString dir) {
+            while (!QFileInfo(dir).isDir()) {
+                const QString parent = QFileInfo(dir).absolutePath();
+                if (parent == dir) {
+                    break;
+                }
+                dir = parent;
+            }
+            return dir;
+        }
+
+        QJsonObject              parseStateFile(const QString& path) {
+            QJsonObject bootstrap;
+            QFile       stateFile(path);
+            if (path.isEmpty() || !stateFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                return bootstrap;
+            }
+
+            while (!stateFile.atEnd()) {
+                const QString line = QString::fromUtf8(stateFile.readLine()).trimmed();
+                if (line.isEmpty() || line.startsWith('#')) {
+                    continue;
+                }
+
+                const qsizetype delimiter = line.indexOf('=');
+                if (delimiter <= 0) {
+                    continue;
+                }
+
+                const QString key   = line.left(delimiter).trimmed();
+                const QString value = line.mid(delimiter + 1).trimmed();
+                if (key.isEmpty()) {
+                    continue;
+                }
+
+                if (key == "timestamp") {
+                    bootstrap[key] = value.toLongLong();
+                } else {
+                    bootstrap[key] = value;
+                }
+            }
+
+            const QByteArray modeOverride = qgetenv("BB_AUTH_CONFLICT_MODE");
+            if (!modeOverride.isEmpty()) {
+                bootstrap["mode"] = QString::fromLocal8Bit(modeOverride);
+            }
+
+            return bootstrap;
+        }
+
+    } // namespace
+
+    BootstrapState::~BootstrapState() {
+        m_notifier.reset();
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    QString BootstrapState::defaultPath() {
+        const QString stateRoot = QStandardPaths::writableLocation(QStandardPaths::GenericStateLocation);
+        return stateRoot.isEmpty() ? QString() : stateRoot + "/bb-auth/bootstrap-state.env";
+    }
+
+    void BootstrapState::watch(const QString& path) {
+        m_path     = path;
+        m_fileName = QFileInfo(path).fileName();
+
+        if (!m_path.isEmpty() && m_fd < 0) {
+            m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (m_fd < 0) {
+                qWarning() << "inotify_init1 failed:" << std::strerror(errno);
+            } else {
+                m_notifier = std::make_unique<QSocketNotifier>(m_fd, QSocketNotifier::Read);
+                QObject::connect(m_notifier.get(), &QSocketNotifier::activated, [this] { onNotify(); });
+            }
+        }
+
+        addWatch();
+        reload();
+    }
+
+    // Watches the directory rather than the file, so replacing or creating it is seen too.
+    // The directory is bb-auth-bootstrap's to create; while it is missing, the nearest
+    // existing ancestor is watched and the watch moves down as directories appear.
+    void BootstrapState::addWatch() {
+        if (m_fd < 0) {
+            return;
+        }
+
+        const QString target = QFileInfo(m_path).absolutePath();
+        QString       dir    = nearestExistingDir(target);
+        for (;;) {
+            const bool ancestor = dir != target;
+            const int  wd       = inotify_add_watch(m_fd, QFile::encodeName(dir).constData(), ancestor ? ANCESTOR_EVENTS : FILE_EVENTS);
+            if (wd < 0) {
+                qWarning() << "inotify_add_watch failed for" << dir << ":" << std::strerror(errno);
+            }
+            if (m_wd >= 0 && m_wd != wd) {
+                inotify_rm_watch(m_fd, m_wd);
+            }
+            m_wd               = wd;
+            m_watchingAncestor = ancestor;
+
+            // A directory created before the watch was in place would go unnoticed
+            const QString nearest = nearestExistingDir(target);
+            if (wd < 0 || nearest == dir) {
+                break;
+            }
+            dir = nearest;
+        }
+    }
+
+    void BootstrapState::onNotify() {
+        alignas(inotify_event) char buffer[4096];
+        bool                        relevant   = false;
+        bool                        rearm      = false;
+        const QByteArray            targetName = QFile::encodeName(m_fileName);
+
+        for (;;) {
+            const ssize_t length = read(m_fd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+
+            for (ssize_t offset = 0; offset < length;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+                // Left over from a watch that has since moved
+                if (event->wd != m_wd) {
+                    continue;
+                }
+
+                // The watched directory went away or moved, or one on the way to the file appeared
+                if (event->mask & (IN_IGNORED | IN_MOVE_SELF)) {
+                    rearm = true;
+                } else if (m_watchingAncestor) {
+                    rearm = rearm || (event->mask & IN_ISDIR);
+                } else if (event->len > 0 && targetName == event->name) {
+                    relevant = true;
+                }
+            }
+        }
+
+        if (rearm) {
+            addWatch();
+        }
+        if (relevant || rearm) {
+            reload();
+        }
+    }
+
+    void BootstrapState::reload() {
+        QJsonObject next = parseStateFile(m_path);
+        if (next == m_snapshot) {
+            return;
+        }
+
+        m_snapshot = std::move(next);
+        if (m_onChanged) {
+            m_onChanged();
+        }
+    }
+
+} // namespace bb
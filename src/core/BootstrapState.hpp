@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QString>
+
+#include <functional>
+#include <memory>
+
+class QSocketNotifier;
+
+namespace bb {
+
+    // What bb-auth-bootstrap last recorded in bootstrap-state.env, parsed once into
+    // an immutable snapshot. An inotify watch on the file's directory re-reads it
+    // whenever it is rewritten, replaced or removed; nothing touches the file between.
+    // Until the directory exists its nearest existing ancestor is watched instead.
+    class BootstrapState {
+      public:
+        BootstrapState() = default;
+        ~BootstrapState();
+
+        BootstrapState(const BootstrapState&)            = delete;
+        BootstrapState& operator=(const BootstrapState&) = delete;
+
+        // $XDG_STATE_HOME/bb-auth/bootstrap-state.env, or empty without a state location
+        static QString defaultPath();
+
+        // Loads `path` and starts watching it; a missing directory is waited for, never created
+        void watch(const QString& path);
+
+        // Called after the snapshot has been replaced by different contents
+        void setOnChanged(std::function<void()> onChanged) {
+            m_onChanged = std::move(onChanged);
+        }
+
+        // Empty while the file is missing
+        const QJsonObject& snapshot() const {
+            return m_snapshot;
+        }
+
+      private:
+        void                             addWatch();
+        void                             onNotify();
+        void                             reload();
+
+        QString                          m_path;
+        QString                          m_fileName;
+        QJsonObject                      m_snapshot;
+        int                              m_fd = -1;
+        int                              m_wd = -1;
+        bool                             m_watchingAncestor = false; // the file's directory does not exist yet
+        std::unique_ptr<QSocketNotifier> m_notifier;
+        std::function<void()>            m_onChanged;
+    };
+
+} // namespace bb
@@ -0,0 +1,147 @@
+#include "Metrics.hpp"
+
+#include <QString>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace bb::metrics {
+
+    namespace {
+
+        struct Registry {
+            std::array<LatencyHistogram, STAGE_COUNT> stages;
+            std::array<quint64, COUNTER_COUNT>        counters{};
+            qint64                                    startedAt     = now();
+            qint64                                    dispatchStart = 0;
+        };
+
+        Registry& registry() {
+            static Registry instance;
+            return instance;
+        }
+
+        QString toKey(std::string_view name) {
+            return QString::fromLatin1(name.data(), static_cast<qsizetype>(name.size()));
+        }
+
+        QJsonObject histogramToJson(const LatencyHistogram& histogram) {
+            return QJsonObject{
+                {"count", static_cast<qint64>(histogram.count())},
+                {"min", histogram.min()},
+                {"mean", std::round(histogram.mean())},
+                {"p50", histogram.percentile(0.50)},
+                {"p90", histogram.percentile(0.90)},
+                {"p99", histogram.percentile(0.99)},
+                {"p999", histogram.percentile(0.999)},
+                {"max", histogram.max()},
+            };
+        }
+
+    } // namespace
+
+    void LatencyHistogram::record(qint64 valueNs) {
+        valueNs = std::clamp<qint64>(valueNs, 0, MAX_VALUE);
+
+        ++m_buckets[bucketIndex(valueNs)];
+        if (m_count == 0 || valueNs < m_min) {
+            m_min = valueNs;
+        }
+        m_max = std::max(m_max, valueNs);
+        m_sum += static_cast<double>(valueNs);
+        ++m_count;
+    }
+
+    void LatencyHistogram::reset() {
+        *this = LatencyHistogram{};
+    }
+
+    double LatencyHistogram::mean() const {
+        return m_count ? m_sum / static_cast<double>(m_count) : 0.0;
+    }
+
+    qint64 LatencyHistogram::percentile(double q) const {
+        if (m_count == 0) {
+            return 0;
+        }
+
+        // Rank of the sample at quantile q, 1-based
+        const auto target = std::clamp<quint64>(static_cast<quint64>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(m_count))), 1, m_count);
+
+        quint64 seen = 0;
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += m_buckets[i];
+            if (seen >= target) {
+                return std::min(bucketUpperBound(i), m_max);
+            }
+        }
+
+        return m_max;
+    }
+
+    qint64 now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void record(Stage stage, qint64 durationNs) {
+        registry().stages[static_cast<std::size_t>(stage)].record(durationNs);
+    }
+
+    void recordSince(Stage stage, qint64 startNs) {
+        if (startNs > 0) {
+            record(stage, now() - startNs);
+        }
+    }
+
+    void increment(Counter counter, quint64 amount) {
+        registry().counters[static_cast<std::size_t>(counter)] += amount;
+    }
+
+    void setDispatchStart(qint64 startNs) {
+        registry().dispatchStart = startNs;
+    }
+
+    qint64 dispatchStart() {
+        return registry().dispatchStart;
+    }
+
+    QJsonObject snapshot() {
+        const Registry& reg = registry();
+
+        QJsonObject stages;
+        for (std::size_t i = 0; i < STAGE_COUNT; ++i) {
+            stages[toKey(STAGE_NAMES[i])] = histogramToJson(reg.stages[i]);
+        }
+
+        QJsonObject counters;
+        for (std::size_t i = 0; i < COUNTER_COUNT; ++i) {
+            counters[toKey(COUNTER_NAMES[i])] = static_cast<qint64>(reg.counters[i]);
+        }
+
+        return QJsonObject{
+            {"uptime_ms", (now() - reg.startedAt) / 1000000},
+            {"unit", "ns"},
+            {"stages", stages},
+            {"counters", counters},
+        };
+    }
+
+    void reset() {
+        Registry& reg = registry();
+        for (auto& histogram : reg.stages) {
+            histogram.reset();
+        }
+        reg.counters.fill(0);
+        reg.startedAt = now();
+    }
+
+    const LatencyHistogram& histogram(Stage stage) {
+        return registry().stages[static_cast<std::size_t>(stage)];
+    }
+
+    quint64 counter(Counter which) {
+        return registry().counters[static_cast<std::size_t>(which)];
+    }
+
+} // namespace bb::metrics
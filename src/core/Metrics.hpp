@@ -0,0 +1,152 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QtGlobal>
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace bb::metrics {
+
+    // Latency stages probed on the daemon's hot paths. Names are the keys of the
+    // "stages" object in the stats reply.
+    enum class Stage : unsigned char {
+        IpcDispatch,       // line received to handler returned (IpcServer)
+        EventRoute,        // one event fanned out to providers/subscribers (EventRouter)
+        SessionUpdate,     // SessionStore mutation plus event construction
+        RequestorResolve,  // /proc lookup of the requesting process
+        PolkitToProvider,  // initiateAuthentication to session.created written out
+        RespondToPolkit,   // session.respond read to Session::setResponse
+        KeyringRoundTrip,  // keyring_request received to keyring_response sent
+        PinentryRoundTrip, // pinentry_request received to pinentry_response sent
+        SessionLifetime,   // session created to session closed
+    };
+
+    inline constexpr std::array<std::string_view, 9> STAGE_NAMES = {
+        "ipc.dispatch",      "event.route",        "session.update",      "requestor.resolve", "polkit.to_provider",
+        "respond.to_polkit", "keyring.round_trip", "pinentry.round_trip", "session.lifetime",
+    };
+
+    inline constexpr std::size_t STAGE_COUNT = STAGE_NAMES.size();
+    static_assert(static_cast<std::size_t>(Stage::SessionLifetime) + 1 == STAGE_COUNT, "STAGE_NAMES must list every Stage");
+
+    enum class Counter : unsigned char {
+        MessagesReceived,
+        InvalidMessages,
+        UnknownTypes,
+        SessionsCreated,
+        SessionsClosed,
+        EventsRouted,
+        BytesSent,
+    };
+
+    inline constexpr std::array<std::string_view, 7> COUNTER_NAMES = {
+        "messages_received", "invalid_messages", "unknown_types", "sessions_created", "sessions_closed", "events_routed", "bytes_sent",
+    };
+
+    inline constexpr std::size_t COUNTER_COUNT = COUNTER_NAMES.size();
+    static_assert(static_cast<std::size_t>(Counter::BytesSent) + 1 == COUNTER_COUNT, "COUNTER_NAMES must list every Counter");
+
+    // Log-linear (HDR-style) histogram of nanosecond values: 32 linear sub-buckets
+    // per power of two, so any recorded value is reported within ~3%. Recording is
+    // an index computation and one increment; values past ~36 minutes saturate.
+    class LatencyHistogram {
+      public:
+        static constexpr int         SUB_BUCKET_BITS = 5;
+        static constexpr std::size_t SUB_BUCKETS     = std::size_t{1} << SUB_BUCKET_BITS;
+        static constexpr int         MAX_VALUE_BITS  = 41;
+        static constexpr qint64      MAX_VALUE       = (qint64{1} << MAX_VALUE_BITS) - 1;
+        static constexpr std::size_t BUCKET_COUNT    = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+        static constexpr std::size_t bucketIndex(qint64 value) {
+            const auto v = static_cast<std::uint64_t>(value < 0 ? 0 : (value > MAX_VALUE ? MAX_VALUE : value));
+            if (v < SUB_BUCKETS) {
+                return static_cast<std::size_t>(v);
+            }
+
+            const int shift = std::bit_width(v) - 1 - SUB_BUCKET_BITS;
+            return static_cast<std::size_t>(shift + 1) * SUB_BUCKETS + static_cast<std::size_t>((v >> shift) & (SUB_BUCKETS - 1));
+        }
+
+        // Largest value that maps to `index`
+        static constexpr qint64 bucketUpperBound(std::size_t index) {
+            if (index < SUB_BUCKETS) {
+                return static_cast<qint64>(index);
+            }
+
+            const auto shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+            const auto lower = static_cast<qint64>(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+            return lower + (qint64{1} << shift) - 1;
+        }
+
+        void                 record(qint64 valueNs);
+        void                 reset();
+
+        [[nodiscard]] quint64 count() const {
+            return m_count;
+        }
+        [[nodiscard]] qint64 min() const {
+            return m_count ? m_min : 0;
+        }
+        [[nodiscard]] qint64 max() const {
+            return m_max;
+        }
+        [[nodiscard]] double mean() const;
+
+        // Value at quantile q in [0, 1], as the upper bound of its bucket (capped at max())
+        [[nodiscard]] qint64 percentile(double q) const;
+
+      private:
+        std::array<quint64, BUCKET_COUNT> m_buckets{};
+        quint64                           m_count = 0;
+        qint64                            m_min   = 0;
+        qint64                            m_max   = 0;
+        double                            m_sum   = 0;
+    };
+
+    static_assert(LatencyHistogram::bucketIndex(LatencyHistogram::MAX_VALUE) == LatencyHistogram::BUCKET_COUNT - 1);
+    static_assert(LatencyHistogram::bucketUpperBound(LatencyHistogram::BUCKET_COUNT - 1) == LatencyHistogram::MAX_VALUE);
+
+    // Monotonic nanoseconds
+    qint64 now();
+
+    // Process-wide registry. The daemon runs everything on the Qt main thread,
+    // so probes are plain (unsynchronized) updates.
+    void        record(Stage stage, qint64 durationNs);
+    void        recordSince(Stage stage, qint64 startNs);
+    void        increment(Counter counter, quint64 amount = 1);
+
+    // Timestamp of the IPC read currently being dispatched (0 outside dispatch),
+    // so downstream probes can measure from the moment the request arrived.
+    void        setDispatchStart(qint64 startNs);
+    qint64      dispatchStart();
+
+    // {"uptime_ms", "unit":"ns", "stages":{name:{count,min,mean,p50,p90,p99,p999,max}}, "counters":{name:n}}
+    QJsonObject snapshot();
+
+    // Clears every histogram and counter and restarts the uptime clock
+    void        reset();
+
+    const LatencyHistogram& histogram(Stage stage);
+    quint64                 counter(Counter which);
+
+    // Records the lifetime of the enclosing scope
+    class ScopedTimer {
+      public:
+        explicit ScopedTimer(Stage stage) : m_stage(stage), m_start(now()) {}
+        ~ScopedTimer() {
+            recordSince(m_stage, m_start);
+        }
+
+        ScopedTimer(const ScopedTimer&)            = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+      private:
+        Stage  m_stage;
+        qint64 m_start;
+    };
+
+} // namespace bb::metrics
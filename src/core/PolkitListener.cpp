@@ -3,8 +3,8 @@
 #include "Agent.hpp"
 #include <polkitqt1-agent-session.h>
 
-#include <print>
-
+#include "../common/Trace.hpp"
+#include "Metrics.hpp"
 #include "RequestContext.hpp"
 
 using namespace PolkitQt1::Agent;
@@ -21,11 +21,11 @@ CPolkitListener::~CPolkitListener() {
 
 void CPolkitListener::initiateAuthentication(const QString& actionId, const QString& message, const QString& iconName, const PolkitQt1::Details& details, const QString& cookie,
                                              const PolkitQt1::Identity::List& identities, AsyncResult* result) {
-
-    std::print("> New authentication session (cookie: {})\n", cookie.toStdString());
+    const qint64 startedAt = bb::metrics::now();
+    BB_TRACE_SCOPE("polkit.initiate", cookie);
 
     if (m_cookieToState.contains(cookie)) {
-        std::print("> REJECTING: Session with cookie {} already exists\n", cookie.toStdString());
+        qWarning() << "Rejecting polkit request: session with this cookie already exists";
         result->setError("Duplicate session");
         result->setCompleted();
         return;
@@ -34,7 +34,7 @@ void CPolkitListener::initiateAuthentication(const QString& actionId, const QStr
     if (identities.isEmpty()) {
         result->setError("No identities, this is a problem with your system configuration.");
         result->setCompleted();
-        std::print("> REJECTING: No idents\n");
+        qWarning() << "Rejecting polkit request: no identities";
         return;
     }
 
@@ -59,6 +59,7 @@ void CPolkitListener::initiateAuthentication(const QString& actionId, const QStr
     m_sessionToState.insert(state->session, state);
 
     g_pAgent->onPolkitRequest(cookie, message, iconName, actionId, state->selectedUser.toString(), details);
+    bb::metrics::recordSince(bb::metrics::Stage::PolkitToProvider, startedAt);
 
     reattempt(state);
 }
@@ -77,12 +78,11 @@ void CPolkitListener::reattempt(SessionState* state) {
 }
 
 bool CPolkitListener::initiateAuthenticationFinish() {
-    std::print("> initiateAuthenticationFinish()\n");
     return true;
 }
 
 void CPolkitListener::cancelAuthentication() {
-    std::print("> cancelAuthentication() - cancelling ALL sessions\n");
+    BB_TRACE_EVENT("polkit.cancel_all", u"");
 
     for (auto* state : m_cookieToState.values()) {
         state->cancelled = true;
@@ -100,7 +100,7 @@ void CPolkitListener::onSessionRequest(const QString& request, bool echo) {
     if (!state)
         return;
 
-    std::print("> PKS request (cookie: {}): {} echo: {}\n", state->cookie.toStdString(), request.toStdString(), echo);
+    BB_TRACE_EVENT_ARG("polkit.request", state->cookie, echo);
     state->prompt = request;
     state->echoOn = echo;
 
@@ -114,7 +114,7 @@ void CPolkitListener::onSessionCompleted(bool gainedAuthorization) {
     if (!state)
         return;
 
-    std::print("> PKS completed (cookie: {}): {}\n", state->cookie.toStdString(), gainedAuthorization ? "Auth successful" : "Auth unsuccessful");
+    BB_TRACE_EVENT_ARG("polkit.completed", state->cookie, gainedAuthorization);
 
     state->gainedAuth = gainedAuthorization;
 
@@ -132,7 +132,7 @@ void CPolkitListener::onSessionError(const QString& text) {
     if (!state)
         return;
 
-    std::print("> PKS showError (cookie: {}): {}\n", state->cookie.toStdString(), text.toStdString());
+    BB_TRACE_EVENT("polkit.show_error", state->cookie);
 
     state->errorText = text;
     g_pAgent->onSessionRetry(state->cookie, text);
@@ -144,7 +144,7 @@ void CPolkitListener::onSessionInfo(const QString& text) {
     if (!state)
         return;
 
-    std::print("> PKS showInfo (cookie: {}): {}\n", state->cookie.toStdString(), text.toStdString());
+    BB_TRACE_EVENT("polkit.show_info", state->cookie);
     g_pAgent->onSessionInfo(state->cookie, text);
 }
 
@@ -153,15 +153,14 @@ void CPolkitListener::finishAuth(SessionState* state) {
         return;
 
     if (!state->inProgress) {
-        std::print("> finishAuth: ODD. !state->inProgress for cookie {}\n", state->cookie.toStdString());
+        qWarning() << "finishAuth called for a polkit session that is no longer in progress";
         return;
     }
 
     if (!state->gainedAuth && !state->cancelled) {
         state->retryCount++;
         if (state->retryCount < SessionState::MAX_AUTH_RETRIES) {
-            std::print("> finishAuth: Did not gain auth (attempt {}/{}). Reattempting for cookie {}.\n", state->retryCount, SessionState::MAX_AUTH_RETRIES,
-                       state->cookie.toStdString());
+            BB_TRACE_EVENT_ARG("polkit.reattempt", state->cookie, state->retryCount);
 
             // Clean up old session but keep state
             if (state->session) {
@@ -176,13 +175,13 @@ void CPolkitListener::finishAuth(SessionState* state) {
             reattempt(state);
             return;
         } else {
-            std::print("> finishAuth: Max retries ({}) reached for cookie {}. Failing.\n", SessionState::MAX_AUTH_RETRIES, state->cookie.toStdString());
+            BB_TRACE_EVENT_ARG("polkit.max_retries", state->cookie, state->retryCount);
             state->errorText = "Too many failed attempts";
             g_pAgent->onSessionRetry(state->cookie, state->errorText);
         }
     }
 
-    std::print("> finishAuth: Gained auth, cancelled, or max retries reached. Cleaning up cookie {}.\n", state->cookie.toStdString());
+    BB_TRACE_EVENT_ARG("polkit.finish", state->cookie, state->gainedAuth);
 
     state->inProgress = false;
 
@@ -201,7 +200,7 @@ void CPolkitListener::finishAuth(SessionState* state) {
     delete state;
 }
 
-void CPolkitListener::submitPassword(const QString& cookie, const QString& pass) {
+void CPolkitListener::submitPassword(const QString& cookie, const bb::SecretString& pass) {
     if (!m_cookieToState.contains(cookie))
         return;
 
@@ -209,7 +208,12 @@ void CPolkitListener::submitPassword(const QString& cookie, const QString& pass)
     if (!state->session)
         return;
 
-    state->session->setResponse(pass);
+    BB_TRACE_EVENT("polkit.set_response", cookie);
+    // polkit-qt only takes a QString; this one copy is wiped as soon as it is handed over
+    QString response = pass.toString();
+    state->session->setResponse(response);
+    bb::secureZero(response);
+    bb::metrics::recordSince(bb::metrics::Stage::RespondToPolkit, bb::metrics::dispatchStart());
 }
 
 void CPolkitListener::cancelPending(const QString& cookie) {
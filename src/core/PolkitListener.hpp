@@ -9,6 +9,8 @@
 #include <polkitqt1-details.h>
 #include <polkitqt1-agent-session.h>
 
+#include "../common/SecureMemory.hpp"
+
 namespace bb {
     class CAgent;
 }
@@ -21,8 +23,9 @@ class CPolkitListener : public PolkitQt1::Agent::Listener {
     CPolkitListener(QObject* parent = nullptr);
     ~CPolkitListener() override;
 
-    void submitPassword(const QString& cookie, const QString& pass);
-    void cancelPending(const QString& cookie);
+    // Virtual so the end-to-end benchmark can stand in for polkitd
+    virtual void submitPassword(const QString& cookie, const bb::SecretString& pass);
+    virtual void cancelPending(const QString& cookie);
 
   Q_SIGNALS:
     // Signal removed, CAgent handles logic now
@@ -1,4 +1,5 @@
 #include "RequestContext.hpp"
+#include "../common/Trace.hpp"
 #include <QFile>
 #include <QFileInfo>
 #include <QTextStream>
@@ -7,7 +8,6 @@
 #include <QStandardPaths>
 #include <QSettings>
 #include <QProcess>
-#include <QDebug>
 #include <iostream>
 
 QJsonObject ProcInfo::toJson() const {
@@ -72,7 +72,7 @@ std::optional<ProcInfo> RequestContextHelper::readProc(qint64 pid) {
         QByteArray data = fStat.readAll();
         fStat.close();
         if (data.isEmpty()) {
-            qDebug() << "readProc: /proc/" << pid << "/status is EMPTY";
+            BB_TRACE_EVENT_ARG("requestor.proc_status_empty", u"", pid);
         }
         QStringList lines = QString::fromUtf8(data).split('\n');
         for (const auto& line : lines) {
@@ -85,7 +85,7 @@ std::optional<ProcInfo> RequestContextHelper::readProc(qint64 pid) {
             }
         }
     } else {
-        qDebug() << "readProc: Failed to open /proc/" << pid << "/status:" << fStat.errorString();
+        BB_TRACE_EVENT_ARG("requestor.proc_unreadable", u"", pid);
         return std::nullopt;
     }
 
@@ -189,7 +189,7 @@ ActorInfo RequestContextHelper::resolveRequestorFromSubject(const ProcInfo& subj
     ActorInfo actor;
     actor.proc = subject;
 
-    qDebug() << "Resolving requestor from PID" << subject.pid << "(uid=" << subject.uid << ", exe=" << subject.exe << ")";
+    BB_TRACE_SCOPE("requestor.resolve", QString());
 
     qint64 currPid = subject.pid;
     int    hops    = 0;
@@ -197,17 +197,16 @@ ActorInfo RequestContextHelper::resolveRequestorFromSubject(const ProcInfo& subj
     while (currPid > 1 && hops < 16) {
         auto info = readProc(currPid);
         if (!info) {
-            qDebug() << "Requestor resolution: failed to read /proc for pid" << currPid;
             break;
         }
 
-        qDebug() << "Requestor resolution: pid" << info->pid << "(name=" << info->name << ", ppid=" << info->ppid << ", uid=" << info->uid << ", exe=" << info->exe << ")";
+        BB_TRACE_EVENT_ARG("requestor.hop", u"", info->pid);
 
         bool isBridge = (info->name == "pkexec" || info->name == "sudo" || info->name == "doas");
 
         // Skip processes not owned by the user (agent) unless it's a known bridge like pkexec
         if (info->uid != agentUid && agentUid != 0 && !isBridge) {
-            qDebug() << "Requestor resolution: stopping at pid" << info->pid << "(uid mismatch)";
+            BB_TRACE_EVENT_ARG("requestor.stop_uid", u"", info->pid);
             break;
         }
 
@@ -229,12 +228,12 @@ ActorInfo RequestContextHelper::resolveRequestorFromSubject(const ProcInfo& subj
             actor.proc       = *info;
             actor.desktop    = d;
             actor.confidence = "desktop";
-            qDebug() << "Requestor resolution: matched desktop entry" << d.desktopId << "(icon=" << d.iconName << ", name=" << d.name << ")";
+            BB_TRACE_EVENT_ARG("requestor.desktop_match", u"", info->pid);
             break;
         }
 
         if (info->ppid <= 1 || info->ppid == currPid) {
-            qDebug() << "Requestor resolution: stopping at pid" << info->pid << "(ppid=" << info->ppid << ")";
+            BB_TRACE_EVENT_ARG("requestor.stop_root", u"", info->pid);
             break;
         }
         currPid = info->ppid;
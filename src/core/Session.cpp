@@ -12,14 +12,17 @@ namespace bb {
             m_error.clear();
         }
         m_info.clear();
+        ++m_revision;
     }
 
     void Session::setError(const QString& error) {
         m_error = error;
+        ++m_revision;
     }
 
     void Session::setInfo(const QString& info) {
         m_info = info;
+        ++m_revision;
     }
 
     void Session::setPinentryRetry(int curRetry, int maxRetries) {
@@ -29,6 +32,7 @@ namespace bb {
 
         m_context.curRetry   = curRetry < 0 ? 0 : curRetry;
         m_context.maxRetries = maxRetries > 0 ? maxRetries : 3;
+        ++m_revision;
     }
 
     void Session::close(Result result) {
@@ -37,6 +41,7 @@ namespace bb {
         if (result == Result::Success) {
             m_error.clear();
         }
+        ++m_revision;
     }
 
     QString Session::sourceToString(Source s) {
@@ -110,11 +115,13 @@ namespace bb {
     }
 
     QJsonObject Session::toCreatedEvent() const {
-        return QJsonObject{{"type", "session.created"}, {"id", m_id}, {"source", sourceToString(m_source)}, {"context", contextToJson()}};
+        return QJsonObject{
+            {"type", "session.created"}, {"id", m_id}, {"source", sourceToString(m_source)}, {"context", contextToJson()}, {"revision", static_cast<qint64>(m_revision)}};
     }
 
     QJsonObject Session::toUpdatedEvent() const {
-        QJsonObject event{{"type", "session.updated"}, {"id", m_id}, {"state", "prompting"}, {"prompt", m_prompt}, {"echo", m_echo}};
+        QJsonObject event{
+            {"type", "session.updated"}, {"id", m_id}, {"state", "prompting"}, {"prompt", m_prompt}, {"echo", m_echo}, {"revision", static_cast<qint64>(m_revision)}};
 
         if (m_source == Source::Pinentry) {
             event["curRetry"]   = m_context.curRetry;
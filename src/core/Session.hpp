@@ -67,6 +67,10 @@ namespace bb {
         [[nodiscard]] State state() const {
             return m_state;
         }
+        // Bumped by every state transition, so a client can drop replays of a state it already shows
+        [[nodiscard]] quint64 revision() const {
+            return m_revision;
+        }
 
         // State transitions
         void setPrompt(const QString& prompt, bool echo = false, bool clearError = true);
@@ -89,6 +93,7 @@ namespace bb {
         QString                      m_error;
         QString                      m_info;
         bool                         m_echo{false};
+        quint64                      m_revision{0};
         std::optional<Result>        m_result;
         [[nodiscard]] static QString sourceToString(Source s);
         [[nodiscard]] static QString resultToString(Result r);
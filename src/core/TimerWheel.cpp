@@ -0,0 +1,227 @@
+#include "TimerWheel.hpp"
+
+#include <QDebug>
+#include <QSocketNotifier>
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace bb {
+
+    namespace {
+
+        inline constexpr quint64 SLOT_MASK = TimerWheel::SLOT_COUNT - 1;
+        inline constexpr quint64 MAX_DELTA = (quint64{1} << (TimerWheel::SLOT_BITS * TimerWheel::LEVEL_COUNT)) - 1;
+
+        qint64 monotonicNs() {
+            timespec ts{};
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<qint64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+
+    } // namespace
+
+    void TimerWheel::Entry::cancel() {
+        if (m_wheel) {
+            m_wheel->unlink(*this);
+            --m_wheel->m_armed;
+            m_wheel = nullptr;
+        }
+    }
+
+    TimerWheel::TimerWheel(int tickMs) : m_tickNs(static_cast<qint64>(std::max(tickMs, 1)) * 1000000), m_originNs(monotonicNs()) {
+        m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_fd < 0) {
+            qWarning() << "timerfd_create failed:" << std::strerror(errno);
+            return;
+        }
+
+        m_notifier = std::make_unique<QSocketNotifier>(m_fd, QSocketNotifier::Read);
+        QObject::connect(m_notifier.get(), &QSocketNotifier::activated, [this] { advance(); });
+    }
+
+    TimerWheel::~TimerWheel() {
+        // Entries outliving the wheel must not unlink themselves from it later
+        for (const Level& level : m_levels) {
+            for (Entry* head : level) {
+                for (Entry* entry = head; entry;) {
+                    Entry* next    = entry->m_next;
+                    entry->m_wheel = nullptr;
+                    entry->m_prev  = nullptr;
+                    entry->m_next  = nullptr;
+                    entry          = next;
+                }
+            }
+        }
+
+        m_notifier.reset();
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    void TimerWheel::schedule(Entry& entry, int delayMs) {
+        entry.cancel();
+
+        const qint64  elapsedNs = monotonicNs() - m_originNs;
+        const quint64 now       = static_cast<quint64>(elapsedNs / m_tickNs);
+        // Nothing is linked, so the wheel can be re-based on the present (not mid-slot, though)
+        if (m_armed == 0 && !m_expiring) {
+            m_tick = now;
+        }
+
+        // First tick boundary at or after the requested time, and never the current tick
+        const qint64  dueNs  = elapsedNs + static_cast<qint64>(std::max(delayMs, 0)) * 1000000;
+        entry.m_deadlineTick = std::max(now + 1, static_cast<quint64>((dueNs + m_tickNs - 1) / m_tickNs));
+        entry.m_wheel         = this;
+        ++m_armed;
+        link(entry);
+        arm();
+    }
+
+    quint64 TimerWheel::currentTick() const {
+        return static_cast<quint64>((monotonicNs() - m_originNs) / m_tickNs);
+    }
+
+    // The earliest tick at which a level-0 slot fires or a coarser slot cascades
+    quint64 TimerWheel::nextEventTick() const {
+        quint64 next = NEVER;
+        for (std::size_t level = 0; level < LEVEL_COUNT; ++level) {
+            if (m_occupied[level] == 0) {
+                continue;
+            }
+
+            const unsigned shift = SLOT_BITS * static_cast<unsigned>(level);
+            const quint64  block = (m_tick >> shift) + 1;
+            const int      skip  = std::countr_zero(std::rotr(m_occupied[level], static_cast<int>(block & SLOT_MASK)));
+            next                 = std::min(next, (block + static_cast<quint64>(skip)) << shift);
+        }
+        return next;
+    }
+
+    // Level is chosen by distance from m_tick, slot by deadline, so a slot on level L
+    // only ever holds entries due within the level-L block it cascades at
+    void TimerWheel::link(Entry& entry) {
+        const quint64 delta = entry.m_deadlineTick - m_tick;
+        // Beyond the top level: parked in its farthest slot and re-placed on cascade
+        const quint64 placed = delta > MAX_DELTA ? m_tick + MAX_DELTA : entry.m_deadlineTick;
+
+        std::size_t   level = 0;
+        while (level + 1 < LEVEL_COUNT && std::min(delta, MAX_DELTA) >= (quint64{1} << (SLOT_BITS * (level + 1)))) {
+            ++level;
+        }
+        const std::size_t slot = (placed >> (SLOT_BITS * level)) & SLOT_MASK;
+
+        Entry*&           head = m_levels[level][slot];
+        entry.m_level          = static_cast<quint8>(level);
+        entry.m_slot           = static_cast<quint8>(slot);
+        entry.m_prev           = nullptr;
+        entry.m_next           = head;
+        if (head) {
+            head->m_prev = &entry;
+        }
+        head = &entry;
+        m_occupied[level] |= quint64{1} << slot;
+    }
+
+    void TimerWheel::unlink(Entry& entry) {
+        Entry*& head = m_levels[entry.m_level][entry.m_slot];
+        if (entry.m_prev) {
+            entry.m_prev->m_next = entry.m_next;
+        } else {
+            head = entry.m_next;
+        }
+        if (entry.m_next) {
+            entry.m_next->m_prev = entry.m_prev;
+        }
+        if (!head) {
+            m_occupied[entry.m_level] &= ~(quint64{1} << entry.m_slot);
+        }
+
+        entry.m_prev = nullptr;
+        entry.m_next = nullptr;
+    }
+
+    void TimerWheel::cascade(std::size_t level, std::size_t slot) {
+        Entry* entry              = m_levels[level][slot];
+        m_levels[level][slot]     = nullptr;
+        m_occupied[level] &= ~(quint64{1} << slot);
+
+        while (entry) {
+            Entry* next = entry->m_next;
+            link(*entry);
+            entry = next;
+        }
+    }
+
+    void TimerWheel::expire(quint64 tick) {
+        m_tick = tick;
+
+        // Coarser slots whose block starts now move down first; some land in this very slot
+        for (std::size_t level = 1; level < LEVEL_COUNT; ++level) {
+            const unsigned shift = SLOT_BITS * static_cast<unsigned>(level);
+            if ((tick & ((quint64{1} << shift) - 1)) != 0) {
+                break;
+            }
+            cascade(level, (tick >> shift) & SLOT_MASK);
+        }
+
+        // Everything left in the level-0 slot is due; callbacks may cancel or arm
+        // other entries, but nothing they arm can land back in this slot
+        const std::size_t slot = tick & SLOT_MASK;
+        while (Entry* entry = m_levels[0][slot]) {
+            entry->cancel();
+            // Copied: the callback may destroy the entry that holds it
+            const std::function<void()> callback = entry->m_callback;
+            if (callback) {
+                callback();
+            }
+        }
+    }
+
+    void TimerWheel::advance() {
+        quint64 expirations = 0;
+        while (read(m_fd, &expirations, sizeof(expirations)) > 0) {
+        }
+        m_armedTick = NEVER;
+
+        // Ticks without events are skipped rather than walked, so a long stall costs nothing extra
+        const quint64 now = currentTick();
+        m_expiring        = true;
+        for (quint64 next = nextEventTick(); next <= now; next = nextEventTick()) {
+            expire(next);
+        }
+        m_expiring = false;
+        m_tick     = std::max(m_tick, now);
+
+        arm();
+    }
+
+    // Programs the timerfd for the next event unless it already wakes us in time
+    void TimerWheel::arm() {
+        if (m_fd < 0) {
+            return;
+        }
+
+        const quint64 next = nextEventTick();
+        if (next >= m_armedTick) {
+            return;
+        }
+
+        const qint64 deadlineNs = m_originNs + static_cast<qint64>(next) * m_tickNs;
+        itimerspec   spec{};
+        spec.it_value.tv_sec  = deadlineNs / 1000000000;
+        spec.it_value.tv_nsec = deadlineNs % 1000000000;
+        if (timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &spec, nullptr) == 0) {
+            m_armedTick = next;
+        } else {
+            qWarning() << "timerfd_settime failed:" << std::strerror(errno);
+        }
+    }
+
+} // namespace bb
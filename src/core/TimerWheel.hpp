@@ -0,0 +1,101 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+class QSocketNotifier;
+
+namespace bb {
+
+    // Hierarchical timer wheel for every daemon timeout: LEVEL_COUNT levels of
+    // SLOT_COUNT slots, each level SLOT_COUNT times coarser than the one below.
+    // Arming and cancelling are O(1) and allocate nothing. A single timerfd is
+    // programmed for the next slot that needs attention, so the daemon wakes only
+    // when a timer is due (or a coarse slot must cascade), never on a fixed tick.
+    // Deadlines are rounded up to the next tick.
+    class TimerWheel {
+      public:
+        // Intrusive entry, embedded in whatever owns the timeout. It must not move
+        // while armed, so keep owners in node-stable containers (std::unordered_map).
+        // Destroying an armed entry cancels it.
+        class Entry {
+          public:
+            Entry() = default;
+            ~Entry() {
+                cancel();
+            }
+
+            Entry(const Entry&)            = delete;
+            Entry& operator=(const Entry&) = delete;
+
+            // Called on expiry; set once, not per schedule(). The callback may destroy the entry.
+            void setCallback(std::function<void()> callback) {
+                m_callback = std::move(callback);
+            }
+
+            bool isArmed() const {
+                return m_wheel != nullptr;
+            }
+
+            void cancel();
+
+          private:
+            friend class TimerWheel;
+
+            TimerWheel*           m_wheel        = nullptr;
+            Entry*                m_prev         = nullptr;
+            Entry*                m_next         = nullptr;
+            quint64               m_deadlineTick = 0;
+            quint8                m_level        = 0;
+            quint8                m_slot         = 0;
+            std::function<void()> m_callback;
+        };
+
+        static constexpr unsigned    SLOT_BITS   = 6;
+        static constexpr std::size_t SLOT_COUNT  = std::size_t{1} << SLOT_BITS;
+        static constexpr std::size_t LEVEL_COUNT = 4; // 2^24 ticks; later deadlines are parked in the top level
+
+        explicit TimerWheel(int tickMs);
+        ~TimerWheel();
+
+        TimerWheel(const TimerWheel&)            = delete;
+        TimerWheel& operator=(const TimerWheel&) = delete;
+
+        // (Re)arms `entry` to fire `delayMs` from now
+        void        schedule(Entry& entry, int delayMs);
+
+        std::size_t armedCount() const {
+            return m_armed;
+        }
+
+      private:
+        using Level = std::array<Entry*, SLOT_COUNT>;
+
+        static constexpr quint64         NEVER = ~quint64{0};
+
+        quint64                          currentTick() const;
+        quint64                          nextEventTick() const;
+        void                             link(Entry& entry);
+        void                             unlink(Entry& entry);
+        void                             cascade(std::size_t level, std::size_t slot);
+        void                             expire(quint64 tick);
+        void                             advance();
+        void                             arm();
+
+        const qint64                     m_tickNs;
+        qint64                           m_originNs = 0;
+        int                              m_fd       = -1;
+        std::unique_ptr<QSocketNotifier> m_notifier;
+        quint64                          m_tick      = 0;     // every event up to this tick has been processed
+        quint64                          m_armedTick = NEVER; // tick the timerfd is programmed for
+        std::size_t                      m_armed     = 0;
+        bool                             m_expiring  = false;
+        std::array<Level, LEVEL_COUNT>   m_levels{};
+        std::array<quint64, LEVEL_COUNT> m_occupied{}; // bit per non-empty slot
+    };
+
+} // namespace bb
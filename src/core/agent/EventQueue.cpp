@@ -1,34 +1,126 @@
 #include "EventQueue.hpp"
 
+#include <algorithm>
+
 namespace bb::agent {
 
     EventQueue::EventQueue(int maxSize) : m_maxSize(maxSize) {}
 
     bool EventQueue::isEmpty() const {
-        return m_eventQueue.isEmpty();
+        return m_liveCount == 0;
     }
 
     bool EventQueue::hasEvents() const {
-        return !m_eventQueue.isEmpty();
+        return m_liveCount > 0;
+    }
+
+    int EventQueue::size() const {
+        return m_liveCount;
+    }
+
+    int EventQueue::waiterCount() const {
+        return static_cast<int>(m_nextWaiters.size());
     }
 
     QJsonObject EventQueue::takeNext() {
-        return m_eventQueue.isEmpty() ? QJsonObject{} : m_eventQueue.takeFirst();
+        if (m_entries.isEmpty()) {
+            return QJsonObject{};
+        }
+
+        // trimDropped() keeps the head a live event
+        Entry        entry = m_entries.takeFirst();
+        const qint64 seq   = m_headSeq++;
+        --m_liveCount;
+
+        if (!entry.sessionId.isEmpty()) {
+            auto pending = m_sessions.find(entry.sessionId);
+            if (pending != m_sessions.end()) {
+                if (pending->updateSeq == seq) {
+                    pending->updateSeq = -1;
+                }
+                if (--pending->queued == 0) {
+                    m_sessions.erase(pending);
+                }
+            }
+        }
+
+        trimDropped();
+        return std::move(entry.event);
+    }
+
+    QJsonObject EventQueue::takeBatch(int max) {
+        QJsonArray events;
+        while (events.size() < max && !isEmpty()) {
+            events.append(takeNext());
+        }
+        return QJsonObject{{"type", "events"}, {"events", events}};
     }
 
     void EventQueue::enqueue(const QJsonObject& event) {
-        if (m_eventQueue.size() >= m_maxSize) {
-            m_eventQueue.dequeue();
+        const QString type      = event.value("type").toString();
+        const QString sessionId = type.startsWith("session.") ? event.value("id").toString() : QString();
+
+        if (!sessionId.isEmpty()) {
+            const auto pending = m_sessions.constFind(sessionId);
+            if (type == "session.updated" && pending != m_sessions.constEnd() && pending->updateSeq >= 0) {
+                m_entries[pending->updateSeq - m_headSeq].event = event;
+                return;
+            }
+            if (type == "session.closed" && pending != m_sessions.constEnd()) {
+                dropSession(sessionId);
+            }
         }
-        m_eventQueue.enqueue(event);
+
+        if (m_liveCount >= m_maxSize) {
+            takeNext();
+        }
+
+        const qint64 seq = m_headSeq + m_entries.size();
+        m_entries.append(Entry{event, sessionId, false});
+        ++m_liveCount;
+
+        if (!sessionId.isEmpty()) {
+            PendingSession& pending = m_sessions[sessionId];
+            ++pending.queued;
+            if (type == "session.updated") {
+                pending.updateSeq = seq;
+            }
+        }
+    }
+
+    // Rare (once per session), so a scan is cheaper than indexing every slot
+    void EventQueue::dropSession(const QString& sessionId) {
+        for (Entry& entry : m_entries) {
+            if (!entry.dropped && entry.sessionId == sessionId) {
+                entry.event   = QJsonObject{};
+                entry.dropped = true;
+                --m_liveCount;
+            }
+        }
+
+        m_sessions.remove(sessionId);
+        trimDropped();
     }
 
-    void EventQueue::subscribeNext(QLocalSocket* socket) {
-        m_nextWaiters.append(socket);
+    // Dropped slots sit ahead of the session.closed that dropped them, so they
+    // leave the list no later than it does
+    void EventQueue::trimDropped() {
+        while (!m_entries.isEmpty() && m_entries.first().dropped) {
+            m_entries.removeFirst();
+            ++m_headSeq;
+        }
+    }
+
+    void EventQueue::subscribeNext(QLocalSocket* socket, int max) {
+        m_nextWaiters.append(Waiter{socket, max});
     }
 
     void EventQueue::removeWaiter(QLocalSocket* socket) {
-        m_nextWaiters.removeAll(socket);
+        m_nextWaiters.removeIf([socket](const Waiter& waiter) { return waiter.socket == socket; });
+    }
+
+    bool EventQueue::isWaiting(QLocalSocket* socket) const {
+        return std::any_of(m_nextWaiters.cbegin(), m_nextWaiters.cend(), [socket](const Waiter& waiter) { return waiter.socket == socket; });
     }
 
 } // namespace bb::agent
@@ -1,37 +1,73 @@
 #pragma once
 
+#include <QHash>
+#include <QJsonArray>
 #include <QJsonObject>
 #include <QList>
-#include <QQueue>
+#include <QString>
 
 class QLocalSocket;
 
 namespace bb::agent {
 
+    // Events waiting for `next` pollers. Session events are compacted as they
+    // arrive: a session.updated replaces that session's queued update, and a
+    // session.closed drops everything queued for the session before it. A poller
+    // therefore reads each session's latest state once, and the queue stays
+    // proportional to the sessions with something pending.
     class EventQueue {
       public:
         explicit EventQueue(int maxSize = 256);
 
         bool        isEmpty() const;
         bool        hasEvents() const;
+        int         size() const;
+        int         waiterCount() const;
         QJsonObject takeNext();
 
+        // Up to `max` events, oldest first, as one {"type":"events"} reply
+        QJsonObject takeBatch(int max);
+
         void        enqueue(const QJsonObject& event);
-        void        subscribeNext(QLocalSocket* socket);
+        // A waiter with `max` > 0 is served a batch rather than a single event
+        void        subscribeNext(QLocalSocket* socket, int max = 0);
         void        removeWaiter(QLocalSocket* socket);
+        bool        isWaiting(QLocalSocket* socket) const;
 
         template <typename SendFn>
         void drainToWaiters(SendFn sendFn) {
-            while (!m_nextWaiters.isEmpty() && !m_eventQueue.isEmpty()) {
-                QLocalSocket* socket = m_nextWaiters.takeFirst();
-                sendFn(socket, m_eventQueue.takeFirst());
+            while (!m_nextWaiters.isEmpty() && !isEmpty()) {
+                const Waiter waiter = m_nextWaiters.takeFirst();
+                sendFn(waiter.socket, waiter.max > 0 ? takeBatch(waiter.max) : takeNext());
             }
         }
 
       private:
-        int                  m_maxSize;
-        QQueue<QJsonObject>  m_eventQueue;
-        QList<QLocalSocket*> m_nextWaiters;
+        struct Waiter {
+            QLocalSocket* socket = nullptr;
+            int           max    = 0;
+        };
+
+        struct Entry {
+            QJsonObject event;
+            QString     sessionId;
+            bool        dropped = false; // superseded by a session.closed
+        };
+
+        struct PendingSession {
+            int    queued    = 0;
+            qint64 updateSeq = -1;
+        };
+
+        void                           dropSession(const QString& sessionId);
+        void                           trimDropped();
+
+        int                            m_maxSize;
+        QList<Entry>                   m_entries;
+        qint64                         m_headSeq   = 0; // sequence number of m_entries.first()
+        int                            m_liveCount = 0;
+        QHash<QString, PendingSession> m_sessions;
+        QList<Waiter>                  m_nextWaiters;
     };
 
 } // namespace bb::agent
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "../Metrics.hpp"
 #include "EventQueue.hpp"
 #include "ProviderRegistry.hpp"
 
@@ -13,8 +14,13 @@ namespace bb::agent {
       public:
         EventRouter(ProviderRegistry& providerRegistry, EventQueue& eventQueue);
 
-        template <typename SendFn>
-        void route(const QJsonObject& event, const QList<QLocalSocket*>& subscribers, SendFn sendFn) {
+        // `sendFn` is called with `event` itself for each direct recipient; `replyFn`
+        // with the replies that answer waiting `next` polls from the queue
+        template <typename SendFn, typename ReplyFn>
+        void route(const QJsonObject& event, const QList<QLocalSocket*>& subscribers, SendFn sendFn, ReplyFn replyFn) {
+            const metrics::ScopedTimer timer(metrics::Stage::EventRoute);
+            metrics::increment(metrics::Counter::EventsRouted);
+
             if (isSessionEventForProviderRouting(event) && m_providerRegistry.hasActiveProvider()) {
                 QLocalSocket* activeProvider = m_providerRegistry.activeProvider();
                 if (activeProvider && activeProvider->isValid()) {
@@ -29,7 +35,12 @@ namespace bb::agent {
             }
 
             m_eventQueue.enqueue(event);
-            m_eventQueue.drainToWaiters(sendFn);
+            m_eventQueue.drainToWaiters(replyFn);
+        }
+
+        template <typename SendFn>
+        void route(const QJsonObject& event, const QList<QLocalSocket*>& subscribers, SendFn sendFn) {
+            route(event, subscribers, sendFn, sendFn);
         }
 
       private:
@@ -1,18 +1,56 @@
 #include "MessageRouter.hpp"
 
+#include <string_view>
+
 namespace bb::agent {
 
-    void MessageRouter::registerHandler(const QString& type, HandlerFn handler) {
-        m_handlers.insert(type, std::move(handler));
+    MessageRouter::DispatchStatus MessageRouter::dispatch(QLocalSocket* socket, const JsonMessage& msg, QString& error) const {
+        const QByteArrayView type     = msg.type();
+        const auto           resolved = messageTypeFromName(std::string_view(type.data(), static_cast<std::size_t>(type.size())));
+        if (!resolved) {
+            return DispatchStatus::UnknownType;
+        }
+
+        return dispatch(socket, *resolved, msg, error);
     }
 
-    bool MessageRouter::dispatch(QLocalSocket* socket, const QString& type, const QJsonObject& msg) const {
-        auto it = m_handlers.constFind(type);
-        if (it == m_handlers.constEnd()) {
-            return false;
+    MessageRouter::DispatchStatus MessageRouter::dispatch(QLocalSocket* socket, MessageType type, const JsonMessage& msg, QString& error) const {
+        const Route& route = m_routes[static_cast<std::size_t>(type)];
+        if (!route.dispatch) {
+            return DispatchStatus::UnknownType;
+        }
+        if (route.guard && !route.guard(socket, msg, error)) {
+            return DispatchStatus::Unauthorized;
         }
 
-        it.value()(socket, msg);
+        return route.dispatch(socket, msg, error) ? DispatchStatus::Handled : DispatchStatus::InvalidRequest;
+    }
+
+    bool MessageRouter::prepareAll(QLocalSocket* socket, const QList<JsonMessage>& msgs, std::vector<PreparedRequest>& out, QString& error) const {
+        out.clear();
+        out.reserve(static_cast<std::size_t>(msgs.size()));
+
+        for (qsizetype i = 0; i < msgs.size(); ++i) {
+            const QByteArrayView type     = msgs[i].type();
+            const auto           resolved = messageTypeFromName(std::string_view(type.data(), static_cast<std::size_t>(type.size())));
+            const Route*         route    = resolved ? &m_routes[static_cast<std::size_t>(*resolved)] : nullptr;
+
+            // Guards are left to run time, where earlier entries may have changed their
+            // answer. A payload that fails to decode for a peer the guard turns away
+            // reports the guard's error, so the fields stay as hidden as on their own.
+            QString entryError;
+            if (!route || !route->prepare) {
+                entryError = QStringLiteral("Unknown type");
+            } else if (route->prepare(msgs[i], out.emplace_back(), entryError)) {
+                continue;
+            } else if (QString guardError; route->guard && !route->guard(socket, msgs[i], guardError)) {
+                entryError = guardError;
+            }
+
+            error = QStringLiteral("requests[%1]: %2").arg(QString::number(i), entryError);
+            out.clear();
+            return false;
+        }
         return true;
     }
 
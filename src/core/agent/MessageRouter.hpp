@@ -1,10 +1,15 @@
 #pragma once
 
-#include <QHash>
-#include <QJsonObject>
+#include "MessageTypes.hpp"
+#include "RequestDecoder.hpp"
+
+#include <QList>
 #include <QString>
 
+#include <array>
 #include <functional>
+#include <utility>
+#include <vector>
 
 class QLocalSocket;
 
@@ -12,13 +17,76 @@ namespace bb::agent {
 
     class MessageRouter {
       public:
-        using HandlerFn = std::function<void(QLocalSocket*, const QJsonObject&)>;
+        enum class DispatchStatus {
+            Handled,
+            UnknownType,
+            InvalidRequest,
+            Unauthorized
+        };
+
+        // Runs before the payload is decoded, so a peer it turns away never learns
+        // which fields would have been accepted. Returns false with `error` set.
+        using Guard = std::function<bool(QLocalSocket*, const JsonMessage&, QString&)>;
+
+        // A request decoded and validated, waiting to run its handler. Running it asks
+        // the guard first, as earlier requests of a batch may have changed the answer;
+        // false with `error` set if it refuses.
+        using PreparedRequest = std::move_only_function<bool(QLocalSocket*, QString&)>;
+
+        // Register the handler for `Type`. It is called with the decoded
+        // RequestFor<Type> payload, only after validation has passed.
+        template <MessageType Type, typename Fn>
+        void registerHandler(Fn handler) {
+            registerHandler<Type>(Guard{}, std::move(handler));
+        }
+
+        template <MessageType Type, typename Fn>
+        void registerHandler(Guard guard, Fn handler) {
+            Route& route   = m_routes[static_cast<std::size_t>(Type)];
+            route.dispatch = [handler](QLocalSocket* socket, const JsonMessage& msg, QString& error) {
+                typename RequestFor<Type>::type request;
+                if (!decodeRequest(msg, request, error)) {
+                    return false;
+                }
 
-        void registerHandler(const QString& type, HandlerFn handler);
-        bool dispatch(QLocalSocket* socket, const QString& type, const QJsonObject& msg) const;
+                handler(socket, request);
+                return true;
+            };
+            route.prepare = [handler, guard](const JsonMessage& msg, PreparedRequest& out, QString& error) {
+                typename RequestFor<Type>::type request;
+                if (!decodeRequest(msg, request, error)) {
+                    return false;
+                }
+
+                out = [handler, guard, &msg, request = std::move(request)](QLocalSocket* socket, QString& runError) {
+                    if (guard && !guard(socket, msg, runError)) {
+                        return false;
+                    }
+                    handler(socket, request);
+                    return true;
+                };
+                return true;
+            };
+            route.guard = std::move(guard);
+        }
+
+        // Resolves msg.type() against MESSAGE_TYPE_NAMES; `error` is set for InvalidRequest and Unauthorized
+        DispatchStatus dispatch(QLocalSocket* socket, const JsonMessage& msg, QString& error) const;
+        DispatchStatus dispatch(QLocalSocket* socket, MessageType type, const JsonMessage& msg, QString& error) const;
+
+        // Decode every message without running any; `msgs` must outlive the prepared
+        // requests. Guards are only asked when each request runs. On the first failure
+        // `out` is cleared and `error` names the entry, e.g. "requests[2]: Missing id".
+        bool prepareAll(QLocalSocket* socket, const QList<JsonMessage>& msgs, std::vector<PreparedRequest>& out, QString& error) const;
 
       private:
-        QHash<QString, HandlerFn> m_handlers;
+        struct Route {
+            Guard                                                               guard;
+            std::function<bool(QLocalSocket*, const JsonMessage&, QString&)>    dispatch;
+            std::function<bool(const JsonMessage&, PreparedRequest&, QString&)> prepare;
+        };
+
+        std::array<Route, MESSAGE_TYPE_COUNT> m_routes;
     };
 
 } // namespace bb::agent
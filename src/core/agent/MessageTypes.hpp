@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+namespace bb::agent {
+
+    // Every request type the daemon accepts, as (enum value, wire name). The enum and
+    // MESSAGE_TYPE_NAMES are both generated from this list, so they cannot drift apart.
+#define BB_MESSAGE_TYPES(X)                                                                                                                                                        \
+    X(Ping, "ping")                                                                                                                                                                \
+    X(Subscribe, "subscribe")                                                                                                                                                      \
+    X(Next, "next")                                                                                                                                                                \
+    X(KeyringRequest, "keyring_request")                                                                                                                                           \
+    X(PinentryRequest, "pinentry_request")                                                                                                                                         \
+    X(PinentryResult, "pinentry_result")                                                                                                                                           \
+    X(UiRegister, "ui.register")                                                                                                                                                   \
+    X(UiHeartbeat, "ui.heartbeat")                                                                                                                                                 \
+    X(UiUnregister, "ui.unregister")                                                                                                                                               \
+    X(SessionRespond, "session.respond")                                                                                                                                           \
+    X(SessionCancel, "session.cancel")                                                                                                                                             \
+    X(Stats, "stats")                                                                                                                                                              \
+    X(Batch, "batch")
+
+    enum class MessageType : unsigned char {
+#define BB_MESSAGE_TYPE_ENUM(value, name) value,
+        BB_MESSAGE_TYPES(BB_MESSAGE_TYPE_ENUM)
+#undef BB_MESSAGE_TYPE_ENUM
+    };
+
+    inline constexpr std::array MESSAGE_TYPE_NAMES = {
+#define BB_MESSAGE_TYPE_NAME(value, name) std::string_view(name),
+        BB_MESSAGE_TYPES(BB_MESSAGE_TYPE_NAME)
+#undef BB_MESSAGE_TYPE_NAME
+    };
+
+    inline constexpr std::size_t MESSAGE_TYPE_COUNT = MESSAGE_TYPE_NAMES.size();
+
+    constexpr std::string_view   messageTypeName(MessageType type) {
+        return MESSAGE_TYPE_NAMES[static_cast<std::size_t>(type)];
+    }
+
+    // Resolve a wire type name (raw bytes of the "type" member) to its enum value
+    constexpr std::optional<MessageType> messageTypeFromName(std::string_view name) {
+        for (std::size_t i = 0; i < MESSAGE_TYPE_COUNT; ++i) {
+            if (MESSAGE_TYPE_NAMES[i] == name) {
+                return static_cast<MessageType>(i);
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Whether every reply is sent before the handler returns, so a batch can collect it.
+    // next may park, keyring and pinentry requests answer once the user has, and
+    // batches do not nest.
+    constexpr bool isBatchable(MessageType type) {
+        switch (type) {
+            case MessageType::Next:
+            case MessageType::KeyringRequest:
+            case MessageType::PinentryRequest:
+            case MessageType::Batch: return false;
+            default: return true;
+        }
+    }
+
+    static_assert(messageTypeFromName("ping") == MessageType::Ping);
+    static_assert(messageTypeFromName("session.cancel") == MessageType::SessionCancel);
+    static_assert(!messageTypeFromName("pong"));
+
+} // namespace bb::agent
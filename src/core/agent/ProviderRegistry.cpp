@@ -4,6 +4,7 @@
 #include <QLocalSocket>
 #include <QUuid>
 
+#include <algorithm>
 #include <limits>
 #include <utility>
 
@@ -19,6 +20,28 @@ namespace bb::agent {
 
     ProviderRegistry::ProviderRegistry(NowFn nowFn) : m_nowFn(std::move(nowFn)) {}
 
+    void ProviderRegistry::setLivenessTimers(TimerWheel& timers, std::function<void()> onLapsed) {
+        m_timers   = &timers;
+        m_onLapsed = std::move(onLapsed);
+    }
+
+    // Due just past the heartbeat timeout, when recomputeActiveProvider() considers the provider stale
+    void ProviderRegistry::armLiveness(QLocalSocket* socket, qint64 delayMs) {
+        if (!m_timers) {
+            return;
+        }
+
+        auto [it, inserted] = m_liveness.try_emplace(socket);
+        if (inserted) {
+            it->second.setCallback([this] {
+                if (m_onLapsed) {
+                    m_onLapsed();
+                }
+            });
+        }
+        m_timers->schedule(it->second, static_cast<int>(std::max<qint64>(delayMs, 0)) + 1);
+    }
+
     UIProvider ProviderRegistry::registerProvider(QLocalSocket* socket, const QJsonObject& msg) {
         auto& provider = m_uiProviders[socket];
 
@@ -48,6 +71,7 @@ namespace bb::agent {
         }
 
         provider.lastHeartbeatMs = m_nowFn();
+        armLiveness(socket, PROVIDER_HEARTBEAT_TIMEOUT_MS);
         return provider;
     }
 
@@ -58,10 +82,12 @@ namespace bb::agent {
         }
 
         it->lastHeartbeatMs = m_nowFn();
+        armLiveness(socket, PROVIDER_HEARTBEAT_TIMEOUT_MS);
         return true;
     }
 
     bool ProviderRegistry::unregisterProvider(QLocalSocket* socket) {
+        m_liveness.erase(socket);
         return m_uiProviders.remove(socket) > 0;
     }
 
@@ -83,10 +109,17 @@ namespace bb::agent {
             const bool    socketInvalid = (!socket || socket->state() != QLocalSocket::ConnectedState);
             const bool    stale         = (nowMs - provider.lastHeartbeatMs) > PROVIDER_HEARTBEAT_TIMEOUT_MS;
             if (socketInvalid || stale) {
+                m_liveness.erase(socket);
                 it = m_uiProviders.erase(it);
                 continue;
             }
 
+            // The wall clock lagged the wheel: wait out the rest
+            const auto liveness = m_liveness.find(socket);
+            if (m_timers && (liveness == m_liveness.end() || !liveness->second.isArmed())) {
+                armLiveness(socket, PROVIDER_HEARTBEAT_TIMEOUT_MS - (nowMs - provider.lastHeartbeatMs));
+            }
+
             if (!bestSocket || provider.priority > bestPriority || (provider.priority == bestPriority && provider.lastHeartbeatMs > bestHeartbeat)) {
                 bestSocket    = socket;
                 bestPriority  = provider.priority;
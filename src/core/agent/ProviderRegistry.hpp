@@ -1,9 +1,12 @@
 #pragma once
 
+#include "../TimerWheel.hpp"
+
 #include <QHash>
 #include <QJsonObject>
 #include <QPointer>
 #include <functional>
+#include <unordered_map>
 
 class QLocalSocket;
 
@@ -24,6 +27,10 @@ namespace bb::agent {
         ProviderRegistry();
         explicit ProviderRegistry(NowFn nowFn);
 
+        // Arms a heartbeat deadline per provider on `timers`; `onLapsed` runs when
+        // one passes, so callers prune only then instead of polling pruneStale()
+        void                 setLivenessTimers(TimerWheel& timers, std::function<void()> onLapsed);
+
         UIProvider           registerProvider(QLocalSocket* socket, const QJsonObject& msg);
         bool                 heartbeat(QLocalSocket* socket);
         bool                 unregisterProvider(QLocalSocket* socket);
@@ -41,10 +48,16 @@ namespace bb::agent {
         QList<QLocalSocket*> sockets() const;
 
       private:
-        NowFn                            m_nowFn;
+        void                                                 armLiveness(QLocalSocket* socket, qint64 delayMs);
+
+        NowFn                                                m_nowFn;
+
+        QHash<QLocalSocket*, UIProvider>                     m_uiProviders;
+        QPointer<QLocalSocket>                               m_activeProvider;
 
-        QHash<QLocalSocket*, UIProvider> m_uiProviders;
-        QPointer<QLocalSocket>           m_activeProvider;
+        TimerWheel*                                          m_timers = nullptr;
+        std::function<void()>                                m_onLapsed;
+        std::unordered_map<QLocalSocket*, TimerWheel::Entry> m_liveness; // same keys as m_uiProviders
     };
 
 } // namespace bb::agent
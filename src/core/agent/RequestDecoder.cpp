@@ -0,0 +1,171 @@
+#include "RequestDecoder.hpp"
+#include "../../common/Constants.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace bb::agent {
+
+    namespace {
+
+        // Absent members decode to an empty string; present ones must be strings
+        bool readString(const JsonMessage& msg, const char* key, QString& out, QString& error) {
+            const auto kind = msg.kind(key);
+            if (!kind) {
+                out.clear();
+                return true;
+            }
+
+            if (*kind != JsonMessage::Kind::String) {
+                error = QStringLiteral("Invalid %1").arg(QLatin1StringView(key));
+                return false;
+            }
+
+            out = msg.string(key);
+            return true;
+        }
+
+        // Same rules as readString, without the value ever becoming a QString
+        bool readSecret(const JsonMessage& msg, const char* key, SecretString& out, QString& error) {
+            const auto kind = msg.kind(key);
+            if (kind && *kind != JsonMessage::Kind::String) {
+                error = QStringLiteral("Invalid %1").arg(QLatin1StringView(key));
+                return false;
+            }
+
+            out = kind ? msg.secret(key) : SecretString();
+            return true;
+        }
+
+        // Absent members keep `out`; present ones must be non-negative integers
+        bool readCount(const JsonMessage& msg, const char* key, int& out, QString& error) {
+            const auto kind = msg.kind(key);
+            if (!kind) {
+                return true;
+            }
+
+            const int value = msg.integer(key, -1);
+            if (*kind != JsonMessage::Kind::Number || value < 0) {
+                error = QStringLiteral("Invalid %1").arg(QLatin1StringView(key));
+                return false;
+            }
+
+            out = value;
+            return true;
+        }
+
+        bool readId(const JsonMessage& msg, QString& out, QString& error) {
+            if (!readString(msg, "id", out, error)) {
+                return false;
+            }
+
+            if (out.isEmpty()) {
+                error = QStringLiteral("Missing id");
+                return false;
+            }
+            return true;
+        }
+
+    } // namespace
+
+    bool decodeRequest(const JsonMessage& msg, EmptyRequest& out, QString& error) {
+        Q_UNUSED(msg)
+        Q_UNUSED(out)
+        Q_UNUSED(error)
+        return true;
+    }
+
+    bool decodeRequest(const JsonMessage& msg, QJsonObject& out, QString& error) {
+        Q_UNUSED(error)
+        out = msg.object();
+        return true;
+    }
+
+    bool decodeRequest(const JsonMessage& msg, NextRequest& out, QString& error) {
+        if (!readCount(msg, "wait_ms", out.waitMs, error) || !readCount(msg, "max", out.max, error)) {
+            return false;
+        }
+
+        // Either member asks for a batch; "max": 0 would be an empty one
+        if (msg.contains("wait_ms") || msg.contains("max")) {
+            out.max = out.max > 0 ? std::min(out.max, NEXT_BATCH_MAX) : NEXT_BATCH_MAX;
+        }
+        return true;
+    }
+
+    // Entries are only parsed and screened here; MessageRouter::prepareAll decodes
+    // their payloads, still before any of them runs
+    bool decodeRequest(const JsonMessage& msg, BatchRequest& out, QString& error) {
+        const auto elements = msg.elements("requests");
+        if (!elements || elements->isEmpty() || elements->size() > MAX_BATCH_REQUESTS) {
+            error = QStringLiteral("Invalid requests");
+            return false;
+        }
+
+        out.requests.reserve(elements->size());
+        for (const QByteArrayView element : *elements) {
+            auto request = JsonMessage::parse(element);
+            if (!request) {
+                error = QStringLiteral("Invalid requests");
+                return false;
+            }
+
+            const QByteArrayView type     = request->type();
+            const auto           resolved = messageTypeFromName(std::string_view(type.data(), static_cast<std::size_t>(type.size())));
+            if (resolved && !isBatchable(*resolved)) {
+                error = QStringLiteral("Not allowed in batch: %1").arg(QLatin1StringView(type));
+                return false;
+            }
+            out.requests.append(std::move(*request));
+        }
+        return true;
+    }
+
+    bool decodeRequest(const JsonMessage& msg, KeyringRequest& out, QString& error) {
+        if (!readString(msg, "cookie", out.cookie, error)) {
+            return false;
+        }
+
+        // Older prompters send "prompt" instead of "title"
+        const char* titleKey = msg.contains("title") ? "title" : "prompt";
+        if (!readString(msg, titleKey, out.title, error) || !readString(msg, "message", out.message, error) || !readString(msg, "choice", out.choice, error)) {
+            return false;
+        }
+
+        out.flags = msg.integer("flags");
+        return true;
+    }
+
+    bool decodeRequest(const JsonMessage& msg, PinentryRequest& out, QString& error) {
+        if (!readString(msg, "cookie", out.cookie, error) || !readString(msg, "prompt", out.prompt, error) || !readString(msg, "description", out.description, error) ||
+            !readString(msg, "error", out.error, error) || !readString(msg, "keyinfo", out.keyinfo, error)) {
+            return false;
+        }
+
+        if (out.prompt.isEmpty()) {
+            out.prompt = QStringLiteral("Enter passphrase:");
+        }
+
+        out.repeat      = msg.boolean("repeat");
+        out.confirmOnly = msg.boolean("confirm_only");
+        return true;
+    }
+
+    bool decodeRequest(const JsonMessage& msg, PinentryResultRequest& out, QString& error) {
+        if (!readId(msg, out.id, error) || !readString(msg, "result", out.result, error) || !readString(msg, "error", out.error, error)) {
+            return false;
+        }
+
+        out.result = out.result.toLower();
+        return true;
+    }
+
+    bool decodeRequest(const JsonMessage& msg, SessionRespondRequest& out, QString& error) {
+        return readId(msg, out.id, error) && readSecret(msg, "response", out.response, error);
+    }
+
+    bool decodeRequest(const JsonMessage& msg, SessionCancelRequest& out, QString& error) {
+        return readId(msg, out.id, error);
+    }
+
+} // namespace bb::agent
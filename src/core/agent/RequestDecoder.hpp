@@ -0,0 +1,63 @@
+#pragma once
+
+#include "MessageTypes.hpp"
+#include "../ipc/JsonMessage.hpp"
+#include "../managers/RequestTypes.hpp"
+
+#include <QJsonObject>
+#include <QString>
+
+namespace bb::agent {
+
+    // Typed payload handed to the handler registered for each MessageType
+    template <MessageType Type>
+    struct RequestFor {
+        using type = EmptyRequest;
+    };
+    template <>
+    struct RequestFor<MessageType::Next> {
+        using type = NextRequest;
+    };
+    template <>
+    struct RequestFor<MessageType::Batch> {
+        using type = BatchRequest;
+    };
+    template <>
+    struct RequestFor<MessageType::KeyringRequest> {
+        using type = KeyringRequest;
+    };
+    template <>
+    struct RequestFor<MessageType::PinentryRequest> {
+        using type = PinentryRequest;
+    };
+    template <>
+    struct RequestFor<MessageType::PinentryResult> {
+        using type = PinentryResultRequest;
+    };
+    template <>
+    struct RequestFor<MessageType::UiRegister> {
+        using type = QJsonObject; // ProviderRegistry owns the provider defaults
+    };
+    template <>
+    struct RequestFor<MessageType::SessionRespond> {
+        using type = SessionRespondRequest;
+    };
+    template <>
+    struct RequestFor<MessageType::SessionCancel> {
+        using type = SessionCancelRequest;
+    };
+
+    // Decode and validate a request payload, reading only the members each type
+    // needs. On failure returns false and sets `error` to the message sent back
+    // to the client.
+    bool decodeRequest(const JsonMessage& msg, EmptyRequest& out, QString& error);
+    bool decodeRequest(const JsonMessage& msg, QJsonObject& out, QString& error);
+    bool decodeRequest(const JsonMessage& msg, NextRequest& out, QString& error);
+    bool decodeRequest(const JsonMessage& msg, BatchRequest& out, QString& error);
+    bool decodeRequest(const JsonMessage& msg, KeyringRequest& out, QString& error);
+    bool decodeRequest(const JsonMessage& msg, PinentryRequest& out, QString& error);
+    bool decodeRequest(const JsonMessage& msg, PinentryResultRequest& out, QString& error);
+    bool decodeRequest(const JsonMessage& msg, SessionRespondRequest& out, QString& error);
+    bool decodeRequest(const JsonMessage& msg, SessionCancelRequest& out, QString& error);
+
+} // namespace bb::agent
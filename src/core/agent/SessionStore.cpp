@@ -1,41 +1,68 @@
 #include "SessionStore.hpp"
 
+#include "../Metrics.hpp"
+
+#include <QJsonDocument>
+
 namespace bb::agent {
 
+    namespace {
+
+        void appendLine(QByteArray& out, const QJsonObject& event) {
+            out += QJsonDocument(event).toJson(QJsonDocument::Compact);
+            out += '\n';
+        }
+
+    } // namespace
+
     QJsonObject SessionStore::createSession(const QString& id, Session::Source source, Session::Context ctx) {
+        const metrics::ScopedTimer timer(metrics::Stage::SessionUpdate);
+        metrics::increment(metrics::Counter::SessionsCreated);
+
         auto session      = std::make_unique<bb::Session>(id, source, ctx);
         auto createdEvent = session->toCreatedEvent();
         m_sessions[id]    = std::move(session);
+        m_createdAt[id]   = metrics::now();
+        changed();
         return createdEvent;
     }
 
     std::optional<QJsonObject> SessionStore::updatePrompt(const QString& id, const QString& prompt, bool echo, bool clearError) {
+        const metrics::ScopedTimer timer(metrics::Stage::SessionUpdate);
+
         auto it = m_sessions.find(id);
         if (it == m_sessions.end()) {
             return std::nullopt;
         }
 
         it->second->setPrompt(prompt, echo, clearError);
+        changed();
         return it->second->toUpdatedEvent();
     }
 
     std::optional<QJsonObject> SessionStore::updateError(const QString& id, const QString& error) {
+        const metrics::ScopedTimer timer(metrics::Stage::SessionUpdate);
+
         auto it = m_sessions.find(id);
         if (it == m_sessions.end()) {
             return std::nullopt;
         }
 
         it->second->setError(error);
+        changed();
         return it->second->toUpdatedEvent();
     }
 
     std::optional<QJsonObject> SessionStore::updateInfo(const QString& id, const QString& info) {
+        const metrics::ScopedTimer timer(metrics::Stage::SessionUpdate);
+
         auto it = m_sessions.find(id);
         if (it == m_sessions.end()) {
             return std::nullopt;
         }
 
         it->second->setInfo(info);
+        changed();
         return it->second->toUpdatedEvent();
     }
 
@@ -46,10 +73,13 @@ namespace bb::agent {
         }
 
         it->second->setPinentryRetry(curRetry, maxRetries);
+        changed();
         return true;
     }
 
     std::optional<QJsonObject> SessionStore::closeSession(const QString& id, Session::Result result) {
+        const metrics::ScopedTimer timer(metrics::Stage::SessionUpdate);
+
         auto it = m_sessions.find(id);
         if (it == m_sessions.end()) {
             return std::nullopt;
@@ -58,6 +88,14 @@ namespace bb::agent {
         it->second->close(result);
         auto event = it->second->toClosedEvent();
         m_sessions.erase(it);
+        m_encoded.erase(id);
+        changed();
+
+        metrics::increment(metrics::Counter::SessionsClosed);
+        if (auto created = m_createdAt.find(id); created != m_createdAt.end()) {
+            metrics::recordSince(metrics::Stage::SessionLifetime, created->second);
+            m_createdAt.erase(created);
+        }
         return event;
     }
 
@@ -78,4 +116,40 @@ namespace bb::agent {
         return m_sessions.size();
     }
 
+    QJsonObject SessionStore::tableSizes() const {
+        return QJsonObject{{"sessions", static_cast<qint64>(m_sessions.size())},
+                           {"session_created_at", static_cast<qint64>(m_createdAt.size())},
+                           {"session_snapshots", static_cast<qint64>(m_encoded.size())}};
+    }
+
+    const QByteArray& SessionStore::encodedSnapshot() {
+        if (!m_snapshotStale) {
+            return m_snapshot;
+        }
+
+        m_snapshot.clear();
+        for (const auto& [id, session] : m_sessions) {
+            EncodedSession& encoded = m_encoded[id];
+            if (encoded.lines.isEmpty() || encoded.revision != session->revision()) {
+                encoded.lines.clear();
+                appendLine(encoded.lines, session->toCreatedEvent());
+                appendLine(encoded.lines, session->toUpdatedEvent());
+                encoded.revision = session->revision();
+            }
+            m_snapshot += encoded.lines;
+        }
+
+        m_snapshotStale = false;
+        return m_snapshot;
+    }
+
+    quint64 SessionStore::sequence() const {
+        return m_sequence;
+    }
+
+    void SessionStore::changed() {
+        ++m_sequence;
+        m_snapshotStale = true;
+    }
+
 } // namespace bb::agent
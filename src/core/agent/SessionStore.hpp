@@ -2,6 +2,8 @@
 
 #include "../Session.hpp"
 
+#include <QByteArray>
+
 #include <memory>
 #include <optional>
 #include <unordered_map>
@@ -22,9 +24,30 @@ namespace bb::agent {
         const SessionMap&          sessions() const;
         bool                       empty() const;
         std::size_t                size() const;
+        // Entry count of each internal table, for leak checks
+        QJsonObject                tableSizes() const;
+
+        // The session.created and session.updated lines of every open session, as
+        // subscribe sends them. Kept between calls: only sessions whose revision has
+        // moved are encoded again, and the image is reassembled only after a change.
+        const QByteArray&          encodedSnapshot();
+        // Advances with every change to any session; the snapshot reflects this point
+        quint64                    sequence() const;
 
       private:
-        SessionMap m_sessions;
+        struct EncodedSession {
+            quint64    revision = 0;
+            QByteArray lines;
+        };
+
+        void                                        changed();
+
+        SessionMap                                  m_sessions;
+        std::unordered_map<QString, qint64>         m_createdAt; // metrics::now() at creation, for session.lifetime
+        std::unordered_map<QString, EncodedSession> m_encoded;   // per-session part of the snapshot
+        QByteArray                                  m_snapshot;
+        bool                                        m_snapshotStale = false;
+        quint64                                     m_sequence      = 0;
     };
 
 } // namespace bb::agent
@@ -1,24 +1,74 @@
 #include "IpcServer.hpp"
 #include "../../common/Constants.hpp"
+#include "../../common/Paths.hpp"
+#include "../Metrics.hpp"
 
+#include <QDebug>
 #include <QFile>
 #include <QJsonDocument>
-#include <QJsonParseError>
+#include <QSocketNotifier>
 
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
+#include <utility>
 
 namespace bb {
 
     namespace {
 
-        void secureZero(void* ptr, std::size_t size) {
-            volatile unsigned char* p = static_cast<volatile unsigned char*>(ptr);
-            while (size--) {
-                *p++ = 0;
+        // JSON string body for a secret, written into the arena line as it goes
+        void appendEscaped(SecretString& out, QByteArrayView value) {
+            static constexpr char HEX[] = "0123456789abcdef";
+            for (const char c : value) {
+                switch (c) {
+                    case '"': out.append(QByteArrayView("\\\"")); break;
+                    case '\\': out.append(QByteArrayView("\\\\")); break;
+                    case '\b': out.append(QByteArrayView("\\b")); break;
+                    case '\f': out.append(QByteArrayView("\\f")); break;
+                    case '\n': out.append(QByteArrayView("\\n")); break;
+                    case '\r': out.append(QByteArrayView("\\r")); break;
+                    case '\t': out.append(QByteArrayView("\\t")); break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20) {
+                            out.append(QByteArrayView("\\u00"));
+                            out.append(HEX[static_cast<unsigned char>(c) >> 4]);
+                            out.append(HEX[static_cast<unsigned char>(c) & 0xF]);
+                        } else {
+                            out.append(c);
+                        }
+                        break;
+                }
             }
         }
 
+        int listenUnixSocket(const QString& socketPath, int type) {
+            const QByteArray path = QFile::encodeName(socketPath);
+
+            sockaddr_un      addr{};
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= static_cast<qsizetype>(sizeof(addr.sun_path)))
+                return -1;
+            std::memcpy(addr.sun_path, path.constData(), static_cast<std::size_t>(path.size()));
+
+            const int fd = ::socket(AF_UNIX, type | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+            if (fd == -1)
+                return -1;
+
+            // Owner-only access, matching QLocalServer::UserAccessOption. Linux
+            // creates the socket node with the mode set on the fd before bind().
+            if (::fchmod(fd, S_IRUSR | S_IWUSR) == -1 || ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 || ::listen(fd, SOMAXCONN) == -1) {
+                ::close(fd);
+                return -1;
+            }
+
+            return fd;
+        }
+
     } // namespace
 
     IpcServer::IpcServer(QObject* parent) : QObject(parent) {}
@@ -46,6 +96,28 @@ namespace bb {
         }
 
         connect(m_server, &QLocalServer::newConnection, this, &IpcServer::onNewConnection);
+
+        // Clients fall back to the stream socket, so a missing packet endpoint is not fatal
+        if (!startPacketListener(socketPath)) {
+            qWarning() << "IpcServer: SOCK_SEQPACKET endpoint unavailable:" << packetSocketPath(socketPath);
+        }
+
+        return true;
+    }
+
+    bool IpcServer::startPacketListener(const QString& socketPath) {
+        const QString path = packetSocketPath(socketPath);
+        if (QFile::exists(path)) {
+            QFile::remove(path);
+        }
+
+        m_packetListenFd = listenUnixSocket(path, SOCK_SEQPACKET);
+        if (m_packetListenFd == -1)
+            return false;
+
+        m_packetSocketPath     = path;
+        m_packetListenNotifier = new QSocketNotifier(m_packetListenFd, QSocketNotifier::Read, this);
+        connect(m_packetListenNotifier, &QSocketNotifier::activated, this, [this]() { acceptPackets(); });
         return true;
     }
 
@@ -54,7 +126,15 @@ namespace bb {
             return;
 
         // Disconnect all clients
-        for (auto* socket : m_buffers.keys()) {
+        QList<QLocalSocket*> sockets;
+        sockets.reserve(static_cast<qsizetype>(m_buffers.size() + m_packetSockets.size()));
+        for (const auto& [socket, buffer] : m_buffers) {
+            sockets.append(socket);
+        }
+        for (const auto& [socket, connection] : m_packetSockets) {
+            sockets.append(socket);
+        }
+        for (auto* socket : sockets) {
             socket->disconnectFromServer();
         }
         m_buffers.clear();
@@ -62,35 +142,216 @@ namespace bb {
         m_server->close();
         delete m_server;
         m_server = nullptr;
+
+        if (m_packetListenFd != -1) {
+            delete m_packetListenNotifier;
+            m_packetListenNotifier = nullptr;
+            ::close(m_packetListenFd);
+            m_packetListenFd = -1;
+            QFile::remove(m_packetSocketPath);
+            m_packetSocketPath.clear();
+        }
     }
 
     void IpcServer::setMessageHandler(MessageHandler handler) {
         m_handler = std::move(handler);
     }
 
-    void IpcServer::sendJson(QLocalSocket* socket, const QJsonObject& json, bool secureWipe) {
+    void IpcServer::sendJson(QLocalSocket* socket, const QJsonObject& json) {
         if (!socket || socket->state() != QLocalSocket::ConnectedState)
             return;
 
-        QByteArray data = QJsonDocument(json).toJson(QJsonDocument::Compact);
-        data.append('\n');
+        sendEncoded(socket, encodeJson(json));
+    }
+
+    void IpcServer::sendSecret(QLocalSocket* socket, const QJsonObject& json, std::string_view key, const SecretString& value) {
+        if (!socket || socket->state() != QLocalSocket::ConnectedState)
+            return;
+
+        // The public members are encoded as usual; the secret is spliced in before the closing brace
+        const QByteArray head = QJsonDocument(json).toJson(QJsonDocument::Compact);
+        SecretString     line;
+        line.reserve(static_cast<std::size_t>(head.size()) + key.size() + value.size() * 2 + 8);
+        line.append(QByteArrayView(head).chopped(1));
+        if (!json.isEmpty()) {
+            line.append(',');
+        }
+        line.append('"');
+        line.append(QByteArrayView(key.data(), static_cast<qsizetype>(key.size())));
+        line.append(QByteArrayView("\":\""));
+        appendEscaped(line, value.view());
+        line.append(QByteArrayView("\"}\n"));
+
+        writeData(socket, line.view(), true);
+    }
+
+    void IpcServer::sendEncoded(QLocalSocket* socket, const QByteArray& data) {
+        // Packet connections get one send() per message so the peer reads it with
+        // a single recv()
+        if (!m_packetSockets.contains(socket)) {
+            writeData(socket, data, false);
+            return;
+        }
+
+        // Several lines may share a packet, but none may outgrow the peer's recv()
+        QByteArrayView rest(data);
+        while (rest.size() > static_cast<qsizetype>(MAX_MESSAGE_SIZE)) {
+            const qsizetype cut = rest.first(static_cast<qsizetype>(MAX_MESSAGE_SIZE)).lastIndexOf('\n');
+            if (cut == -1) {
+                break;
+            }
+            writeData(socket, rest.first(cut + 1), true);
+            rest = rest.sliced(cut + 1);
+        }
+        writeData(socket, rest, true);
+    }
+
+    void IpcServer::sendEvent(QLocalSocket* socket, const QByteArray& data) {
+        QLocalSocket* const batchSocket = std::exchange(m_batchSocket, nullptr);
+        sendEncoded(socket, data);
+        m_batchSocket = batchSocket;
+    }
+
+    void IpcServer::beginBatch(QLocalSocket* socket) {
+        m_batchSocket = socket;
+        m_batchLines.clear();
+    }
+
+    void IpcServer::endBatch() {
+        QLocalSocket* socket = std::exchange(m_batchSocket, nullptr);
+
+        static constexpr QByteArrayView HEAD = R"({"type":"batch","replies":[)";
+        static constexpr QByteArrayView TAIL = "]}\n";
+        QByteArrayView                  rest = m_batchLines.view();
+
+        // Past what a peer reads in one packet the replies go out as their own lines
+        if (static_cast<std::size_t>(HEAD.size() + TAIL.size()) + m_batchLines.size() > MAX_MESSAGE_SIZE) {
+            for (qsizetype newline = rest.indexOf('\n'); newline != -1; newline = rest.indexOf('\n')) {
+                writeData(socket, rest.first(newline + 1), true);
+                rest = rest.sliced(newline + 1);
+            }
+            m_batchLines.clear();
+            return;
+        }
+
+        SecretString reply;
+        reply.reserve(static_cast<std::size_t>(HEAD.size() + TAIL.size()) + m_batchLines.size());
+        reply.append(HEAD);
+        for (qsizetype newline = rest.indexOf('\n'); newline != -1; newline = rest.indexOf('\n')) {
+            if (reply.size() > static_cast<std::size_t>(HEAD.size())) {
+                reply.append(',');
+            }
+            reply.append(rest.first(newline));
+            rest = rest.sliced(newline + 1);
+        }
+        reply.append(TAIL);
+        m_batchLines.clear();
+
+        writeData(socket, reply.view(), true);
+    }
+
+    void IpcServer::writeData(QLocalSocket* socket, QByteArrayView data, bool direct) {
+        if (!socket || socket->state() != QLocalSocket::ConnectedState)
+            return;
+
+        if (socket == m_batchSocket) {
+            m_batchLines.append(data);
+            return;
+        }
+
+        // Qt's write buffer flushes in its own chunk sizes, which would split or
+        // merge packets, so packet connections never go through it
+        if (m_packetSockets.contains(socket)) {
+            metrics::increment(metrics::Counter::BytesSent, static_cast<quint64>(data.size()));
+            writePacket(socket, data);
+            return;
+        }
+
+        // Direct writes go to the kernel first. Only if it cannot take all of it right
+        // now (or earlier output is still queued) does the rest go through the socket's
+        // write buffer.
+        qsizetype written = 0;
+        if (direct && socket->bytesToWrite() == 0) {
+            const auto sent = ::send(static_cast<int>(socket->socketDescriptor()), data.data(), static_cast<std::size_t>(data.size()), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                socket->disconnectFromServer();
+                return;
+            }
+            written = sent == -1 ? 0 : static_cast<qsizetype>(sent);
+        }
 
-        socket->write(data);
-        socket->flush();
+        // Not flushed here: the write buffer is drained by the event loop once the
+        // socket turns writable, so a fan-out costs each recipient one buffer append
+        if (written < data.size()) {
+            socket->write(data.data() + written, data.size() - written);
+        }
+        metrics::increment(metrics::Counter::BytesSent, static_cast<quint64>(data.size()));
+    }
 
-        if (secureWipe) {
-            secureZero(data.data(), static_cast<std::size_t>(data.size()));
+    void IpcServer::writePacket(QLocalSocket* socket, QByteArrayView data) {
+        PacketConnection& connection = m_packetSockets.at(socket);
+
+        // Sent at once unless earlier packets still wait, which keeps them in order.
+        // A seqpacket send() is all or nothing, so anything short of the whole
+        // packet is a failed connection.
+        if (connection.packets.empty()) {
+            auto sent = ::send(connection.fd, data.data(), static_cast<std::size_t>(data.size()), MSG_NOSIGNAL | MSG_DONTWAIT);
+            while (sent == -1 && errno == EINTR)
+                sent = ::send(connection.fd, data.data(), static_cast<std::size_t>(data.size()), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent == data.size())
+                return;
+            if (sent != -1 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                socket->disconnectFromServer();
+                return;
+            }
+        }
+
+        // The packet may carry a password, so it waits in the arena
+        connection.packets.push_back(SecretString::fromUtf8(data));
+        connection.writeNotifier->setEnabled(true);
+    }
+
+    void IpcServer::flushPackets(QLocalSocket* socket) {
+        auto it = m_packetSockets.find(socket);
+        if (it == m_packetSockets.end())
+            return;
+
+        auto&     packets = it->second.packets;
+        const int fd      = it->second.fd;
+        while (!packets.empty()) {
+            const SecretString& packet = packets.front();
+            const auto          sent   = ::send(fd, packet.data(), packet.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent == -1 && errno == EINTR)
+                continue;
+            if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
+            if (sent != static_cast<qsizetype>(packet.size())) {
+                // Drops the queue along with the connection
+                socket->disconnectFromServer();
+                return;
+            }
+            packets.pop_front();
         }
+
+        it->second.writeNotifier->setEnabled(false);
+    }
+
+    QByteArray IpcServer::encodeJson(const QJsonObject& json) {
+        QByteArray data = QJsonDocument(json).toJson(QJsonDocument::Compact);
+        data.append('\n');
+        return data;
     }
 
-    pid_t IpcServer::getPeerPid(QLocalSocket* socket) {
+    pid_t IpcServer::getPeerPid(QLocalSocket* socket) const {
         if (!socket)
             return -1;
 
         struct ucred cred;
         socklen_t    len = sizeof(cred);
 
-        const int    fd = static_cast<int>(socket->socketDescriptor());
+        // A packet connection's handle is a socketpair end; its peer is this process
+        const auto   packet = m_packetSockets.find(socket);
+        const int    fd     = packet != m_packetSockets.end() ? packet->second.fd : static_cast<int>(socket->socketDescriptor());
         if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1) {
             return -1;
         }
@@ -104,73 +365,219 @@ namespace bb {
             if (!socket)
                 continue;
 
-            m_buffers[socket] = QByteArray();
+            adoptSocket(socket);
+        }
+    }
+
+    void IpcServer::acceptPackets() {
+        // Drain the whole backlog per wakeup so bursts of short-lived CLI
+        // connections cost one notifier activation, not one per client.
+        while (true) {
+            const int fd = ::accept4(m_packetListenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd == -1) {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                return;
+            }
+
+            // Every reply is written as a single packet, so the send buffer
+            // must hold a full MAX_MESSAGE_SIZE message (kernel doubles this).
+            const int sndbuf = static_cast<int>(MAX_MESSAGE_SIZE);
+            ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+            // Handlers and managers key their state on a QLocalSocket. This one wraps
+            // a socketpair end instead of `fd`, so Qt never reads the datagrams into
+            // its stream buffer; see PacketConnection.
+            int pair[2];
+            if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, pair) == -1) {
+                ::close(fd);
+                continue;
+            }
+
+            auto* socket = new QLocalSocket(this);
+            if (!socket->setSocketDescriptor(pair[0], QLocalSocket::ConnectedState, QIODevice::ReadWrite)) {
+                ::close(pair[0]);
+                ::close(pair[1]);
+                ::close(fd);
+                delete socket;
+                continue;
+            }
+
+            PacketConnection& connection = m_packetSockets[socket];
+            connection.fd                = fd;
+            connection.handlePeer        = pair[1];
+            connection.readNotifier      = new QSocketNotifier(fd, QSocketNotifier::Read, socket);
+            connection.writeNotifier     = new QSocketNotifier(fd, QSocketNotifier::Write, socket);
+            connection.writeNotifier->setEnabled(false);
+            connect(connection.readNotifier, &QSocketNotifier::activated, this, [this, socket]() { onPacketReadable(socket); });
+            connect(connection.writeNotifier, &QSocketNotifier::activated, this, [this, socket]() { flushPackets(socket); });
 
-            connect(socket, &QLocalSocket::readyRead, this, &IpcServer::onReadyRead);
-            connect(socket, &QLocalSocket::disconnected, this, &IpcServer::onDisconnected);
+            adoptSocket(socket);
+        }
+    }
 
-            emit clientConnected(socket);
+    void IpcServer::adoptSocket(QLocalSocket* socket) {
+        if (!m_packetSockets.contains(socket)) {
+            m_buffers[socket] = SecretString();
         }
+
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() { onDisconnected(socket); });
+
+        emit clientConnected(socket);
     }
 
-    void IpcServer::onReadyRead() {
-        auto* socket = qobject_cast<QLocalSocket*>(sender());
-        if (!socket)
+    void IpcServer::onReadyRead(QLocalSocket* socket) {
+        auto it = m_buffers.find(socket);
+        if (it == m_buffers.end())
             return;
 
-        QByteArray& buffer = m_buffers[socket];
-        buffer.append(socket->readAll());
+        // The connection keeps one buffer in the arena, reused by every read. It is
+        // filled a pooled IPC_READ_CHUNK at a time and only grows past that for a line
+        // that does not fit. Lines are dispatched as views into it, so it is moved out
+        // of m_buffers for the duration: handlers may drop the connection and its entry.
+        const qint64 readAt = metrics::now();
+        SecretString data   = std::move(it->second);
+
+        // Later lines of a read are timed from its start, so queueing behind
+        // earlier handlers shows up in their dispatch latency.
+        metrics::setDispatchStart(readAt);
+        for (qint64 available = socket->bytesAvailable(); available > 0 && m_buffers.contains(socket); available = socket->bytesAvailable()) {
+            // A partial line that fills the buffer doubles it, up to the largest message
+            const std::size_t room = std::min(data.size() < IPC_READ_CHUNK ? IPC_READ_CHUNK - data.size() : data.size(), MAX_MESSAGE_SIZE - data.size());
+            if (room == 0) {
+                socket->disconnectFromServer();
+                break;
+            }
 
-        // Enforce max message size
-        if (buffer.size() > static_cast<qsizetype>(MAX_MESSAGE_SIZE)) {
-            socket->disconnectFromServer();
-            return;
-        }
+            const qint64 want = std::min(available, static_cast<qint64>(room));
+            const qint64 got  = socket->read(data.spare(static_cast<std::size_t>(want)), want);
+            if (got <= 0)
+                break;
+            data.commit(static_cast<std::size_t>(got));
+
+            const QByteArrayView  bytes = data.view();
+            QList<QByteArrayView> lines;
+            qsizetype             start = 0;
+            qsizetype             idx;
+            while ((idx = bytes.indexOf('\n', start)) != -1) {
+                const QByteArrayView line = bytes.sliced(start, idx - start).trimmed();
+                if (!line.isEmpty()) {
+                    lines.append(line);
+                }
+                start = idx + 1;
+            }
 
-        // Process complete lines
-        qsizetype idx;
-        while ((idx = buffer.indexOf('\n')) != -1) {
-            QByteArray line = buffer.left(idx).trimmed();
-            buffer.remove(0, static_cast<qsizetype>(idx + 1));
+            for (const QByteArrayView line : lines) {
+                // The handler may have dropped the connection
+                if (!m_buffers.contains(socket))
+                    break;
 
-            if (!line.isEmpty()) {
                 handleLine(socket, line);
             }
+
+            // Keep the partial line, if any, for the next chunk
+            data.removePrefix(static_cast<std::size_t>(start));
+        }
+        metrics::setDispatchStart(0);
+
+        // Hand the block back for the next read
+        it = m_buffers.find(socket);
+        if (it != m_buffers.end()) {
+            it->second = std::move(data);
         }
     }
 
-    void IpcServer::onDisconnected() {
-        auto* socket = qobject_cast<QLocalSocket*>(sender());
-        if (!socket)
+    void IpcServer::onPacketReadable(QLocalSocket* socket) {
+        auto it = m_packetSockets.find(socket);
+        if (it == m_packetSockets.end())
             return;
 
-        m_buffers.remove(socket);
+        // Each datagram is one message, received whole into the connection's arena
+        // buffer. As in onReadyRead() the buffer is moved out while it is dispatched.
+        const int    fd     = it->second.fd;
+        const qint64 readAt = metrics::now();
+        SecretString data   = std::move(it->second.buffer);
+
+        metrics::setDispatchStart(readAt);
+        while (m_packetSockets.contains(socket)) {
+            // MSG_TRUNC reports the whole datagram's length without consuming it
+            const auto length = ::recv(fd, nullptr, 0, MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+            if (length == -1 && errno == EINTR)
+                continue;
+            if (length == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+
+            // Peers never send an empty packet, so 0 is the end of the connection
+            if (length <= 0 || static_cast<std::size_t>(length) > MAX_MESSAGE_SIZE) {
+                socket->disconnectFromServer();
+                break;
+            }
+
+            data.clear();
+            auto received = ::recv(fd, data.spare(static_cast<std::size_t>(length)), static_cast<std::size_t>(length), MSG_DONTWAIT);
+            while (received == -1 && errno == EINTR)
+                received = ::recv(fd, data.spare(static_cast<std::size_t>(length)), static_cast<std::size_t>(length), MSG_DONTWAIT);
+            if (received != length) {
+                socket->disconnectFromServer();
+                break;
+            }
+            data.commit(static_cast<std::size_t>(received));
+
+            // The packet boundary frames the message; the trailing newline is optional
+            const QByteArrayView message = data.view().trimmed();
+            if (!message.isEmpty()) {
+                handleLine(socket, message);
+            }
+        }
+        metrics::setDispatchStart(0);
+
+        // Hand the block back for the next datagram
+        it = m_packetSockets.find(socket);
+        if (it != m_packetSockets.end()) {
+            it->second.buffer = std::move(data);
+        }
+    }
+
+    void IpcServer::onDisconnected(QLocalSocket* socket) {
+        m_buffers.erase(socket);
+        if (auto packet = m_packetSockets.find(socket); packet != m_packetSockets.end()) {
+            // Qt closed the handle; the datagram socket and the pair's other end are
+            // ours. The notifiers may be mid-activation, so they only stop here and go
+            // with the handle. Unsent packets are wiped with the queue.
+            packet->second.readNotifier->setEnabled(false);
+            packet->second.writeNotifier->setEnabled(false);
+            ::close(packet->second.fd);
+            ::close(packet->second.handlePeer);
+            m_packetSockets.erase(packet);
+        }
         emit clientDisconnected(socket);
 
         socket->deleteLater();
     }
 
-    void IpcServer::handleLine(QLocalSocket* socket, const QByteArray& line) {
+    void IpcServer::handleLine(QLocalSocket* socket, QByteArrayView line) {
         if (!m_handler)
             return;
 
-        QJsonParseError parseError;
-        const auto      doc = QJsonDocument::fromJson(line, &parseError);
+        metrics::increment(metrics::Counter::MessagesReceived);
 
-        if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+        // One validating pass over the line; handlers decode only the fields they read
+        const auto message = JsonMessage::parse(line);
+        if (!message) {
+            metrics::increment(metrics::Counter::InvalidMessages);
             sendJson(socket, QJsonObject{{"type", "error"}, {"message", "Invalid JSON"}});
             return;
         }
 
-        const QJsonObject obj  = doc.object();
-        const QString     type = obj.value("type").toString();
-
-        if (type.isEmpty()) {
+        if (message->type().isEmpty()) {
+            metrics::increment(metrics::Counter::InvalidMessages);
             sendJson(socket, QJsonObject{{"type", "error"}, {"message", "Missing type field"}});
             return;
         }
 
-        m_handler(socket, type, obj);
+        m_handler(socket, *message);
+        metrics::recordSince(metrics::Stage::IpcDispatch, metrics::dispatchStart());
     }
 
 } // namespace bb
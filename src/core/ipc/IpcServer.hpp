@@ -1,17 +1,25 @@
 #pragma once
 
+#include "../../common/SecureMemory.hpp"
+#include "JsonMessage.hpp"
+
 #include <QLocalServer>
 #include <QLocalSocket>
 #include <QJsonObject>
 #include <QObject>
 
+#include <deque>
 #include <functional>
+#include <string_view>
+#include <unordered_map>
+
+class QSocketNotifier;
 
 namespace bb {
 
-    // Callback type for handling parsed JSON messages
-    // Parameters: socket, message type, full JSON object
-    using MessageHandler = std::function<void(QLocalSocket*, const QString&, const QJsonObject&)>;
+    // Callback type for handling validated messages; fields are decoded on demand
+    // The message views the received line and is only valid for the call
+    using MessageHandler = std::function<void(QLocalSocket*, const JsonMessage&)>;
 
     class IpcServer : public QObject {
         Q_OBJECT
@@ -20,8 +28,9 @@ namespace bb {
         explicit IpcServer(QObject* parent = nullptr);
         ~IpcServer() override;
 
-        // Start listening on the given socket path
-        // Returns false if binding fails
+        // Start listening on the given socket path, plus a best-effort
+        // SOCK_SEQPACKET endpoint at packetSocketPath(socketPath)
+        // Returns false if binding the stream socket fails
         bool start(const QString& socketPath);
 
         // Stop the server and disconnect all clients
@@ -31,28 +40,75 @@ namespace bb {
         void setMessageHandler(MessageHandler handler);
 
         // Send a JSON response to a specific socket
-        // If secureWipe is true, zeros the buffer after sending
-        void sendJson(QLocalSocket* socket, const QJsonObject& json, bool secureWipe = false);
+        void sendJson(QLocalSocket* socket, const QJsonObject& json);
+
+        // Send `json` with `key` set to a secret. The line is assembled in the secure
+        // arena and handed straight to the kernel; Qt's write buffer only sees a
+        // remainder the kernel could not take at once (a packet connection queues
+        // the whole packet in the arena instead)
+        void sendSecret(QLocalSocket* socket, const QJsonObject& json, std::string_view key, const SecretString& value);
+
+        // Send an already-encoded message (see encodeJson)
+        // Lets fan-out paths serialize an event once for every recipient
+        void sendEncoded(QLocalSocket* socket, const QByteArray& data);
+
+        // Send an encoded event. Events are never part of a batch reply: one raised
+        // while a batch runs goes out at once, ahead of the batch's reply line
+        void sendEvent(QLocalSocket* socket, const QByteArray& data);
+
+        // Replies sent to `socket` from here on are collected rather than written, until
+        // endBatch() sends them in order as one {"type":"batch","replies":[...]} line
+        void beginBatch(QLocalSocket* socket);
+        void endBatch();
+
+        // Encode a JSON object into its wire form (compact JSON + newline)
+        static QByteArray encodeJson(const QJsonObject& json);
 
         // Get peer process ID for a connected socket
         // Returns -1 on failure
-        static pid_t getPeerPid(QLocalSocket* socket);
+        pid_t getPeerPid(QLocalSocket* socket) const;
 
       Q_SIGNALS:
         void clientConnected(QLocalSocket* socket);
         void clientDisconnected(QLocalSocket* socket);
 
-      private Q_SLOTS:
-        void onNewConnection();
-        void onReadyRead();
-        void onDisconnected();
-
       private:
-        void                             handleLine(QLocalSocket* socket, const QByteArray& line);
-
-        QLocalServer*                    m_server = nullptr;
+        void                             onNewConnection();
+        void                             acceptPackets();
+        bool                             startPacketListener(const QString& socketPath);
+        void                             adoptSocket(QLocalSocket* socket);
+        void                             onReadyRead(QLocalSocket* socket);
+        void                             onPacketReadable(QLocalSocket* socket);
+        void                             onDisconnected(QLocalSocket* socket);
+        void                             handleLine(QLocalSocket* socket, QByteArrayView line);
+        void                             writeData(QLocalSocket* socket, QByteArrayView data, bool direct);
+        void                             writePacket(QLocalSocket* socket, QByteArrayView data);
+        void                             flushPackets(QLocalSocket* socket);
+
+        // A SOCK_SEQPACKET connection. Qt never touches its descriptor: the QLocalSocket
+        // handed to handlers wraps one end of a socketpair that carries no data and only
+        // stands for the connection, so every datagram is read here whole, one recv()
+        // per message. Replies waiting for the kernel are queued as whole packets and
+        // sent with a single send() each once the socket turns writable.
+        struct PacketConnection {
+            int                      fd            = -1;
+            int                      handlePeer    = -1; // keeps the handle's socketpair connected
+            QSocketNotifier*         readNotifier  = nullptr;
+            QSocketNotifier*         writeNotifier = nullptr; // enabled while packets wait
+            SecretString             buffer;                  // the datagram being dispatched
+            std::deque<SecretString> packets;
+        };
+
+        QLocalServer*                    m_server               = nullptr;
+        int                              m_packetListenFd       = -1;
+        QSocketNotifier*                 m_packetListenNotifier = nullptr;
+        QString                          m_packetSocketPath;
         MessageHandler                   m_handler;
-        QHash<QLocalSocket*, QByteArray> m_buffers;
+        std::unordered_map<QLocalSocket*, PacketConnection> m_packetSockets;
+        // Partial lines per stream connection, kept in the secure arena
+        std::unordered_map<QLocalSocket*, SecretString> m_buffers;
+        QLocalSocket*                    m_batchSocket = nullptr;
+        SecretString                     m_batchLines; // replies to the batch so far; one may carry a password
     };
 
 } // namespace bb
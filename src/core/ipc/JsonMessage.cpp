@@ -0,0 +1,544 @@
+#include "JsonMessage.hpp"
+
+#include <QJsonDocument>
+#include <QJsonValue>
+
+#include <charconv>
+#include <cmath>
+#include <limits>
+
+namespace bb {
+
+    namespace {
+
+        // Same nesting limit as QJsonDocument
+        inline constexpr int MAX_NESTING_DEPTH = 1024;
+
+        struct Cursor {
+            const char* pos;
+            const char* end;
+
+            void        skipWhitespace() {
+                while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r')) {
+                    ++pos;
+                }
+            }
+
+            bool consume(char c) {
+                skipWhitespace();
+                if (pos < end && *pos == c) {
+                    ++pos;
+                    return true;
+                }
+                return false;
+            }
+        };
+
+        bool isHex(char c) {
+            return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+        }
+
+        bool isDigit(char c) {
+            return c >= '0' && c <= '9';
+        }
+
+        // Validates one multi-byte UTF-8 sequence starting at a lead byte >= 0x80
+        bool skipUtf8Sequence(Cursor& cursor) {
+            const auto lead = static_cast<unsigned char>(*cursor.pos);
+            int        length;
+            char32_t   codePoint;
+            if (lead >= 0xC2 && lead <= 0xDF) {
+                length    = 2;
+                codePoint = lead & 0x1F;
+            } else if (lead >= 0xE0 && lead <= 0xEF) {
+                length    = 3;
+                codePoint = lead & 0x0F;
+            } else if (lead >= 0xF0 && lead <= 0xF4) {
+                length    = 4;
+                codePoint = lead & 0x07;
+            } else {
+                return false;
+            }
+
+            if (cursor.end - cursor.pos < length) {
+                return false;
+            }
+            for (int i = 1; i < length; ++i) {
+                const auto next = static_cast<unsigned char>(cursor.pos[i]);
+                if ((next & 0xC0) != 0x80) {
+                    return false;
+                }
+                codePoint = (codePoint << 6) | (next & 0x3F);
+            }
+
+            // Overlong forms, surrogates and values past U+10FFFF
+            if ((length == 3 && codePoint < 0x800) || (length == 4 && (codePoint < 0x10000 || codePoint > 0x10FFFF)) || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+                return false;
+            }
+
+            cursor.pos += length;
+            return true;
+        }
+
+        // Expects the cursor on the opening quote; `raw` excludes the quotes
+        bool scanString(Cursor& cursor, std::string_view& raw, bool& escaped) {
+            const char* start = ++cursor.pos;
+            escaped           = false;
+            while (cursor.pos < cursor.end) {
+                const char c = *cursor.pos;
+                if (c == '"') {
+                    raw = std::string_view(start, static_cast<std::size_t>(cursor.pos - start));
+                    ++cursor.pos;
+                    return true;
+                }
+
+                if (c == '\\') {
+                    if (cursor.end - cursor.pos < 2) {
+                        return false;
+                    }
+                    escaped = true;
+                    switch (cursor.pos[1]) {
+                        case '"':
+                        case '\\':
+                        case '/':
+                        case 'b':
+                        case 'f':
+                        case 'n':
+                        case 'r':
+                        case 't': cursor.pos += 2; break;
+                        case 'u':
+                            if (cursor.end - cursor.pos < 6 || !isHex(cursor.pos[2]) || !isHex(cursor.pos[3]) || !isHex(cursor.pos[4]) || !isHex(cursor.pos[5])) {
+                                return false;
+                            }
+                            cursor.pos += 6;
+                            break;
+                        default: return false;
+                    }
+                    continue;
+                }
+
+                const auto byte = static_cast<unsigned char>(c);
+                if (byte < 0x20) {
+                    return false;
+                }
+                if (byte < 0x80) {
+                    ++cursor.pos;
+                } else if (!skipUtf8Sequence(cursor)) {
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        bool scanNumber(Cursor& cursor) {
+            if (cursor.pos < cursor.end && *cursor.pos == '-') {
+                ++cursor.pos;
+            }
+
+            if (cursor.pos >= cursor.end || !isDigit(*cursor.pos)) {
+                return false;
+            }
+            if (*cursor.pos == '0') {
+                ++cursor.pos;
+            } else {
+                while (cursor.pos < cursor.end && isDigit(*cursor.pos)) {
+                    ++cursor.pos;
+                }
+            }
+
+            if (cursor.pos < cursor.end && *cursor.pos == '.') {
+                ++cursor.pos;
+                if (cursor.pos >= cursor.end || !isDigit(*cursor.pos)) {
+                    return false;
+                }
+                while (cursor.pos < cursor.end && isDigit(*cursor.pos)) {
+                    ++cursor.pos;
+                }
+            }
+
+            if (cursor.pos < cursor.end && (*cursor.pos == 'e' || *cursor.pos == 'E')) {
+                ++cursor.pos;
+                if (cursor.pos < cursor.end && (*cursor.pos == '+' || *cursor.pos == '-')) {
+                    ++cursor.pos;
+                }
+                if (cursor.pos >= cursor.end || !isDigit(*cursor.pos)) {
+                    return false;
+                }
+                while (cursor.pos < cursor.end && isDigit(*cursor.pos)) {
+                    ++cursor.pos;
+                }
+            }
+            return true;
+        }
+
+        bool scanLiteral(Cursor& cursor, std::string_view literal) {
+            if (static_cast<std::size_t>(cursor.end - cursor.pos) < literal.size() || std::string_view(cursor.pos, literal.size()) != literal) {
+                return false;
+            }
+            cursor.pos += literal.size();
+            return true;
+        }
+
+        bool scanValue(Cursor& cursor, int depth, JsonMessage::Kind& kind, std::string_view& raw, bool& escaped);
+
+        bool scanContainer(Cursor& cursor, int depth, char close) {
+            if (depth > MAX_NESTING_DEPTH) {
+                return false;
+            }
+
+            ++cursor.pos;
+            if (cursor.consume(close)) {
+                return true;
+            }
+
+            JsonMessage::Kind kind;
+            std::string_view  raw;
+            bool              escaped = false;
+            do {
+                if (close == '}') {
+                    cursor.skipWhitespace();
+                    if (cursor.pos >= cursor.end || *cursor.pos != '"' || !scanString(cursor, raw, escaped) || !cursor.consume(':')) {
+                        return false;
+                    }
+                }
+                if (!scanValue(cursor, depth + 1, kind, raw, escaped)) {
+                    return false;
+                }
+            } while (cursor.consume(','));
+
+            return cursor.consume(close);
+        }
+
+        bool scanValue(Cursor& cursor, int depth, JsonMessage::Kind& kind, std::string_view& raw, bool& escaped) {
+            cursor.skipWhitespace();
+            if (cursor.pos >= cursor.end) {
+                return false;
+            }
+
+            const char* start = cursor.pos;
+            bool        ok    = false;
+            escaped           = false;
+            switch (*cursor.pos) {
+                case '"': kind = JsonMessage::Kind::String; return scanString(cursor, raw, escaped);
+                case '{':
+                    kind = JsonMessage::Kind::Object;
+                    ok   = scanContainer(cursor, depth, '}');
+                    break;
+                case '[':
+                    kind = JsonMessage::Kind::Array;
+                    ok   = scanContainer(cursor, depth, ']');
+                    break;
+                case 't':
+                    kind = JsonMessage::Kind::Bool;
+                    ok   = scanLiteral(cursor, "true");
+                    break;
+                case 'f':
+                    kind = JsonMessage::Kind::Bool;
+                    ok   = scanLiteral(cursor, "false");
+                    break;
+                case 'n':
+                    kind = JsonMessage::Kind::Null;
+                    ok   = scanLiteral(cursor, "null");
+                    break;
+                default:
+                    kind = JsonMessage::Kind::Number;
+                    ok   = scanNumber(cursor);
+                    break;
+            }
+
+            raw = std::string_view(start, static_cast<std::size_t>(cursor.pos - start));
+            return ok;
+        }
+
+        template <typename Out>
+        void appendUtf8(Out& out, char32_t codePoint) {
+            if (codePoint < 0x80) {
+                out.append(static_cast<char>(codePoint));
+            } else if (codePoint < 0x800) {
+                out.append(static_cast<char>(0xC0 | (codePoint >> 6)));
+                out.append(static_cast<char>(0x80 | (codePoint & 0x3F)));
+            } else if (codePoint < 0x10000) {
+                out.append(static_cast<char>(0xE0 | (codePoint >> 12)));
+                out.append(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+                out.append(static_cast<char>(0x80 | (codePoint & 0x3F)));
+            } else {
+                out.append(static_cast<char>(0xF0 | (codePoint >> 18)));
+                out.append(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+                out.append(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+                out.append(static_cast<char>(0x80 | (codePoint & 0x3F)));
+            }
+        }
+
+        char32_t readHex4(const char* p) {
+            unsigned value = 0;
+            std::from_chars(p, p + 4, value, 16);
+            return static_cast<char32_t>(value);
+        }
+
+        // Decodes a string body already checked by scanString; never longer than `raw`
+        template <typename Out>
+        void unescapeInto(std::string_view raw, Out& out) {
+            for (std::size_t i = 0; i < raw.size(); ++i) {
+                if (raw[i] != '\\') {
+                    out.append(raw[i]);
+                    continue;
+                }
+
+                const char escape = raw[++i];
+                switch (escape) {
+                    case 'b': out.append('\b'); break;
+                    case 'f': out.append('\f'); break;
+                    case 'n': out.append('\n'); break;
+                    case 'r': out.append('\r'); break;
+                    case 't': out.append('\t'); break;
+                    case 'u': {
+                        char32_t codePoint = readHex4(raw.data() + i + 1);
+                        i += 4;
+                        if (codePoint >= 0xD800 && codePoint <= 0xDBFF && i + 6 < raw.size() && raw.substr(i + 1, 2) == "\\u") {
+                            const char32_t low = readHex4(raw.data() + i + 3);
+                            if (low >= 0xDC00 && low <= 0xDFFF) {
+                                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                                i += 6;
+                            }
+                        }
+                        if (codePoint >= 0xD800 && codePoint <= 0xDFFF) {
+                            codePoint = 0xFFFD;
+                        }
+                        appendUtf8(out, codePoint);
+                        break;
+                    }
+                    default: out.append(escape); break;
+                }
+            }
+        }
+
+        QByteArray unescape(std::string_view raw) {
+            QByteArray out;
+            out.reserve(static_cast<qsizetype>(raw.size()));
+            unescapeInto(raw, out);
+            return out;
+        }
+
+        bool keyEquals(std::string_view raw, bool escaped, std::string_view key) {
+            return escaped ? unescape(raw) == QByteArray(key.data(), static_cast<qsizetype>(key.size())) : raw == key;
+        }
+
+        QString keyString(std::string_view key) {
+            return QString::fromUtf8(key.data(), static_cast<qsizetype>(key.size()));
+        }
+
+    } // namespace
+
+    std::optional<JsonMessage> JsonMessage::parse(QByteArrayView line) {
+        JsonMessage message;
+        message.m_line = std::string_view(line.data(), static_cast<std::size_t>(line.size()));
+
+        Cursor cursor{message.m_line.data(), message.m_line.data() + message.m_line.size()};
+        if (!cursor.consume('{')) {
+            return std::nullopt;
+        }
+
+        if (!cursor.consume('}')) {
+            do {
+                Member member;
+                cursor.skipWhitespace();
+                if (cursor.pos >= cursor.end || *cursor.pos != '"' || !scanString(cursor, member.key, member.keyEscaped) || !cursor.consume(':')) {
+                    return std::nullopt;
+                }
+                if (!scanValue(cursor, 1, member.kind, member.value, member.valueEscaped)) {
+                    return std::nullopt;
+                }
+
+                // Duplicate keys resolve to the last one, as in QJsonDocument
+                const bool isType = member.keyEscaped ? unescape(member.key) == "type" : member.key == "type";
+                if (isType) {
+                    message.m_rawType = {};
+                    message.m_decodedType.clear();
+                    if (member.kind == Kind::String) {
+                        if (member.valueEscaped) {
+                            message.m_decodedType = unescape(member.value);
+                        } else {
+                            message.m_rawType = member.value;
+                        }
+                    }
+                }
+
+                if (message.m_memberCount < MAX_INDEXED_MEMBERS) {
+                    message.m_members[message.m_memberCount++] = member;
+                } else {
+                    message.m_overflow = true;
+                }
+            } while (cursor.consume(','));
+
+            if (!cursor.consume('}')) {
+                return std::nullopt;
+            }
+        }
+
+        cursor.skipWhitespace();
+        if (cursor.pos != cursor.end) {
+            return std::nullopt;
+        }
+
+        return message;
+    }
+
+    QByteArrayView JsonMessage::type() const {
+        if (!m_decodedType.isEmpty()) {
+            return m_decodedType;
+        }
+        return QByteArrayView(m_rawType.data(), static_cast<qsizetype>(m_rawType.size()));
+    }
+
+    const JsonMessage::Member* JsonMessage::find(std::string_view key) const {
+        for (std::size_t i = m_memberCount; i > 0; --i) {
+            const Member& member = m_members[i - 1];
+            if (keyEquals(member.key, member.keyEscaped, key)) {
+                return &member;
+            }
+        }
+        return nullptr;
+    }
+
+    std::optional<JsonMessage::Member> JsonMessage::scan(std::string_view key) const {
+        // parse() has validated the line; this pass only finds where each member lies
+        std::optional<Member> found;
+        Cursor                cursor{m_line.data(), m_line.data() + m_line.size()};
+        cursor.consume('{');
+        if (cursor.consume('}')) {
+            return found;
+        }
+
+        do {
+            Member member;
+            cursor.skipWhitespace();
+            scanString(cursor, member.key, member.keyEscaped);
+            cursor.consume(':');
+            scanValue(cursor, 1, member.kind, member.value, member.valueEscaped);
+            if (keyEquals(member.key, member.keyEscaped, key)) {
+                found = member;
+            }
+        } while (cursor.consume(','));
+        return found;
+    }
+
+    bool JsonMessage::contains(std::string_view key) const {
+        if (m_overflow) {
+            return object().contains(keyString(key));
+        }
+        return find(key) != nullptr;
+    }
+
+    std::optional<JsonMessage::Kind> JsonMessage::kind(std::string_view key) const {
+        if (m_overflow) {
+            const QJsonValue value = object().value(keyString(key));
+            switch (value.type()) {
+                case QJsonValue::String: return Kind::String;
+                case QJsonValue::Double: return Kind::Number;
+                case QJsonValue::Bool: return Kind::Bool;
+                case QJsonValue::Null: return Kind::Null;
+                case QJsonValue::Object: return Kind::Object;
+                case QJsonValue::Array: return Kind::Array;
+                case QJsonValue::Undefined: return std::nullopt;
+            }
+            return std::nullopt;
+        }
+
+        const Member* member = find(key);
+        return member ? std::optional<Kind>(member->kind) : std::nullopt;
+    }
+
+    QString JsonMessage::string(std::string_view key) const {
+        if (m_overflow) {
+            return object().value(keyString(key)).toString();
+        }
+
+        const Member* member = find(key);
+        if (!member || member->kind != Kind::String) {
+            return {};
+        }
+        if (member->valueEscaped) {
+            return QString::fromUtf8(unescape(member->value));
+        }
+        return QString::fromUtf8(member->value.data(), static_cast<qsizetype>(member->value.size()));
+    }
+
+    SecretString JsonMessage::secret(std::string_view key) const {
+        const std::optional<Member> scanned = m_overflow ? scan(key) : std::nullopt;
+        const Member*               member  = m_overflow ? (scanned ? &*scanned : nullptr) : find(key);
+
+        SecretString secret;
+        if (!member || member->kind != Kind::String) {
+            return secret;
+        }
+
+        secret.reserve(member->value.size());
+        if (member->valueEscaped) {
+            unescapeInto(member->value, secret);
+        } else {
+            secret.append(QByteArrayView(member->value.data(), static_cast<qsizetype>(member->value.size())));
+        }
+        return secret;
+    }
+
+    bool JsonMessage::boolean(std::string_view key) const {
+        if (m_overflow) {
+            return object().value(keyString(key)).toBool();
+        }
+
+        const Member* member = find(key);
+        return member && member->kind == Kind::Bool && member->value == "true";
+    }
+
+    int JsonMessage::integer(std::string_view key, int defaultValue) const {
+        if (m_overflow) {
+            return object().value(keyString(key)).toInt(defaultValue);
+        }
+
+        const Member* member = find(key);
+        if (!member || member->kind != Kind::Number) {
+            return defaultValue;
+        }
+
+        double value = 0;
+        if (std::from_chars(member->value.data(), member->value.data() + member->value.size(), value).ec != std::errc()) {
+            return defaultValue;
+        }
+
+        // Same rule as QJsonValue::toInt(): only exact integers in range
+        if (std::trunc(value) != value || value < std::numeric_limits<int>::min() || value > std::numeric_limits<int>::max()) {
+            return defaultValue;
+        }
+        return static_cast<int>(value);
+    }
+
+    std::optional<QList<QByteArrayView>> JsonMessage::elements(std::string_view key) const {
+        const Member* member = m_overflow ? nullptr : find(key);
+        if (!member || member->kind != Kind::Array) {
+            return std::nullopt;
+        }
+
+        // parse() has validated the array; this pass only finds where each element ends
+        QList<QByteArrayView> elements;
+        Cursor                cursor{member->value.data() + 1, member->value.data() + member->value.size()};
+        if (cursor.consume(']')) {
+            return elements;
+        }
+
+        Kind             kind;
+        std::string_view raw;
+        bool             escaped = false;
+        do {
+            cursor.skipWhitespace();
+            const char* start = cursor.pos;
+            scanValue(cursor, 1, kind, raw, escaped);
+            elements.append(QByteArrayView(start, cursor.pos - start));
+        } while (cursor.consume(','));
+        return elements;
+    }
+
+    QJsonObject JsonMessage::object() const {
+        return QJsonDocument::fromJson(QByteArray::fromRawData(m_line.data(), static_cast<qsizetype>(m_line.size()))).object();
+    }
+
+} // namespace bb
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "../../common/SecureMemory.hpp"
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+namespace bb {
+
+    // One wire line, validated and indexed in a single pass without building a
+    // QJsonObject. Top-level members are kept as views into the line and values
+    // are decoded only when a handler asks for them, so payload-less control
+    // messages (ping, next, subscribe, ui.heartbeat) never touch the heap.
+    // The line must outlive the message.
+    class JsonMessage {
+      public:
+        enum class Kind : unsigned char {
+            String,
+            Number,
+            Bool,
+            Null,
+            Object,
+            Array
+        };
+
+        // std::nullopt unless `line` holds exactly one valid JSON object
+        static std::optional<JsonMessage> parse(QByteArrayView line);
+
+        // The "type" member as UTF-8; empty if missing or not a string
+        [[nodiscard]] QByteArrayView type() const;
+
+        [[nodiscard]] bool           contains(std::string_view key) const;
+        [[nodiscard]] std::optional<Kind> kind(std::string_view key) const;
+
+        // QJsonValue-style accessors: missing or mistyped members yield the default
+        [[nodiscard]] QString     string(std::string_view key) const;
+        [[nodiscard]] bool        boolean(std::string_view key) const;
+        [[nodiscard]] int         integer(std::string_view key, int defaultValue = 0) const;
+
+        // A string member decoded straight into the secure arena, for passwords
+        [[nodiscard]] SecretString secret(std::string_view key) const;
+
+        // Each element of an array member as a view into the line, ready for parse();
+        // std::nullopt if the member is missing or not an array, or the line has more
+        // members than are indexed
+        [[nodiscard]] std::optional<QList<QByteArrayView>> elements(std::string_view key) const;
+
+        // Full decode for consumers that still take a QJsonObject
+        [[nodiscard]] QJsonObject object() const;
+
+      private:
+        struct Member {
+            std::string_view key;
+            std::string_view value; // raw value; strings without their quotes
+            Kind             kind         = Kind::Null;
+            bool             keyEscaped   = false;
+            bool             valueEscaped = false;
+        };
+
+        // Lines with more members than this are still validated, but lookups use object();
+        // secret() walks the line again instead, so the value never reaches the heap
+        static constexpr std::size_t MAX_INDEXED_MEMBERS = 16;
+
+        const Member*                           find(std::string_view key) const;
+        std::optional<Member>                   scan(std::string_view key) const;
+
+        std::string_view                        m_line;
+        std::array<Member, MAX_INDEXED_MEMBERS> m_members{};
+        std::size_t                             m_memberCount = 0;
+        bool                                    m_overflow    = false;
+        std::string_view                        m_rawType;
+        QByteArray                              m_decodedType; // only when "type" contains escapes
+    };
+
+} // namespace bb
@@ -1,5 +1,7 @@
 #include "KeyringManager.hpp"
+#include "../../common/Trace.hpp"
 #include "../Agent.hpp"
+#include "../Metrics.hpp"
 
 #include <QJsonDocument>
 #include <QUuid>
@@ -8,34 +10,25 @@ namespace bb {
 
     KeyringManager::KeyringManager(QObject* parent) : QObject(parent) {}
 
-    void KeyringManager::handleRequest(const QJsonObject& msg, QLocalSocket* socket, pid_t peerPid) {
-        QString cookie = msg.value("cookie").toString();
-        if (cookie.isEmpty()) {
-            cookie = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    void KeyringManager::handleRequest(KeyringRequest request) {
+        if (request.cookie.isEmpty()) {
+            request.cookie = QUuid::createUuid().toString(QUuid::WithoutBraces);
         }
 
-        KeyringRequest request;
-        request.cookie  = cookie;
-        request.socket  = socket;
-        request.peerPid = peerPid;
-
-        if (msg.contains("title")) {
-            request.title = msg.value("title").toString();
-        } else {
-            request.title = msg.value("prompt").toString();
-        }
-
-        request.message = msg.value("message").toString();
-        request.choice  = msg.value("choice").toString();
-        request.flags   = msg.value("flags").toInt();
+        const QString cookie  = request.cookie;
+        const pid_t   peerPid = request.peerPid;
+        BB_TRACE_SCOPE("agent.keyring_request", cookie);
 
         m_pendingRequests[cookie] = request;
 
         // Resolve requestor
-        std::optional<ProcInfo> proc = RequestContextHelper::readProc(peerPid);
-        ActorInfo               actor;
-        if (proc) {
-            actor = RequestContextHelper::resolveRequestorFromSubject(*proc, getuid());
+        ActorInfo actor;
+        {
+            const metrics::ScopedTimer timer(metrics::Stage::RequestorResolve);
+            std::optional<ProcInfo>    proc = RequestContextHelper::readProc(peerPid);
+            if (proc) {
+                actor = RequestContextHelper::resolveRequestorFromSubject(*proc, getuid());
+            }
         }
 
         bb::Session::Context ctx;
@@ -52,18 +45,21 @@ namespace bb {
         g_pAgent->updateSessionPrompt(cookie, request.message, false);
     }
 
-    QJsonObject KeyringManager::handleResponse(const QString& cookie, const QString& response) {
+    QJsonObject KeyringManager::handleResponse(const QString& cookie) {
         auto it = m_pendingRequests.find(cookie);
         if (it == m_pendingRequests.end()) {
             return QJsonObject{{"type", "error"}, {"message", "Unknown cookie"}};
         }
 
+        BB_TRACE_EVENT("agent.keyring_response", cookie);
+        const qint64 receivedAt = it->receivedAt;
         m_pendingRequests.erase(it);
 
         // Close session via Agent
         g_pAgent->closeSession(cookie, bb::Session::Result::Success);
+        metrics::recordSince(metrics::Stage::KeyringRoundTrip, receivedAt);
 
-        return QJsonObject{{"type", "keyring_response"}, {"id", cookie}, {"result", "ok"}, {"password", response}};
+        return QJsonObject{{"type", "keyring_response"}, {"id", cookie}, {"result", "ok"}};
     }
 
     QJsonObject KeyringManager::handleCancel(const QString& cookie) {
@@ -80,6 +76,10 @@ namespace bb {
         return QJsonObject{{"type", "keyring_response"}, {"result", "cancelled"}, {"id", cookie}};
     }
 
+    QJsonObject KeyringManager::tableSizes() const {
+        return QJsonObject{{"keyring_pending", static_cast<qint64>(m_pendingRequests.size())}};
+    }
+
     bool KeyringManager::hasPendingRequest(const QString& cookie) const {
         return m_pendingRequests.contains(cookie);
     }
@@ -16,12 +16,13 @@ namespace bb {
       public:
         explicit KeyringManager(QObject* parent = nullptr);
 
-        // Process an incoming keyring request
-        void handleRequest(const QJsonObject& msg, QLocalSocket* socket, pid_t peerPid);
+        // Process an incoming keyring request (socket and peerPid already filled in)
+        void handleRequest(KeyringRequest request);
 
         // Process a response to a pending request
-        // Returns responseJson to be sent to the socket
-        QJsonObject handleResponse(const QString& cookie, const QString& response);
+        // Returns responseJson to be sent to the socket; the caller adds the
+        // password with IpcServer::sendSecret so it never enters the JSON object
+        QJsonObject handleResponse(const QString& cookie);
 
         // Process a cancellation
         QJsonObject handleCancel(const QString& cookie);
@@ -35,6 +36,9 @@ namespace bb {
         // Clean up requests for a disconnected socket
         void cleanupForSocket(QLocalSocket* socket);
 
+        // Entry count of each internal table, for leak checks
+        QJsonObject tableSizes() const;
+
       private:
         QHash<QString, KeyringRequest> m_pendingRequests;
     };
@@ -1,6 +1,8 @@
 #include "PinentryManager.hpp"
 #include "../Agent.hpp"
 #include "../../common/Constants.hpp"
+#include "../../common/Trace.hpp"
+#include "../Metrics.hpp"
 
 #include <QDebug>
 #include <QList>
@@ -9,91 +11,99 @@
 
 #include <optional>
 #include <unistd.h>
+#include <utility>
 
 namespace bb {
 
 namespace {
 
-PinentryRequest parsePinentryRequest(const QJsonObject& msg, QLocalSocket* socket, pid_t peerPid) {
-    PinentryRequest request;
-    request.cookie = msg.value("cookie").toString();
-    request.socket = socket;
-    request.peerPid = peerPid;
-
-    request.prompt = msg.value("prompt").toString();
-    if (request.prompt.isEmpty()) {
-        request.prompt = "Enter passphrase:";
-    }
-
-    request.description = msg.value("description").toString();
-
-    request.error = msg.value("error").toString();
-
-    request.keyinfo = msg.value("keyinfo").toString();
-
-    request.repeat = msg.value("repeat").toBool();
-
-    request.confirmOnly = msg.value("confirm_only").toBool();
-
-    return request;
+ProcInfo readPeer(pid_t peerPid) {
+    return RequestContextHelper::readProc(peerPid).value_or(ProcInfo{});
 }
 
-ActorInfo resolveActorForPid(pid_t peerPid) {
-    std::optional<ProcInfo> proc = RequestContextHelper::readProc(peerPid);
-    if (!proc) {
+ActorInfo resolveActor(const ProcInfo& peer) {
+    if (peer.pid == 0) {
         return {};
     }
 
-    return RequestContextHelper::resolveRequestorFromSubject(*proc, getuid());
+    const metrics::ScopedTimer timer(metrics::Stage::RequestorResolve);
+    return RequestContextHelper::resolveRequestorFromSubject(peer, getuid());
+}
+
+// The same pinentry binary, run by the same user and spawned by the same parent
+// (the gpg-agent). A peer whose /proc entry could not be read matches nothing.
+bool sameRequestor(const ProcInfo& a, const ProcInfo& b) {
+    return a.pid != 0 && b.pid != 0 && !a.exe.isEmpty() && a.exe == b.exe && a.uid == b.uid && a.ppid == b.ppid;
 }
 
 } // namespace
 
-PinentryManager::PinentryManager(QObject* parent) : QObject(parent) {}
+PinentryManager::PinentryManager(TimerWheel& timers, QObject* parent) : QObject(parent), m_timers(timers) {}
 
 PinentryManager::~PinentryManager() = default;
 
-void PinentryManager::handleRequest(const QJsonObject& msg, QLocalSocket* socket, pid_t peerPid) {
-    PinentryRequest request = parsePinentryRequest(msg, socket, peerPid);
+void PinentryManager::handleRequest(PinentryRequest request) {
     if (request.cookie.isEmpty()) {
         request.cookie = QUuid::createUuid().toString(QUuid::WithoutBraces);
     }
 
-    const QString cookie = request.cookie;
+    const QString cookie  = request.cookie;
+    const pid_t   peerPid = request.peerPid;
+    BB_TRACE_SCOPE("agent.pinentry_request", cookie);
 
-    if (m_flowOwners.contains(cookie) && m_flowOwners.value(cookie) != peerPid) {
+    auto [it, inserted] = m_flows.try_emplace(cookie);
+    Flow& flow = it->second;
+    if (inserted) {
+        flow.owner = peerPid;
+        flow.peer = readPeer(peerPid);
+        flow.timeout.setCallback([this, cookie]() { onTimeout(cookie); });
+    } else if (flow.owner != peerPid) {
         qWarning() << "Pinentry owner mismatch for cookie" << cookie << "expected pid"
-                   << m_flowOwners.value(cookie) << "got" << peerPid;
+                   << flow.owner << "got" << peerPid;
         return;
     }
 
-    m_flowOwners[cookie] = peerPid;
-    if (!request.keyinfo.isEmpty()) {
-        m_flowKeyinfos[cookie] = request.keyinfo;
+    // A coalesced request asking again (after a wrong passphrase) starts over
+    if (!flow.leader.isEmpty()) {
+        detachFollower(cookie, flow);
+    }
+
+    flow.request = std::move(request);
+    if (coalesce(cookie, flow)) {
+        return;
     }
 
-    const auto [curRetry, maxRetries] = resolveRetryInfo(request);
+    const auto [curRetry, maxRetries] = resolveRetryInfo(flow);
     const bool sessionExists = g_pAgent->getSession(cookie) != nullptr;
+    const bool reopened = flow.state == Flow::State::AwaitingOutcome;
+
+    // A retry the pinentry already reported has its error on the session
+    const bool shouldEmitRequestError = !flow.request.error.isEmpty() && !flow.retryReported;
+    flow.retryReported = false;
 
-    if (m_awaitingOutcome.contains(cookie)) {
-        cleanupAwaiting(cookie);
-        const QString retryError = request.error.isEmpty() ? QString("Authentication failed") : request.error;
+    flow.state = Flow::State::AwaitingInput;
+    m_timers.schedule(flow.timeout, PINENTRY_REQUEST_TIMEOUT_MS);
+
+    // Copied: the session calls below may re-enter and close this flow
+    const PinentryRequest req = flow.request;
+    const ProcInfo peer = flow.peer;
+
+    if (reopened) {
+        const QString retryError = req.error.isEmpty() ? QString("Authentication failed") : req.error;
         g_pAgent->updateSessionError(cookie, retryError);
     }
 
-    m_pendingRequests[cookie] = request;
-
     if (!sessionExists) {
-        const ActorInfo actor = resolveActorForPid(peerPid);
+        const ActorInfo actor = resolveActor(peer);
 
         Session::Context ctx;
-        ctx.message = request.prompt;
-        ctx.description = request.description;
-        ctx.keyinfo = request.keyinfo;
+        ctx.message = req.prompt;
+        ctx.description = req.description;
+        ctx.keyinfo = req.keyinfo;
         ctx.curRetry = curRetry;
         ctx.maxRetries = maxRetries;
-        ctx.confirmOnly = request.confirmOnly;
-        ctx.repeat = request.repeat;
+        ctx.confirmOnly = req.confirmOnly;
+        ctx.repeat = req.repeat;
         ctx.requestor.name = actor.displayName;
         ctx.requestor.icon = actor.iconName;
         ctx.requestor.fallbackLetter = actor.fallbackLetter;
@@ -105,77 +115,63 @@ void PinentryManager::handleRequest(const QJsonObject& msg, QLocalSocket* socket
         g_pAgent->updateSessionPinentryRetry(cookie, curRetry, maxRetries);
     }
 
-    g_pAgent->updateSessionPrompt(cookie, request.prompt, false, false);
-
-    bool shouldEmitRequestError = !request.error.isEmpty();
-    if (m_retryReported.contains(cookie)) {
-        if (shouldEmitRequestError) {
-            shouldEmitRequestError = false;
-        }
-        m_retryReported.remove(cookie);
-    }
+    g_pAgent->updateSessionPrompt(cookie, req.prompt, false, false);
 
     if (shouldEmitRequestError) {
-        g_pAgent->updateSessionError(cookie, request.error);
+        g_pAgent->updateSessionError(cookie, req.error);
     }
 }
 
-PinentryManager::ResponseResult PinentryManager::handleResponse(const QString& cookie, const QString& response) {
-    auto pendingIt = m_pendingRequests.find(cookie);
-    if (pendingIt == m_pendingRequests.end()) {
-        if (m_awaitingOutcome.contains(cookie)) {
+PinentryManager::ResponseResult PinentryManager::handleResponse(const QString& cookie, const SecretString& response) {
+    Flow* flow = findFlow(cookie);
+    if (!flow || flow->state != Flow::State::AwaitingInput) {
+        if (flow && flow->state == Flow::State::AwaitingOutcome) {
             return {QJsonObject{{"type", "error"}, {"message", "Session is already awaiting terminal result"}}};
         }
         return {QJsonObject{{"type", "error"}, {"message", "Unknown session"}}};
     }
 
-    PinentryRequest request = pendingIt.value();
-    m_pendingRequests.erase(pendingIt);
+    BB_TRACE_EVENT("agent.pinentry_response", cookie);
+    const qint64 receivedAt = flow->request.receivedAt;
 
     QJsonObject socketResponse;
     socketResponse["type"] = "pinentry_response";
     socketResponse["id"] = cookie;
-    if (request.confirmOnly) {
-        socketResponse["result"] = "confirmed";
-    } else {
-        socketResponse["result"] = "ok";
-        socketResponse["password"] = response;
-    }
+    socketResponse["result"] = flow->request.confirmOnly ? "confirmed" : "ok";
+    const bool withPassword = !flow->request.confirmOnly;
 
-    cleanupAwaiting(cookie);
+    startAwaiting(*flow);
+    releaseFollowers(*flow, socketResponse, withPassword ? &response : nullptr);
 
-    auto* timer = new QTimer(this);
-    timer->setSingleShot(true);
-    connect(timer, &QTimer::timeout, this, [this, cookie]() {
-        closeFlow(cookie, Session::Result::Error, "Pinentry did not report terminal result");
-    });
-
-    AwaitingOutcome awaiting;
-    awaiting.request = request;
-    awaiting.timer = timer;
-    m_awaitingOutcome[cookie] = awaiting;
-    timer->start(PINENTRY_RESULT_TIMEOUT_MS);
-
-    return {socketResponse};
+    metrics::recordSince(metrics::Stage::PinentryRoundTrip, receivedAt);
+    return {socketResponse, withPassword};
 }
 
-QJsonObject PinentryManager::handleResult(const QJsonObject& msg, pid_t peerPid) {
-    const QString cookie = msg.value("id").toString();
-    if (cookie.isEmpty()) {
-        return QJsonObject{{"type", "error"}, {"message", "Missing id"}};
-    }
+QJsonObject PinentryManager::handleResult(const PinentryResultRequest& request, pid_t peerPid) {
+    const QString& cookie = request.id;
 
-    if (!validateResultOwner(cookie, peerPid)) {
+    Flow* flow = findFlow(cookie);
+    if (flow && flow->owner != peerPid) {
         return QJsonObject{{"type", "error"}, {"message", "Result sender does not own session"}};
     }
 
+    // Coalesced requests have no session of their own; their outcome only ends their wait
+    if (flow && !flow->leader.isEmpty()) {
+        if (request.result == "retry") {
+            stopAwaiting(*flow);
+        } else {
+            closeFlow(cookie, Session::Result::Success);
+        }
+        return QJsonObject{{"type", "ok"}};
+    }
+
     Session* session = g_pAgent->getSession(cookie);
     if (!session || session->source() != Session::Source::Pinentry) {
         return QJsonObject{{"type", "error"}, {"message", "Unknown pinentry session"}};
     }
 
-    const QString result = msg.value("result").toString().toLower();
-    const QString error = msg.value("error").toString();
+    const QString& result = request.result;
+    const QString& error = request.error;
 
     if (result == "success") {
         closeFlow(cookie, Session::Result::Success);
@@ -183,9 +179,11 @@ QJsonObject PinentryManager::handleResult(const QJsonObject& msg, pid_t peerPid)
     }
 
     if (result == "retry") {
-        cleanupAwaiting(cookie);
+        if (flow) {
+            stopAwaiting(*flow);
+            flow->retryReported = true;
+        }
         const QString reason = error.isEmpty() ? QString("Authentication failed") : error;
-        m_retryReported.insert(cookie);
         g_pAgent->updateSessionError(cookie, reason);
         return QJsonObject{{"type", "ok"}};
     }
@@ -205,19 +203,7 @@ QJsonObject PinentryManager::handleResult(const QJsonObject& msg, pid_t peerPid)
 }
 
 QJsonObject PinentryManager::handleCancel(const QString& cookie) {
-    Session* session = g_pAgent->getSession(cookie);
-
-    if (m_pendingRequests.contains(cookie)) {
-        closeFlow(cookie, Session::Result::Cancelled);
-        return QJsonObject{{"type", "pinentry_response"}, {"id", cookie}, {"result", "cancelled"}};
-    }
-
-    if (m_awaitingOutcome.contains(cookie)) {
-        closeFlow(cookie, Session::Result::Cancelled);
-        return QJsonObject{{"type", "pinentry_response"}, {"id", cookie}, {"result", "cancelled"}};
-    }
-
-    if (session && session->source() == Session::Source::Pinentry) {
+    if (hasRequest(cookie)) {
         closeFlow(cookie, Session::Result::Cancelled);
         return QJsonObject{{"type", "pinentry_response"}, {"id", cookie}, {"result", "cancelled"}};
     }
@@ -226,11 +212,13 @@ QJsonObject PinentryManager::handleCancel(const QString& cookie) {
 }
 
 bool PinentryManager::hasPendingInput(const QString& cookie) const {
-    return m_pendingRequests.contains(cookie);
+    const Flow* flow = findFlow(cookie);
+    return flow && flow->state == Flow::State::AwaitingInput;
 }
 
 bool PinentryManager::hasRequest(const QString& cookie) const {
-    if (m_pendingRequests.contains(cookie) || m_awaitingOutcome.contains(cookie)) {
+    const Flow* flow = findFlow(cookie);
+    if (flow && (flow->state == Flow::State::AwaitingInput || flow->state == Flow::State::AwaitingOutcome)) {
         return true;
     }
 
@@ -239,88 +227,209 @@ bool PinentryManager::hasRequest(const QString& cookie) const {
 }
 
 bool PinentryManager::isAwaitingOutcome(const QString& cookie) const {
-    return m_awaitingOutcome.contains(cookie);
+    const Flow* flow = findFlow(cookie);
+    return flow && flow->state == Flow::State::AwaitingOutcome;
 }
 
 QLocalSocket* PinentryManager::getSocketForPendingInput(const QString& cookie) const {
-    auto it = m_pendingRequests.find(cookie);
-    if (it == m_pendingRequests.end()) {
+    const Flow* flow = findFlow(cookie);
+    if (!flow || flow->state != Flow::State::AwaitingInput) {
         return nullptr;
     }
 
-    return it->socket;
+    return flow->request.socket;
 }
 
 void PinentryManager::cleanupForSocket(QLocalSocket* socket) {
     QList<QString> cookiesToClose;
-    for (auto it = m_pendingRequests.cbegin(); it != m_pendingRequests.cend(); ++it) {
-        if (it->socket == socket) {
-            cookiesToClose.push_back(it.key());
+    for (auto it = m_flows.begin(); it != m_flows.end();) {
+        Flow& flow = it->second;
+        if (flow.request.socket != socket) {
+            ++it;
+            continue;
+        }
+
+        // A departed follower just stops waiting
+        if (flow.state == Flow::State::Following) {
+            detachFollower(it->first, flow);
+            it = m_flows.erase(it);
+            continue;
         }
+
+        cookiesToClose.push_back(it->first);
+        ++it;
     }
 
     for (const QString& cookie : cookiesToClose) {
+        Flow* flow = findFlow(cookie);
+        if (!flow) {
+            continue;
+        }
+
+        // The pinentry keeps one connection for its lifetime, so past the prompt a
+        // disconnect means no result or next request is coming
+        if (flow->state == Flow::State::AwaitingOutcome) {
+            closeFlow(cookie, Session::Result::Error, "Pinentry disconnected before reporting a result");
+            continue;
+        }
+
+        // The open or retried prompt is handed to the next coalesced request instead of cancelling everyone
+        const QList<QString> followers = std::exchange(flow->followers, {});
         closeFlow(cookie, Session::Result::Cancelled, "Pinentry disconnected");
+        promoteFollowers(followers);
     }
 }
 
-std::pair<int, int> PinentryManager::resolveRetryInfo(const PinentryRequest& request) {
-    int curRetry = 0;
-    int maxRetries = 3;
-    bool parsed = false;
+QJsonObject PinentryManager::tableSizes() const {
+    return QJsonObject{
+        {"pinentry_flows", static_cast<qint64>(m_flows.size())},
+    };
+}
 
+PinentryManager::Flow* PinentryManager::findFlow(const QString& cookie) {
+    auto it = m_flows.find(cookie);
+    return it == m_flows.end() ? nullptr : &it->second;
+}
+
+const PinentryManager::Flow* PinentryManager::findFlow(const QString& cookie) const {
+    auto it = m_flows.find(cookie);
+    return it == m_flows.end() ? nullptr : &it->second;
+}
+
+// Attempt counters come from gpg-agent's description; later prompts of the
+// same flow without them keep the last ones seen
+std::pair<int, int> PinentryManager::resolveRetryInfo(Flow& flow) {
     static const QRegularExpression retryRe(R"(\((\d+)\s+of\s+(\d+)\s+attempts\))");
-    const auto match = retryRe.match(request.description);
+    const auto match = retryRe.match(flow.request.description);
     if (match.hasMatch()) {
-        curRetry = match.captured(1).toInt();
-        maxRetries = match.captured(2).toInt();
-        parsed = true;
+        flow.curRetry = match.captured(1).toInt();
+        flow.maxRetries = match.captured(2).toInt();
     }
 
-    if (!request.keyinfo.isEmpty()) {
-        auto& info = m_retryInfo[request.keyinfo];
-        info.keyinfo = request.keyinfo;
+    const int curRetry = flow.curRetry < 0 ? 0 : flow.curRetry;
+    const int maxRetries = flow.maxRetries <= 0 ? 3 : flow.maxRetries;
+    return {curRetry, maxRetries};
+}
 
-        if (parsed) {
-            info.curRetry = curRetry;
-            info.maxRetries = maxRetries;
-        } else {
-            curRetry = info.curRetry;
-            maxRetries = info.maxRetries > 0 ? info.maxRetries : 3;
-        }
+// The pinentry gives up on an unanswered prompt after PINENTRY_REQUEST_TIMEOUT_MS;
+// the flow must not outlive it, nor an answered one whose result or retry never arrives
+void PinentryManager::onTimeout(const QString& cookie) {
+    Flow* flow = findFlow(cookie);
+    if (!flow) {
+        return;
     }
 
-    if (curRetry < 0) {
-        curRetry = 0;
+    if (flow->state == Flow::State::AwaitingInput) {
+        QLocalSocket* socket = flow->request.socket;
+        closeFlow(cookie, Session::Result::Cancelled, "Pinentry request timed out");
+        emit deferredReply(socket, QJsonObject{{"type", "pinentry_response"}, {"id", cookie}, {"result", "cancelled"}}, nullptr);
+        return;
     }
-    if (maxRetries <= 0) {
-        maxRetries = 3;
+
+    if (flow->state == Flow::State::Retrying) {
+        // Requests that joined the retry were never prompted; they ask on their own
+        const QList<QString> followers = std::exchange(flow->followers, {});
+        closeFlow(cookie, Session::Result::Error, "Pinentry did not ask again after a retry");
+        promoteFollowers(followers);
+        return;
     }
 
-    return {curRetry, maxRetries};
+    closeFlow(cookie, Session::Result::Error, "Pinentry did not report terminal result");
+}
+
+void PinentryManager::startAwaiting(Flow& flow) {
+    flow.state = Flow::State::AwaitingOutcome;
+    m_timers.schedule(flow.timeout, PINENTRY_RESULT_TIMEOUT_MS);
+}
+
+void PinentryManager::stopAwaiting(Flow& flow) {
+    if (flow.state != Flow::State::AwaitingOutcome) {
+        return;
+    }
+
+    flow.state = Flow::State::Retrying;
+    m_timers.schedule(flow.timeout, PINENTRY_RETRY_TIMEOUT_MS);
 }
 
-bool PinentryManager::validateResultOwner(const QString& cookie, pid_t peerPid) const {
-    auto ownerIt = m_flowOwners.find(cookie);
-    if (ownerIt == m_flowOwners.end()) {
+// Joins an open prompt for the same key instead of opening a second one. Only
+// plain passphrase prompts from the same requestor qualify (the answer is sent to
+// every follower), and never a request whose cookie already has a session. A
+// prompt whose pinentry is about to ask again after a retry counts as open: the
+// follower is answered by the retried attempt.
+bool PinentryManager::coalesce(const QString& cookie, Flow& flow) {
+    const PinentryRequest& request = flow.request;
+    if (request.keyinfo.isEmpty() || request.confirmOnly || g_pAgent->getSession(cookie)) {
+        return false;
+    }
+
+    for (auto& [leaderCookie, leader] : m_flows) {
+        const bool open = leader.state == Flow::State::AwaitingInput || (leader.state == Flow::State::Retrying && leader.leader.isEmpty());
+        if (&leader == &flow || !open || leader.request.keyinfo != request.keyinfo || leader.request.confirmOnly || leader.request.repeat != request.repeat ||
+            !sameRequestor(leader.peer, flow.peer)) {
+            continue;
+        }
+
+        BB_TRACE_EVENT("agent.pinentry_coalesced", cookie);
+        leader.followers.append(cookie);
+        flow.timeout.cancel();
+        flow.state = Flow::State::Following;
+        flow.leader = leaderCookie;
         return true;
     }
 
-    return ownerIt.value() == peerPid;
+    return false;
 }
 
-void PinentryManager::cleanupAwaiting(const QString& cookie) {
-    auto it = m_awaitingOutcome.find(cookie);
-    if (it == m_awaitingOutcome.end()) {
-        return;
+void PinentryManager::detachFollower(const QString& cookie, Flow& flow) {
+    if (Flow* leader = findFlow(flow.leader)) {
+        leader->followers.removeOne(cookie);
+    }
+
+    flow.leader.clear();
+    flow.timeout.cancel();
+}
+
+// Sends the session's reply to every request coalesced into it. Answered followers
+// then wait for their own terminal result; cancelled ones are done.
+void PinentryManager::releaseFollowers(Flow& leader, const QJsonObject& reply, const SecretString* password) {
+    const QList<QString> followers = std::exchange(leader.followers, {});
+    const bool           answered  = reply.value("result").toString() != "cancelled";
+
+    // Sent only once the table is settled: a failed write may re-enter cleanupForSocket
+    QList<std::pair<QLocalSocket*, QJsonObject>> replies;
+    for (const QString& cookie : followers) {
+        auto it = m_flows.find(cookie);
+        if (it == m_flows.end() || it->second.state != Flow::State::Following) {
+            continue;
+        }
+
+        QJsonObject forwarded = reply;
+        forwarded["id"]       = cookie;
+        replies.append({it->second.request.socket, forwarded});
+
+        if (answered) {
+            startAwaiting(it->second);
+        } else {
+            m_flows.erase(it);
+        }
     }
 
-    if (it->timer) {
-        it->timer->stop();
-        it->timer->deleteLater();
+    for (const auto& [socket, forwarded] : replies) {
+        emit deferredReply(socket, forwarded, password);
     }
+}
 
-    m_awaitingOutcome.erase(it);
+// Requests left waiting on a prompt that will not be answered ask again on their
+// own: the first opens a prompt and the rest coalesce into it
+void PinentryManager::promoteFollowers(const QList<QString>& followers) {
+    for (const QString& cookie : followers) {
+        Flow* follower = findFlow(cookie);
+        if (!follower || follower->state != Flow::State::Following) {
+            continue;
+        }
+        follower->leader.clear();
+        handleRequest(follower->request);
+    }
 }
 
 void PinentryManager::closeFlow(const QString& cookie, Session::Result result, const QString& error) {
@@ -332,15 +441,17 @@ void PinentryManager::closeFlow(const QString& cookie, Session::Result result, c
         g_pAgent->closeSession(cookie, result);
     }
 
-    m_pendingRequests.remove(cookie);
-    cleanupAwaiting(cookie);
-    m_flowOwners.remove(cookie);
-    m_retryReported.remove(cookie);
+    Flow* flow = findFlow(cookie);
+    if (!flow) {
+        return;
+    }
 
-    const QString keyinfo = m_flowKeyinfos.take(cookie);
-    if (!keyinfo.isEmpty()) {
-        m_retryInfo.remove(keyinfo);
+    if (!flow->leader.isEmpty()) {
+        detachFollower(cookie, *flow);
     }
+    releaseFollowers(*flow, QJsonObject{{"type", "pinentry_response"}, {"id", cookie}, {"result", "cancelled"}});
+
+    m_flows.erase(cookie);
 }
 
 } // namespace bb
@@ -3,12 +3,12 @@
 #include "RequestTypes.hpp"
 #include "../RequestContext.hpp"
 #include "../Session.hpp"
+#include "../TimerWheel.hpp"
 
-#include <QHash>
+#include <QList>
 #include <QObject>
-#include <QSet>
-#include <QTimer>
 
+#include <unordered_map>
 #include <utility>
 
 namespace bb {
@@ -17,20 +17,23 @@ namespace bb {
         Q_OBJECT
 
       public:
-        explicit PinentryManager(QObject* parent = nullptr);
+        // Flow timeouts are armed on `timers`, which must outlive the manager
+        explicit PinentryManager(TimerWheel& timers, QObject* parent = nullptr);
         ~PinentryManager() override;
 
-        // Process incoming pinentry request
-        void handleRequest(const QJsonObject& msg, QLocalSocket* socket, pid_t peerPid);
+        // Process incoming pinentry request (socket and peerPid already filled in)
+        void handleRequest(PinentryRequest request);
 
-        // Process response for pending user input
+        // Process response for pending user input. The password is not copied into
+        // socketResponse; when withPassword is set the caller sends it alongside.
         struct ResponseResult {
             QJsonObject socketResponse;
+            bool        withPassword = false;
         };
-        ResponseResult handleResponse(const QString& cookie, const QString& response);
+        ResponseResult handleResponse(const QString& cookie, const SecretString& response);
 
         // Process terminal result from pinentry mode
-        QJsonObject handleResult(const QJsonObject& msg, pid_t peerPid);
+        QJsonObject handleResult(const PinentryResultRequest& request, pid_t peerPid);
 
         // Process cancellation
         QJsonObject handleCancel(const QString& cookie);
@@ -44,24 +47,58 @@ namespace bb {
         // Cleanup
         void cleanupForSocket(QLocalSocket* socket);
 
+        // Entry count of each internal table, for leak checks
+        QJsonObject tableSizes() const;
+
+      Q_SIGNALS:
+        // A reply the caller of handleResponse/handleCancel does not know about: for a
+        // coalesced request, or for a prompt that timed out. A non-null password is sent
+        // as the reply's "password" member; it is only valid for the call.
+        void deferredReply(QLocalSocket* socket, const QJsonObject& reply, const bb::SecretString* password);
+
       private:
-        struct AwaitingOutcome {
-            PinentryRequest request;
-            QTimer*         timer = nullptr;
+        // One record per cookie, from the first request to the terminal result.
+        //
+        //   AwaitingInput   -> session is prompting; the pinentry waits on request.socket until `timeout`
+        //   Following       -> coalesced into `leader`'s prompt (or the retry it is about to reopen), waiting for its answer
+        //   AwaitingOutcome -> answered; `timeout` runs until the pinentry reports back
+        //   Retrying        -> the pinentry reported "retry"; its next request reopens the prompt before `timeout`
+        struct Flow {
+            enum class State {
+                AwaitingInput,
+                Following,
+                AwaitingOutcome,
+                Retrying
+            };
+
+            State             state         = State::AwaitingInput;
+            PinentryRequest   request;
+            pid_t             owner         = 0;
+            ProcInfo          peer;                  // owner's /proc entry, read once; coalescing requires a match
+            int               curRetry      = 0;
+            int               maxRetries    = 0;
+            bool              retryReported = false; // the retry error is already on the session
+            QString           leader;                // set while coalesced, until the terminal result
+            QList<QString>    followers;             // cookies coalesced into this flow's prompt
+            TimerWheel::Entry timeout;
         };
 
-        std::pair<int, int> resolveRetryInfo(const PinentryRequest& request);
-        bool                validateResultOwner(const QString& cookie, pid_t peerPid) const;
+        Flow*               findFlow(const QString& cookie);
+        const Flow*         findFlow(const QString& cookie) const;
+
+        std::pair<int, int> resolveRetryInfo(Flow& flow);
 
-        void cleanupAwaiting(const QString& cookie);
-        void closeFlow(const QString& cookie, Session::Result result, const QString& error = {});
+        void                onTimeout(const QString& cookie);
+        void                startAwaiting(Flow& flow);
+        void                stopAwaiting(Flow& flow);
+        bool                coalesce(const QString& cookie, Flow& flow);
+        void                detachFollower(const QString& cookie, Flow& flow);
+        void                releaseFollowers(Flow& leader, const QJsonObject& reply, const SecretString* password = nullptr);
+        void                promoteFollowers(const QList<QString>& followers);
+        void                closeFlow(const QString& cookie, Session::Result result, const QString& error = {});
 
-        QHash<QString, PinentryRequest>    m_pendingRequests;
-        QHash<QString, AwaitingOutcome>    m_awaitingOutcome;
-        QHash<QString, PinentryRetryInfo>  m_retryInfo;
-        QHash<QString, pid_t>              m_flowOwners;
-        QHash<QString, QString>            m_flowKeyinfos;
-        QSet<QString>                      m_retryReported;
+        TimerWheel&                       m_timers;
+        std::unordered_map<QString, Flow> m_flows;
     };
 
 } // namespace bb
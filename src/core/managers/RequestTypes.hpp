@@ -1,5 +1,8 @@
 #pragma once
 
+#include "../../common/SecureMemory.hpp"
+#include "../ipc/JsonMessage.hpp"
+
 #include <QJsonObject>
 #include <QLocalSocket>
 #include <QString>
@@ -9,8 +12,9 @@ namespace bb {
     // Base information common to all request types
     struct BaseRequest {
         QString       cookie;
-        QLocalSocket* socket  = nullptr;
-        pid_t         peerPid = -1;
+        QLocalSocket* socket     = nullptr;
+        pid_t         peerPid    = -1;
+        qint64        receivedAt = 0; // metrics::now() when the request was read
     };
 
     struct KeyringRequest : BaseRequest {
@@ -29,13 +33,41 @@ namespace bb {
         bool    confirmOnly = false;
     };
 
-    // Retry tracking for pinentry
-    struct PinentryRetryInfo {
-        QString keyinfo;
-        int     curRetry   = 0;
-        int     maxRetries = 0;
+    // Terminal outcome reported by pinentry mode (pinentry_result)
+    struct PinentryResultRequest {
+        QString id;
+        QString result; // lower-cased: success, retry, cancelled/canceled, error
+        QString error;
+    };
+
+    // UI reply to a prompting session (session.respond)
+    // The response never exists as a QString; it is decoded into the secure arena
+    struct SessionRespondRequest {
+        QString      id;
+        SecretString response;
+    };
+
+    // UI cancellation of a session (session.cancel)
+    struct SessionCancelRequest {
+        QString id;
+    };
+
+    // Event queue poll (next). Without "max" or "wait_ms" the reply is a single
+    // bare event, sent whenever one arrives
+    struct NextRequest {
+        int waitMs = -1; // how long to hold an empty poll open; -1 means until an event arrives
+        int max    = 0;  // events per "events" batch; 0 selects the single-event reply
     };
 
+    // Requests run back to back and answered with one reply (batch). Each message
+    // views the batch's line, so the request must not outlive the call.
+    struct BatchRequest {
+        QList<JsonMessage> requests;
+    };
+
+    // Message types that carry no payload beyond "type"
+    struct EmptyRequest {};
+
     // Event types for the UI queue
     struct RequestEvent {
         QString     type; // "request", "error", "complete"
@@ -1,9 +1,13 @@
 #include "FallbackClient.hpp"
+#include "../common/Trace.hpp"
 
 #include <QDateTime>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonParseError>
 
+#include <algorithm>
+
 namespace bb {
 
     FallbackClient::FallbackClient(const QString& socketPath, QObject* parent) : QObject(parent), m_socketPath(socketPath) {
@@ -21,8 +25,8 @@ namespace bb {
             emit connectionStateChanged(true);
             emit statusMessage("Connected to auth daemon");
 
-            registerProvider();
-            subscribe();
+            // One round trip; the watchdog repeats whichever half a daemon without batch ignored
+            sendJson(QJsonObject{{"type", "batch"}, {"requests", QJsonArray{registerRequest(), QJsonObject{{"type", "subscribe"}}}}});
         });
 
         connect(&m_socket, &QLocalSocket::disconnected, this, [this]() {
@@ -44,19 +48,23 @@ namespace bb {
         });
 
         connect(&m_socket, &QLocalSocket::readyRead, this, [this]() {
-            m_buffer.append(m_socket.readAll());
-
- qsizetype newline = -1;
-            while ((newline = m_buffer.indexOf('\n')) != -1) {
-                QByteArray line = m_buffer.left(newline).trimmed();
-                m_buffer.remove(0, static_cast<qsizetype>(newline + 1));
-
+            const qint64 available = m_socket.bytesAvailable();
+            const qint64 got       = m_socket.read(m_buffer.spare(static_cast<std::size_t>(available)), available);
+            m_buffer.commit(static_cast<std::size_t>(std::max<qint64>(got, 0)));
+
+            qsizetype newline = -1;
+            while ((newline = m_buffer.view().indexOf('\n')) != -1) {
+                // Parsed in place; the line is wiped before its message is handled
+                const QByteArrayView line = m_buffer.view().first(newline).trimmed();
                 if (line.isEmpty()) {
+                    m_buffer.removePrefix(static_cast<std::size_t>(newline + 1));
                     continue;
                 }
 
                 QJsonParseError     parseError;
-                const QJsonDocument doc = QJsonDocument::fromJson(line, &parseError);
+                const QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromRawData(line.data(), line.size()), &parseError);
+                m_buffer.removePrefix(static_cast<std::size_t>(newline + 1));
+
                 if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
                     emit statusMessage("Invalid daemon payload");
                     continue;
@@ -119,11 +127,13 @@ namespace bb {
     }
 
     void FallbackClient::sendResponse(const QString& id, const QString& response) {
+        BB_TRACE_EVENT("fallback.respond", id);
         QJsonObject req{{"type", "session.respond"}, {"id", id}, {"response", response}};
         sendJson(req);
     }
 
     void FallbackClient::sendCancel(const QString& id) {
+        BB_TRACE_EVENT("fallback.cancel", id);
         QJsonObject req{{"type", "session.cancel"}, {"id", id}};
         sendJson(req);
     }
@@ -141,15 +151,20 @@ namespace bb {
             return;
         }
 
+        // session.respond carries what the user typed
         QByteArray payload = QJsonDocument(json).toJson(QJsonDocument::Compact);
+        ScopedWipe wipePayload(payload);
         payload.append('\n');
         m_socket.write(payload);
         m_socket.flush();
     }
 
+    QJsonObject FallbackClient::registerRequest() {
+        return QJsonObject{{"type", "ui.register"}, {"name", "bb-auth-fallback"}, {"kind", "fallback"}, {"priority", 10}};
+    }
+
     void FallbackClient::registerProvider() {
-        QJsonObject reg{{"type", "ui.register"}, {"name", "bb-auth-fallback"}, {"kind", "fallback"}, {"priority", 10}};
-        sendJson(reg);
+        sendJson(registerRequest());
     }
 
     void FallbackClient::subscribe() {
@@ -191,6 +206,13 @@ namespace bb {
     void FallbackClient::handleMessage(const QJsonObject& msg) {
         const QString type = msg.value("type").toString();
 
+        if (type == "batch") {
+            for (const QJsonValue& reply : msg.value("replies").toArray()) {
+                handleMessage(reply.toObject());
+            }
+            return;
+        }
+
         if (type == "subscribed") {
             m_subscribed = true;
             if (msg.contains("active")) {
@@ -267,6 +289,7 @@ namespace bb {
         }
 
         if (type == "session.created") {
+            BB_TRACE_SCOPE("fallback.session_created", msg.value("id").toString());
             emit sessionCreated(msg);
         } else if (type == "session.updated") {
             emit sessionUpdated(msg);
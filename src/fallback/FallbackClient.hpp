@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../common/SecureMemory.hpp"
+
 #include <QByteArray>
 #include <QJsonObject>
 #include <QLocalSocket>
@@ -34,6 +36,7 @@ class FallbackClient : public QObject {
   private:
     void ensureConnected();
     void sendJson(const QJsonObject& json);
+    static QJsonObject registerRequest();
     void registerProvider();
     void subscribe();
     void setProviderActive(bool active);
@@ -42,7 +45,7 @@ class FallbackClient : public QObject {
 
     QString      m_socketPath;
     QLocalSocket m_socket;
-    QByteArray   m_buffer;
+    SecretString m_buffer; // received, not yet parsed; wiped as lines are consumed
 
     QTimer       m_reconnectTimer;
     QTimer       m_subscribeWatchdog;
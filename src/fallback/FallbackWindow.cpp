@@ -1,252 +1,40 @@
 #include "FallbackWindow.hpp"
 
+#include "prompt/TextNormalize.hpp"
+
 #include <QCloseEvent>
 #include <QAction>
 #include <QCoreApplication>
-#include <QFileInfo>
 #include <QHBoxLayout>
 #include <QJsonObject>
 #include <QLabel>
 #include <QKeySequence>
 #include <QLineEdit>
 #include <QPushButton>
-#include <QRegularExpression>
 #include <QSizePolicy>
 #include <QTimer>
 #include <QVBoxLayout>
 
 namespace {
 
-    QString normalizeDetailText(const QString& text) {
-        QString normalized = text;
-        normalized.replace('\r', '\n');
-        QStringList lines = normalized.split('\n');
-        QStringList cleaned;
-        cleaned.reserve(lines.size());
-        for (const QString& line : lines) {
-            const QString simplified = line.simplified();
-            if (!simplified.isEmpty()) {
-                cleaned << simplified;
-            }
-        }
-
-        return cleaned.join("\n");
-    }
-
-    QString normalizeCompareText(const QString& text) {
-        QString normalized = normalizeDetailText(text).toLower();
-        normalized.replace('`', ' ');
-        normalized.replace('"', ' ');
-        normalized.replace(',', ' ');
-        normalized.replace('.', ' ');
-        normalized = normalized.simplified();
-        return normalized;
-    }
-
-    bool textEquivalent(const QString& left, const QString& right) {
-        const QString a = normalizeCompareText(left);
-        const QString b = normalizeCompareText(right);
-        if (a.isEmpty() || b.isEmpty()) {
+    // Both return whether anything visible changed
+    bool updateLabel(QLabel* label, const QString& text) {
+        if (label->text() == text) {
             return false;
         }
 
-        return a == b || a.startsWith(b) || b.startsWith(a);
-    }
-
-    QString firstMeaningfulLine(const QString& text) {
-        const QString cleaned = normalizeDetailText(text);
-        if (cleaned.isEmpty()) {
-            return QString();
-        }
-
-        const int newline = cleaned.indexOf('\n');
-        if (newline == -1) {
-            return cleaned;
-        }
-
-        return cleaned.left(newline);
-    }
-
-    QString captureFirst(const QString& text, const QRegularExpression& regex) {
-        const QRegularExpressionMatch match = regex.match(text);
-        if (!match.hasMatch()) {
-            return QString();
-        }
-
-        return match.captured(1).trimmed();
-    }
-
-    QString cleanIdentity(QString identity) {
-        identity = identity.simplified();
-        identity.replace(" (github)", "", Qt::CaseInsensitive);
-        return identity.trimmed();
-    }
-
-    QString trimToLength(const QString& text, int maxChars) {
-        if (text.size() <= maxChars) {
-            return text;
-        }
-
-        return text.left(maxChars - 3).trimmed() + "...";
-    }
-
-    bool isLowSignalCommand(const QString& commandName) {
-        const QString normalized = commandName.trimmed().toLower();
-        if (normalized.isEmpty()) {
-            return true;
-        }
-
-        static const QStringList lowSignal = {QStringLiteral("true"), QStringLiteral("sh"), QStringLiteral("bash")};
-        return lowSignal.contains(normalized);
-    }
-
-    bool isIdentityLine(const QString& line) {
-        return line.contains('"') && line.contains('<') && line.contains('>');
-    }
-
-    bool isKeyMetadataLine(const QString& line) {
-        const QString lower = line.toLower();
-        return (lower.contains(" id ") || lower.startsWith("id ")) && lower.contains("created");
-    }
-
-    bool containsAnyTerm(const QString& text, std::initializer_list<const char*> terms) {
-        const QString lower = text.toLower();
-        for (const char* term : terms) {
-            if (lower.contains(QString::fromLatin1(term))) {
-                return true;
-            }
-        }
-        return false;
-    }
-
-    bool looksLikeFingerprintPrompt(const QString& text) {
-        return containsAnyTerm(text, {"fingerprint", "finger print", "fprint", "swipe", "scan your finger"});
-    }
-
-    bool looksLikeFidoPrompt(const QString& text) {
-        return containsAnyTerm(text, {"fido", "fido2", "webauthn", "security key", "yubikey", "hardware token", "user presence"});
-    }
-
-    bool looksLikeTouchPrompt(const QString& text) {
-        return containsAnyTerm(text, {"touch", "tap", "insert", "use your security key", "verify your identity"});
+        label->setText(text);
+        return true;
     }
 
-    QString extractCommandName(const QString& message) {
-        const QRegularExpression explicitRunRegex(R"(run\s+[`'"]([^`'"\s]+)[`'"])", QRegularExpression::CaseInsensitiveOption);
-        QString                  command = captureFirst(message, explicitRunRegex);
-
-        if (command.isEmpty()) {
-            const QRegularExpression pathRegex(R"((/[A-Za-z0-9_\-\./]+))");
-            command = captureFirst(message, pathRegex);
-        }
-
-        if (command.isEmpty()) {
-            return QString();
-        }
-
-        const QString commandName = QFileInfo(command).fileName();
-        return commandName.isEmpty() ? command : commandName;
-    }
-
-    QString extractUnlockTarget(const QString& text) {
-        const QString normalized = normalizeDetailText(text);
-        if (normalized.isEmpty()) {
-            return QString();
-        }
-
-        const QRegularExpression unlockRegex(R"(unlock\s+([^\n]+))", QRegularExpression::CaseInsensitiveOption);
-        QString                  target = captureFirst(normalized, unlockRegex);
-        if (target.isEmpty()) {
-            return QString();
-        }
-
-        target = target.trimmed();
-        if (target.endsWith('.')) {
-            target.chop(1);
-        }
-
-        return target.trimmed();
-    }
-
-    QString uniqueJoined(const QStringList& values) {
-        QStringList filtered;
-        filtered.reserve(values.size());
-        for (const QString& value : values) {
-            const QString simplified = value.trimmed();
-            if (simplified.isEmpty()) {
-                continue;
-            }
-
-            bool duplicate = false;
-            for (const QString& existing : filtered) {
-                if (textEquivalent(existing, simplified)) {
-                    duplicate = true;
-                    break;
-                }
-            }
-
-            if (!duplicate) {
-                filtered << simplified;
-            }
-        }
-
-        return filtered.join("\n");
-    }
-
-    QString extractUnlockTargetFromContext(const QJsonObject& context) {
-        QString target = extractUnlockTarget(context.value("keyringName").toString());
-        if (target.isEmpty()) {
-            target = extractUnlockTarget(context.value("message").toString());
-        }
-        if (target.isEmpty()) {
-            target = extractUnlockTarget(context.value("description").toString());
-        }
-        return target;
-    }
-
-    bool isTemplateUnlockLine(const QString& line, const QString& target) {
-        const QString normalized = normalizeCompareText(line);
-        if (normalized.isEmpty()) {
-            return true;
-        }
-
-        const QString normalizedTarget = normalizeCompareText(target);
-        if (!normalizedTarget.isEmpty() && normalized == normalizedTarget) {
-            return true;
-        }
-
-        if (!normalizedTarget.isEmpty() && normalized.contains("unlock") && normalized.contains(normalizedTarget)) {
-            if (normalized.startsWith("authenticate to unlock") || normalized.startsWith("unlock") || normalized.startsWith("use your password to unlock") ||
-                normalized.startsWith("use your account password to unlock")) {
-                return true;
-            }
-        }
-
-        return false;
-    }
-
-    QString buildUnlockDetails(const QJsonObject& context, const QString& target) {
-        QStringList       details;
-
-        const QStringList candidates = {normalizeDetailText(context.value("description").toString()), normalizeDetailText(context.value("message").toString()),
-                                        normalizeDetailText(context.value("keyringName").toString())};
-
-        for (const QString& candidate : candidates) {
-            if (candidate.isEmpty()) {
-                continue;
-            }
-
-            const QStringList lines = candidate.split('\n');
-            for (const QString& rawLine : lines) {
-                const QString line = rawLine.trimmed();
-                if (line.isEmpty() || isTemplateUnlockLine(line, target)) {
-                    continue;
-                }
-                details << line;
-            }
+    bool updateOptionalLabel(QLabel* label, const QString& text) {
+        if (label->text() == text && label->isHidden() == text.isEmpty()) {
+            return false;
         }
 
-        return uniqueJoined(details);
+        label->setText(text);
+        label->setVisible(!text.isEmpty());
+        return true;
     }
 
     QPair<QString, bool> collapseDetailText(const QString& text, int maxLines, int maxChars) {
@@ -357,13 +145,13 @@ namespace bb {
         m_input->setMinimumHeight(38);
         m_input->setTextMargins(12, 0, 12, 0);
         m_input->setPlaceholderText("Enter password");
-        auto* togglePasswordAction = m_input->addAction("Show", QLineEdit::TrailingPosition);
-        togglePasswordAction->setCheckable(true);
-        togglePasswordAction->setToolTip("Show password");
-        connect(togglePasswordAction, &QAction::toggled, this, [this, togglePasswordAction](bool checked) {
+        m_togglePasswordAction = m_input->addAction("Show", QLineEdit::TrailingPosition);
+        m_togglePasswordAction->setCheckable(true);
+        m_togglePasswordAction->setToolTip("Show password");
+        connect(m_togglePasswordAction, &QAction::toggled, this, [this](bool checked) {
             m_input->setEchoMode(checked ? QLineEdit::Normal : QLineEdit::Password);
-            togglePasswordAction->setText(checked ? "Hide" : "Show");
-            togglePasswordAction->setToolTip(checked ? "Hide password" : "Show password");
+            m_togglePasswordAction->setText(checked ? "Hide" : "Show");
+            m_togglePasswordAction->setToolTip(checked ? "Hide password" : "Show password");
         });
         m_errorLabel = new QLabel(m_contentWidget);
         m_errorLabel->setWordWrap(true);
@@ -467,6 +255,8 @@ namespace bb {
                     setStatusText("Connected");
                 }
             } else {
+                // Sessions that close while disconnected are never reported; the resubscribe replays the rest
+                m_modelCache.clear();
                 setStatusText("Disconnected from daemon, reconnecting...");
                 setBusy(true);
             }
@@ -481,6 +271,7 @@ namespace bb {
                 return;
             }
 
+            m_modelCache.clear();
             if (!m_currentSessionId.isEmpty()) {
                 clearSession();
             }
@@ -490,46 +281,35 @@ namespace bb {
 
         connect(m_client, &FallbackClient::statusMessage, this, [this](const QString& status) { setStatusText(status); });
 
-        connect(m_client, &FallbackClient::sessionCreated, this, [this, togglePasswordAction](const QJsonObject& event) {
+        connect(m_client, &FallbackClient::sessionCreated, this, [this](const QJsonObject& event) {
             const QString id = event.value("id").toString();
             if (id.isEmpty()) {
                 return;
             }
 
-            m_currentSessionId             = id;
-            m_confirmOnly                  = event.value("context").toObject().value("confirmOnly").toBool();
-            m_allowEmptyResponse           = false;
-            const PromptDisplayModel model = buildDisplayModel(event);
-            configureSizingForIntent(model.intent);
+            const fallback::prompt::PromptView& view = m_modelCache.created(event);
+
+            // Every resubscribe replays the session on screen; keep what has been typed so far
+            if (id == m_currentSessionId) {
+                applyView(view, false);
+                setBusy(false);
+                return;
+            }
 
-            m_titleLabel->setText(model.title);
-            m_summaryLabel->setText(model.summary);
-            m_summaryLabel->setVisible(!model.summary.isEmpty());
-            m_requestorLabel->setText(model.requestor);
-            m_requestorLabel->setVisible(!model.requestor.isEmpty());
-            setDetailsText(model.details);
-            m_promptLabel->setText(model.prompt);
+            m_currentSessionId = id;
+            m_confirmOnly      = view.confirmOnly;
 
             m_input->clear();
             m_input->setEchoMode(QLineEdit::Password);
-            togglePasswordAction->setChecked(false);
-            togglePasswordAction->setText("Show");
-            togglePasswordAction->setToolTip("Show password");
-            togglePasswordAction->setVisible(!m_confirmOnly);
-            togglePasswordAction->setEnabled(!m_confirmOnly);
+            m_togglePasswordAction->setChecked(false);
+            m_togglePasswordAction->setText("Show");
+            m_togglePasswordAction->setToolTip("Show password");
+            m_togglePasswordAction->setVisible(!m_confirmOnly);
+            m_togglePasswordAction->setEnabled(!m_confirmOnly);
             m_input->setVisible(!m_confirmOnly);
             m_promptLabel->setVisible(!m_confirmOnly);
-            const bool    passphrasePrompt = model.passphrasePrompt;
-            const QString placeholder =
-                model.allowEmptyResponse ? QString("Press Enter to continue (optional)") : (passphrasePrompt ? QString("Enter passphrase") : QString("Enter password"));
-            m_input->setPlaceholderText(m_confirmOnly ? QString() : placeholder);
-            m_submitButton->setText(m_confirmOnly ? "Confirm" : (model.allowEmptyResponse ? "Continue" : "Authenticate"));
-            m_allowEmptyResponse = model.allowEmptyResponse;
-
-            setErrorText("");
-            setStatusText("");
+            applyView(view, true);
             setBusy(false);
-            ensureContentFits();
 
             stopIdleExitTimer();
             show();
@@ -543,62 +323,14 @@ namespace bb {
             }
         });
 
-        connect(m_client, &FallbackClient::sessionUpdated, this, [this, togglePasswordAction](const QJsonObject& event) {
-            const QString id = event.value("id").toString();
-            if (id.isEmpty() || id != m_currentSessionId) {
+        connect(m_client, &FallbackClient::sessionUpdated, this, [this](const QJsonObject& event) {
+            const QString                       id   = event.value("id").toString();
+            const fallback::prompt::PromptView* view = m_modelCache.updated(event);
+            if (!view || id != m_currentSessionId) {
                 return;
             }
 
-            const QString prompt = event.value("prompt").toString();
-            if (!prompt.isEmpty()) {
-                m_promptLabel->setText(prompt);
-            }
-
-            const QString info              = event.value("info").toString().trimmed();
-            const QString hint              = prompt + "\n" + info;
-            const bool    fingerprintPrompt = looksLikeFingerprintPrompt(hint);
-            const bool    fidoPrompt        = looksLikeFidoPrompt(hint);
-            const bool    touchPrompt       = fingerprintPrompt || fidoPrompt || looksLikeTouchPrompt(hint);
-
-            if (fingerprintPrompt) {
-                m_titleLabel->setText("Verify Fingerprint");
-            } else if (fidoPrompt) {
-                m_titleLabel->setText("Use Security Key");
-            }
-
-            if (!m_confirmOnly) {
-                m_allowEmptyResponse = touchPrompt;
-                if (touchPrompt) {
-                    m_promptLabel->setText("Press Enter to continue (or wait)");
-                    m_input->setPlaceholderText("Press Enter to continue (optional)");
-                    m_submitButton->setText("Continue");
-                } else {
-                    const bool passphrasePrompt = m_promptLabel->text().contains("passphrase", Qt::CaseInsensitive);
-                    m_input->setPlaceholderText(passphrasePrompt ? QString("Enter passphrase") : QString("Enter password"));
-                    m_submitButton->setText("Authenticate");
-                }
-            }
-
-            if (!info.isEmpty()) {
-                setStatusText(info);
-            }
-
-            if (event.contains("echo")) {
-                const bool echo = event.value("echo").toBool();
-                togglePasswordAction->setChecked(echo);
-            }
-
-            const QString error = event.value("error").toString();
-            if (!error.isEmpty()) {
-                setErrorText(error);
-            } else {
-                setErrorText("");
-            }
-
-            if (info.isEmpty()) {
-                setStatusText("");
-            }
-
+            applyView(*view, false);
             setBusy(false);
 
             if (!m_confirmOnly) {
@@ -608,6 +340,7 @@ namespace bb {
 
         connect(m_client, &FallbackClient::sessionClosed, this, [this](const QJsonObject& event) {
             const QString id = event.value("id").toString();
+            m_modelCache.remove(id);
             if (id.isEmpty() || id != m_currentSessionId) {
                 return;
             }
@@ -671,6 +404,7 @@ namespace bb {
         m_summaryLabel->hide();
         m_requestorLabel->clear();
         m_requestorLabel->hide();
+        m_detailsSource.clear();
         setDetailsText("");
         setErrorText("");
         setStatusText("");
@@ -679,33 +413,58 @@ namespace bb {
     }
 
     void FallbackWindow::setErrorText(const QString& text) {
-        if (text.isEmpty()) {
-            m_errorLabel->clear();
-            m_errorLabel->hide();
+        if (updateOptionalLabel(m_errorLabel, text)) {
             ensureContentFits();
-            return;
         }
-
-        m_errorLabel->setText(text);
-        m_errorLabel->show();
-        ensureContentFits();
     }
 
     void FallbackWindow::setStatusText(const QString& text) {
-        if (text.isEmpty()) {
-            m_statusLabel->clear();
-            m_statusLabel->hide();
+        if (updateOptionalLabel(m_statusLabel, text)) {
             ensureContentFits();
-            return;
         }
+    }
 
-        m_statusLabel->setText(text);
-        m_statusLabel->show();
-        ensureContentFits();
+    // Only what differs from the widgets is touched, and the window is laid out at most once
+    void FallbackWindow::applyView(const fallback::prompt::PromptView& view, bool force) {
+        bool relayout = force;
+        if (force || view.model.intent != m_activeIntent) {
+            configureSizingForIntent(view.model.intent);
+            relayout = true;
+        }
+
+        relayout |= updateLabel(m_titleLabel, view.model.title);
+        relayout |= updateOptionalLabel(m_summaryLabel, view.model.summary);
+        relayout |= updateOptionalLabel(m_requestorLabel, view.model.requestor);
+        if (force || view.model.details != m_detailsSource) {
+            m_detailsSource = view.model.details;
+            setDetailsText(view.model.details);
+            relayout = true;
+        }
+        relayout |= updateLabel(m_promptLabel, view.model.prompt);
+        relayout |= updateOptionalLabel(m_errorLabel, view.error);
+        relayout |= updateOptionalLabel(m_statusLabel, view.status);
+        if (m_submitButton->text() != view.submitText) {
+            m_submitButton->setText(view.submitText);
+            relayout = true;
+        }
+        if (m_input->placeholderText() != view.placeholder) {
+            m_input->setPlaceholderText(view.placeholder);
+        }
+
+        // Left alone otherwise, so replays do not undo the user's own Show/Hide
+        if (force || view.echo != m_shownEcho) {
+            m_shownEcho = view.echo;
+            m_togglePasswordAction->setChecked(view.echo);
+        }
+        m_allowEmptyResponse = view.model.allowEmptyResponse;
+
+        if (relayout) {
+            ensureContentFits();
+        }
     }
 
     void FallbackWindow::setDetailsText(const QString& text) {
-        m_fullContextText = normalizeDetailText(text);
+        m_fullContextText = fallback::prompt::normalizeDetailText(text);
         if (m_fullContextText.isEmpty()) {
             m_collapsedContextText.clear();
             m_contextExpandable = false;
@@ -812,163 +571,6 @@ namespace bb {
         setMinimumSize(m_minWidth, m_minHeight);
     }
 
-    FallbackWindow::PromptDisplayModel FallbackWindow::buildDisplayModel(const QJsonObject& event) const {
-        PromptDisplayModel model;
-        const QString      source                = event.value("source").toString();
-        const QJsonObject  context               = event.value("context").toObject();
-        const QJsonObject  requestor             = context.value("requestor").toObject();
-        const QString      message               = context.value("message").toString();
-        const QString      description           = context.value("description").toString();
-        const QString      requestorName         = requestor.value("name").toString().trimmed();
-        const QString      infoText              = normalizeDetailText(event.value("info").toString());
-        const QString      normalizedMessage     = normalizeDetailText(message);
-        const QString      normalizedDescription = normalizeDetailText(description);
-        const QString      detailText            = (normalizedDescription + " " + normalizedMessage).toLower();
-        const QString      authHintText          = (detailText + " " + infoText).toLower();
-        const QString      commandName           = (source == "polkit") ? extractCommandName(message) : QString();
-        QString            unlockTarget          = (source == "polkit" || source == "keyring") ? extractUnlockTargetFromContext(context) : QString();
-        const bool         fingerprintHint       = looksLikeFingerprintPrompt(authHintText);
-        const bool         fidoHint              = looksLikeFidoPrompt(authHintText);
-        const bool         touchHint             = fingerprintHint || fidoHint || looksLikeTouchPrompt(authHintText);
-        if (source == "keyring" && unlockTarget.isEmpty()) {
-            unlockTarget = requestorName;
-        }
-        if (source == "polkit" && fingerprintHint) {
-            model.intent = PromptIntent::Fingerprint;
-        } else if (source == "polkit" && fidoHint) {
-            model.intent = PromptIntent::Fido2;
-        } else if (source == "pinentry" && (detailText.contains("openpgp") || detailText.contains("gpg"))) {
-            model.intent = PromptIntent::OpenPgp;
-        } else if (source == "polkit" && !commandName.isEmpty()) {
-            model.intent = PromptIntent::RunCommand;
-        } else if ((source == "polkit" || source == "keyring") && !unlockTarget.isEmpty()) {
-            model.intent = PromptIntent::Unlock;
-        }
-        if (model.intent == PromptIntent::Unlock) {
-            model.title   = QString("Unlock %1").arg(unlockTarget);
-            model.summary = QString("Use your password to unlock %1").arg(unlockTarget);
-            model.details = buildUnlockDetails(context, unlockTarget);
-        } else if (model.intent == PromptIntent::Fingerprint) {
-            model.title   = QString("Verify Fingerprint");
-            model.summary = infoText.isEmpty() ? QString("Use your fingerprint sensor to continue") : firstMeaningfulLine(infoText);
-            model.details = normalizeDetailText(description);
-        } else if (model.intent == PromptIntent::Fido2) {
-            model.title   = QString("Use Security Key");
-            model.summary = infoText.isEmpty() ? QString("Touch your security key to continue") : firstMeaningfulLine(infoText);
-            model.details = normalizeDetailText(description);
-        } else if (model.intent == PromptIntent::RunCommand) {
-            model.title   = QString("Authorization Required");
-            model.summary = firstMeaningfulLine(normalizedDescription);
-            if (model.summary.isEmpty()) {
-                model.summary = firstMeaningfulLine(normalizedMessage);
-            }
-            if (model.summary.isEmpty()) {
-                model.summary = isLowSignalCommand(commandName) ? QString("Administrative privileges required") : QString("Run %1 as superuser").arg(commandName);
-            }
-            model.details.clear();
-        } else if (source == "pinentry") {
-            if (model.intent == PromptIntent::OpenPgp) {
-                model.title = QString("Unlock OpenPGP Key");
-            } else if (detailText.contains("ssh")) {
-                model.title = QString("Unlock SSH Key");
-            } else {
-                model.title = QString("Authentication Required");
-            }
-            const QString referenceText = description.isEmpty() ? message : description;
-            const QString identity      = cleanIdentity(captureFirst(referenceText, QRegularExpression(QStringLiteral("\"([^\"]+)\""))));
-            const QString keyId         = captureFirst(referenceText, QRegularExpression(R"(ID\s+([A-F0-9]{8,}))", QRegularExpression::CaseInsensitiveOption));
-            const QString keyType       = captureFirst(referenceText, QRegularExpression(R"((\d{3,5}-bit\s+[A-Za-z0-9-]+\s+key))", QRegularExpression::CaseInsensitiveOption));
-            const QString created       = captureFirst(referenceText, QRegularExpression(R"(created\s+([0-9]{4}-[0-9]{2}-[0-9]{2}))", QRegularExpression::CaseInsensitiveOption));
-            QStringList   pieces;
-            if (!identity.isEmpty()) {
-                pieces << trimToLength(identity, 72);
-            } else if (!keyType.isEmpty()) {
-                pieces << keyType;
-            }
-            if (!keyId.isEmpty()) {
-                pieces << keyId;
-            }
-            if (!created.isEmpty()) {
-                pieces << ("created " + created);
-            }
-            if (!pieces.isEmpty()) {
-                model.summary = pieces.join("  •  ");
-            } else {
-                model.summary = firstMeaningfulLine(referenceText);
-            }
-            const QString pinText = normalizeDetailText(description.isEmpty() ? message : description);
-            if (!pinText.isEmpty()) {
-                QStringList       filtered;
-                const QStringList lines = pinText.split('\n');
-                filtered.reserve(lines.size());
-                for (const QString& line : lines) {
-                    if (isIdentityLine(line) || isKeyMetadataLine(line)) {
-                        continue;
-                    }
-                    filtered << line;
-                }
-                model.details = filtered.isEmpty() ? pinText : filtered.join("\n");
-            }
-        } else {
-            model.title   = (source == "polkit") ? QString("Authorization Required") : QString("Authentication Required");
-            model.summary = firstMeaningfulLine(normalizedMessage);
-            if (model.summary.isEmpty()) {
-                model.summary = firstMeaningfulLine(normalizedDescription);
-            }
-            if (!normalizedDescription.isEmpty() && !textEquivalent(normalizedDescription, model.summary)) {
-                model.details = normalizedDescription;
-            } else if (!normalizedMessage.isEmpty() && !textEquivalent(normalizedMessage, model.summary)) {
-                model.details = normalizedMessage;
-            }
-        }
-        if (!requestorName.isEmpty()) {
-            const bool duplicateUnlockRequestor = (model.intent == PromptIntent::Unlock) && (requestorName.compare(unlockTarget, Qt::CaseInsensitive) == 0);
-            if (!duplicateUnlockRequestor) {
-                model.requestor = QString("Requested by %1").arg(requestorName);
-            }
-        }
-        if (model.summary.isEmpty() && !model.details.isEmpty()) {
-            const QString normalizedDetails = normalizeDetailText(model.details);
-            const int     newline           = normalizedDetails.indexOf('\n');
-            if (newline == -1) {
-                model.summary = normalizedDetails;
-                model.details.clear();
-            } else {
-                model.summary = normalizedDetails.left(newline).trimmed();
-                model.details = normalizedDetails.mid(newline + 1).trimmed();
-            }
-        }
-        if (!model.summary.isEmpty() && !model.details.isEmpty()) {
-            const QString normalizedDetails = normalizeDetailText(model.details);
-            QStringList   detailLines       = normalizedDetails.split('\n');
-            if (!detailLines.isEmpty() && textEquivalent(detailLines.first(), model.summary)) {
-                detailLines.removeFirst();
-                model.details = detailLines.join("\n").trimmed();
-            }
-            if (textEquivalent(model.summary, model.details)) {
-                model.details.clear();
-            }
-        }
-        if (!infoText.isEmpty() && !textEquivalent(infoText, model.summary) && !textEquivalent(infoText, model.details)) {
-            model.details = model.details.isEmpty() ? infoText : uniqueJoined(QStringList{model.details, infoText});
-        }
-        if (source == "pinentry") {
-            const QString pinPrompt = context.value("message").toString().trimmed();
-            model.prompt            = pinPrompt.isEmpty() ? QString("Passphrase:") : pinPrompt;
-        } else {
-            model.prompt = QString("Password:");
-            if (source == "polkit" && touchHint) {
-                model.prompt             = QString("Press Enter to continue (or wait)");
-                model.allowEmptyResponse = true;
-            }
-        }
-        model.passphrasePrompt = (source == "pinentry") || model.prompt.contains("passphrase", Qt::CaseInsensitive);
-        if (source == "polkit" && touchHint) {
-            model.passphrasePrompt = false;
-        }
-        return model;
-    }
-
     void FallbackWindow::startIdleExitTimer() {
         // Start countdown to exit when hidden with no active session
         if (m_idleExitTimer && m_currentSessionId.isEmpty() && !isVisible()) {
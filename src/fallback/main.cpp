@@ -1,5 +1,6 @@
 #include "FallbackClient.hpp"
 #include "FallbackWindow.hpp"
+#include "../common/Trace.h"
 
 #include <QApplication>
 #include <QCommandLineOption>
@@ -36,6 +37,8 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
+    BB_TRACE_INIT("fallback");
+
     bb::FallbackClient client(socketPath);
     bb::FallbackWindow window(&client);
     client.start();
@@ -18,6 +18,13 @@ namespace bb::fallback::prompt {
             return match.captured(1).trimmed();
         }
 
+        // Compiled and JIT-optimized once, on first use
+        QRegularExpression compiledRegex(const QString& pattern, QRegularExpression::PatternOptions options = QRegularExpression::NoPatternOption) {
+            QRegularExpression regex(pattern, options);
+            regex.optimize();
+            return regex;
+        }
+
         bool isTemplateUnlockLine(const QString& line, const QString& target) {
             const QString normalized = normalizeCompareText(line);
             if (normalized.isEmpty()) {
@@ -42,11 +49,11 @@ namespace bb::fallback::prompt {
     } // namespace
 
     QString extractCommandName(const QString& message) {
-        const QRegularExpression explicitRunRegex(R"(run\s+[`'"]([^`'"\s]+)[`'"])", QRegularExpression::CaseInsensitiveOption);
-        QString                  command = captureFirst(message, explicitRunRegex);
+        static const QRegularExpression explicitRunRegex = compiledRegex(R"(run\s+[`'"]([^`'"\s]+)[`'"])", QRegularExpression::CaseInsensitiveOption);
+        static const QRegularExpression pathRegex        = compiledRegex(R"((/[A-Za-z0-9_\-\./]+))");
+        QString                         command          = captureFirst(message, explicitRunRegex);
 
         if (command.isEmpty()) {
-            const QRegularExpression pathRegex(R"((/[A-Za-z0-9_\-\./]+))");
             command = captureFirst(message, pathRegex);
         }
 
@@ -64,8 +71,8 @@ namespace bb::fallback::prompt {
             return QString();
         }
 
-        const QRegularExpression unlockRegex(R"(unlock\s+([^\n]+))", QRegularExpression::CaseInsensitiveOption);
-        QString                  target = captureFirst(normalized, unlockRegex);
+        static const QRegularExpression unlockRegex = compiledRegex(R"(unlock\s+([^\n]+))", QRegularExpression::CaseInsensitiveOption);
+        QString                         target      = captureFirst(normalized, unlockRegex);
         if (target.isEmpty()) {
             return QString();
         }
@@ -1,31 +1,198 @@
 #include "PromptHeuristics.hpp"
 
+#include <array>
+#include <cstdint>
+#include <string_view>
+
 namespace bb::fallback::prompt {
 
     namespace {
 
-        bool containsAnyTerm(const QString& text, std::initializer_list<const char*> terms) {
-            const QString lower = text.toLower();
-            for (const char* term : terms) {
-                if (lower.contains(QString::fromLatin1(term))) {
-                    return true;
+        enum HintBit : std::uint8_t {
+            FINGERPRINT = 1 << 0,
+            FIDO        = 1 << 1,
+            TOUCH       = 1 << 2,
+            OPEN_PGP    = 1 << 3,
+            SSH         = 1 << 4,
+        };
+
+        struct Term {
+            std::string_view text;
+            std::uint8_t     hint;
+        };
+
+        inline constexpr std::array TERMS = {
+            Term{"fingerprint", FINGERPRINT},
+            Term{"finger print", FINGERPRINT},
+            Term{"fprint", FINGERPRINT},
+            Term{"swipe", FINGERPRINT},
+            Term{"scan your finger", FINGERPRINT},
+            Term{"fido", FIDO},
+            Term{"fido2", FIDO},
+            Term{"webauthn", FIDO},
+            Term{"security key", FIDO},
+            Term{"yubikey", FIDO},
+            Term{"hardware token", FIDO},
+            Term{"user presence", FIDO},
+            Term{"touch", TOUCH},
+            Term{"tap", TOUCH},
+            Term{"insert", TOUCH},
+            Term{"use your security key", TOUCH},
+            Term{"verify your identity", TOUCH},
+            Term{"openpgp", OPEN_PGP},
+            Term{"gpg", OPEN_PGP},
+            Term{"ssh", SSH},
+        };
+
+        // Each character that appears in a term gets its own input class, folded to lower case;
+        // everything else is class 0 and sends the automaton back to the root
+        inline constexpr std::array<std::uint8_t, 128> CHAR_CLASS = [] {
+            std::array<std::uint8_t, 128> classes{};
+            std::uint8_t                  next = 1;
+            for (const Term& term : TERMS) {
+                for (const char ch : term.text) {
+                    if (classes[static_cast<unsigned char>(ch)] == 0) {
+                        classes[static_cast<unsigned char>(ch)] = next++;
+                    }
                 }
             }
-            return false;
+            for (char upper = 'A'; upper <= 'Z'; ++upper) {
+                classes[static_cast<unsigned char>(upper)] = classes[static_cast<unsigned char>(upper - 'A' + 'a')];
+            }
+            return classes;
+        }();
+
+        inline constexpr std::size_t CLASS_COUNT = [] {
+            std::uint8_t highest = 0;
+            for (const std::uint8_t cls : CHAR_CLASS) {
+                highest = cls > highest ? cls : highest;
+            }
+            return std::size_t{highest} + 1;
+        }();
+
+        inline constexpr std::size_t STATE_COUNT = [] {
+            std::size_t states = 1;
+            for (const Term& term : TERMS) {
+                states += term.text.size();
+            }
+            return states;
+        }();
+
+        // Aho-Corasick over TERMS with the failure links folded into a complete transition table,
+        // so every input character is exactly one lookup. State 0 is the root.
+        struct Automaton {
+            std::array<std::array<std::uint16_t, CLASS_COUNT>, STATE_COUNT> next{};
+            std::array<std::uint8_t, STATE_COUNT>                           hints{};
+        };
+
+        constexpr Automaton buildAutomaton() {
+            Automaton     automaton;
+            std::uint16_t states = 1;
+            for (const Term& term : TERMS) {
+                std::uint16_t state = 0;
+                for (const char ch : term.text) {
+                    const std::uint8_t cls = CHAR_CLASS[static_cast<unsigned char>(ch)];
+                    if (automaton.next[state][cls] == 0) {
+                        automaton.next[state][cls] = states++;
+                    }
+                    state = automaton.next[state][cls];
+                }
+                automaton.hints[state] |= term.hint;
+            }
+
+            // Breadth first, so a state's failure target is always complete before the state itself
+            std::array<std::uint16_t, STATE_COUNT> fail{};
+            std::array<std::uint16_t, STATE_COUNT> queue{};
+            std::size_t                            head = 0;
+            std::size_t                            tail = 0;
+            for (std::size_t cls = 0; cls < CLASS_COUNT; ++cls) {
+                if (automaton.next[0][cls] != 0) {
+                    queue[tail++] = automaton.next[0][cls];
+                }
+            }
+            while (head < tail) {
+                const std::uint16_t state = queue[head++];
+                automaton.hints[state] |= automaton.hints[fail[state]];
+                for (std::size_t cls = 0; cls < CLASS_COUNT; ++cls) {
+                    const std::uint16_t child = automaton.next[state][cls];
+                    if (child != 0) {
+                        fail[child]   = automaton.next[fail[state]][cls];
+                        queue[tail++] = child;
+                    } else {
+                        automaton.next[state][cls] = automaton.next[fail[state]][cls];
+                    }
+                }
+            }
+            return automaton;
         }
 
-    } // namespace
+        inline constexpr Automaton AUTOMATON = buildAutomaton();
 
-    bool looksLikeFingerprintPrompt(const QString& text) {
-        return containsAnyTerm(text, {"fingerprint", "finger print", "fprint", "swipe", "scan your finger"});
-    }
+        class Scanner {
+          public:
+            // Whitespace is collapsed the way normalizeDetailText() does it: runs inside a line become
+            // one space, runs spanning a line break become a newline, and both ends are trimmed
+            void feed(QStringView text) {
+                char pending = 0;
+                bool leading = true;
+                for (const QChar ch : text) {
+                    if (ch.isSpace()) {
+                        if (!leading) {
+                            pending = (pending == '\n' || ch == u'\n' || ch == u'\r') ? '\n' : ' ';
+                        }
+                        continue;
+                    }
+                    if (pending != 0) {
+                        step(pending);
+                        pending = 0;
+                    }
+                    leading = false;
+                    step(ch.unicode());
+                }
+            }
 
-    bool looksLikeFidoPrompt(const QString& text) {
-        return containsAnyTerm(text, {"fido", "fido2", "webauthn", "security key", "yubikey", "hardware token", "user presence"});
-    }
+            void separate() {
+                step(' ');
+            }
+
+            std::uint8_t hints() const {
+                return m_hints;
+            }
+
+          private:
+            void step(char16_t ch) {
+                if (ch >= 128) {
+                    // Non-ASCII letters only matter when they fold onto a term's letter (U+212A KELVIN SIGN)
+                    const char32_t folded = QChar::toLower(char32_t{ch});
+                    ch                    = folded < 128 ? static_cast<char16_t>(folded) : 0;
+                }
+                m_state = AUTOMATON.next[m_state][CHAR_CLASS[ch]];
+                m_hints |= AUTOMATON.hints[m_state];
+            }
+
+            std::uint16_t m_state = 0;
+            std::uint8_t  m_hints = 0;
+        };
+
+    } // namespace
+
+    PromptHints classifyPrompt(QStringView description, QStringView message, QStringView info) {
+        Scanner scanner;
+        scanner.feed(description);
+        scanner.separate();
+        scanner.feed(message);
+        const std::uint8_t detailHints = scanner.hints();
+        scanner.separate();
+        scanner.feed(info);
+        const std::uint8_t authHints = scanner.hints();
 
-    bool looksLikeTouchPrompt(const QString& text) {
-        return containsAnyTerm(text, {"touch", "tap", "insert", "use your security key", "verify your identity"});
+        PromptHints        hints;
+        hints.fingerprint = (authHints & FINGERPRINT) != 0;
+        hints.fido        = (authHints & FIDO) != 0;
+        hints.touch       = (authHints & (FINGERPRINT | FIDO | TOUCH)) != 0;
+        hints.openPgp     = (detailHints & OPEN_PGP) != 0;
+        hints.ssh         = (detailHints & SSH) != 0;
+        return hints;
     }
 
 } // namespace bb::fallback::prompt
@@ -1,11 +1,20 @@
 #pragma once
 
-#include <QString>
+#include <QStringView>
 
 namespace bb::fallback::prompt {
 
-    bool looksLikeFingerprintPrompt(const QString& text);
-    bool looksLikeFidoPrompt(const QString& text);
-    bool looksLikeTouchPrompt(const QString& text);
+    struct PromptHints {
+        bool fingerprint = false;
+        bool fido        = false;
+        // Any prompt answered by the device rather than a password, fingerprint and fido included
+        bool touch   = false;
+        bool openPgp = false;
+        bool ssh     = false;
+    };
+
+    // One case-insensitive pass over the texts as normalizeDetailText() would leave them, joined by
+    // spaces. openPgp and ssh only look at description and message; the auth hints see info too.
+    PromptHints classifyPrompt(QStringView description, QStringView message, QStringView info = {});
 
 } // namespace bb::fallback::prompt
@@ -6,6 +6,8 @@
 
 #include <QRegularExpression>
 
+#include <array>
+
 namespace bb::fallback::prompt {
 
     namespace {
@@ -29,13 +31,43 @@ namespace bb::fallback::prompt {
             return (lower.contains(" id ") || lower.startsWith("id ")) && lower.contains("created");
         }
 
-        QString captureFirst(const QString& text, const QRegularExpression& regex) {
-            const QRegularExpressionMatch match = regex.match(text);
-            if (!match.hasMatch()) {
-                return QString();
-            }
+        struct KeyFields {
+            QString identity;
+            QString keyId;
+            QString keyType;
+            QString created;
+        };
+
+        // gpg describes a key as `"Name <mail>"`, `3072-bit RSA key, ID 0123ABCD,` and `created 2024-01-31`;
+        // one alternation picks the first of each out of the description in a single scan
+        KeyFields extractKeyFields(const QString& text) {
+            static const QRegularExpression keyFieldsRegex = [] {
+                QRegularExpression regex(R"("([^"]+)"|ID\s+([A-F0-9]{8,})|(\d{3,5}-bit\s+[A-Za-z0-9-]+\s+key)|created\s+([0-9]{4}-[0-9]{2}-[0-9]{2}))",
+                                         QRegularExpression::CaseInsensitiveOption);
+                regex.optimize();
+                return regex;
+            }();
 
-            return match.captured(1).trimmed();
+            KeyFields                       fields;
+            const std::array<QString*, 4>   slots     = {&fields.identity, &fields.keyId, &fields.keyType, &fields.created};
+            std::array<bool, 4>             seen      = {};
+            qsizetype                       remaining = qsizetype(slots.size());
+            QRegularExpressionMatchIterator it        = keyFieldsRegex.globalMatch(text);
+            while (remaining > 0 && it.hasNext()) {
+                const QRegularExpressionMatch match = it.next();
+                // Only the alternative that matched has a capture; keep the first one of each
+                for (qsizetype slot = 0; slot < qsizetype(slots.size()); ++slot) {
+                    if (match.hasCaptured(int(slot) + 1)) {
+                        if (!seen[slot]) {
+                            seen[slot]   = true;
+                            *slots[slot] = match.captured(int(slot) + 1).trimmed();
+                            --remaining;
+                        }
+                        break;
+                    }
+                }
+            }
+            return fields;
         }
 
         QString cleanIdentity(QString identity) {
@@ -57,21 +89,17 @@ namespace bb::fallback::prompt {
         const QString      infoText              = normalizeDetailText(event.value("info").toString());
         const QString      normalizedMessage     = normalizeDetailText(message);
         const QString      normalizedDescription = normalizeDetailText(description);
-        const QString      detailText            = (normalizedDescription + " " + normalizedMessage).toLower();
-        const QString      authHintText          = (detailText + " " + infoText).toLower();
+        const PromptHints  hints                 = classifyPrompt(normalizedDescription, normalizedMessage, infoText);
         const QString      commandName           = (source == "polkit") ? extractCommandName(message) : QString();
         QString            unlockTarget          = (source == "polkit" || source == "keyring") ? extractUnlockTargetFromContext(context) : QString();
-        const bool         fingerprintHint       = looksLikeFingerprintPrompt(authHintText);
-        const bool         fidoHint              = looksLikeFidoPrompt(authHintText);
-        const bool         touchHint             = fingerprintHint || fidoHint || looksLikeTouchPrompt(authHintText);
         if (source == "keyring" && unlockTarget.isEmpty()) {
             unlockTarget = requestorName;
         }
-        if (source == "polkit" && fingerprintHint) {
+        if (source == "polkit" && hints.fingerprint) {
             model.intent = PromptIntent::Fingerprint;
-        } else if (source == "polkit" && fidoHint) {
+        } else if (source == "polkit" && hints.fido) {
             model.intent = PromptIntent::Fido2;
-        } else if (source == "pinentry" && (detailText.contains("openpgp") || detailText.contains("gpg"))) {
+        } else if (source == "pinentry" && hints.openPgp) {
             model.intent = PromptIntent::OpenPgp;
         } else if (source == "polkit" && !commandName.isEmpty()) {
             model.intent = PromptIntent::RunCommand;
@@ -85,11 +113,11 @@ namespace bb::fallback::prompt {
         } else if (model.intent == PromptIntent::Fingerprint) {
             model.title   = QString("Verify Fingerprint");
             model.summary = infoText.isEmpty() ? QString("Use your fingerprint sensor to continue") : firstMeaningfulLine(infoText);
-            model.details = normalizeDetailText(description);
+            model.details = normalizedDescription;
         } else if (model.intent == PromptIntent::Fido2) {
             model.title   = QString("Use Security Key");
             model.summary = infoText.isEmpty() ? QString("Touch your security key to continue") : firstMeaningfulLine(infoText);
-            model.details = normalizeDetailText(description);
+            model.details = normalizedDescription;
         } else if (model.intent == PromptIntent::RunCommand) {
             model.title   = QString("Authorization Required");
             model.summary = firstMeaningfulLine(normalizedDescription);
@@ -103,34 +131,32 @@ namespace bb::fallback::prompt {
         } else if (source == "pinentry") {
             if (model.intent == PromptIntent::OpenPgp) {
                 model.title = QString("Unlock OpenPGP Key");
-            } else if (detailText.contains("ssh")) {
+            } else if (hints.ssh) {
                 model.title = QString("Unlock SSH Key");
             } else {
                 model.title = QString("Authentication Required");
             }
-            const QString referenceText = description.isEmpty() ? message : description;
-            const QString identity      = cleanIdentity(captureFirst(referenceText, QRegularExpression(QStringLiteral("\"([^\"]+)\""))));
-            const QString keyId         = captureFirst(referenceText, QRegularExpression(R"(ID\s+([A-F0-9]{8,}))", QRegularExpression::CaseInsensitiveOption));
-            const QString keyType       = captureFirst(referenceText, QRegularExpression(R"((\d{3,5}-bit\s+[A-Za-z0-9-]+\s+key))", QRegularExpression::CaseInsensitiveOption));
-            const QString created       = captureFirst(referenceText, QRegularExpression(R"(created\s+([0-9]{4}-[0-9]{2}-[0-9]{2}))", QRegularExpression::CaseInsensitiveOption));
-            QStringList   pieces;
+            const QString   referenceText = description.isEmpty() ? message : description;
+            const KeyFields keyFields     = extractKeyFields(referenceText);
+            const QString   identity      = cleanIdentity(keyFields.identity);
+            QStringList     pieces;
             if (!identity.isEmpty()) {
                 pieces << trimToLength(identity, 72);
-            } else if (!keyType.isEmpty()) {
-                pieces << keyType;
+            } else if (!keyFields.keyType.isEmpty()) {
+                pieces << keyFields.keyType;
             }
-            if (!keyId.isEmpty()) {
-                pieces << keyId;
+            if (!keyFields.keyId.isEmpty()) {
+                pieces << keyFields.keyId;
             }
-            if (!created.isEmpty()) {
-                pieces << ("created " + created);
+            if (!keyFields.created.isEmpty()) {
+                pieces << ("created " + keyFields.created);
             }
             if (!pieces.isEmpty()) {
                 model.summary = pieces.join("  •  ");
             } else {
                 model.summary = firstMeaningfulLine(referenceText);
             }
-            const QString pinText = normalizeDetailText(description.isEmpty() ? message : description);
+            const QString pinText = description.isEmpty() ? normalizedMessage : normalizedDescription;
             if (!pinText.isEmpty()) {
                 QStringList       filtered;
                 const QStringList lines = pinText.split('\n');
@@ -191,13 +217,13 @@ namespace bb::fallback::prompt {
             model.prompt            = pinPrompt.isEmpty() ? QString("Passphrase:") : pinPrompt;
         } else {
             model.prompt = QString("Password:");
-            if (source == "polkit" && touchHint) {
+            if (source == "polkit" && hints.touch) {
                 model.prompt             = QString("Press Enter to continue (or wait)");
                 model.allowEmptyResponse = true;
             }
         }
         model.passphrasePrompt = (source == "pinentry") || model.prompt.contains("passphrase", Qt::CaseInsensitive);
-        if (source == "polkit" && touchHint) {
+        if (source == "polkit" && hints.touch) {
             model.passphrasePrompt = false;
         }
         return model;
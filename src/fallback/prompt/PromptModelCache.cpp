@@ -0,0 +1,102 @@
+#include "PromptModelCache.hpp"
+
+namespace bb::fallback::prompt {
+
+    namespace {
+
+        // The parts of session.created that the model depends on; the revision is not one of them
+        QJsonObject createdInputs(QJsonObject event) {
+            event.remove("revision");
+            return event;
+        }
+
+    } // namespace
+
+    const PromptView& PromptModelCache::created(const QJsonObject& event) {
+        const QString     id     = event.value("id").toString();
+        const QJsonObject inputs = createdInputs(event);
+        auto              it     = m_entries.find(id);
+        if (it != m_entries.end() && it->createdEvent == inputs) {
+            return it->view;
+        }
+
+        Entry entry;
+        entry.createdEvent     = inputs;
+        entry.view.model       = m_builder.build(event);
+        entry.view.confirmOnly = event.value("context").toObject().value("confirmOnly").toBool();
+        if (entry.view.confirmOnly) {
+            entry.view.submitText = QString("Confirm");
+        } else if (entry.view.model.allowEmptyResponse) {
+            entry.view.placeholder = QString("Press Enter to continue (optional)");
+            entry.view.submitText  = QString("Continue");
+        } else {
+            entry.view.placeholder = entry.view.model.passphrasePrompt ? QString("Enter passphrase") : QString("Enter password");
+            entry.view.submitText  = QString("Authenticate");
+        }
+
+        it = m_entries.insert(id, std::move(entry));
+        return it->view;
+    }
+
+    const PromptView* PromptModelCache::updated(const QJsonObject& event) {
+        const auto it = m_entries.find(event.value("id").toString());
+        if (it == m_entries.end()) {
+            return nullptr;
+        }
+
+        Entry&       entry    = *it;
+        const qint64 revision = event.value("revision").toInteger(-1);
+        if (revision >= 0 && revision <= entry.revision) {
+            return &entry.view;
+        }
+        entry.revision = revision;
+
+        const QString prompt = event.value("prompt").toString();
+        const QString info   = event.value("info").toString().trimmed();
+        if (prompt != entry.prompt || info != entry.info) {
+            entry.prompt = prompt;
+            entry.info   = info;
+            entry.hints  = classifyPrompt(QStringView(), prompt, info);
+        }
+
+        PromptView& view = entry.view;
+        if (!prompt.isEmpty()) {
+            view.model.prompt = prompt;
+        }
+        if (entry.hints.fingerprint) {
+            view.model.title = QString("Verify Fingerprint");
+        } else if (entry.hints.fido) {
+            view.model.title = QString("Use Security Key");
+        }
+        if (!view.confirmOnly) {
+            view.model.allowEmptyResponse = entry.hints.touch;
+            if (entry.hints.touch) {
+                view.model.prompt = QString("Press Enter to continue (or wait)");
+                view.placeholder  = QString("Press Enter to continue (optional)");
+                view.submitText   = QString("Continue");
+            } else {
+                view.placeholder = view.model.prompt.contains("passphrase", Qt::CaseInsensitive) ? QString("Enter passphrase") : QString("Enter password");
+                view.submitText  = QString("Authenticate");
+            }
+        }
+        view.status = info;
+        view.error  = event.value("error").toString();
+        if (event.contains("echo")) {
+            view.echo = event.value("echo").toBool();
+        }
+        return &view;
+    }
+
+    void PromptModelCache::remove(const QString& id) {
+        m_entries.remove(id);
+    }
+
+    void PromptModelCache::clear() {
+        m_entries.clear();
+    }
+
+    qsizetype PromptModelCache::size() const {
+        return m_entries.size();
+    }
+
+} // namespace bb::fallback::prompt
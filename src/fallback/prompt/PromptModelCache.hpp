@@ -0,0 +1,55 @@
+#pragma once
+
+#include "PromptHeuristics.hpp"
+#include "PromptModel.hpp"
+#include "PromptModelBuilder.hpp"
+
+#include <QHash>
+#include <QJsonObject>
+#include <QString>
+
+namespace bb::fallback::prompt {
+
+    // Everything the fallback window shows for a session: the model built from
+    // session.created with the latest session.updated applied on top
+    struct PromptView {
+        PromptDisplayModel model;
+        QString            placeholder;
+        QString            submitText;
+        QString            status;
+        QString            error;
+        bool               confirmOnly = false;
+        bool               echo        = false;
+    };
+
+    // Derived views per session id. Every subscribe replays created + updated for each live
+    // session; a replayed context reuses the built model and an update whose revision was
+    // already applied is not derived again. A new revision only re-classifies the prompt
+    // when its prompt or info text changed.
+    class PromptModelCache {
+      public:
+        const PromptView& created(const QJsonObject& event);
+        // nullptr for sessions this cache has not seen created
+        const PromptView* updated(const QJsonObject& event);
+
+        void              remove(const QString& id);
+        void              clear();
+        qsizetype         size() const;
+
+      private:
+        struct Entry {
+            QJsonObject createdEvent;
+            PromptView  view;
+            // Newest session.updated revision applied, -1 before the first
+            qint64      revision = -1;
+            // Inputs of the last classification
+            QString     prompt;
+            QString     info;
+            PromptHints hints;
+        };
+
+        PromptModelBuilder    m_builder;
+        QHash<QString, Entry> m_entries;
+    };
+
+} // namespace bb::fallback::prompt
@@ -1,41 +1,258 @@
 #include "TextNormalize.hpp"
 
+#include <cstdint>
+#include <cstring>
+
 namespace bb::fallback::prompt {
 
+    namespace {
+
+        // The ASCII fast path looks at four UTF-16 units per 64-bit word. Each helper below
+        // assumes every lane is ASCII, which allAscii() checks first; nothing carries across lanes.
+        inline constexpr std::uint64_t LANES_ONE  = 0x0001000100010001ULL;
+        inline constexpr std::uint64_t LANES_HIGH = 0x8000800080008000ULL;
+        inline constexpr std::uint64_t NON_ASCII  = 0xFF80FF80FF80FF80ULL;
+        inline constexpr qsizetype     LANES      = 4;
+
+        constexpr std::uint64_t        broadcast(char16_t unit) {
+            return LANES_ONE * unit;
+        }
+
+        constexpr bool allAscii(std::uint64_t word) {
+            return (word & NON_ASCII) == 0;
+        }
+
+        // High bit set in each lane holding at least `bound`
+        constexpr std::uint64_t lanesAtLeast(std::uint64_t word, char16_t bound) {
+            return (word + broadcast(0x8000 - bound)) & LANES_HIGH;
+        }
+
+        // High bit set in each lane holding exactly `unit`
+        constexpr std::uint64_t lanesEqual(std::uint64_t word, char16_t unit) {
+            return ~((word ^ broadcast(unit)) + broadcast(0x7FFF)) & LANES_HIGH;
+        }
+
+        // No whitespace or control characters: copied through unchanged by both kernels
+        constexpr bool allGraphic(std::uint64_t word) {
+            return allAscii(word) && lanesAtLeast(word, 0x21) == LANES_HIGH;
+        }
+
+        // Graphic and free of the punctuation normalizeCompareText() treats as a space
+        constexpr bool allCompareGraphic(std::uint64_t word) {
+            return allGraphic(word) && (lanesEqual(word, u'`') | lanesEqual(word, u'"') | lanesEqual(word, u',') | lanesEqual(word, u'.')) == 0;
+        }
+
+        constexpr std::uint64_t toLowerLanes(std::uint64_t word) {
+            const std::uint64_t upper = lanesAtLeast(word, u'A') & ~lanesAtLeast(word, u'Z' + 1);
+            return word + (upper >> 10); // 0x8000 >> 10 == 0x20
+        }
+
+        static_assert(toLowerLanes(0x0041005A0061007BULL) == 0x0061007A0061007BULL);
+        static_assert(allCompareGraphic(0x0061007A0021007EULL) && !allCompareGraphic(0x0061002E0061007AULL) && !allGraphic(0x0061002000610062ULL));
+
+        std::uint64_t loadLanes(const char16_t* pos) {
+            std::uint64_t word;
+            std::memcpy(&word, pos, sizeof(word));
+            return word;
+        }
+
+        void storeLanes(char16_t* pos, std::uint64_t word) {
+            std::memcpy(pos, &word, sizeof(word));
+        }
+
+        bool isLineBreak(char16_t unit) {
+            return unit == u'\n' || unit == u'\r';
+        }
+
+        bool isCompareSeparator(char16_t unit) {
+            return unit == u'`' || unit == u'"' || unit == u',' || unit == u'.' || QChar::isSpace(unit);
+        }
+
+        // Lower-cases the code point at `pos` the way QString::toLower() does and advances past it.
+        // Returns the number of units written to `out`, which is two for a surrogate pair and for
+        // U+0130, the one unconditional special casing (i followed by a combining dot above).
+        int lowerCodePoint(const char16_t*& pos, const char16_t* end, char16_t* out) {
+            const char16_t unit = *pos++;
+            if (unit < 0x80) {
+                out[0] = (unit >= u'A' && unit <= u'Z') ? static_cast<char16_t>(unit + 0x20) : unit;
+                return 1;
+            }
+            if (QChar::isHighSurrogate(unit) && pos < end && QChar::isLowSurrogate(*pos)) {
+                const char32_t lower = QChar::toLower(QChar::surrogateToUcs4(unit, *pos++));
+                out[0]               = QChar::highSurrogate(lower);
+                out[1]               = QChar::lowSurrogate(lower);
+                return 2;
+            }
+            if (unit == 0x0130) {
+                out[0] = u'i';
+                out[1] = 0x0307;
+                return 2;
+            }
+
+            out[0] = static_cast<char16_t>(QChar::toLower(char32_t{unit}));
+            return 1;
+        }
+
+        const char16_t* unitsOf(QStringView text) {
+            return text.utf16();
+        }
+
+        char16_t* unitsOf(QString& text) {
+            return reinterpret_cast<char16_t*>(text.data());
+        }
+
+        // Yields normalizeCompareText(text) one unit at a time, so two texts can be compared
+        // without materializing either; -1 once exhausted
+        class CompareCursor {
+          public:
+            explicit CompareCursor(QStringView text) : m_pos(unitsOf(text)), m_end(m_pos + text.size()) {}
+
+            int next() {
+                if (m_queued > 0) {
+                    return m_folded[2 - m_queued--];
+                }
+
+                bool separated = false;
+                while (m_pos < m_end) {
+                    if (isCompareSeparator(*m_pos)) {
+                        separated = m_started;
+                        ++m_pos;
+                        continue;
+                    }
+                    if (separated) {
+                        return u' ';
+                    }
+
+                    m_started    = true;
+                    const int n = lowerCodePoint(m_pos, m_end, m_folded);
+                    m_queued     = n - 1;
+                    return m_folded[0];
+                }
+                return -1;
+            }
+
+          private:
+            const char16_t* m_pos;
+            const char16_t* m_end;
+            char16_t        m_folded[2] = {};
+            int             m_queued    = 0;
+            bool            m_started   = false;
+        };
+
+    } // namespace
+
+    // One pass into a buffer the size of the input: the output is never longer. A whitespace run
+    // becomes one space, or one newline when it crosses a line break, and is dropped at either end;
+    // that is exactly what splitting on lines, simplifying each and joining the non-empty ones gives.
     QString normalizeDetailText(const QString& text) {
-        QString normalized = text;
-        normalized.replace('\r', '\n');
-        QStringList lines = normalized.split('\n');
-        QStringList cleaned;
-        cleaned.reserve(lines.size());
-        for (const QString& line : lines) {
-            const QString simplified = line.simplified();
-            if (!simplified.isEmpty()) {
-                cleaned << simplified;
+        const char16_t* pos   = unitsOf(QStringView(text));
+        const char16_t* end   = pos + text.size();
+        QString         normalized(text.size(), Qt::Uninitialized);
+        char16_t* const begin   = unitsOf(normalized);
+        char16_t*       out     = begin;
+        char16_t        pending = 0;
+
+        while (pos < end) {
+            if (end - pos >= LANES && allGraphic(loadLanes(pos))) {
+                if (pending != 0) {
+                    *out++  = pending;
+                    pending = 0;
+                }
+                do {
+                    storeLanes(out, loadLanes(pos));
+                    out += LANES;
+                    pos += LANES;
+                } while (end - pos >= LANES && allGraphic(loadLanes(pos)));
+                continue;
+            }
+
+            const char16_t unit = *pos++;
+            if (QChar::isSpace(unit)) {
+                if (out != begin) {
+                    pending = (pending == u'\n' || isLineBreak(unit)) ? u'\n' : u' ';
+                }
+                continue;
             }
+            if (pending != 0) {
+                *out++  = pending;
+                pending = 0;
+            }
+            *out++ = unit;
         }
 
-        return cleaned.join("\n");
+        normalized.truncate(out - begin);
+        return normalized;
     }
 
+    // Same single pass, with lower-casing folded in and `"`,. treated as whitespace, so the
+    // result is space-separated words. Only U+0130 can outgrow the input buffer.
     QString normalizeCompareText(const QString& text) {
-        QString normalized = normalizeDetailText(text).toLower();
-        normalized.replace('`', ' ');
-        normalized.replace('"', ' ');
-        normalized.replace(',', ' ');
-        normalized.replace('.', ' ');
-        normalized = normalized.simplified();
+        const char16_t* pos = unitsOf(QStringView(text));
+        const char16_t* end = pos + text.size();
+        QString         normalized(text.size(), Qt::Uninitialized);
+        char16_t*       out       = unitsOf(normalized);
+        qsizetype       written   = 0;
+        bool            separated = false;
+
+        while (pos < end) {
+            if (end - pos >= LANES && allCompareGraphic(loadLanes(pos))) {
+                if (separated && written > 0) {
+                    out[written++] = u' ';
+                }
+                separated = false;
+                do {
+                    storeLanes(out + written, toLowerLanes(loadLanes(pos)));
+                    written += LANES;
+                    pos += LANES;
+                } while (end - pos >= LANES && allCompareGraphic(loadLanes(pos)));
+                continue;
+            }
+
+            if (isCompareSeparator(*pos)) {
+                separated = true;
+                ++pos;
+                continue;
+            }
+            if (separated && written > 0) {
+                out[written++] = u' ';
+            }
+            separated = false;
+
+            char16_t  folded[2];
+            const int n = lowerCodePoint(pos, end, folded);
+            // Keep room for the rest of the input at one unit each
+            if (written + n + (end - pos) > normalized.size()) {
+                normalized.resize(written + n + (end - pos));
+                out = unitsOf(normalized);
+            }
+            for (int i = 0; i < n; ++i) {
+                out[written++] = folded[i];
+            }
+        }
+
+        normalized.truncate(written);
         return normalized;
     }
 
+    // Equal, or one a prefix of the other, once both are normalized: walked in lockstep and
+    // usually decided within the first few units
     bool textEquivalent(const QString& left, const QString& right) {
-        const QString a = normalizeCompareText(left);
-        const QString b = normalizeCompareText(right);
-        if (a.isEmpty() || b.isEmpty()) {
+        CompareCursor a(left);
+        CompareCursor b(right);
+        int           unitA = a.next();
+        int           unitB = b.next();
+        if (unitA < 0 || unitB < 0) {
             return false;
         }
 
-        return a == b || a.startsWith(b) || b.startsWith(a);
+        while (unitA >= 0 && unitB >= 0) {
+            if (unitA != unitB) {
+                return false;
+            }
+            unitA = a.next();
+            unitB = b.next();
+        }
+        return true;
     }
 
     QString firstMeaningfulLine(const QString& text) {
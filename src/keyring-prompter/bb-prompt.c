@@ -1,6 +1,7 @@
 #define GCR_API_SUBJECT_TO_CHANGE 1
 #include "bb-prompt.h"
 #include "ipc-client.h"
+#include "../common/Trace.h"
 
 #include <string.h>
 #include <unistd.h>
@@ -176,48 +177,34 @@ generate_cookie (BbAuthPrompt *self)
                             self->cookie_counter);
 }
 
-/* Thread function for async password prompt */
 static void
-password_request_thread (GTask        *task,
-                         gpointer      source_object,
-                         gpointer      task_data,
-                         GCancellable *cancellable)
+on_password_reply (GObject      *source G_GNUC_UNUSED,
+                   GAsyncResult *result,
+                   gpointer      user_data)
 {
-    BbAuthPrompt *self = BB_AUTH_PROMPT (source_object);
-    (void) task_data;
-    (void) cancellable;
-    gchar *password = NULL;
-    gboolean success;
-
-    g_message ("Thread: Sending keyring password request: cookie=%s",
-               self->request_cookie);
+    g_autoptr(GTask) task = user_data;
+    BbAuthPrompt *self = g_task_get_source_object (task);
+    g_autoptr(GError) error = NULL;
+    gchar *password;
 
-    /* Send request to bb-auth - this blocks until user responds */
-    success = bb_auth_ipc_send_keyring_request (
-        self->request_cookie,
-        self->title ? self->title : "Unlock Keyring",
-        self->message ? self->message : "Password required",
-        self->description,
-        self->warning,
-        self->password_new,
-        &password
-    );
+    password = bb_auth_ipc_keyring_request_finish (result, &error);
+    if (error)
+        g_debug ("Keyring request failed: %s", error->message);
 
     if (g_task_return_error_if_cancelled (task)) {
         g_free (password);
         return;
     }
 
-    if (success && password != NULL) {
+    if (password != NULL) {
         g_free (self->password);
         self->password = password;
         self->cancelled = FALSE;
-        g_message ("Thread: Keyring request successful");
+        BB_TRACE_INSTANT_C ("keyring.request.ok", self->request_cookie);
         g_task_return_pointer (task, (gpointer)self->password, NULL);
     } else {
         self->cancelled = TRUE;
-        g_free (password);
-        g_message ("Thread: Keyring request cancelled or failed");
+        BB_TRACE_INSTANT_C ("keyring.request.cancelled", self->request_cookie);
         g_task_return_pointer (task, NULL, NULL);
     }
 }
@@ -238,15 +225,21 @@ bb_auth_prompt_password_async (GcrPrompt          *prompt,
     g_free (self->request_cookie);
     self->request_cookie = generate_cookie (self);
 
-    g_message ("Async: Starting keyring password request: cookie=%s title=%s message=%s warning=%s",
-               self->request_cookie,
-               self->title ? self->title : "(null)",
-               self->message ? self->message : "(null)",
-               self->warning ? self->warning : "(null)");
+    BB_TRACE_INSTANT_C ("keyring.request.send", self->request_cookie);
 
-    /* Run the blocking IPC in a thread to not block the main loop */
-    g_task_run_in_thread (task, password_request_thread);
-    g_object_unref (task);
+    /* Answered from the main loop once the user responds; the task is
+     * released by the reply callback */
+    bb_auth_ipc_keyring_request_async (
+        self->request_cookie,
+        self->title ? self->title : "Unlock Keyring",
+        self->message ? self->message : "Password required",
+        self->description,
+        self->warning,
+        self->password_new,
+        cancellable,
+        on_password_reply,
+        task
+    );
 }
 
 static const gchar *
@@ -259,28 +252,18 @@ bb_auth_prompt_password_finish (GcrPrompt    *prompt,
     return g_task_propagate_pointer (G_TASK (result), error);
 }
 
-/* Thread function for async confirm prompt */
 static void
-confirm_request_thread (GTask        *task,
-                        gpointer      source_object,
-                        gpointer      task_data,
-                        GCancellable *cancellable)
+on_confirm_reply (GObject      *source G_GNUC_UNUSED,
+                  GAsyncResult *result,
+                  gpointer      user_data)
 {
-    BbAuthPrompt *self = BB_AUTH_PROMPT (source_object);
-    (void) task_data;
-    (void) cancellable;
+    g_autoptr(GTask) task = user_data;
+    g_autoptr(GError) error = NULL;
     gboolean confirmed;
 
-    g_message ("Thread: Sending keyring confirm request: cookie=%s",
-               self->request_cookie);
-
-    /* Send confirm request to bb-auth */
-    confirmed = bb_auth_ipc_send_confirm_request (
-        self->request_cookie,
-        self->title ? self->title : "Confirm",
-        self->message ? self->message : "Please confirm",
-        self->description
-    );
+    confirmed = bb_auth_ipc_confirm_request_finish (result, &error);
+    if (error)
+        g_debug ("Confirm request failed: %s", error->message);
 
     if (g_task_return_error_if_cancelled (task))
         return;
@@ -304,13 +287,17 @@ bb_auth_prompt_confirm_async (GcrPrompt          *prompt,
     g_free (self->request_cookie);
     self->request_cookie = generate_cookie (self);
 
-    g_message ("Async: Starting keyring confirm request: cookie=%s title=%s",
-               self->request_cookie,
-               self->title ? self->title : "(null)");
+    BB_TRACE_INSTANT_C ("keyring.confirm.send", self->request_cookie);
 
-    /* Run the blocking IPC in a thread to not block the main loop */
-    g_task_run_in_thread (task, confirm_request_thread);
-    g_object_unref (task);
+    bb_auth_ipc_confirm_request_async (
+        self->request_cookie,
+        self->title ? self->title : "Confirm",
+        self->message ? self->message : "Please confirm",
+        self->description,
+        cancellable,
+        on_confirm_reply,
+        task
+    );
 }
 
 static GcrPromptReply
@@ -330,8 +317,9 @@ bb_auth_prompt_close (GcrPrompt *prompt)
 
     g_debug ("Closing prompt, cookie=%s", self->request_cookie ? self->request_cookie : "(null)");
 
+    /* Forwards the cancel if the request is still in flight */
     if (self->request_cookie) {
-        bb_auth_ipc_send_cancel (self->request_cookie);
+        bb_auth_ipc_cancel (self->request_cookie);
     }
 }
 
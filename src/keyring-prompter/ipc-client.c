@@ -1,11 +1,49 @@
 #include "ipc-client.h"
 
-#include <gio/gio.h>
 #include <gio/gunixsocketaddress.h>
 #include <json-glib/json-glib.h>
-#include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
+
+/* Keep in sync with MAX_MESSAGE_SIZE and IPC_READ_CHUNK in common/Constants.hpp */
+#define BB_AUTH_MAX_MESSAGE_SIZE (64 * 1024)
+#define BB_AUTH_READ_CHUNK       2048
+
+typedef enum {
+    REQUEST_PING,
+    REQUEST_KEYRING,
+    REQUEST_CONFIRM,
+    REQUEST_DRAIN   /* fire-and-forget; its reply is read and dropped */
+} RequestKind;
+
+/* A request waiting for its reply. Keyring and confirm requests are answered
+ * whenever the user is done, with their cookie as "id" (errors included);
+ * pings and drains are answered in order and without an id. */
+typedef struct {
+    RequestKind   kind;
+    gchar        *cookie;
+    GTask        *task;
+    GCancellable *cancellable;
+    gulong        cancel_id;
+} PendingRequest;
+
+typedef struct {
+    GSocketConnection *connection;
+    gchar             *line;
+} WriteOp;
+
+/* The one connection of this process. Callbacks carry a reference to the
+ * connection they were started on and ignore results from an older one. */
+static struct {
+    GSocketConnection *connection;
+    GByteArray        *received; /* the reply line read so far */
+    gboolean           connecting;
+    gboolean           writing;
+    GQueue             outbox;  /* gchar *, written one at a time */
+    GQueue             pending; /* PendingRequest *, in send order */
+} client = { NULL, NULL, FALSE, FALSE, G_QUEUE_INIT, G_QUEUE_INIT };
+
+static void flush_outbox (void);
+static void read_next_chunk (void);
 
 static gchar *
 get_socket_path (void)
@@ -14,134 +52,412 @@ get_socket_path (void)
     return g_build_filename (runtime_dir, "bb-auth.sock", NULL);
 }
 
-static GSocketConnection *
-connect_to_socket (void)
+static void
+pending_request_free (PendingRequest *request)
 {
-    g_autoptr(GSocketClient) client = NULL;
-    g_autoptr(GSocketAddress) address = NULL;
-    g_autofree gchar *socket_path = NULL;
-    GSocketConnection *connection = NULL;
-    GError *error = NULL;
+    if (request->cancel_id != 0)
+        g_cancellable_disconnect (request->cancellable, request->cancel_id);
+    g_clear_object (&request->cancellable);
+    g_clear_object (&request->task);
+    g_free (request->cookie);
+    g_free (request);
+}
 
-    socket_path = get_socket_path ();
+static void
+write_op_free (WriteOp *op)
+{
+    g_object_unref (op->connection);
+    g_free (op->line);
+    g_free (op);
+}
 
-    client = g_socket_client_new ();
-    address = g_unix_socket_address_new (socket_path);
+static const gchar *
+get_string_member (JsonObject *obj, const gchar *name)
+{
+    if (!json_object_has_member (obj, name))
+        return NULL;
 
-    connection = g_socket_client_connect (client,
-                                          G_SOCKET_CONNECTABLE (address),
-                                          NULL, &error);
+    return json_object_get_string_member (obj, name);
+}
 
-    if (error) {
-        g_debug ("Failed to connect to socket %s: %s", socket_path, error->message);
-        g_error_free (error);
-        return NULL;
+static GList *
+find_request (const gchar *cookie)
+{
+    for (GList *link = client.pending.head; link; link = link->next) {
+        PendingRequest *request = link->data;
+        if (request->cookie && g_strcmp0 (request->cookie, cookie) == 0)
+            return link;
     }
 
-    return connection;
+    return NULL;
 }
 
-static gchar *
-send_json_command (const gchar *json_request)
+/* Oldest request of `kind`; replies without an id come back in send order */
+static GList *
+find_oldest (RequestKind kind)
+{
+    for (GList *link = client.pending.head; link; link = link->next) {
+        PendingRequest *request = link->data;
+        if (request->kind == kind)
+            return link;
+    }
+
+    return NULL;
+}
+
+/* Fails everything in flight; the next request opens a new connection */
+static void
+drop_connection (const GError *error)
+{
+    PendingRequest *request;
+
+    g_clear_pointer (&client.received, g_byte_array_unref);
+    g_clear_object (&client.connection);
+    client.writing = FALSE;
+    g_queue_clear_full (&client.outbox, g_free);
+
+    while ((request = g_queue_pop_head (&client.pending))) {
+        if (request->task)
+            g_task_return_error (request->task, g_error_copy (error));
+        pending_request_free (request);
+    }
+}
+
+static void
+complete_request (PendingRequest *request, JsonObject *reply, const gchar *line)
+{
+    const gchar *type = get_string_member (reply, "type");
+    const gchar *result = get_string_member (reply, "result");
+    const gchar *password;
+
+    switch (request->kind) {
+    case REQUEST_PING:
+        g_task_return_boolean (request->task, g_strcmp0 (type, "pong") == 0);
+        break;
+    case REQUEST_KEYRING:
+        if (g_strcmp0 (type, "keyring_response") != 0) {
+            g_warning ("Unexpected response from bb-auth: %s", line);
+            g_task_return_pointer (request->task, NULL, NULL);
+        } else if (g_strcmp0 (result, "ok") == 0) {
+            password = get_string_member (reply, "password");
+            g_task_return_pointer (request->task, g_strdup (password), g_free);
+        } else {
+            if (g_strcmp0 (result, "cancelled") == 0)
+                g_debug ("Keyring request cancelled by user");
+            else
+                g_warning ("Unexpected response from bb-auth: %s", line);
+            g_task_return_pointer (request->task, NULL, NULL);
+        }
+        break;
+    case REQUEST_CONFIRM:
+        g_task_return_boolean (request->task,
+                               g_strcmp0 (type, "keyring_response") == 0 &&
+                               g_strcmp0 (result, "confirmed") == 0);
+        break;
+    case REQUEST_DRAIN:
+        break;
+    }
+}
+
+static void
+dispatch_reply (const gchar *line)
 {
-    g_autoptr(GSocketConnection) connection = NULL;
-    GOutputStream *output;
-    GInputStream *input;
-    g_autoptr(GDataInputStream) data_input = NULL;
+    g_autoptr(JsonParser) parser = NULL;
     GError *error = NULL;
-    g_autofree gchar *request = NULL;
-    gchar *line = NULL;
+    JsonNode *root;
+    JsonObject *reply;
+    const gchar *id;
+    GList *link = NULL;
+    PendingRequest *request;
 
-    connection = connect_to_socket ();
-    if (!connection)
-        return NULL;
+    parser = json_parser_new ();
+    if (!json_parser_load_from_data (parser, line, -1, &error)) {
+        g_warning ("Failed to parse bb-auth reply: %s", error->message);
+        g_error_free (error);
+        return;
+    }
+
+    root = json_parser_get_root (parser);
+    if (!JSON_NODE_HOLDS_OBJECT (root))
+        return;
+
+    reply = json_node_get_object (root);
+    id = get_string_member (reply, "id");
+
+    if (id) {
+        /* No match means we cancelled it already */
+        link = find_request (id);
+    } else if (g_strcmp0 (get_string_member (reply, "type"), "pong") == 0) {
+        link = find_oldest (REQUEST_PING);
+    } else {
+        /* The ok or error for a session.cancel; the daemon echoes the
+         * cookie on errors for keyring requests */
+        link = find_oldest (REQUEST_DRAIN);
+        if (!link)
+            g_warning ("Unmatched reply from bb-auth: %s", line);
+    }
+
+    if (!link)
+        return;
+
+    request = link->data;
+    g_queue_delete_link (&client.pending, link);
+    complete_request (request, reply, line);
+    pending_request_free (request);
+}
+
+/* Replies are read a bounded chunk at a time, so a line is refused as soon
+ * as it outgrows BB_AUTH_MAX_MESSAGE_SIZE rather than once it is complete */
+static void
+on_chunk_read (GObject      *source,
+               GAsyncResult *result,
+               gpointer      user_data)
+{
+    g_autoptr(GSocketConnection) connection = user_data;
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GBytes) chunk = NULL;
+    const guint8 *data;
+    gsize size = 0;
+
+    chunk = g_input_stream_read_bytes_finish (G_INPUT_STREAM (source), result, &error);
+    if (connection != client.connection)
+        return;
 
-    output = g_io_stream_get_output_stream (G_IO_STREAM (connection));
-    input = g_io_stream_get_input_stream (G_IO_STREAM (connection));
-    data_input = g_data_input_stream_new (input);
+    if (chunk && g_bytes_get_size (chunk) == 0)
+        error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED, "bb-auth closed the connection");
 
-    request = g_strdup_printf ("%s\n", json_request);
+    if (error) {
+        g_debug ("Lost connection to bb-auth: %s", error->message);
+        drop_connection (error);
+        return;
+    }
+
+    data = g_bytes_get_data (chunk, &size);
+    g_byte_array_append (client.received, data, size);
+
+    /* A completion callback may drop the connection, and the buffer with it */
+    while (connection == client.connection) {
+        const guint8 *newline = memchr (client.received->data, '\n', client.received->len);
+        g_autofree gchar *line = NULL;
+        gsize length;
+
+        if (!newline)
+            break;
+
+        length = newline - client.received->data;
+        if (length > BB_AUTH_MAX_MESSAGE_SIZE)
+            break;
 
-    if (!g_output_stream_write_all (output, request, strlen (request),
-                                    NULL, NULL, &error)) {
+        line = g_strndup ((const gchar *) client.received->data, length);
+        g_byte_array_remove_range (client.received, 0, length + 1);
+        if (length > 0)
+            dispatch_reply (line);
+    }
+
+    if (connection != client.connection)
+        return;
+
+    if (client.received->len > BB_AUTH_MAX_MESSAGE_SIZE) {
+        error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE, "Reply exceeds maximum message size");
+        g_debug ("Lost connection to bb-auth: %s", error->message);
+        drop_connection (error);
+        return;
+    }
+
+    read_next_chunk ();
+}
+
+static void
+read_next_chunk (void)
+{
+    g_input_stream_read_bytes_async (g_io_stream_get_input_stream (G_IO_STREAM (client.connection)),
+                                     BB_AUTH_READ_CHUNK, G_PRIORITY_DEFAULT, NULL,
+                                     on_chunk_read, g_object_ref (client.connection));
+}
+
+static void
+on_line_written (GObject      *source,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+    WriteOp *op = user_data;
+    g_autoptr(GError) error = NULL;
+    gboolean stale = op->connection != client.connection;
+    gboolean written;
+
+    written = g_output_stream_write_all_finish (G_OUTPUT_STREAM (source), result, NULL, &error);
+    write_op_free (op);
+    if (stale)
+        return;
+
+    client.writing = FALSE;
+    if (!written) {
         g_debug ("Failed to write command: %s", error->message);
-        g_error_free (error);
-        return NULL;
+        drop_connection (error);
+        return;
     }
 
-    line = g_data_input_stream_read_line (data_input, NULL, NULL, &error);
-    if (!line) {
-        g_debug ("Failed to read response: %s", error->message);
-        g_error_free (error);
-        return NULL;
+    flush_outbox ();
+}
+
+static void
+flush_outbox (void)
+{
+    WriteOp *op;
+
+    if (client.writing || !client.connection || g_queue_is_empty (&client.outbox))
+        return;
+
+    op = g_new0 (WriteOp, 1);
+    op->connection = g_object_ref (client.connection);
+    op->line = g_queue_pop_head (&client.outbox);
+
+    client.writing = TRUE;
+    g_output_stream_write_all_async (g_io_stream_get_output_stream (G_IO_STREAM (client.connection)),
+                                     op->line, strlen (op->line), G_PRIORITY_DEFAULT, NULL,
+                                     on_line_written, op);
+}
+
+static void
+on_connected (GObject      *source,
+              GAsyncResult *result,
+              gpointer      user_data G_GNUC_UNUSED)
+{
+    g_autoptr(GError) error = NULL;
+    GSocketConnection *connection;
+
+    connection = g_socket_client_connect_finish (G_SOCKET_CLIENT (source), result, &error);
+    client.connecting = FALSE;
+
+    if (!connection) {
+        g_debug ("Failed to connect to bb-auth: %s", error->message);
+        drop_connection (error);
+        return;
     }
 
-    return line;
+    client.connection = connection;
+    client.received = g_byte_array_new ();
+
+    read_next_chunk ();
+    flush_outbox ();
 }
 
-gboolean
-bb_auth_ipc_ping (void)
+static void
+ensure_connected (void)
+{
+    g_autoptr(GSocketClient) socket_client = NULL;
+    g_autoptr(GSocketAddress) address = NULL;
+    g_autofree gchar *socket_path = NULL;
+
+    if (client.connection || client.connecting)
+        return;
+
+    socket_path = get_socket_path ();
+    socket_client = g_socket_client_new ();
+    address = g_unix_socket_address_new (socket_path);
+
+    client.connecting = TRUE;
+    g_socket_client_connect_async (socket_client, G_SOCKET_CONNECTABLE (address), NULL, on_connected, NULL);
+}
+
+static gboolean
+forward_cancel (gpointer user_data)
+{
+    bb_auth_ipc_cancel (user_data);
+    return G_SOURCE_REMOVE;
+}
+
+/* GCancellable handlers must not disconnect themselves, so defer to an idle */
+static void
+on_request_cancelled (GCancellable *cancellable G_GNUC_UNUSED,
+                      gpointer      user_data)
+{
+    g_idle_add_full (G_PRIORITY_DEFAULT, forward_cancel, g_strdup (user_data), g_free);
+}
+
+/* Queues `builder`'s object as one line; `task` is consumed */
+static void
+send_request (RequestKind   kind,
+              const gchar  *cookie,
+              JsonBuilder  *builder,
+              GTask        *task,
+              GCancellable *cancellable)
 {
-    g_autoptr(JsonBuilder) builder = NULL;
     g_autoptr(JsonGenerator) generator = NULL;
     g_autoptr(JsonNode) root = NULL;
     g_autofree gchar *json_str = NULL;
-    g_autofree gchar *response = NULL;
-    g_autoptr(JsonParser) parser = NULL;
-    GError *error = NULL;
-
-    builder = json_builder_new ();
-    json_builder_begin_object (builder);
-    json_builder_set_member_name (builder, "type");
-    json_builder_add_string_value (builder, "ping");
-    json_builder_end_object (builder);
+    PendingRequest *request;
+    gchar *line;
 
     root = json_builder_get_root (builder);
     generator = json_generator_new ();
     json_generator_set_root (generator, root);
     json_str = json_generator_to_data (generator, NULL);
 
-    response = send_json_command (json_str);
-    if (!response)
-        return FALSE;
+    line = g_strdup_printf ("%s\n", json_str);
+    if (strlen (line) > BB_AUTH_MAX_MESSAGE_SIZE) {
+        g_free (line);
+        if (task) {
+            g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE, "Request exceeds maximum message size");
+            g_object_unref (task);
+        }
+        return;
+    }
+
+    request = g_new0 (PendingRequest, 1);
+    request->kind = kind;
+    request->cookie = g_strdup (cookie);
+    request->task = task;
+    g_queue_push_tail (&client.pending, request);
 
-    parser = json_parser_new ();
-    if (!json_parser_load_from_data (parser, response, -1, &error)) {
-        g_debug ("Failed to parse ping response: %s", error->message);
-        g_error_free (error);
-        return FALSE;
+    if (cookie && cancellable) {
+        request->cancellable = g_object_ref (cancellable);
+        request->cancel_id = g_cancellable_connect (cancellable, G_CALLBACK (on_request_cancelled),
+                                                    g_strdup (cookie), g_free);
     }
 
-    JsonNode *resp_root = json_parser_get_root (parser);
-    if (!JSON_NODE_HOLDS_OBJECT (resp_root))
-        return FALSE;
+    g_queue_push_tail (&client.outbox, line);
+    ensure_connected ();
+    flush_outbox ();
+}
+
+void
+bb_auth_ipc_ping_async (GCancellable        *cancellable,
+                        GAsyncReadyCallback  callback,
+                        gpointer             user_data)
+{
+    g_autoptr(JsonBuilder) builder = NULL;
 
-    JsonObject *resp_obj = json_node_get_object (resp_root);
-    if (!json_object_has_member (resp_obj, "type"))
-        return FALSE;
+    builder = json_builder_new ();
+    json_builder_begin_object (builder);
+    json_builder_set_member_name (builder, "type");
+    json_builder_add_string_value (builder, "ping");
+    json_builder_end_object (builder);
 
-    const gchar *type = json_object_get_string_member (resp_obj, "type");
-    return type && g_strcmp0 (type, "pong") == 0;
+    send_request (REQUEST_PING, NULL, builder, g_task_new (NULL, cancellable, callback, user_data), NULL);
 }
 
 gboolean
-bb_auth_ipc_send_keyring_request (const gchar *cookie,
-                                   const gchar *title,
-                                   const gchar *message,
-                                   const gchar *description,
-                                   const gchar *warning,
-                                   gboolean     password_new,
-                                   gchar      **out_password)
+bb_auth_ipc_ping_finish (GAsyncResult  *result,
+                         GError       **error)
 {
-    GError *error = NULL;
-    g_autoptr(JsonBuilder) builder = NULL;
-    g_autoptr(JsonGenerator) generator = NULL;
-    g_autoptr(JsonNode) root = NULL;
-    g_autofree gchar *json_str = NULL;
-    g_autofree gchar *response = NULL;
-    g_autoptr(JsonParser) parser = NULL;
+    g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
 
-    *out_password = NULL;
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+void
+bb_auth_ipc_keyring_request_async (const gchar         *cookie,
+                                   const gchar         *title,
+                                   const gchar         *message,
+                                   const gchar         *description,
+                                   const gchar         *warning,
+                                   gboolean             password_new,
+                                   GCancellable        *cancellable,
+                                   GAsyncReadyCallback  callback,
+                                   gpointer             user_data)
+{
+    g_autoptr(JsonBuilder) builder = NULL;
 
     /* Build JSON payload */
     builder = json_builder_new ();
@@ -177,74 +493,28 @@ bb_auth_ipc_send_keyring_request (const gchar *cookie,
 
     json_builder_end_object (builder);
 
-    root = json_builder_get_root (builder);
-    generator = json_generator_new ();
-    json_generator_set_root (generator, root);
-    json_str = json_generator_to_data (generator, NULL);
-
-    response = send_json_command (json_str);
-    if (!response) {
-        g_warning ("Failed to connect to bb-auth.socket");
-        return FALSE;
-    }
-
-    parser = json_parser_new ();
-    if (!json_parser_load_from_data (parser, response, -1, &error)) {
-        g_warning ("Failed to parse keyring response: %s", error->message);
-        g_error_free (error);
-        return FALSE;
-    }
-
-    JsonNode *resp_root = json_parser_get_root (parser);
-    if (!JSON_NODE_HOLDS_OBJECT (resp_root))
-        return FALSE;
-
-    JsonObject *resp_obj = json_node_get_object (resp_root);
-    if (!json_object_has_member (resp_obj, "type"))
-        return FALSE;
-
-    const gchar *type = json_object_get_string_member (resp_obj, "type");
-    if (!type || g_strcmp0 (type, "keyring_response") != 0)
-        return FALSE;
-
-    if (!json_object_has_member (resp_obj, "result"))
-        return FALSE;
-
-    const gchar *result = json_object_get_string_member (resp_obj, "result");
-    if (result && g_strcmp0 (result, "ok") == 0) {
-        if (!json_object_has_member (resp_obj, "password"))
-            return FALSE;
-
-        const gchar *password = json_object_get_string_member (resp_obj, "password");
-        if (password) {
-            *out_password = g_strdup (password);
-            return TRUE;
-        }
-        return FALSE;
-    }
+    send_request (REQUEST_KEYRING, cookie, builder, g_task_new (NULL, cancellable, callback, user_data), cancellable);
+}
 
-    if (result && g_strcmp0 (result, "cancelled") == 0) {
-        g_debug ("Keyring request cancelled by user");
-        return FALSE;
-    }
+gchar *
+bb_auth_ipc_keyring_request_finish (GAsyncResult  *result,
+                                    GError       **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
 
-    g_warning ("Unexpected response from bb-auth: %s", response);
-    return FALSE;
+    return g_task_propagate_pointer (G_TASK (result), error);
 }
 
-gboolean
-bb_auth_ipc_send_confirm_request (const gchar *cookie,
-                                   const gchar *title,
-                                   const gchar *message,
-                                   const gchar *description)
+void
+bb_auth_ipc_confirm_request_async (const gchar         *cookie,
+                                   const gchar         *title,
+                                   const gchar         *message,
+                                   const gchar         *description,
+                                   GCancellable        *cancellable,
+                                   GAsyncReadyCallback  callback,
+                                   gpointer             user_data)
 {
-    GError *error = NULL;
     g_autoptr(JsonBuilder) builder = NULL;
-    g_autoptr(JsonGenerator) generator = NULL;
-    g_autoptr(JsonNode) root = NULL;
-    g_autofree gchar *json_str = NULL;
-    g_autofree gchar *response = NULL;
-    g_autoptr(JsonParser) parser = NULL;
 
     /* Build JSON payload */
     builder = json_builder_new ();
@@ -272,50 +542,36 @@ bb_auth_ipc_send_confirm_request (const gchar *cookie,
 
     json_builder_end_object (builder);
 
-    root = json_builder_get_root (builder);
-    generator = json_generator_new ();
-    json_generator_set_root (generator, root);
-    json_str = json_generator_to_data (generator, NULL);
-
-    response = send_json_command (json_str);
-    if (!response)
-        return FALSE;
-
-    parser = json_parser_new ();
-    if (!json_parser_load_from_data (parser, response, -1, &error)) {
-        g_warning ("Failed to parse confirm response: %s", error->message);
-        g_error_free (error);
-        return FALSE;
-    }
-
-    JsonNode *resp_root = json_parser_get_root (parser);
-    if (!JSON_NODE_HOLDS_OBJECT (resp_root))
-        return FALSE;
-
-    JsonObject *resp_obj = json_node_get_object (resp_root);
-    if (!json_object_has_member (resp_obj, "type"))
-        return FALSE;
-
-    const gchar *type = json_object_get_string_member (resp_obj, "type");
-    if (!type || g_strcmp0 (type, "keyring_response") != 0)
-        return FALSE;
+    send_request (REQUEST_CONFIRM, cookie, builder, g_task_new (NULL, cancellable, callback, user_data), cancellable);
+}
 
-    if (!json_object_has_member (resp_obj, "result"))
-        return FALSE;
+gboolean
+bb_auth_ipc_confirm_request_finish (GAsyncResult  *result,
+                                    GError       **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
 
-    const gchar *result = json_object_get_string_member (resp_obj, "result");
-    return result && g_strcmp0 (result, "confirmed") == 0;
+    return g_task_propagate_boolean (G_TASK (result), error);
 }
 
 void
-bb_auth_ipc_send_cancel (const gchar *cookie)
+bb_auth_ipc_cancel (const gchar *cookie)
 {
     g_autoptr(JsonBuilder) builder = NULL;
-    g_autoptr(JsonGenerator) generator = NULL;
-    g_autoptr(JsonNode) root = NULL;
-    g_autofree gchar *json_str = NULL;
-    g_autofree gchar *response = NULL;
+    PendingRequest *request;
+    GList *link;
+
+    link = find_request (cookie);
+    if (!link)
+        return;
+
+    request = link->data;
+    g_queue_delete_link (&client.pending, link);
+    g_task_return_new_error (request->task, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Request cancelled");
+    pending_request_free (request);
 
+    /* The daemon answers with a keyring_response for the dropped request,
+     * ignored as unknown, and an ok or error for the cancel itself */
     builder = json_builder_new ();
     json_builder_begin_object (builder);
     json_builder_set_member_name (builder, "type");
@@ -324,11 +580,5 @@ bb_auth_ipc_send_cancel (const gchar *cookie)
     json_builder_add_string_value (builder, cookie);
     json_builder_end_object (builder);
 
-    root = json_builder_get_root (builder);
-    generator = json_generator_new ();
-    json_generator_set_root (generator, root);
-    json_str = json_generator_to_data (generator, NULL);
-
-    response = send_json_command (json_str);
-    /* Ignore response - best effort cancel */
+    send_request (REQUEST_DRAIN, NULL, builder, NULL, NULL);
 }
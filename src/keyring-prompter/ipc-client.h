@@ -1,33 +1,49 @@
 #ifndef __IPC_CLIENT_H__
 #define __IPC_CLIENT_H__
 
-#include <glib.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
+/* All requests share one connection to bb-auth.sock, opened on first use and
+ * reopened after the daemon goes away. Everything runs on the main context. */
+
 /* Check if bb-auth socket is available */
-gboolean bb_auth_ipc_ping (void);
-
-/* Send a keyring password request, blocks until response received
- * Returns TRUE on success with password in out_password (caller must free)
- * Returns FALSE on cancel or error */
-gboolean bb_auth_ipc_send_keyring_request (const gchar *cookie,
-                                            const gchar *title,
-                                            const gchar *message,
-                                            const gchar *description,
-                                            const gchar *warning,
-                                            gboolean     password_new,
-                                            gchar      **out_password);
-
-/* Send a confirm request, blocks until response
- * Returns TRUE if confirmed, FALSE if cancelled */
-gboolean bb_auth_ipc_send_confirm_request (const gchar *cookie,
-                                            const gchar *title,
-                                            const gchar *message,
-                                            const gchar *description);
-
-/* Send cancel for a pending request */
-void bb_auth_ipc_send_cancel (const gchar *cookie);
+void     bb_auth_ipc_ping_async  (GCancellable        *cancellable,
+                                  GAsyncReadyCallback  callback,
+                                  gpointer             user_data);
+gboolean bb_auth_ipc_ping_finish (GAsyncResult        *result,
+                                  GError             **error);
+
+/* Send a keyring password request. Finishes with the password (caller must
+ * free) once the user answers, or NULL on cancel or error. Cancelling
+ * `cancellable` forwards the cancel to the daemon straight away. */
+void   bb_auth_ipc_keyring_request_async  (const gchar         *cookie,
+                                           const gchar         *title,
+                                           const gchar         *message,
+                                           const gchar         *description,
+                                           const gchar         *warning,
+                                           gboolean             password_new,
+                                           GCancellable        *cancellable,
+                                           GAsyncReadyCallback  callback,
+                                           gpointer             user_data);
+gchar *bb_auth_ipc_keyring_request_finish (GAsyncResult        *result,
+                                           GError             **error);
+
+/* Send a confirm request. Finishes with TRUE if confirmed, FALSE if cancelled */
+void     bb_auth_ipc_confirm_request_async  (const gchar         *cookie,
+                                             const gchar         *title,
+                                             const gchar         *message,
+                                             const gchar         *description,
+                                             GCancellable        *cancellable,
+                                             GAsyncReadyCallback  callback,
+                                             gpointer             user_data);
+gboolean bb_auth_ipc_confirm_request_finish (GAsyncResult        *result,
+                                             GError             **error);
+
+/* Cancel a pending request: tells the daemon and finishes it with
+ * G_IO_ERROR_CANCELLED. Does nothing once the request has finished. */
+void bb_auth_ipc_cancel (const gchar *cookie);
 
 G_END_DECLS
 
@@ -7,11 +7,16 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include "bb-prompt.h"
 #include "ipc-client.h"
+#include "../common/Trace.h"
 
 #define FALLBACK_GCR_PROMPTER "/usr/lib/gcr-prompter"
+#define DEFAULT_IDLE_TIMEOUT_S 30
 
 /* Entry point callable from C++ unified binary */
 #ifdef __cplusplus
@@ -22,10 +27,13 @@ int bb_auth_keyring_main(int argc, char* argv[]);
 }
 #endif
 
-static GcrSystemPrompter* the_prompter = NULL;
-static GMainLoop*         main_loop    = NULL;
-static guint              timeout_id   = 0;
-static gboolean           registered   = FALSE;
+static GcrSystemPrompter* the_prompter   = NULL;
+static GMainLoop*         main_loop      = NULL;
+static guint              timeout_id     = 0;
+static guint              owner_id       = 0;
+static gboolean           registered     = FALSE;
+/* 0 keeps the prompter resident: no exit, no timers */
+static guint              idle_timeout_s = DEFAULT_IDLE_TIMEOUT_S;
 
 static gboolean           on_timeout(gpointer user_data G_GNUC_UNUSED) {
     timeout_id = 0;
@@ -34,13 +42,26 @@ static gboolean           on_timeout(gpointer user_data G_GNUC_UNUSED) {
     return G_SOURCE_REMOVE;
 }
 
+/* Hand the pages a prompt dirtied back to the kernel before idling */
+static void trim_heap(void) {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
 static void reset_timeout(void) {
     if (timeout_id != 0) {
         g_source_remove(timeout_id);
         timeout_id = 0;
     }
-    /* Quit after 30 seconds of inactivity */
-    timeout_id = g_timeout_add_seconds(30, on_timeout, NULL);
+
+    if (idle_timeout_s == 0) {
+        trim_heap();
+        return;
+    }
+
+    /* Quit after idle_timeout_s seconds of inactivity */
+    timeout_id = g_timeout_add_seconds(idle_timeout_s, on_timeout, NULL);
 }
 
 static void on_prompting_changed(GObject* obj G_GNUC_UNUSED, GParamSpec* pspec G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED) {
@@ -95,10 +116,33 @@ static void fallback_to_gcr_prompter(char* argv[]) {
     exit(1);
 }
 
+static void register_prompter(void) {
+    /* Create system prompter with our custom prompt type */
+    the_prompter = gcr_system_prompter_new(GCR_SYSTEM_PROMPTER_SINGLE, BB_AUTH_TYPE_PROMPT);
+
+    g_signal_connect(the_prompter, "notify::prompting", G_CALLBACK(on_prompting_changed), NULL);
+
+    /* Acquire the D-Bus name */
+    owner_id = g_bus_own_name(G_BUS_TYPE_SESSION, "org.gnome.keyring.SystemPrompter", G_BUS_NAME_OWNER_FLAGS_REPLACE, on_bus_acquired, on_name_acquired, on_name_lost, NULL, NULL);
+
+    reset_timeout();
+}
+
+static void on_ping_finished(GObject* source G_GNUC_UNUSED, GAsyncResult* result, gpointer user_data) {
+    g_autoptr(GError) error = NULL;
+
+    if (!bb_auth_ipc_ping_finish(result, &error)) {
+        g_message("bb-auth daemon socket not available%s%s", error ? ": " : "", error ? error->message : "");
+        fallback_to_gcr_prompter(user_data);
+        /* Not reached */
+    }
+
+    g_message("bb-auth daemon socket is available, registering prompter");
+    register_prompter();
+}
+
 /* Renamed entry point for unified binary */
 int bb_auth_keyring_main(int argc G_GNUC_UNUSED, char* argv[]) {
-    guint owner_id;
-
     setlocale(LC_ALL, "");
 
     /* Enable debug output if requested */
@@ -107,28 +151,27 @@ int bb_auth_keyring_main(int argc G_GNUC_UNUSED, char* argv[]) {
                           NULL);
     }
 
-    g_message("bb-auth starting in keyring mode");
-
-    /* Check if bb-auth daemon socket is available */
-    if (!bb_auth_ipc_ping()) {
-        g_message("bb-auth daemon socket not available");
-        fallback_to_gcr_prompter(argv);
-        /* Not reached */
+    /* BB_AUTH_KEYRING_IDLE_S=0 for a resident prompter. Anything that is not a
+     * number keeps the default, so a typo never makes the prompter resident. */
+    const gchar* idle_env = g_getenv("BB_AUTH_KEYRING_IDLE_S");
+    if (idle_env && *idle_env) {
+        guint64 idle_s = 0;
+        GError* error  = NULL;
+        if (g_ascii_string_to_unsigned(idle_env, 10, 0, G_MAXUINT, &idle_s, &error)) {
+            idle_timeout_s = (guint)idle_s;
+        } else {
+            g_warning("Ignoring BB_AUTH_KEYRING_IDLE_S=%s (%s); using %d s", idle_env, error->message, DEFAULT_IDLE_TIMEOUT_S);
+            g_error_free(error);
+        }
     }
 
-    g_message("bb-auth daemon socket is available, registering prompter");
-
-    /* Create system prompter with our custom prompt type */
-    the_prompter = gcr_system_prompter_new(GCR_SYSTEM_PROMPTER_SINGLE, BB_AUTH_TYPE_PROMPT);
-
-    g_signal_connect(the_prompter, "notify::prompting", G_CALLBACK(on_prompting_changed), NULL);
+    g_message("bb-auth starting in keyring mode%s", idle_timeout_s == 0 ? " (resident)" : "");
+    BB_TRACE_INIT("keyring-prompter");
 
     main_loop = g_main_loop_new(NULL, FALSE);
 
-    /* Acquire the D-Bus name */
-    owner_id = g_bus_own_name(G_BUS_TYPE_SESSION, "org.gnome.keyring.SystemPrompter", G_BUS_NAME_OWNER_FLAGS_REPLACE, on_bus_acquired, on_name_acquired, on_name_lost, NULL, NULL);
-
-    reset_timeout();
+    /* Check if bb-auth daemon socket is available; this also opens the connection prompts reuse */
+    bb_auth_ipc_ping_async(NULL, on_ping_finished, argv);
 
     g_main_loop_run(main_loop);
 
@@ -138,12 +181,13 @@ int bb_auth_keyring_main(int argc G_GNUC_UNUSED, char* argv[]) {
     if (timeout_id != 0)
         g_source_remove(timeout_id);
 
-    g_bus_unown_name(owner_id);
+    if (owner_id != 0)
+        g_bus_unown_name(owner_id);
 
     if (registered)
         gcr_system_prompter_unregister(the_prompter, TRUE);
 
-    g_object_unref(the_prompter);
+    g_clear_object(&the_prompter);
     g_main_loop_unref(main_loop);
 
     return 0;
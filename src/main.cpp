@@ -1,16 +1,22 @@
+#include "common/Constants.hpp"
 #include "common/IpcClient.hpp"
 #include "common/Paths.hpp"
+#include "common/TraceDump.hpp"
 #include "core/Agent.hpp"
+#include "core/Metrics.hpp"
 #include "modes/daemon.hpp"
 #include "modes/pinentry.hpp"
 
 #include <QCommandLineParser>
 #include <QFileInfo>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QTextStream>
 
+#include <optional>
 #include <print>
+#include <string>
 
 // Forward declarations for mode runners
 namespace modes {
@@ -27,6 +33,93 @@ namespace {
         Cli
     };
 
+    // Nanoseconds as a short human-readable duration
+    std::string formatDuration(double ns) {
+        if (ns >= 1e9)
+            return std::format("{:.2f}s", ns / 1e9);
+        if (ns >= 1e6)
+            return std::format("{:.2f}ms", ns / 1e6);
+        if (ns >= 1e3)
+            return std::format("{:.1f}us", ns / 1e3);
+        return std::format("{:.0f}ns", ns);
+    }
+
+    void printStats(const QJsonObject& stats) {
+        std::print("uptime {}s, {} open session(s)\n\n", stats.value("uptime_ms").toInteger() / 1000, stats.value("sessions").toInt());
+
+        std::print("{:<22}{:>9}{:>10}{:>10}{:>10}{:>10}{:>10}{:>10}\n", "stage", "count", "min", "p50", "p90", "p99", "p99.9", "max");
+        // Pipeline order rather than the reply's alphabetical key order
+        const QJsonObject stages = stats.value("stages").toObject();
+        for (const std::string_view name : bb::metrics::STAGE_NAMES) {
+            const QJsonObject stage = stages.value(QLatin1StringView(name.data(), static_cast<qsizetype>(name.size()))).toObject();
+            const qint64      count = stage.value("count").toInteger();
+            if (count == 0) {
+                std::print("{:<22}{:>9}\n", name, 0);
+                continue;
+            }
+
+            auto field = [&stage](const char* key) { return formatDuration(stage.value(key).toDouble()); };
+            std::print("{:<22}{:>9}{:>10}{:>10}{:>10}{:>10}{:>10}{:>10}\n", name, count, field("min"), field("p50"), field("p90"), field("p99"), field("p999"), field("max"));
+        }
+
+        std::print("\n");
+        const QJsonObject counters = stats.value("counters").toObject();
+        for (auto it = counters.constBegin(); it != counters.constEnd(); ++it) {
+            std::print("{:<22}{:>9}\n", it.key().toStdString(), it.value().toInteger());
+        }
+
+        std::print("\n");
+        const QJsonObject tables = stats.value("tables").toObject();
+        for (auto it = tables.constBegin(); it != tables.constEnd(); ++it) {
+            std::print("{:<24}{:>7}\n", it.key().toStdString(), it.value().toInteger());
+        }
+    }
+
+    // An idle --follow poll is answered empty after this long and re-sent, so a
+    // wedged daemon is noticed without giving up the connection every time
+    inline constexpr int FOLLOW_WAIT_MS = 30 * 1000;
+
+    // The events of a `next` batch as newline-delimited JSON; false once stdout is gone
+    bool printEvents(const QJsonObject& batch) {
+        for (const QJsonValue& event : batch.value("events").toArray()) {
+            const auto out = QJsonDocument(event.toObject()).toJson(QJsonDocument::Compact);
+            std::print("{}\n", out.toStdString());
+        }
+        return fflush(stdout) == 0;
+    }
+
+    // One connection for the whole stream; the next poll goes out as soon as a batch is printed
+    int followEvents(const QString& socketPath, int max) {
+        bb::IpcConnection connection(socketPath);
+        const QJsonObject request{{"type", "next"}, {"max", max}, {"wait_ms", FOLLOW_WAIT_MS}};
+        for (;;) {
+            if (!connection.send(request))
+                return 1;
+
+            const auto reply = connection.waitReply(FOLLOW_WAIT_MS + bb::IPC_READ_TIMEOUT_MS);
+            if (!reply || reply->value("type").toString() != "events")
+                return 1;
+
+            // The reader went away (`| head`)
+            if (!printEvents(*reply))
+                return 0;
+        }
+    }
+
+    // Value of a numeric option, or std::nullopt (after an error message) if it is not an integer >= minimum
+    std::optional<int> intOption(const QCommandLineParser& parser, const QCommandLineOption& option, int defaultValue, int minimum) {
+        if (!parser.isSet(option))
+            return defaultValue;
+
+        bool      ok    = false;
+        const int value = parser.value(option).toInt(&ok);
+        if (!ok || value < minimum) {
+            std::print(stderr, "--{} expects an integer of at least {}\n", option.names().constFirst().toStdString(), minimum);
+            return std::nullopt;
+        }
+        return value;
+    }
+
     Mode detectModeFromArgv0(const QString& argv0) {
         const QString basename = QFileInfo(argv0).fileName();
 
@@ -53,8 +146,15 @@ namespace {
         // CLI options (for interacting with running daemon)
         QCommandLineOption optPing(QStringList{"ping"}, "Check if the daemon is reachable.");
         QCommandLineOption optNext(QStringList{"next"}, "Fetch the next pending request.");
+        QCommandLineOption optFollow(QStringList{"follow"}, "Stream pending requests as newline-delimited JSON over one connection.");
+        QCommandLineOption optMax(QStringList{"max"}, "With --next or --follow, fetch up to this many requests per reply.", "count");
+        QCommandLineOption optWait(QStringList{"wait-ms"}, "With --next, how long to wait for a request to arrive.", "ms");
         QCommandLineOption optRespond(QStringList{"respond"}, "Respond to a request (cookie).", "cookie");
         QCommandLineOption optCancel(QStringList{"cancel"}, "Cancel a request (cookie).", "cookie");
+        QCommandLineOption optStats(QStringList{"stats"}, "Show daemon latency percentiles and counters.");
+        QCommandLineOption optJson(QStringList{"json"}, "With --stats, print the raw JSON reply.");
+        QCommandLineOption optTraceDump(QStringList{"trace-dump"}, "Merge the trace rings of all bb-auth processes into Chrome/Perfetto JSON.");
+        QCommandLineOption optTraceCookie(QStringList{"trace-cookie"}, "With --trace-dump, keep only this session's flow.", "cookie");
         QCommandLineOption optSocket(QStringList{"socket", "s"}, "Override socket path.", "path");
 
         parser.addOption(optDaemon);
@@ -62,8 +162,15 @@ namespace {
         parser.addOption(optPinentry);
         parser.addOption(optPing);
         parser.addOption(optNext);
+        parser.addOption(optFollow);
+        parser.addOption(optMax);
+        parser.addOption(optWait);
         parser.addOption(optRespond);
         parser.addOption(optCancel);
+        parser.addOption(optStats);
+        parser.addOption(optJson);
+        parser.addOption(optTraceDump);
+        parser.addOption(optTraceCookie);
         parser.addOption(optSocket);
 
         parser.process(app);
@@ -89,12 +196,32 @@ namespace {
             return client.ping() ? 0 : 1;
         }
 
+        if (parser.isSet(optFollow)) {
+            const auto max = intOption(parser, optMax, bb::NEXT_BATCH_MAX, 1);
+            return max ? followEvents(socketPath, *max) : 2;
+        }
+
+        if (parser.isSet(optNext) && (parser.isSet(optMax) || parser.isSet(optWait))) {
+            const auto max    = intOption(parser, optMax, bb::NEXT_BATCH_MAX, 1);
+            const auto waitMs = intOption(parser, optWait, bb::IPC_READ_TIMEOUT_MS, 0);
+            if (!max || !waitMs)
+                return 2;
+
+            bb::IpcClient client(socketPath);
+            auto          response = client.sendRequest(QJsonObject{{"type", "next"}, {"max", *max}, {"wait_ms", *waitMs}}, *waitMs + bb::IPC_READ_TIMEOUT_MS);
+            if (!response || response->value("type").toString() != "events")
+                return 1;
+
+            printEvents(*response);
+            return response->value("events").toArray().isEmpty() ? 1 : 0;
+        }
+
         if (parser.isSet(optNext)) {
             bb::IpcClient client(socketPath);
             auto          response = client.sendRequest(QJsonObject{{"type", "next"}}, 1000);
             if (response) {
                 const auto out = QJsonDocument(*response).toJson(QJsonDocument::Compact);
-                fprintf(stdout, "%s\n", out.constData());
+                std::print("{}\n", out.toStdString());
             }
             return response ? 0 : 1;
         }
@@ -117,6 +244,30 @@ namespace {
             return (response && response->value("type").toString() == "ok") ? 0 : 1;
         }
 
+        if (parser.isSet(optStats)) {
+            bb::IpcClient client(socketPath);
+            auto          response = client.sendRequest(QJsonObject{{"type", "stats"}}, 1000);
+            if (!response || response->value("type").toString() != "stats") {
+                return 1;
+            }
+
+            if (parser.isSet(optJson)) {
+                const auto out = QJsonDocument(*response).toJson(QJsonDocument::Compact);
+                std::print("{}\n", out.toStdString());
+            } else {
+                printStats(*response);
+            }
+            return 0;
+        }
+
+        if (parser.isSet(optTraceDump)) {
+            // Reads the rings directly; the daemon does not need to be running
+            const QJsonObject trace = bb::trace::dumpChromeTrace(parser.value(optTraceCookie));
+            const auto        out   = QJsonDocument(trace).toJson(QJsonDocument::Compact);
+            std::print("{}\n", out.toStdString());
+            return 0;
+        }
+
         // No explicit mode or CLI command - default to daemon
         return modes::runDaemon(app, socketPath);
     }
@@ -1,5 +1,6 @@
 #include "daemon.hpp"
 #include "../common/Paths.hpp"
+#include "../common/Trace.h"
 #include "../core/Agent.hpp"
 
 #include <print>
@@ -11,6 +12,7 @@ namespace modes {
 
         std::print("Starting bb-auth daemon\n");
         std::print("Socket path: {}\n", socketPath.toStdString());
+        BB_TRACE_INIT("daemon");
 
         g_pAgent = std::make_unique<CAgent>();
         return g_pAgent->start(app, socketPath) ? 0 : 1;
@@ -3,17 +3,26 @@
 #include "../common/Constants.hpp"
 #include "../common/IpcClient.hpp"
 #include "../common/Paths.hpp"
+#include "../common/SecureMemory.hpp"
+#include "../common/Trace.hpp"
+#include "../core/ipc/JsonMessage.hpp"
 
 #include <QCoreApplication>
+#include <QElapsedTimer>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QTextStream>
 #include <QUuid>
 
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <iostream>
+#include <optional>
+#include <poll.h>
 #include <print>
 #include <string>
+#include <unistd.h>
 
 namespace {
 
@@ -53,6 +62,18 @@ namespace {
         return result;
     }
 
+    // The same encoding for a passphrase, written straight into the arena line
+    void assuanEncodeInto(bb::SecretString& out, QByteArrayView input) {
+        for (const char c : input) {
+            switch (c) {
+                case '%': out.append(QByteArrayView("%25")); break;
+                case '\n': out.append(QByteArrayView("%0A")); break;
+                case '\r': out.append(QByteArrayView("%0D")); break;
+                default: out.append(c); break;
+            }
+        }
+    }
+
     struct PinentryState {
         QString description;
         QString prompt;
@@ -66,6 +87,71 @@ namespace {
         bool    confirmMode = false;
     };
 
+    // Assuan commands from gpg-agent, read straight off fd 0 (not through std::cin's
+    // buffer) so that stdin can share one poll() with the daemon socket
+    class CommandReader {
+      public:
+        int fd() const {
+            return STDIN_FILENO;
+        }
+
+        bool atEof() const {
+            return m_eof;
+        }
+
+        // One read() of whatever stdin holds; call only once poll() reports it readable
+        void readAvailable() {
+            char    buffer[4096];
+            ssize_t received;
+            do {
+                received = ::read(STDIN_FILENO, buffer, sizeof(buffer));
+            } while (received == -1 && errno == EINTR);
+
+            if (received <= 0) {
+                m_eof = true;
+                return;
+            }
+            m_buffer.append(buffer, received);
+        }
+
+        // Next non-empty line, without its line ending. A last line missing its newline counts once stdin is closed.
+        std::optional<QString> takeLine() {
+            for (;;) {
+                qsizetype newline = m_buffer.indexOf('\n');
+                if (newline == -1) {
+                    if (!m_eof || m_buffer.isEmpty()) {
+                        return std::nullopt;
+                    }
+                    newline = m_buffer.size();
+                }
+
+                QByteArray line = m_buffer.left(newline);
+                m_buffer.remove(0, std::min(newline + 1, m_buffer.size()));
+                // Remove trailing \r if present (Windows line endings)
+                if (line.endsWith('\r')) {
+                    line.chop(1);
+                }
+                if (!line.isEmpty()) {
+                    return QString::fromUtf8(line);
+                }
+            }
+        }
+
+        // gpg-agent queued BYE behind the command being served
+        bool hasPendingBye() const {
+            for (const QByteArray& line : m_buffer.split('\n')) {
+                if (line.trimmed().toUpper() == "BYE") {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+      private:
+        QByteArray m_buffer;
+        bool       m_eof = false;
+    };
+
     class PinentrySession {
       public:
         PinentrySession() = default;
@@ -74,17 +160,22 @@ namespace {
             // Send initial greeting
             sendOk("BB Auth Pinentry");
 
-            std::string line;
-            while (std::getline(std::cin, line)) {
-                if (line.empty())
-                    continue;
-
-                // Remove trailing \r if present (Windows line endings)
-                if (!line.empty() && line.back() == '\r')
-                    line.pop_back();
-
-                if (!handleCommand(QString::fromStdString(line)))
+            bool running = true;
+            while (running) {
+                while (auto line = input.takeLine()) {
+                    if (!handleCommand(*line)) {
+                        running = false;
+                        break;
+                    }
+                }
+                if (!running || input.atEof()) {
                     break;
+                }
+
+                pollfd pfd{input.fd(), POLLIN, 0};
+                if (::poll(&pfd, 1, -1) > 0) {
+                    input.readAvailable();
+                }
             }
 
             finalizeOnStreamClose();
@@ -93,9 +184,14 @@ namespace {
         }
 
       private:
-        PinentryState state;
-        QString       flowCookie;
-        bool          awaitingTerminalResult = false;
+        PinentryState     state;
+        QString           flowCookie;
+        bool              awaitingTerminalResult = false;
+
+        CommandReader     input;
+        // Kept for the whole process, so a retry's result and the next request share one connection
+        bb::IpcConnection daemon{bb::socketPath()};
+        int               pendingAcks = 0; // replies to pinentry_result still owed on `daemon`
 
         QString       ensureFlowCookie() {
             if (flowCookie.isEmpty()) {
@@ -137,8 +233,9 @@ namespace {
                 return;
             }
 
-            bb::IpcClient client(bb::socketPath());
-            QJsonObject   request;
+            BB_TRACE_SCOPE("pinentry.result", flowCookie);
+
+            QJsonObject request;
             request["type"]   = "pinentry_result";
             request["id"]     = flowCookie;
             request["result"] = result;
@@ -146,8 +243,14 @@ namespace {
                 request["error"] = error;
             }
 
-            auto response = client.sendRequest(request, bb::IPC_READ_TIMEOUT_MS);
-            if (!response || (*response)["type"].toString() == "error") {
+            if (sendToDaemon(request)) {
+                ++pendingAcks;
+                // A retry is followed by the next request on the same connection; its
+                // acknowledgement is read then, saving a round trip on the retry path
+                if (result != "retry") {
+                    drainAcks(bb::IPC_READ_TIMEOUT_MS);
+                }
+            } else {
                 std::print(stderr, "pinentry: failed to report terminal result for cookie {}\n", flowCookie.toStdString());
             }
 
@@ -158,6 +261,88 @@ namespace {
             }
         }
 
+        bool sendToDaemon(const QJsonObject& request) {
+            if (daemon.send(request)) {
+                return true;
+            }
+
+            // The daemon may have restarted since the last exchange; acknowledgements owed on the old connection went with it
+            pendingAcks = 0;
+            return daemon.send(request);
+        }
+
+        void checkAck(const bb::JsonMessage& reply) {
+            if (reply.type() == "error") {
+                std::print(stderr, "pinentry: failed to report terminal result: {}\n", reply.string("message").toStdString());
+            }
+        }
+
+        void drainAcks(int timeoutMs) {
+            while (pendingAcks > 0) {
+                const auto line  = daemon.waitLine(timeoutMs);
+                const auto reply = line ? bb::JsonMessage::parse(line->view()) : std::nullopt;
+                if (!reply) {
+                    std::print(stderr, "pinentry: no acknowledgement for terminal result of cookie {}\n", flowCookie.toStdString());
+                    pendingAcks = 0;
+                    return;
+                }
+                --pendingAcks;
+                checkAck(*reply);
+            }
+        }
+
+        // Sends a prompt request and waits for its reply while still watching gpg-agent.
+        // Returns nullopt if the daemon is gone, the prompt times out, or gpg-agent gave
+        // up (closed stdin or queued BYE). Then the connection is dropped, which the daemon
+        // takes as a cancel of the prompt, so no terminal result follows. The reply is
+        // returned as its raw line, still in the arena, for JsonMessage::parse().
+        std::optional<bb::SecretString> exchange(const QJsonObject& request) {
+            if (!sendToDaemon(request)) {
+                return std::nullopt;
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+            for (;;) {
+                while (auto line = daemon.takeLine()) {
+                    const auto reply = bb::JsonMessage::parse(line->view());
+                    if (!reply) {
+                        continue;
+                    }
+                    if (pendingAcks > 0) {
+                        --pendingAcks;
+                        checkAck(*reply);
+                        continue;
+                    }
+                    return line;
+                }
+
+                if (!daemon.isOpen()) {
+                    pendingAcks = 0;
+                    return std::nullopt;
+                }
+
+                const qint64 remaining = bb::PINENTRY_REQUEST_TIMEOUT_MS - timer.elapsed();
+                if (input.atEof() || input.hasPendingBye() || remaining <= 0) {
+                    daemon.close();
+                    pendingAcks = 0;
+                    resetFlow();
+                    return std::nullopt;
+                }
+
+                pollfd fds[] = {{input.fd(), POLLIN, 0}, {daemon.fd(), POLLIN, 0}};
+                if (::poll(fds, 2, static_cast<int>(remaining)) <= 0) {
+                    continue;
+                }
+                if (fds[1].revents != 0) {
+                    daemon.readAvailable();
+                }
+                if (fds[0].revents != 0) {
+                    input.readAvailable();
+                }
+            }
+        }
+
         void sendOk(const QString& comment = {}) {
             if (comment.isEmpty())
                 std::cout << "OK\n";
@@ -176,6 +361,30 @@ namespace {
             std::cout.flush();
         }
 
+        // The passphrase line is built in the arena and leaves in one write(), so no
+        // iostream or stdio buffer ever holds it
+        bool sendSecretData(const bb::SecretString& data) {
+            bb::SecretString line;
+            line.reserve(data.size() * 3 + 3);
+            line.append(QByteArrayView("D "));
+            assuanEncodeInto(line, data.view());
+            line.append('\n');
+
+            std::cout.flush();
+            std::size_t written = 0;
+            while (written < line.size()) {
+                const ssize_t n = ::write(STDOUT_FILENO, line.data() + written, line.size() - written);
+                if (n == -1 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    return false;
+                }
+                written += static_cast<std::size_t>(n);
+            }
+            return true;
+        }
+
         bool handleCommand(const QString& line) {
             // Split command and argument
             qsizetype spaceIdx = line.indexOf(' ');
@@ -315,13 +524,11 @@ namespace {
                 reportTerminalResult("retry", retryError);
             }
 
-            QString password;
-            bool    success = requestPasswordFromDaemon(password);
+            bb::SecretString password;
+            bool             success = requestPasswordFromDaemon(password);
 
             if (success && !password.isEmpty()) {
-                sendData(password);
-                // Securely clear password string
-                password.fill('\0');
+                sendSecretData(password);
                 sendOk();
             } else {
                 // User cancelled or error - use Operation cancelled error code
@@ -353,10 +560,9 @@ namespace {
             return true;
         }
 
-        bool requestPasswordFromDaemon(QString& password) {
-            bb::IpcClient client(bb::socketPath());
-
+        bool requestPasswordFromDaemon(bb::SecretString& password) {
             const QString cookie = ensureFlowCookie();
+            BB_TRACE_SCOPE("pinentry.request", cookie);
 
             // Build request JSON
             QJsonObject request;
@@ -374,20 +580,21 @@ namespace {
             if (!state.keyinfo.isEmpty())
                 request["keyinfo"] = state.keyinfo;
 
-            auto response = client.sendRequest(request, bb::PINENTRY_REQUEST_TIMEOUT_MS);
+            const auto line = exchange(request);
 
-            if (!response) {
-                std::print(stderr, "pinentry: failed to communicate with daemon\n");
+            if (!line) {
+                std::print(stderr, "pinentry: no reply from daemon\n");
                 resetFlow();
                 return false;
             }
 
-            QString type = (*response)["type"].toString();
+            // The passphrase is decoded from the line straight into the arena
+            const auto           response = bb::JsonMessage::parse(line->view());
+            const QByteArrayView type     = response->type();
 
             if (type == "pinentry_response") {
-                QString result = (*response)["result"].toString();
-                if (result == "ok") {
-                    password               = (*response)["password"].toString();
+                if (response->string("result") == "ok") {
+                    password               = response->secret("password");
                     awaitingTerminalResult = true;
                     return true;
                 }
@@ -397,7 +604,7 @@ namespace {
             }
 
             if (type == "error") {
-                std::print(stderr, "pinentry: daemon error: {}\n", (*response)["error"].toString().toStdString());
+                std::print(stderr, "pinentry: daemon error: {}\n", response->string("error").toStdString());
                 resetFlow();
                 return false;
             }
@@ -407,9 +614,8 @@ namespace {
         }
 
         bool requestConfirmFromDaemon() {
-            bb::IpcClient client(bb::socketPath());
-
             const QString cookie = ensureFlowCookie();
+            BB_TRACE_SCOPE("pinentry.confirm", cookie);
 
             QJsonObject   request;
             request["type"]         = "pinentry_request";
@@ -418,14 +624,15 @@ namespace {
             request["prompt"]       = state.description.isEmpty() ? "Please confirm" : state.description;
             request["confirm_only"] = true;
 
-            auto response = client.sendRequest(request, bb::PINENTRY_REQUEST_TIMEOUT_MS);
+            const auto line = exchange(request);
 
-            if (!response) {
+            if (!line) {
                 resetFlow();
                 return false;
             }
 
-            const bool confirmed = (*response)["type"].toString() == "pinentry_response" && (*response)["result"].toString() == "confirmed";
+            const auto response  = bb::JsonMessage::parse(line->view());
+            const bool confirmed = response->type() == "pinentry_response" && response->string("result") == "confirmed";
             if (confirmed) {
                 awaitingTerminalResult = true;
             } else {
@@ -441,6 +648,8 @@ namespace {
 namespace modes {
 
     int runPinentry() {
+        BB_TRACE_INIT("pinentry");
+
         PinentrySession session;
         return session.run();
     }
@@ -0,0 +1,157 @@
+#pragma once
+
+// In-process stand-ins for the parties around CAgent, shared by the end-to-end
+// benchmark and the stress test: a polkitd stub behind CPolkitListener and a
+// provider client without a UI. The agent and its clients share one thread, so
+// everything here is driven by pumping the event loop.
+
+#include "../src/core/Agent.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QProcess>
+#include <QTimer>
+
+#include <functional>
+#include <memory>
+
+namespace bb::harness {
+
+    inline constexpr int STEP_TIMEOUT_MS       = 2000;
+    inline constexpr int HEARTBEAT_INTERVAL_MS = 5000;
+
+    template <typename Predicate>
+    bool pumpUntil(Predicate done, int timeoutMs = STEP_TIMEOUT_MS) {
+        QElapsedTimer timer;
+        timer.start();
+        while (!done()) {
+            if (timer.elapsed() > timeoutMs) {
+                return false;
+            }
+            QCoreApplication::processEvents(QEventLoop::AllEvents, 50);
+            QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+        }
+        return true;
+    }
+
+    inline void writeJson(QLocalSocket* socket, const QJsonObject& msg) {
+        socket->write(QJsonDocument(msg).toJson(QJsonDocument::Compact) + '\n');
+        socket->flush();
+    }
+
+    // Plays gpg-agent towards a started `--pinentry` child: writes `script` at once
+    // and sends BYE after the last command's reply, as gpg-agent never queues a command
+    // behind a pending one (the pinentry treats a queued BYE as giving up on the prompt).
+    // The returned buffer collects stdout; it is complete once the process has finished.
+    inline std::shared_ptr<QByteArray> scriptPinentry(QProcess* process, const QByteArray& script) {
+        auto      output  = std::make_shared<QByteArray>();
+        // The greeting, then one OK or ERR per command
+        const int replies = 1 + static_cast<int>(script.count('\n'));
+
+        QObject::connect(process, &QProcess::readyReadStandardOutput, process, [process, output, replies] {
+            const int before = static_cast<int>(output->count("\nOK") + output->count("\nERR") + (output->startsWith("OK") ? 1 : 0));
+            output->append(process->readAllStandardOutput());
+            const int after = static_cast<int>(output->count("\nOK") + output->count("\nERR") + (output->startsWith("OK") ? 1 : 0));
+            if (before < replies && after >= replies) {
+                process->write("BYE\n");
+                process->closeWriteChannel();
+            }
+        });
+
+        process->write(script);
+        return output;
+    }
+
+    // Stands in for polkitd: whatever the provider answers, the PAM conversation
+    // ends on the next loop turn, as the real helper's completion would arrive.
+    class StubPolkitListener : public CPolkitListener {
+      public:
+        void submitPassword(const QString& cookie, const bb::SecretString& pass) override {
+            Q_UNUSED(pass)
+            QTimer::singleShot(0, g_pAgent.get(), [cookie] { g_pAgent->onSessionComplete(cookie, true); });
+        }
+
+        void cancelPending(const QString& cookie) override {
+            QTimer::singleShot(0, g_pAgent.get(), [cookie] { g_pAgent->onSessionComplete(cookie, false); });
+        }
+    };
+
+    // A shell without a UI: registers, subscribes, heartbeats and hands every
+    // message to `onMessage`. Tracks its own id and whether it is the active provider.
+    class HeadlessProvider : public QObject {
+      public:
+        std::function<void(HeadlessProvider* provider, const QJsonObject& msg)> onMessage;
+
+        bool connectTo(const QString& path, const QString& name, int priority) {
+            m_socket.connectToServer(path);
+            if (!m_socket.waitForConnected(STEP_TIMEOUT_MS)) {
+                return false;
+            }
+
+            QObject::connect(&m_socket, &QLocalSocket::readyRead, this, [this] { readLines(); });
+            send(QJsonObject{{"type", "ui.register"}, {"name", name}, {"kind", "headless"}, {"priority", priority}});
+            send(QJsonObject{{"type", "subscribe"}});
+
+            m_heartbeat.setInterval(HEARTBEAT_INTERVAL_MS);
+            QObject::connect(&m_heartbeat, &QTimer::timeout, this, [this] { send(QJsonObject{{"type", "ui.heartbeat"}}); });
+            m_heartbeat.start();
+
+            return pumpUntil([this] { return m_subscribed; });
+        }
+
+        void send(const QJsonObject& msg) {
+            writeJson(&m_socket, msg);
+        }
+
+        // Graceful shutdown
+        void close() {
+            m_heartbeat.stop();
+            m_socket.disconnectFromServer();
+        }
+
+        // As if the shell crashed: unsent output is dropped
+        void abort() {
+            m_heartbeat.stop();
+            m_socket.abort();
+        }
+
+        const QString& id() const {
+            return m_id;
+        }
+
+        bool isActive() const {
+            return m_active;
+        }
+
+      private:
+        void readLines() {
+            while (m_socket.canReadLine()) {
+                const QJsonObject msg  = QJsonDocument::fromJson(m_socket.readLine()).object();
+                const QString     type = msg.value("type").toString();
+
+                if (type == "ui.registered") {
+                    m_id     = msg.value("id").toString();
+                    m_active = msg.value("active").toBool();
+                } else if (type == "ui.active") {
+                    m_active = msg.value("active").toBool() && msg.value("id").toString() == m_id;
+                } else if (type == "subscribed") {
+                    m_subscribed = true;
+                }
+
+                if (onMessage) {
+                    onMessage(this, msg);
+                }
+            }
+        }
+
+        QLocalSocket m_socket;
+        QTimer       m_heartbeat;
+        QString      m_id;
+        bool         m_active     = false;
+        bool         m_subscribed = false;
+    };
+
+} // namespace bb::harness
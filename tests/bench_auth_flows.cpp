@@ -0,0 +1,389 @@
+#include "agent_harness.hpp"
+#include "../src/core/Metrics.hpp"
+#include "../src/modes/pinentry.hpp"
+
+#include <QtTest/QtTest>
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QTimer>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace bb {
+
+    enum class FlowKind {
+        Polkit,
+        Keyring,
+        Pinentry
+    };
+
+} // namespace bb
+
+Q_DECLARE_METATYPE(bb::FlowKind)
+
+namespace bb {
+
+    using harness::HeadlessProvider;
+    using harness::pumpUntil;
+    using harness::writeJson;
+
+    namespace {
+
+        inline constexpr int  POLKIT_FLOWS   = 2000;
+        inline constexpr int  KEYRING_FLOWS  = 2000;
+        inline constexpr int  PINENTRY_FLOWS = 200; // one pinentry process per flow, as gpg-agent does
+        inline constexpr int  ROW_TIMEOUT_MS = 120000;
+        inline constexpr int  FANOUT_SAMPLES = 1000; // enough output to fill a stalled reader's socket buffer
+        inline constexpr char PINENTRY_ARG[] = "--pinentry";
+        inline constexpr char PASSWORD[]     = "hunter2";
+
+    } // namespace
+
+    // Whole authentication flows through CAgent's IPC side: polkit sessions injected
+    // through a stub listener, keyring prompts from a prompter-like client and
+    // pinentry prompts from real `--pinentry` processes driven over Assuan.
+    // Each row keeps `concurrency` flows in flight until its flow count completes.
+    class AuthFlowBenchmark : public QObject {
+        Q_OBJECT
+
+      private slots:
+        void initTestCase();
+        void cleanupTestCase();
+
+        void flows_data();
+        void flows();
+
+        void polkitFanout_data();
+        void polkitFanout();
+
+      private:
+        void launchFlows();
+        void launchPolkit(int index);
+        void launchKeyring(int index);
+        void launchPinentry(int index);
+        void finishFlow(qint64 startedAt, bool ok);
+
+        QTemporaryDir                     m_dir;
+        QString                           m_socketPath;
+        std::unique_ptr<HeadlessProvider> m_provider;
+
+        // Current row
+        FlowKind                          m_kind        = FlowKind::Polkit;
+        int                               m_concurrency = 1;
+        int                               m_total       = 0;
+        int                               m_launched    = 0;
+        int                               m_completed   = 0;
+        int                               m_failed      = 0;
+        int                               m_inFlight    = 0;
+        bool                              m_standDown   = false; // the provider ignores sessions while a fan-out row runs
+        QHash<QString, qint64>            m_polkitStartedAt;
+        metrics::LatencyHistogram         m_latency;
+    };
+
+    void AuthFlowBenchmark::initTestCase() {
+        QVERIFY(m_dir.isValid());
+        m_socketPath = m_dir.filePath("bb-auth.sock");
+
+        g_pAgent = std::make_unique<CAgent>(new harness::StubPolkitListener);
+        QVERIFY(g_pAgent->startIpc(m_socketPath));
+
+        // Answers every session the moment it is announced
+        m_provider            = std::make_unique<HeadlessProvider>();
+        m_provider->onMessage = [this](HeadlessProvider* provider, const QJsonObject& msg) {
+            if (m_standDown) {
+                return;
+            }
+
+            const QString type = msg.value("type").toString();
+            if (type == "session.created") {
+                provider->send(QJsonObject{{"type", "session.respond"}, {"id", msg.value("id")}, {"response", PASSWORD}});
+                return;
+            }
+            if (type != "session.closed") {
+                return;
+            }
+
+            const auto it = m_polkitStartedAt.constFind(msg.value("id").toString());
+            if (it == m_polkitStartedAt.constEnd()) {
+                return;
+            }
+            const qint64 startedAt = it.value();
+            m_polkitStartedAt.erase(it);
+            finishFlow(startedAt, true);
+        };
+        QVERIFY(m_provider->connectTo(m_socketPath, "bench", 100));
+    }
+
+    void AuthFlowBenchmark::cleanupTestCase() {
+        if (m_provider) {
+            m_provider->close();
+            pumpUntil([] { return false; }, 100);
+            m_provider.reset();
+        }
+        g_pAgent.reset();
+    }
+
+    void AuthFlowBenchmark::flows_data() {
+        QTest::addColumn<FlowKind>("kind");
+        QTest::addColumn<int>("concurrency");
+        QTest::addColumn<int>("flowCount");
+
+        const struct {
+            const char* name;
+            FlowKind    kind;
+            int         flowCount;
+        } kinds[] = {{"polkit", FlowKind::Polkit, POLKIT_FLOWS}, {"keyring", FlowKind::Keyring, KEYRING_FLOWS}, {"pinentry", FlowKind::Pinentry, PINENTRY_FLOWS}};
+
+        for (const auto& kind : kinds) {
+            for (const int concurrency : {1, 16, 64}) {
+                const QByteArray tag = QByteArray(kind.name) + "/n=" + QByteArray::number(concurrency);
+                QTest::newRow(tag.constData()) << kind.kind << concurrency << kind.flowCount;
+            }
+        }
+    }
+
+    void AuthFlowBenchmark::flows() {
+        QFETCH(FlowKind, kind);
+        QFETCH(int, concurrency);
+        QFETCH(int, flowCount);
+
+        m_kind        = kind;
+        m_concurrency = concurrency;
+        m_total       = flowCount;
+        m_launched    = 0;
+        m_completed   = 0;
+        m_failed      = 0;
+        m_inFlight    = 0;
+        m_polkitStartedAt.clear();
+        m_latency.reset();
+
+        QElapsedTimer timer;
+        timer.start();
+
+        launchFlows();
+        QVERIFY2(pumpUntil([this] { return m_completed + m_failed == m_total; }, ROW_TIMEOUT_MS), "flows did not complete in time");
+        const qint64 elapsedNs = timer.nsecsElapsed();
+
+        QCOMPARE(m_failed, 0);
+
+        const double flowsPerSecond = static_cast<double>(m_completed) * 1e9 / static_cast<double>(elapsedNs);
+        qInfo("flows=%s completed=%d throughput=%.0f/s p50=%lldus p99=%lldus max=%lldus", QTest::currentDataTag(), m_completed, flowsPerSecond,
+              m_latency.percentile(0.50) / 1000, m_latency.percentile(0.99) / 1000, m_latency.max() / 1000);
+        QTest::setBenchmarkResult(static_cast<qreal>(elapsedNs / m_completed), QTest::WalltimeNanoseconds);
+    }
+
+    void AuthFlowBenchmark::polkitFanout_data() {
+        QTest::addColumn<int>("subscriberCount");
+        QTest::addColumn<bool>("stalled");
+
+        for (const int count : {1, 10, 100}) {
+            QTest::addRow("n=%d", count) << count << false;
+            QTest::addRow("n=%d/stalled", count) << count << true;
+        }
+    }
+
+    // Session events reach every subscriber while no provider is registered. Measures,
+    // per polkit request, how long CAgent::onPolkitRequest (what initiateAuthentication
+    // calls) takes and when the first byte is readable at the last subscriber in fan-out
+    // order. In the stalled rows one more subscriber, early in that order, never reads.
+    void AuthFlowBenchmark::polkitFanout() {
+        QFETCH(int, subscriberCount);
+        QFETCH(bool, stalled);
+
+        // Each session would otherwise start the real fallback UI
+        qputenv("BB_AUTH_FALLBACK_PATH", "/bin/true");
+        m_standDown = true;
+        m_provider->send(QJsonObject{{"type", "ui.unregister"}});
+        QVERIFY(pumpUntil([this] { return !m_provider->isActive(); }));
+
+        const qint64     idleSubscribers = g_pAgent->tableSizes().value("subscribers").toInteger();
+        qint64           subscribed      = idleSubscribers;
+        const auto       awaitSubscribed = [&subscribed] {
+            ++subscribed;
+            return pumpUntil([&subscribed] { return g_pAgent->tableSizes().value("subscribers").toInteger() == subscribed; });
+        };
+        const QByteArray subscribeLine = QJsonDocument(QJsonObject{{"type", "subscribe"}}).toJson(QJsonDocument::Compact) + '\n';
+
+        // A bare descriptor: a QLocalSocket would be drained by the event loop
+        int stalledFd = -1;
+        if (stalled) {
+            const QByteArray path = QFile::encodeName(m_socketPath);
+            sockaddr_un      addr{};
+            addr.sun_family = AF_UNIX;
+            std::memcpy(addr.sun_path, path.constData(), static_cast<std::size_t>(path.size()));
+
+            stalledFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            QVERIFY(stalledFd != -1);
+            QVERIFY(::connect(stalledFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+            QCOMPARE(::write(stalledFd, subscribeLine.constData(), static_cast<std::size_t>(subscribeLine.size())), static_cast<ssize_t>(subscribeLine.size()));
+            QVERIFY(awaitSubscribed());
+        }
+
+        std::vector<std::unique_ptr<QLocalSocket>> readers;
+        for (int i = 0; i < subscriberCount; ++i) {
+            auto reader = std::make_unique<QLocalSocket>();
+            reader->connectToServer(m_socketPath);
+            QVERIFY(reader->waitForConnected(harness::STEP_TIMEOUT_MS));
+            reader->write(subscribeLine);
+            reader->flush();
+            QVERIFY(awaitSubscribed());
+            readers.push_back(std::move(reader));
+        }
+        QLocalSocket* last = readers.back().get();
+
+        metrics::LatencyHistogram handling;
+        metrics::LatencyHistogram firstByte;
+        for (int i = 0; i < FANOUT_SAMPLES; ++i) {
+            for (auto& reader : readers) {
+                reader->readAll();
+            }
+
+            const QString cookie    = QStringLiteral("bench-fanout-%1").arg(i);
+            const qint64  startedAt = metrics::now();
+            g_pAgent->onPolkitRequest(cookie, "Authentication is required to run the benchmark", "dialog-password", "org.bb.auth.bench", "bench", PolkitQt1::Details{});
+            handling.record(metrics::now() - startedAt);
+
+            QVERIFY(pumpUntil([last] { return last->bytesAvailable() > 0; }));
+            firstByte.record(metrics::now() - startedAt);
+
+            g_pAgent->onSessionComplete(cookie, false);
+            // Lets the unregistered provider, still a subscriber, and the readers keep up
+            QCoreApplication::processEvents();
+        }
+
+        qInfo("fanout=%s handling_p50=%lldus handling_p99=%lldus first_byte_p50=%lldus first_byte_p99=%lldus", QTest::currentDataTag(), handling.percentile(0.50) / 1000,
+              handling.percentile(0.99) / 1000, firstByte.percentile(0.50) / 1000, firstByte.percentile(0.99) / 1000);
+        QTest::setBenchmarkResult(static_cast<qreal>(firstByte.percentile(0.50)), QTest::WalltimeNanoseconds);
+
+        for (auto& reader : readers) {
+            reader->abort();
+        }
+        if (stalledFd != -1) {
+            ::close(stalledFd);
+        }
+        QVERIFY(pumpUntil([idleSubscribers] { return g_pAgent->tableSizes().value("subscribers").toInteger() == idleSubscribers; }));
+        m_standDown = false;
+        m_provider->send(QJsonObject{{"type", "ui.register"}, {"name", "bench"}, {"kind", "headless"}, {"priority", 100}});
+        QVERIFY(pumpUntil([this] { return m_provider->isActive(); }));
+        qunsetenv("BB_AUTH_FALLBACK_PATH");
+    }
+
+    void AuthFlowBenchmark::launchFlows() {
+        while (m_inFlight < m_concurrency && m_launched < m_total) {
+            const int index = m_launched++;
+            ++m_inFlight;
+            switch (m_kind) {
+                case FlowKind::Polkit: launchPolkit(index); break;
+                case FlowKind::Keyring: launchKeyring(index); break;
+                case FlowKind::Pinentry: launchPinentry(index); break;
+            }
+        }
+    }
+
+    void AuthFlowBenchmark::finishFlow(qint64 startedAt, bool ok) {
+        --m_inFlight;
+        if (ok) {
+            ++m_completed;
+            m_latency.record(metrics::now() - startedAt);
+        } else {
+            ++m_failed;
+        }
+
+        // Refill from the next loop turn so completions never recurse into launches
+        QTimer::singleShot(0, this, [this] { launchFlows(); });
+    }
+
+    // What CPolkitListener does for polkitd: create the session, then hand it the PAM prompt
+    void AuthFlowBenchmark::launchPolkit(int index) {
+        const QString cookie      = QStringLiteral("bench-polkit-%1").arg(index);
+        m_polkitStartedAt[cookie] = metrics::now();
+
+        g_pAgent->onPolkitRequest(cookie, "Authentication is required to run the benchmark", "dialog-password", "org.bb.auth.bench", "bench", PolkitQt1::Details{});
+        g_pAgent->onSessionRequest(cookie, "Password: ", false);
+    }
+
+    // What the keyring prompter does per prompt: connect, send keyring_request, wait for the reply
+    void AuthFlowBenchmark::launchKeyring(int index) {
+        const qint64 startedAt = metrics::now();
+        auto*        client    = new QLocalSocket(this);
+
+        connect(client, &QLocalSocket::connected, client, [client, index] {
+            writeJson(client, QJsonObject{{"type", "keyring_request"},
+                                          {"cookie", QStringLiteral("bench-keyring-%1").arg(index)},
+                                          {"title", "Unlock Keyring"},
+                                          {"message", "An application wants access to the keyring \"login\""}});
+        });
+        connect(client, &QLocalSocket::readyRead, client, [this, client, startedAt] {
+            if (!client->canReadLine()) {
+                return;
+            }
+            const QJsonObject reply = QJsonDocument::fromJson(client->readLine()).object();
+            finishFlow(startedAt, reply.value("type").toString() == "keyring_response" && reply.value("password").toString() == PASSWORD);
+            client->disconnect();
+            client->disconnectFromServer();
+            client->deleteLater();
+        });
+        connect(client, &QLocalSocket::errorOccurred, client, [this, client, startedAt] {
+            finishFlow(startedAt, false);
+            client->disconnect();
+            client->deleteLater();
+        });
+
+        client->connectToServer(m_socketPath);
+    }
+
+    // What gpg-agent does: spawn a pinentry, script the Assuan exchange, wait for it to exit
+    void AuthFlowBenchmark::launchPinentry(int index) {
+        const qint64 startedAt = metrics::now();
+        auto*        process   = new QProcess(this);
+
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        env.insert("XDG_RUNTIME_DIR", m_dir.path());
+        process->setProcessEnvironment(env);
+
+        process->start(QCoreApplication::applicationFilePath(), {PINENTRY_ARG});
+        const auto output = harness::scriptPinentry(process, QStringLiteral("OPTION ttyname=/dev/null\n"
+                                                                            "SETKEYINFO n/BENCH%1\n"
+                                                                            "SETDESC Please enter the passphrase to unlock the OpenPGP secret key\n"
+                                                                            "SETPROMPT Passphrase:\n"
+                                                                            "GETPIN\n")
+                                                                 .arg(index)
+                                                                 .toUtf8());
+
+        connect(process, &QProcess::finished, process, [this, process, output, startedAt](int exitCode, QProcess::ExitStatus status) {
+            output->append(process->readAllStandardOutput());
+            finishFlow(startedAt, status == QProcess::NormalExit && exitCode == 0 && output->contains("\nD " + QByteArray(PASSWORD) + "\nOK"));
+            process->deleteLater();
+        });
+        connect(process, &QProcess::errorOccurred, process, [this, process, startedAt](QProcess::ProcessError error) {
+            if (error == QProcess::FailedToStart) {
+                finishFlow(startedAt, false);
+                process->deleteLater();
+            }
+        });
+    }
+
+} // namespace bb
+
+int main(int argc, char** argv) {
+    // Re-executed by the benchmark as the pinentry under test
+    if (argc > 1 && std::strcmp(argv[1], bb::PINENTRY_ARG) == 0) {
+        return modes::runPinentry();
+    }
+
+    QCoreApplication      app(argc, argv);
+    bb::AuthFlowBenchmark bench;
+    return QTest::qExec(&bench, argc, argv);
+}
+
+#include "bench_auth_flows.moc"
@@ -0,0 +1,142 @@
+#include "agent_harness.hpp"
+#include "../src/core/Session.hpp"
+#include "../src/core/agent/EventQueue.hpp"
+#include "../src/core/agent/EventRouter.hpp"
+#include "../src/core/agent/ProviderRegistry.hpp"
+#include "../src/core/ipc/IpcServer.hpp"
+
+#include <QtTest/QtTest>
+
+#include <QElapsedTimer>
+#include <QLocalSocket>
+#include <QTemporaryDir>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace bb {
+
+    namespace {
+
+        inline constexpr int SAMPLE_COUNT = 200;
+
+        Session makePolkitSession() {
+            Session::Context ctx;
+            ctx.message                  = "Authentication is required to run `/usr/bin/pacman' as the super user";
+            ctx.actionId                 = "org.freedesktop.policykit.exec";
+            ctx.user                     = "unix-user:root";
+            ctx.requestor.name           = "pkexec";
+            ctx.requestor.icon           = "utilities-terminal";
+            ctx.requestor.fallbackLetter = "P";
+            ctx.requestor.fallbackKey    = "pkexec";
+            ctx.requestor.pid            = 4242;
+            return Session("bench-cookie", Session::Source::Polkit, ctx);
+        }
+
+        qint64 percentile(std::vector<qint64> samples, double p) {
+            if (samples.empty()) {
+                return 0;
+            }
+            std::sort(samples.begin(), samples.end());
+            const auto idx = static_cast<std::size_t>(p * static_cast<double>(samples.size() - 1));
+            return samples[idx];
+        }
+
+    } // namespace
+
+    // Measures the time from a polkit request being routed to the first byte
+    // becoming readable at the provider, i.e. the last socket in fan-out order.
+    class EventFanoutBenchmark : public QObject {
+        Q_OBJECT
+
+      private slots:
+        void requestToFirstByte_data();
+        void requestToFirstByte();
+    };
+
+    void EventFanoutBenchmark::requestToFirstByte_data() {
+        QTest::addColumn<int>("subscriberCount");
+        QTest::addColumn<bool>("encodeOnce");
+
+        for (const int count : {1, 10, 100}) {
+            QTest::addRow("%d-subscribers/per-socket-encode", count) << count << false;
+            QTest::addRow("%d-subscribers/encode-once", count) << count << true;
+        }
+    }
+
+    void EventFanoutBenchmark::requestToFirstByte() {
+        QFETCH(int, subscriberCount);
+        QFETCH(bool, encodeOnce);
+
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+
+        IpcServer            server;
+        QList<QLocalSocket*> serverSockets;
+        connect(&server, &IpcServer::clientConnected, this, [&serverSockets](QLocalSocket* socket) { serverSockets.append(socket); });
+        QVERIFY(server.start(dir.filePath("bench.sock")));
+
+        std::vector<std::unique_ptr<QLocalSocket>> clients;
+        for (int i = 0; i < subscriberCount; ++i) {
+            auto client = std::make_unique<QLocalSocket>();
+            client->connectToServer(dir.filePath("bench.sock"));
+            QVERIFY(client->waitForConnected(1000));
+            clients.push_back(std::move(client));
+        }
+        QTRY_COMPARE(serverSockets.size(), subscriberCount);
+
+        agent::ProviderRegistry registry;
+        agent::EventQueue       queue;
+        agent::EventRouter      router(registry, queue);
+
+        const Session           session  = makePolkitSession();
+        QLocalSocket*           provider = clients.back().get();
+
+        std::vector<qint64>     samples;
+        samples.reserve(SAMPLE_COUNT);
+
+        for (int i = 0; i < SAMPLE_COUNT; ++i) {
+            QElapsedTimer timer;
+            timer.start();
+
+            const QJsonObject event = session.toCreatedEvent();
+            QByteArray        encoded;
+            router.route(
+                event, serverSockets,
+                [&](QLocalSocket* socket, const QJsonObject& routedEvent) {
+                    if (!encodeOnce) {
+                        server.sendJson(socket, routedEvent);
+                        return;
+                    }
+                    if (encoded.isEmpty()) {
+                        encoded = IpcServer::encodeJson(event);
+                    }
+                    server.sendEncoded(socket, encoded);
+                },
+                [&server](QLocalSocket* socket, const QJsonObject& reply) { server.sendJson(socket, reply); });
+
+            // Writes are drained by the event loop, which the first byte waits on too
+            QVERIFY(harness::pumpUntil([provider] { return provider->bytesAvailable() > 0; }));
+            samples.push_back(timer.nsecsElapsed());
+
+            // Drain every client so kernel buffers never back up between samples.
+            QVERIFY(harness::pumpUntil([&clients] { return std::ranges::all_of(clients, [](const auto& client) { return client->bytesAvailable() > 0; }); }));
+            for (auto& client : clients) {
+                client->readAll();
+            }
+            queue.takeNext();
+        }
+
+        qInfo("subscribers=%d encodeOnce=%d p50=%lldns p99=%lldns", subscriberCount, encodeOnce ? 1 : 0, percentile(samples, 0.50), percentile(samples, 0.99));
+        QTest::setBenchmarkResult(static_cast<qreal>(percentile(samples, 0.50)), QTest::WalltimeNanoseconds);
+    }
+
+} // namespace bb
+
+int runEventFanoutBenchmarks(int argc, char** argv) {
+    bb::EventFanoutBenchmark bench;
+    return QTest::qExec(&bench, argc, argv);
+}
+
+#include "bench_event_fanout.moc"
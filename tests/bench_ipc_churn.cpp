@@ -0,0 +1,69 @@
+#include "agent_harness.hpp"
+#include "../src/core/ipc/IpcServer.hpp"
+
+#include <QtTest/QtTest>
+
+#include <QElapsedTimer>
+#include <QLocalSocket>
+#include <QTemporaryDir>
+
+namespace bb {
+
+    namespace {
+
+        inline constexpr int CONNECTION_COUNT = 500;
+
+        using harness::pumpUntil;
+
+    } // namespace
+
+    // Models status-bar watchers: connect, ping, read the pong, disconnect.
+    class IpcChurnBenchmark : public QObject {
+        Q_OBJECT
+
+      private slots:
+        void connectPingDisconnect();
+    };
+
+    void IpcChurnBenchmark::connectPingDisconnect() {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString path = dir.filePath("churn.sock");
+
+        IpcServer     server;
+        int           liveConnections = 0;
+        connect(&server, &IpcServer::clientConnected, this, [&liveConnections](QLocalSocket*) { ++liveConnections; });
+        connect(&server, &IpcServer::clientDisconnected, this, [&liveConnections](QLocalSocket*) { --liveConnections; });
+        server.setMessageHandler([&server](QLocalSocket* socket, const JsonMessage&) { server.sendJson(socket, QJsonObject{{"type", "pong"}}); });
+        QVERIFY(server.start(path));
+
+        QElapsedTimer timer;
+        timer.start();
+
+        for (int i = 0; i < CONNECTION_COUNT; ++i) {
+            QLocalSocket client;
+            client.connectToServer(path);
+            QVERIFY(client.waitForConnected(1000));
+
+            client.write("{\"type\":\"ping\"}\n");
+            client.flush();
+            QVERIFY(pumpUntil([&client] { return client.canReadLine(); }));
+            QCOMPARE(client.readLine().trimmed(), QByteArray("{\"type\":\"pong\"}"));
+
+            client.disconnectFromServer();
+            QVERIFY(pumpUntil([&liveConnections] { return liveConnections == 0; }));
+        }
+
+        const qint64 perConnectionNs = timer.nsecsElapsed() / CONNECTION_COUNT;
+        qInfo("perConnection=%lldns", perConnectionNs);
+        QTest::setBenchmarkResult(static_cast<qreal>(perConnectionNs), QTest::WalltimeNanoseconds);
+    }
+
+} // namespace bb
+
+int runIpcChurnBenchmarks(int argc, char** argv) {
+    bb::IpcChurnBenchmark bench;
+    return QTest::qExec(&bench, argc, argv);
+}
+
+#include "bench_ipc_churn.moc"
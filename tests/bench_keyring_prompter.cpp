@@ -0,0 +1,322 @@
+// GLib headers use `signals` as an identifier, so they come before Qt's keyword macros
+#define GCR_API_SUBJECT_TO_CHANGE 1
+#include <gcr/gcr.h>
+
+#include "agent_harness.hpp"
+#include "../src/core/Metrics.hpp"
+#include "../src/modes/keyring.hpp"
+
+#include <QtTest/QtTest>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+#include <csignal>
+#include <cstring>
+#include <memory>
+
+namespace bb {
+
+    using harness::HeadlessProvider;
+    using harness::pumpUntil;
+
+    namespace {
+
+        inline constexpr int  PROMPTS_PER_ROW   = 20;
+        inline constexpr int  PROMPT_TIMEOUT_MS = 10000;
+        // Longer than the one-shot rows' idle timeout, so that prompter is gone by the next prompt
+        inline constexpr int  REPEAT_GAP_MS     = 1500;
+        inline constexpr char KEYRING_ARG[]     = "--keyring";
+        inline constexpr char PROMPTER_NAME[]   = "org.gnome.keyring.SystemPrompter";
+        inline constexpr char PASSWORD[]        = "hunter2";
+
+        struct PromptCall {
+            GcrPrompt* prompt = nullptr;
+            bool       done   = false;
+            bool       ok     = false;
+        };
+
+    } // namespace
+
+    // Keyring unlocks the way gnome-keyring drives them: open a GcrSystemPrompt on a
+    // private session bus, which D-Bus-activates this binary as `--keyring`, ask for
+    // the password and close the prompt. `first` rows start every prompt with no
+    // prompter running; `repeat` rows leave REPEAT_GAP_MS between prompts, past the
+    // one-shot idle timeout, which a resident prompter sleeps through. GLib callbacks
+    // run from Qt's event loop through its GLib event dispatcher.
+    class KeyringPrompterBenchmark : public QObject {
+        Q_OBJECT
+
+      private slots:
+        void initTestCase();
+        void cleanupTestCase();
+
+        void prompts_data();
+        void prompts();
+
+      private:
+        bool      startBus();
+        GVariant* callBus(const char* method, GVariant* parameters, const char* replyType);
+        bool      setIdleTimeout(int seconds);
+        pid_t     prompterPid();
+        bool      stopPrompter();
+        qint64    prompterRssKb();
+        qint64    promptOnce();
+
+        QTemporaryDir                     m_dir;
+        QString                           m_socketPath;
+        QProcess                          m_bus;
+        GDBusConnection*                  m_connection = nullptr;
+        std::unique_ptr<HeadlessProvider> m_provider;
+    };
+
+    void KeyringPrompterBenchmark::initTestCase() {
+        QVERIFY(m_dir.isValid());
+        m_socketPath = m_dir.filePath("bb-auth.sock");
+
+        if (QStandardPaths::findExecutable("dbus-daemon").isEmpty()) {
+            QSKIP("dbus-daemon not found");
+        }
+        QVERIFY2(startBus(), "private session bus did not start");
+
+        g_pAgent = std::make_unique<CAgent>(new harness::StubPolkitListener);
+        QVERIFY(g_pAgent->startIpc(m_socketPath));
+
+        // Answers every keyring session the moment it is announced
+        m_provider            = std::make_unique<HeadlessProvider>();
+        m_provider->onMessage = [](HeadlessProvider* provider, const QJsonObject& msg) {
+            if (msg.value("type").toString() == "session.created") {
+                provider->send(QJsonObject{{"type", "session.respond"}, {"id", msg.value("id")}, {"response", PASSWORD}});
+            }
+        };
+        QVERIFY(m_provider->connectTo(m_socketPath, "bench", 100));
+    }
+
+    void KeyringPrompterBenchmark::cleanupTestCase() {
+        if (m_connection) {
+            stopPrompter();
+            g_clear_object(&m_connection);
+        }
+        if (m_provider) {
+            m_provider->close();
+            pumpUntil([] { return false; }, 100);
+            m_provider.reset();
+        }
+        g_pAgent.reset();
+
+        if (m_bus.state() != QProcess::NotRunning) {
+            m_bus.terminate();
+            m_bus.waitForFinished();
+        }
+    }
+
+    // A bus with only our prompter to activate, so the desktop's own never gets involved
+    bool KeyringPrompterBenchmark::startBus() {
+        const QString serviceDir = m_dir.filePath("services");
+        const QString configPath = m_dir.filePath("bus.conf");
+
+        QFile         service(QDir(serviceDir).filePath("org.gnome.keyring.SystemPrompter.service"));
+        QFile         config(configPath);
+        if (!QDir().mkpath(serviceDir) || !service.open(QIODevice::WriteOnly) || !config.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+
+        service.write(QStringLiteral("[D-BUS Service]\nName=%1\nExec=%2 %3\n").arg(PROMPTER_NAME, QCoreApplication::applicationFilePath(), KEYRING_ARG).toUtf8());
+        config.write(QStringLiteral("<!DOCTYPE busconfig PUBLIC \"-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN\"\n"
+                                    " \"http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd\">\n"
+                                    "<busconfig>\n"
+                                    "  <type>session</type>\n"
+                                    "  <listen>unix:path=%1</listen>\n"
+                                    "  <servicedir>%2</servicedir>\n"
+                                    "  <policy context=\"default\">\n"
+                                    "    <allow send_destination=\"*\" eavesdrop=\"true\"/>\n"
+                                    "    <allow eavesdrop=\"true\"/>\n"
+                                    "    <allow own=\"*\"/>\n"
+                                    "  </policy>\n"
+                                    "</busconfig>\n")
+                         .arg(m_dir.filePath("bus"), serviceDir)
+                         .toUtf8());
+        service.close();
+        config.close();
+
+        // Activated prompters inherit this environment and find the daemon socket through it
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        env.insert("XDG_RUNTIME_DIR", m_dir.path());
+        env.remove("BB_AUTH_KEYRING_IDLE_S");
+        m_bus.setProcessEnvironment(env);
+        m_bus.start("dbus-daemon", {"--config-file=" + configPath, "--nofork", "--print-address"});
+        if (!m_bus.waitForReadyRead(harness::STEP_TIMEOUT_MS)) {
+            return false;
+        }
+
+        const QByteArray address = m_bus.readLine().trimmed();
+        // gcr reaches the prompter through the session bus
+        qputenv("DBUS_SESSION_BUS_ADDRESS", address);
+
+        m_connection = g_dbus_connection_new_for_address_sync(address.constData(),
+                                                              static_cast<GDBusConnectionFlags>(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                                                                G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+                                                              nullptr, nullptr, nullptr);
+        return m_connection != nullptr;
+    }
+
+    GVariant* KeyringPrompterBenchmark::callBus(const char* method, GVariant* parameters, const char* replyType) {
+        return g_dbus_connection_call_sync(m_connection, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus", method, parameters,
+                                           replyType ? G_VARIANT_TYPE(replyType) : nullptr, G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
+    }
+
+    // Applies to prompters activated from now on
+    bool KeyringPrompterBenchmark::setIdleTimeout(int seconds) {
+        const QByteArray value = QByteArray::number(seconds);
+        GVariantBuilder  env;
+        g_variant_builder_init(&env, G_VARIANT_TYPE("a{ss}"));
+        g_variant_builder_add(&env, "{ss}", "BB_AUTH_KEYRING_IDLE_S", value.constData());
+
+        GVariant* reply = callBus("UpdateActivationEnvironment", g_variant_new("(a{ss})", &env), nullptr);
+        if (!reply) {
+            return false;
+        }
+        g_variant_unref(reply);
+        return true;
+    }
+
+    pid_t KeyringPrompterBenchmark::prompterPid() {
+        GVariant* reply = callBus("GetConnectionUnixProcessID", g_variant_new("(s)", PROMPTER_NAME), "(u)");
+        if (!reply) {
+            return 0;
+        }
+
+        guint32 pid = 0;
+        g_variant_get(reply, "(u)", &pid);
+        g_variant_unref(reply);
+        return static_cast<pid_t>(pid);
+    }
+
+    bool KeyringPrompterBenchmark::stopPrompter() {
+        const pid_t pid = prompterPid();
+        if (pid <= 0) {
+            return true;
+        }
+
+        ::kill(pid, SIGTERM);
+        return pumpUntil([this] { return prompterPid() == 0; });
+    }
+
+    qint64 KeyringPrompterBenchmark::prompterRssKb() {
+        const pid_t pid = prompterPid();
+        QFile       status(QStringLiteral("/proc/%1/status").arg(pid));
+        if (pid <= 0 || !status.open(QIODevice::ReadOnly)) {
+            return 0;
+        }
+
+        for (const QByteArray& line : status.readAll().split('\n')) {
+            if (line.startsWith("VmRSS:")) {
+                return line.mid(6).trimmed().split(' ').value(0).toLongLong();
+            }
+        }
+        return 0;
+    }
+
+    // Open, GETPIN-equivalent, close; returns the latency up to the password, or -1
+    qint64 KeyringPrompterBenchmark::promptOnce() {
+        const qint64 startedAt = metrics::now();
+        // Left behind if the prompt never finishes, as its callbacks may still fire
+        auto*        call      = new PromptCall;
+
+        gcr_system_prompt_open_for_prompter_async(
+            PROMPTER_NAME, PROMPT_TIMEOUT_MS / 1000, nullptr,
+            [](GObject*, GAsyncResult* result, gpointer data) {
+                auto* call   = static_cast<PromptCall*>(data);
+                call->prompt = gcr_system_prompt_open_finish(result, nullptr);
+                if (!call->prompt) {
+                    call->done = true;
+                    return;
+                }
+
+                gcr_prompt_set_title(call->prompt, "Unlock Keyring");
+                gcr_prompt_set_message(call->prompt, "An application wants access to the keyring \"login\"");
+                gcr_prompt_password_async(
+                    call->prompt, nullptr,
+                    [](GObject* source, GAsyncResult* result, gpointer data) {
+                        auto* call = static_cast<PromptCall*>(data);
+                        call->ok   = g_strcmp0(gcr_prompt_password_finish(GCR_PROMPT(source), result, nullptr), PASSWORD) == 0;
+                        call->done = true;
+                    },
+                    call);
+            },
+            call);
+
+        if (!pumpUntil([call] { return call->done; }, PROMPT_TIMEOUT_MS)) {
+            return -1;
+        }
+
+        const qint64 latency = metrics::now() - startedAt;
+        const bool   ok      = call->ok;
+        if (call->prompt) {
+            gcr_system_prompt_close(GCR_SYSTEM_PROMPT(call->prompt), nullptr, nullptr);
+            g_object_unref(call->prompt);
+        }
+        delete call;
+        return ok ? latency : -1;
+    }
+
+    void KeyringPrompterBenchmark::prompts_data() {
+        QTest::addColumn<int>("idleTimeoutS");
+        QTest::addColumn<bool>("cold");
+
+        QTest::newRow("oneshot/first") << 1 << true;
+        QTest::newRow("oneshot/repeat") << 1 << false;
+        QTest::newRow("resident/first") << 0 << true;
+        QTest::newRow("resident/repeat") << 0 << false;
+    }
+
+    void KeyringPrompterBenchmark::prompts() {
+        QFETCH(int, idleTimeoutS);
+        QFETCH(bool, cold);
+
+        QVERIFY(stopPrompter());
+        QVERIFY(setIdleTimeout(idleTimeoutS));
+
+        // Repeat rows measure a prompter that has already served one prompt
+        if (!cold) {
+            QVERIFY2(promptOnce() >= 0, "warm-up prompt failed");
+        }
+
+        metrics::LatencyHistogram latency;
+        for (int i = 0; i < PROMPTS_PER_ROW; ++i) {
+            if (cold) {
+                QVERIFY(stopPrompter());
+            } else {
+                pumpUntil([] { return false; }, REPEAT_GAP_MS);
+            }
+
+            const qint64 ns = promptOnce();
+            QVERIFY2(ns >= 0, qPrintable(QStringLiteral("prompt %1 failed").arg(i)));
+            latency.record(ns);
+        }
+
+        // Idle footprint between prompts; 0 once a one-shot prompter has exited
+        pumpUntil([] { return false; }, REPEAT_GAP_MS);
+        qInfo("prompts=%s p50=%lldus p99=%lldus max=%lldus prompter_rss=%lldkB", QTest::currentDataTag(), latency.percentile(0.50) / 1000,
+              latency.percentile(0.99) / 1000, latency.max() / 1000, prompterRssKb());
+        QTest::setBenchmarkResult(static_cast<qreal>(latency.percentile(0.50)), QTest::WalltimeNanoseconds);
+    }
+
+} // namespace bb
+
+int main(int argc, char** argv) {
+    // Activated over the private bus as the keyring prompter under test
+    if (argc > 1 && std::strcmp(argv[1], bb::KEYRING_ARG) == 0) {
+        return modes::runKeyring(argc, argv);
+    }
+
+    QCoreApplication             app(argc, argv);
+    bb::KeyringPrompterBenchmark bench;
+    return QTest::qExec(&bench, argc, argv);
+}
+
+#include "bench_keyring_prompter.moc"
@@ -0,0 +1,29 @@
+#include <QCoreApplication>
+
+int runEventFanoutBenchmarks(int argc, char** argv);
+int runIpcChurnBenchmarks(int argc, char** argv);
+int runMessageDispatchBenchmarks(int argc, char** argv);
+int runPromptClassifyBenchmarks(int argc, char** argv);
+int runTextNormalizeBenchmarks(int argc, char** argv);
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    const int        fanoutResult    = runEventFanoutBenchmarks(argc, argv);
+    const int        churnResult     = runIpcChurnBenchmarks(argc, argv);
+    const int        dispatchResult  = runMessageDispatchBenchmarks(argc, argv);
+    const int        promptResult    = runPromptClassifyBenchmarks(argc, argv);
+    const int        normalizeResult = runTextNormalizeBenchmarks(argc, argv);
+    if (fanoutResult != 0) {
+        return fanoutResult;
+    }
+    if (churnResult != 0) {
+        return churnResult;
+    }
+    if (dispatchResult != 0) {
+        return dispatchResult;
+    }
+    if (promptResult != 0) {
+        return promptResult;
+    }
+    return normalizeResult;
+}
@@ -0,0 +1,109 @@
+#include "../src/core/agent/MessageRouter.hpp"
+#include "../src/core/ipc/JsonMessage.hpp"
+
+#include <QtTest/QtTest>
+
+#include <QHash>
+#include <QJsonDocument>
+
+#include <functional>
+#include <string_view>
+#include <utility>
+
+namespace bb {
+
+    namespace {
+
+        // One representative wire line per entry in MESSAGE_TYPE_NAMES (the handlers CAgent registers)
+        inline constexpr std::array<std::string_view, agent::MESSAGE_TYPE_COUNT> SAMPLE_LINES = {
+            R"({"type":"ping"})",
+            R"({"type":"subscribe"})",
+            R"({"type":"next"})",
+            R"({"type":"keyring_request","cookie":"c1","title":"Unlock Keyring","message":"Password required","password_new":false,"confirm_only":false})",
+            R"({"type":"pinentry_request","cookie":"c2","prompt":"Passphrase:","description":"Please enter the passphrase","keyinfo":"n/0123ABCD","repeat":false,"confirm_only":false})",
+            R"({"type":"pinentry_result","id":"c2","result":"success"})",
+            R"({"type":"ui.register","name":"quickshell","kind":"quickshell","priority":100})",
+            R"({"type":"ui.heartbeat"})",
+            R"({"type":"ui.unregister"})",
+            R"({"type":"session.respond","id":"c1","response":"correct horse battery staple"})",
+            R"({"type":"session.cancel","id":"c1"})",
+            R"({"type":"stats"})",
+        };
+
+        template <std::size_t... I>
+        void registerAll(agent::MessageRouter& router, int& hits, std::index_sequence<I...>) {
+            (router.registerHandler<static_cast<agent::MessageType>(I)>([&hits](QLocalSocket*, const auto&) { ++hits; }), ...);
+        }
+
+        // The previous path: full QJsonDocument, QString type, QHash lookup. Its handlers
+        // do not read any fields here, which only flatters the baseline.
+        template <std::size_t... I>
+        void registerAllLegacy(QHash<QString, std::function<void(QLocalSocket*, const QJsonObject&)>>& handlers, int& hits, std::index_sequence<I...>) {
+            (handlers.insert(QString::fromLatin1(agent::MESSAGE_TYPE_NAMES[I].data(), static_cast<qsizetype>(agent::MESSAGE_TYPE_NAMES[I].size())),
+                             [&hits](QLocalSocket*, const QJsonObject&) { ++hits; }),
+             ...);
+        }
+
+    } // namespace
+
+    // Line bytes to handler call: validation, type resolution, request decoding and dispatch.
+    class MessageDispatchBenchmark : public QObject {
+        Q_OBJECT
+
+      private slots:
+        void dispatch_data();
+        void dispatch();
+    };
+
+    void MessageDispatchBenchmark::dispatch_data() {
+        QTest::addColumn<QByteArray>("line");
+        QTest::addColumn<bool>("lazy");
+
+        for (std::size_t i = 0; i < agent::MESSAGE_TYPE_COUNT; ++i) {
+            const QByteArray       line(SAMPLE_LINES[i].data(), static_cast<qsizetype>(SAMPLE_LINES[i].size()));
+            const QByteArray       name(agent::MESSAGE_TYPE_NAMES[i].data(), static_cast<qsizetype>(agent::MESSAGE_TYPE_NAMES[i].size()));
+            QTest::newRow(QByteArray(name + "/qjson-qhash").constData()) << line << false;
+            QTest::newRow(QByteArray(name + "/lazy-interned").constData()) << line << true;
+        }
+    }
+
+    void MessageDispatchBenchmark::dispatch() {
+        QFETCH(QByteArray, line);
+        QFETCH(bool, lazy);
+
+        int hits = 0;
+
+        if (lazy) {
+            agent::MessageRouter router;
+            registerAll(router, hits, std::make_index_sequence<agent::MESSAGE_TYPE_COUNT>{});
+
+            QBENCHMARK {
+                const auto message = JsonMessage::parse(line);
+                QString    error;
+                router.dispatch(nullptr, *message, error);
+            }
+        } else {
+            QHash<QString, std::function<void(QLocalSocket*, const QJsonObject&)>> handlers;
+            registerAllLegacy(handlers, hits, std::make_index_sequence<agent::MESSAGE_TYPE_COUNT>{});
+
+            QBENCHMARK {
+                const QJsonObject msg  = QJsonDocument::fromJson(line).object();
+                const QString     type = msg.value("type").toString();
+                auto              it   = handlers.constFind(type);
+                if (it != handlers.constEnd()) {
+                    it.value()(nullptr, msg);
+                }
+            }
+        }
+
+        QVERIFY(hits > 0);
+    }
+
+} // namespace bb
+
+int runMessageDispatchBenchmarks(int argc, char** argv) {
+    bb::MessageDispatchBenchmark bench;
+    return QTest::qExec(&bench, argc, argv);
+}
+
+#include "bench_message_dispatch.moc"
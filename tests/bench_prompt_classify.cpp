@@ -0,0 +1,163 @@
+#include "../src/fallback/prompt/PromptHeuristics.hpp"
+#include "../src/fallback/prompt/PromptModelBuilder.hpp"
+#include "../src/fallback/prompt/TextNormalize.hpp"
+
+#include <QtTest/QtTest>
+
+#include <QJsonObject>
+
+#include <array>
+#include <initializer_list>
+
+namespace bb {
+
+    namespace {
+
+        struct PromptSample {
+            const char* tag;
+            const char* source;
+            const char* description;
+            const char* message;
+            const char* info;
+        };
+
+        // What polkit agents, pinentry (gpg-agent, also on behalf of ssh) and the keyring prompter actually send
+        inline constexpr std::array CORPUS = {
+            PromptSample{"polkit/pkexec", "polkit", "", "Authentication is needed to run `/usr/bin/bash' as the super user", ""},
+            PromptSample{"polkit/systemd", "polkit", "", "Authentication is required to restart 'sshd.service'.", ""},
+            PromptSample{"polkit/packagekit", "polkit", "", "Authentication is required to install software\nfirefox-128.0-1.x86_64", ""},
+            PromptSample{"polkit/udisks", "polkit", "", "Authentication is required to unlock the encrypted device Samsung SSD 970 EVO (/dev/nvme0n1p3)", ""},
+            PromptSample{"polkit/fprintd", "polkit", "", "Authentication is required to change system settings",
+                         "Swipe your right index finger across the fingerprint reader"},
+            PromptSample{"polkit/pam-u2f", "polkit", "", "Authentication is required to run `/usr/bin/pacman' as the super user", "Please touch the device."},
+            PromptSample{"gpg/sign", "pinentry",
+                         "Please enter the passphrase to unlock the OpenPGP secret key:\n\"Alice Example (work) <alice@example.org>\"\n3072-bit RSA key, ID "
+                         "0123456789ABCDEF,\ncreated 2021-04-05 (main key ID FEDCBA9876543210).\n",
+                         "Passphrase:", ""},
+            PromptSample{"gpg/import", "pinentry", "Please enter the passphrase to import the OpenPGP secret key:\n\"Bob <bob@example.net>\"\n255-bit EDDSA key, ID 89ABCDEF01234567,\ncreated 2023-11-30.\n",
+                         "Passphrase:", ""},
+            PromptSample{"ssh/agent-confirm", "pinentry",
+                         "An ssh process requested the use of key\nSHA256:Yy7pV5n1uB0cYb2m6bB2N8W8s0nqG4k3r1mZqG2JwXo\n(alice@laptop)\nDo you want to allow this?", "", ""},
+            PromptSample{"ssh/add-key", "pinentry",
+                         "Please enter a passphrase to protect the received secret key\nED25519 key SHA256:Yy7pV5n1uB0cYb2m6bB2N8W8s0nqG4k3r1mZqG2JwXo\nalice@laptop\nwithin gpg-agent's key "
+                         "storage",
+                         "Passphrase:", ""},
+            PromptSample{"keyring/login", "keyring", "An application wants access to the keyring “login”, but it is locked", "Authenticate to unlock the login keyring", ""},
+        };
+
+        // The term checks PromptModelBuilder used to make: lowercase and concatenate, then one contains() per term
+        bool containsAnyTerm(const QString& text, std::initializer_list<const char*> terms) {
+            const QString lower = text.toLower();
+            for (const char* term : terms) {
+                if (lower.contains(QString::fromLatin1(term))) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        fallback::prompt::PromptHints legacyClassify(const QString& description, const QString& message, const QString& info) {
+            const QString                 detailText   = (description + " " + message).toLower();
+            const QString                 authHintText = (detailText + " " + info).toLower();
+            fallback::prompt::PromptHints hints;
+            hints.fingerprint = containsAnyTerm(authHintText, {"fingerprint", "finger print", "fprint", "swipe", "scan your finger"});
+            hints.fido        = containsAnyTerm(authHintText, {"fido", "fido2", "webauthn", "security key", "yubikey", "hardware token", "user presence"});
+            hints.touch       = hints.fingerprint || hints.fido || containsAnyTerm(authHintText, {"touch", "tap", "insert", "use your security key", "verify your identity"});
+            hints.openPgp     = detailText.contains("openpgp") || detailText.contains("gpg");
+            hints.ssh         = detailText.contains("ssh");
+            return hints;
+        }
+
+        QJsonObject makeEvent(const PromptSample& sample) {
+            const QJsonObject context{{"message", QString::fromUtf8(sample.message)},
+                                      {"description", QString::fromUtf8(sample.description)},
+                                      {"requestor", QJsonObject{{"name", "bench"}}}};
+            QJsonObject       event{{"type", "session.created"}, {"id", "session-1"}, {"source", QString::fromLatin1(sample.source)}, {"context", context}};
+            if (*sample.info != '\0') {
+                event.insert("info", QString::fromUtf8(sample.info));
+            }
+            return event;
+        }
+
+    } // namespace
+
+    // Term classification and the full display model for one prompt of each kind the fallback UI sees.
+    class PromptClassifyBenchmark : public QObject {
+        Q_OBJECT
+
+      private slots:
+        void classify_data();
+        void classify();
+        void build_data();
+        void build();
+    };
+
+    void PromptClassifyBenchmark::classify_data() {
+        QTest::addColumn<int>("sample");
+        QTest::addColumn<bool>("automaton");
+
+        for (int i = 0; i < int(CORPUS.size()); ++i) {
+            QTest::newRow(QByteArray(QByteArray(CORPUS[i].tag) + "/contains").constData()) << i << false;
+            QTest::newRow(QByteArray(QByteArray(CORPUS[i].tag) + "/automaton").constData()) << i << true;
+        }
+    }
+
+    void PromptClassifyBenchmark::classify() {
+        QFETCH(int, sample);
+        QFETCH(bool, automaton);
+
+        const QString description = fallback::prompt::normalizeDetailText(QString::fromUtf8(CORPUS[sample].description));
+        const QString message     = fallback::prompt::normalizeDetailText(QString::fromUtf8(CORPUS[sample].message));
+        const QString info        = fallback::prompt::normalizeDetailText(QString::fromUtf8(CORPUS[sample].info));
+
+        // Both must agree before either is worth timing
+        const auto    expected = legacyClassify(description, message, info);
+        const auto    actual   = fallback::prompt::classifyPrompt(description, message, info);
+        QCOMPARE(actual.fingerprint, expected.fingerprint);
+        QCOMPARE(actual.fido, expected.fido);
+        QCOMPARE(actual.touch, expected.touch);
+        QCOMPARE(actual.openPgp, expected.openPgp);
+        QCOMPARE(actual.ssh, expected.ssh);
+
+        bool touch = false;
+        if (automaton) {
+            QBENCHMARK {
+                touch ^= fallback::prompt::classifyPrompt(description, message, info).touch;
+            }
+        } else {
+            QBENCHMARK {
+                touch ^= legacyClassify(description, message, info).touch;
+            }
+        }
+        Q_UNUSED(touch);
+    }
+
+    void PromptClassifyBenchmark::build_data() {
+        QTest::addColumn<int>("sample");
+
+        for (int i = 0; i < int(CORPUS.size()); ++i) {
+            QTest::newRow(CORPUS[i].tag) << i;
+        }
+    }
+
+    void PromptClassifyBenchmark::build() {
+        QFETCH(int, sample);
+
+        const fallback::prompt::PromptModelBuilder builder;
+        const QJsonObject                          event = makeEvent(CORPUS[sample]);
+        QVERIFY(!builder.build(event).title.isEmpty());
+
+        QBENCHMARK {
+            const auto model = builder.build(event);
+            Q_UNUSED(model);
+        }
+    }
+
+} // namespace bb
+
+int runPromptClassifyBenchmarks(int argc, char** argv) {
+    bb::PromptClassifyBenchmark bench;
+    return QTest::qExec(&bench, argc, argv);
+}
+
+#include "bench_prompt_classify.moc"
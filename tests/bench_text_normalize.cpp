@@ -0,0 +1,136 @@
+#include "../src/fallback/prompt/TextNormalize.hpp"
+
+#include <QtTest/QtTest>
+
+namespace bb {
+
+    namespace {
+
+        // The functions TextNormalize.cpp replaced, kept as the baseline
+        QString legacyNormalizeDetailText(const QString& text) {
+            QString normalized = text;
+            normalized.replace('\r', '\n');
+            QStringList lines = normalized.split('\n');
+            QStringList cleaned;
+            cleaned.reserve(lines.size());
+            for (const QString& line : lines) {
+                const QString simplified = line.simplified();
+                if (!simplified.isEmpty()) {
+                    cleaned << simplified;
+                }
+            }
+
+            return cleaned.join("\n");
+        }
+
+        QString legacyNormalizeCompareText(const QString& text) {
+            QString normalized = legacyNormalizeDetailText(text).toLower();
+            normalized.replace('`', ' ');
+            normalized.replace('"', ' ');
+            normalized.replace(',', ' ');
+            normalized.replace('.', ' ');
+            normalized = normalized.simplified();
+            return normalized;
+        }
+
+        bool legacyTextEquivalent(const QString& left, const QString& right) {
+            const QString a = legacyNormalizeCompareText(left);
+            const QString b = legacyNormalizeCompareText(right);
+            if (a.isEmpty() || b.isEmpty()) {
+                return false;
+            }
+
+            return a == b || a.startsWith(b) || b.startsWith(a);
+        }
+
+        enum class Kernel {
+            Detail,
+            Compare,
+            Equivalent
+        };
+
+        // gpg-agent's unlock text as pinentry receives it (after %0A decoding), with the
+        // indentation and blank lines gpg leaves in, repeated up to a realistic worst case
+        QString gpgDescription(const QString& name, int repeats) {
+            const QString paragraph = QString("Please enter the passphrase to unlock the OpenPGP secret key:\r\n"
+                                              "\"%1\"\r\n"
+                                              "  3072-bit RSA key, ID 0123456789ABCDEF,\r\n"
+                                              "  created 2021-04-05 (main key ID FEDCBA9876543210).\r\n"
+                                              "\r\n")
+                                          .arg(name);
+            return paragraph.repeated(repeats);
+        }
+
+    } // namespace
+
+    // The fallback normalizes every description several times per session event (details,
+    // summary dedupe, uniqueJoined); gpg's are the longest texts it sees.
+    class TextNormalizeBenchmark : public QObject {
+        Q_OBJECT
+
+      private slots:
+        void normalize_data();
+        void normalize();
+    };
+
+    void TextNormalizeBenchmark::normalize_data() {
+        QTest::addColumn<int>("kernel");
+        QTest::addColumn<QString>("text");
+        QTest::addColumn<bool>("legacy");
+
+        const QList<QPair<QByteArray, QString>> inputs = {
+            {"gpg-ascii", gpgDescription("Alice Example (work) <alice@example.org>", 1)},
+            {"gpg-ascii-x8", gpgDescription("Alice Example (work) <alice@example.org>", 8)},
+            {"gpg-utf8", gpgDescription(QString::fromUtf8("Jürgen Groß (Büro) <juergen@example.de>"), 1)},
+        };
+        const QList<QPair<QByteArray, Kernel>> kernels = {{"detail", Kernel::Detail}, {"compare", Kernel::Compare}, {"equivalent", Kernel::Equivalent}};
+
+        for (const auto& [kernelName, kernel] : kernels) {
+            for (const auto& [inputName, text] : inputs) {
+                QTest::newRow(QByteArray(kernelName + "/" + inputName + "/legacy").constData()) << int(kernel) << text << true;
+                QTest::newRow(QByteArray(kernelName + "/" + inputName + "/single-pass").constData()) << int(kernel) << text << false;
+            }
+        }
+    }
+
+    void TextNormalizeBenchmark::normalize() {
+        QFETCH(int, kernel);
+        QFETCH(QString, text);
+        QFETCH(bool, legacy);
+
+        // Compared against the summary line, as the fallback's dedupe does
+        const QString other = fallback::prompt::firstMeaningfulLine(text);
+
+        QCOMPARE(fallback::prompt::normalizeDetailText(text), legacyNormalizeDetailText(text));
+        QCOMPARE(fallback::prompt::normalizeCompareText(text), legacyNormalizeCompareText(text));
+        QCOMPARE(fallback::prompt::textEquivalent(text, other), legacyTextEquivalent(text, other));
+
+        qsizetype sink = 0;
+        switch (static_cast<Kernel>(kernel)) {
+            case Kernel::Detail:
+                QBENCHMARK {
+                    sink += legacy ? legacyNormalizeDetailText(text).size() : fallback::prompt::normalizeDetailText(text).size();
+                }
+                break;
+            case Kernel::Compare:
+                QBENCHMARK {
+                    sink += legacy ? legacyNormalizeCompareText(text).size() : fallback::prompt::normalizeCompareText(text).size();
+                }
+                break;
+            case Kernel::Equivalent:
+                QBENCHMARK {
+                    sink += legacy ? legacyTextEquivalent(text, other) : fallback::prompt::textEquivalent(text, other);
+                }
+                break;
+        }
+        QVERIFY(sink >= 0);
+    }
+
+} // namespace bb
+
+int runTextNormalizeBenchmarks(int argc, char** argv) {
+    bb::TextNormalizeBenchmark bench;
+    return QTest::qExec(&bench, argc, argv);
+}
+
+#include "bench_text_normalize.moc"
@@ -0,0 +1,647 @@
+#include "agent_harness.hpp"
+#include "../src/common/Constants.hpp"
+#include "../src/core/Metrics.hpp"
+#include "../src/modes/pinentry.hpp"
+
+#include <QtTest/QtTest>
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QHash>
+#include <QPointer>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTimer>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace bb {
+
+    using harness::HeadlessProvider;
+    using harness::pumpUntil;
+    using harness::writeJson;
+
+    namespace {
+
+        // Defaults keep a ctest run to a few seconds; BB_AUTH_STRESS_ROUNDS turns it into a soak
+        inline constexpr int     DEFAULT_ROUNDS    = 3;
+        inline constexpr int     FLOWS_PER_ROUND   = 400; // alternating keyring and pinentry
+        inline constexpr int     CONCURRENCY       = 64;
+        inline constexpr int     ROUND_TIMEOUT_MS  = 120000;
+        // A pinentry killed after its answer is only reaped by the terminal-result timeout
+        inline constexpr int     SETTLE_TIMEOUT_MS = PINENTRY_RESULT_TIMEOUT_MS + 5000;
+        inline constexpr quint32 RANDOM_SEED       = 0xbba5e55;
+
+        inline constexpr qint64  OPEN_P99_LIMIT_NS        = 1'000'000'000; // request sent -> session.created at the provider
+        inline constexpr qint64  EVENT_ROUTE_P99_LIMIT_NS = 10'000'000;    // metrics stage event.route, inside the agent
+        inline constexpr qint64  RSS_GROWTH_LIMIT_KB      = 16 * 1024;     // from the end of the first round to the end
+
+        inline constexpr char    PINENTRY_ARG[] = "--pinentry";
+        inline constexpr char    PASSWORD[]     = "hunter2";
+
+        enum class FlowKind {
+            Keyring,
+            Pinentry
+        };
+
+        // What the provider (or the client) does once the session is announced
+        enum class Action {
+            Respond,
+            Cancel,     // provider sends session.cancel
+            Disconnect, // client goes away mid-prompt
+            Failover,   // active provider crashes; the standby takes over and answers
+        };
+
+        enum class Op {
+            Open,
+            Respond,
+            Cancel,
+            Disconnect,
+            Failover,
+            Settle,
+        };
+
+        inline constexpr std::array<const char*, 6> OP_NAMES = {"open", "respond", "cancel", "disconnect", "failover", "settle"};
+
+        Action pickAction(QRandomGenerator& rng) {
+            const quint32 roll = rng.bounded(100U);
+            if (roll < 60)
+                return Action::Respond;
+            if (roll < 75)
+                return Action::Cancel;
+            if (roll < 90)
+                return Action::Disconnect;
+            return Action::Failover;
+        }
+
+        qint64 residentKb() {
+            QFile status("/proc/self/status");
+            if (!status.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                return 0;
+            }
+
+            while (!status.atEnd()) {
+                const QByteArray line = status.readLine();
+                if (line.startsWith("VmRSS:")) {
+                    return line.mid(6).trimmed().split(' ').value(0).toLongLong();
+                }
+            }
+            return 0;
+        }
+
+        int configuredRounds() {
+            bool      ok     = false;
+            const int rounds = qEnvironmentVariableIntValue("BB_AUTH_STRESS_ROUNDS", &ok);
+            return ok && rounds > 0 ? rounds : DEFAULT_ROUNDS;
+        }
+
+    } // namespace
+
+    // Hundreds of overlapping keyring and pinentry flows against one agent, each
+    // ending in a random way: answered, cancelled by the provider, abandoned by its
+    // client, or interrupted by the active provider crashing. After every round the
+    // agent must be back to zero per-session state.
+    class SessionStressTest : public QObject {
+        Q_OBJECT
+
+      private slots:
+        void initTestCase();
+        void cleanupTestCase();
+
+        void coalescesOnlySameRequestor();
+        void followerJoiningRetryGetsRetriedAnswer();
+        void pinentryDisconnectInEachState();
+        void soak();
+
+      private:
+        struct Flow {
+            FlowKind               kind      = FlowKind::Keyring;
+            Action                 action    = Action::Respond;
+            qint64                 startedAt = 0;
+            qint64                 actedAt   = 0;
+            bool                   announced = false;
+            bool                   acted     = false;
+            bool                   done      = false;
+            QPointer<QLocalSocket> client;
+            QPointer<QProcess>     process;
+        };
+
+        bool addProvider();
+        void onProviderMessage(HeadlessProvider* provider, const QJsonObject& msg);
+        void onSessionCreated(HeadlessProvider* provider, const QJsonObject& msg);
+        void failover(HeadlessProvider* provider);
+
+        void runRound(int round);
+        void launchFlows();
+        void launchKeyring(const QString& tag);
+        void launchPinentry(const QString& tag);
+        void finishFlow(const QString& tag);
+        void record(Op op, qint64 startedAt);
+
+        QTemporaryDir                                  m_dir;
+        QString                                        m_socketPath;
+        QRandomGenerator                               m_rng{RANDOM_SEED};
+        std::vector<std::unique_ptr<HeadlessProvider>> m_providers;
+        int                                            m_nextPriority    = 1000;
+        qint64                                         m_failoverStarted = 0;
+
+        QHash<QString, Flow>                           m_flows;        // by tag: keyring cookie or pinentry keyinfo
+        QHash<QString, qint64>                         m_disconnected; // cookie -> client gone, awaiting session.closed
+        int                                            m_round    = 0;
+        int                                            m_launched = 0;
+        int                                            m_finished = 0;
+        int                                            m_inFlight = 0;
+
+        std::array<metrics::LatencyHistogram, OP_NAMES.size()> m_ops;
+    };
+
+    void SessionStressTest::initTestCase() {
+        QVERIFY(m_dir.isValid());
+        m_socketPath = m_dir.filePath("bb-auth.sock");
+
+        g_pAgent = std::make_unique<CAgent>(new harness::StubPolkitListener);
+        QVERIFY(g_pAgent->startIpc(m_socketPath));
+
+        // Active provider plus one standby
+        QVERIFY(addProvider());
+        QVERIFY(addProvider());
+    }
+
+    void SessionStressTest::cleanupTestCase() {
+        for (auto& provider : m_providers) {
+            provider->close();
+        }
+        pumpUntil([] { return false; }, 100);
+        m_providers.clear();
+        g_pAgent.reset();
+    }
+
+    // Each new provider ranks below every earlier one, so it joins as the standby
+    bool SessionStressTest::addProvider() {
+        auto provider       = std::make_unique<HeadlessProvider>();
+        provider->onMessage = [this](HeadlessProvider* from, const QJsonObject& msg) { onProviderMessage(from, msg); };
+        if (!provider->connectTo(m_socketPath, QStringLiteral("stress-%1").arg(m_nextPriority), m_nextPriority)) {
+            return false;
+        }
+        --m_nextPriority;
+        m_providers.push_back(std::move(provider));
+        return true;
+    }
+
+    void SessionStressTest::onProviderMessage(HeadlessProvider* provider, const QJsonObject& msg) {
+        const QString type = msg.value("type").toString();
+
+        if (type == "session.created") {
+            onSessionCreated(provider, msg);
+        } else if (type == "session.closed") {
+            const auto it = m_disconnected.constFind(msg.value("id").toString());
+            if (it != m_disconnected.constEnd()) {
+                record(Op::Disconnect, it.value());
+                m_disconnected.erase(it);
+            }
+        } else if (type == "ui.active" && provider->isActive() && m_failoverStarted != 0) {
+            // The standby took over; re-subscribing replays every open session to it
+            record(Op::Failover, m_failoverStarted);
+            m_failoverStarted = 0;
+            provider->send(QJsonObject{{"type", "subscribe"}});
+            QTimer::singleShot(0, this, [this] {
+                if (!addProvider()) {
+                    qWarning("could not connect a new standby provider");
+                }
+            });
+        }
+    }
+
+    void SessionStressTest::onSessionCreated(HeadlessProvider* provider, const QJsonObject& msg) {
+        const QString cookie     = msg.value("id").toString();
+        const bool    isPinentry = msg.value("source").toString() == "pinentry";
+        const QString tag        = isPinentry ? msg.value("context").toObject().value("keyinfo").toString() : cookie;
+
+        const auto    it         = m_flows.find(tag);
+        if (it == m_flows.end() || it->done) {
+            return;
+        }
+
+        Flow& flow = it.value();
+        if (!flow.announced) {
+            flow.announced = true;
+            record(Op::Open, flow.startedAt);
+        }
+        // A failover replays sessions that were already handled; only a lost answer needs repeating
+        if (flow.acted && flow.action == Action::Disconnect) {
+            return;
+        }
+
+        if (flow.action == Action::Failover) {
+            // Whoever sees it next (the standby, after the replay) just answers
+            flow.action = Action::Respond;
+            if (m_failoverStarted == 0 && m_providers.size() > 1) {
+                failover(provider);
+                return;
+            }
+        }
+
+        flow.acted   = true;
+        flow.actedAt = metrics::now();
+        switch (flow.action) {
+            case Action::Respond: provider->send(QJsonObject{{"type", "session.respond"}, {"id", cookie}, {"response", PASSWORD}}); break;
+            case Action::Cancel: provider->send(QJsonObject{{"type", "session.cancel"}, {"id", cookie}}); break;
+            case Action::Disconnect:
+                m_disconnected[cookie] = flow.actedAt;
+                if (flow.client) {
+                    flow.client->abort();
+                    finishFlow(tag);
+                } else if (flow.process) {
+                    flow.process->kill();
+                }
+                break;
+            case Action::Failover: break;
+        }
+    }
+
+    // The active provider dies without answering; its flow is left to the standby
+    void SessionStressTest::failover(HeadlessProvider* provider) {
+        m_failoverStarted = metrics::now();
+        provider->abort();
+
+        const auto it = std::find_if(m_providers.begin(), m_providers.end(), [provider](const auto& entry) { return entry.get() == provider; });
+        if (it != m_providers.end()) {
+            it->release()->deleteLater();
+            m_providers.erase(it);
+        }
+    }
+
+    // Two requests for one key from this process share a prompt; a pinentry spawned
+    // by a different parent asking for the same key gets its own. The soak's
+    // providers ignore these sessions, so the test cancels them itself.
+    void SessionStressTest::coalescesOnlySameRequestor() {
+        const QString keyinfo = QStringLiteral("n/COALESCE");
+
+        QStringList   created;
+        QLocalSocket  subscriber;
+        subscriber.connectToServer(m_socketPath);
+        QVERIFY(subscriber.waitForConnected(harness::STEP_TIMEOUT_MS));
+        connect(&subscriber, &QLocalSocket::readyRead, &subscriber, [&subscriber, &created, &keyinfo] {
+            while (subscriber.canReadLine()) {
+                const QJsonObject msg = QJsonDocument::fromJson(subscriber.readLine()).object();
+                if (msg.value("type").toString() == "session.created" && msg.value("context").toObject().value("keyinfo").toString() == keyinfo) {
+                    created << msg.value("id").toString();
+                }
+            }
+        });
+        writeJson(&subscriber, QJsonObject{{"type", "subscribe"}});
+
+        QJsonObject  request{{"type", "pinentry_request"}, {"keyinfo", keyinfo}, {"prompt", "Passphrase:"}, {"description", "Coalesce test"}};
+        QLocalSocket leader;
+        QLocalSocket follower;
+        for (QLocalSocket* socket : {&leader, &follower}) {
+            socket->connectToServer(m_socketPath);
+            QVERIFY(socket->waitForConnected(harness::STEP_TIMEOUT_MS));
+        }
+
+        request["cookie"] = "coalesce-leader";
+        writeJson(&leader, request);
+        QVERIFY(pumpUntil([&created] { return created.size() == 1; }));
+
+        request["cookie"] = "coalesce-follower";
+        writeJson(&follower, request);
+        QVERIFY(pumpUntil([] { return g_pAgent->tableSizes().value("pinentry_flows").toInteger() == 2; }));
+
+        auto* process = new QProcess(this);
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        env.insert("XDG_RUNTIME_DIR", m_dir.path());
+        process->setProcessEnvironment(env);
+        process->setStandardErrorFile(QProcess::nullDevice());
+        process->start(QCoreApplication::applicationFilePath(), {PINENTRY_ARG});
+        harness::scriptPinentry(process, QStringLiteral("SETKEYINFO %1\nSETDESC Coalesce test\nSETPROMPT Passphrase:\nGETPIN\n").arg(keyinfo).toUtf8());
+
+        QVERIFY2(pumpUntil([&created] { return created.size() == 2; }), "a pinentry from another parent was coalesced");
+        QCOMPARE(created.first(), QString("coalesce-leader"));
+        QVERIFY(!created.contains("coalesce-follower"));
+
+        const auto active = std::find_if(m_providers.begin(), m_providers.end(), [](const auto& provider) { return provider->isActive(); });
+        QVERIFY(active != m_providers.end());
+        for (const QString& id : created) {
+            (*active)->send(QJsonObject{{"type", "session.cancel"}, {"id", id}});
+        }
+
+        // The follower is answered with its leader's outcome
+        QVERIFY(pumpUntil([&follower] { return follower.canReadLine(); }));
+        const QJsonObject reply = QJsonDocument::fromJson(follower.readLine()).object();
+        QCOMPARE(reply.value("id").toString(), QString("coalesce-follower"));
+        QCOMPARE(reply.value("result").toString(), QString("cancelled"));
+
+        QVERIFY(pumpUntil([process] { return process->state() == QProcess::NotRunning; }));
+        process->deleteLater();
+        for (QLocalSocket* socket : {&leader, &follower, &subscriber}) {
+            socket->disconnectFromServer();
+        }
+        QVERIFY(pumpUntil([] {
+            const QJsonObject tables = g_pAgent->tableSizes();
+            return tables.value("pinentry_flows").toInteger() == 0 && tables.value("sessions").toInteger() == 0;
+        }));
+    }
+
+    // A request for the key arriving while the leader's pinentry is between a retry and
+    // asking again waits for that retried prompt instead of opening its own
+    void SessionStressTest::followerJoiningRetryGetsRetriedAnswer() {
+        const auto active = std::find_if(m_providers.begin(), m_providers.end(), [](const auto& provider) { return provider->isActive(); });
+        QVERIFY(active != m_providers.end());
+
+        const auto readReply = [](QLocalSocket& socket) {
+            return pumpUntil([&socket] { return socket.canReadLine(); }) ? QJsonDocument::fromJson(socket.readLine()).object() : QJsonObject{};
+        };
+        const auto tables = [] { return g_pAgent->tableSizes(); };
+
+        QLocalSocket leader;
+        QLocalSocket follower;
+        for (QLocalSocket* socket : {&leader, &follower}) {
+            socket->connectToServer(m_socketPath);
+            QVERIFY(socket->waitForConnected(harness::STEP_TIMEOUT_MS));
+        }
+
+        QJsonObject request{{"type", "pinentry_request"}, {"keyinfo", "n/RETRY-JOIN"}, {"prompt", "Passphrase:"}, {"cookie", "retry-leader"}};
+        writeJson(&leader, request);
+        QVERIFY(pumpUntil([&tables] { return tables().value("sessions").toInteger() == 1; }));
+
+        // A wrong passphrase: answered, then reported back as a retry
+        (*active)->send(QJsonObject{{"type", "session.respond"}, {"id", "retry-leader"}, {"response", "wrong"}});
+        QCOMPARE(readReply(leader).value("result").toString(), QString("ok"));
+        writeJson(&leader, QJsonObject{{"type", "pinentry_result"}, {"id", "retry-leader"}, {"result", "retry"}});
+        QCOMPARE(readReply(leader).value("type").toString(), QString("ok"));
+
+        QJsonObject joining = request;
+        joining["cookie"]   = "retry-follower";
+        writeJson(&follower, joining);
+        QVERIFY(pumpUntil([&tables] { return tables().value("pinentry_flows").toInteger() == 2; }));
+        QCOMPARE(tables().value("sessions").toInteger(), 1);
+
+        // The leader's pinentry asks again; the one answer goes to both
+        // (the pong only comes once the request ahead of it on the connection is handled)
+        request["error"] = "Bad passphrase";
+        writeJson(&leader, request);
+        writeJson(&leader, QJsonObject{{"type", "ping"}});
+        QCOMPARE(readReply(leader).value("type").toString(), QString("pong"));
+        (*active)->send(QJsonObject{{"type", "session.respond"}, {"id", "retry-leader"}, {"response", PASSWORD}});
+
+        const QJsonObject leaderReply = readReply(leader);
+        QCOMPARE(leaderReply.value("result").toString(), QString("ok"));
+        QCOMPARE(leaderReply.value("password").toString(), QString(PASSWORD));
+        const QJsonObject followerReply = readReply(follower);
+        QCOMPARE(followerReply.value("id").toString(), QString("retry-follower"));
+        QCOMPARE(followerReply.value("result").toString(), QString("ok"));
+        QCOMPARE(followerReply.value("password").toString(), QString(PASSWORD));
+
+        for (QLocalSocket* socket : {&leader, &follower}) {
+            const QString cookie = socket == &leader ? "retry-leader" : "retry-follower";
+            writeJson(socket, QJsonObject{{"type", "pinentry_result"}, {"id", cookie}, {"result", "success"}});
+            QCOMPARE(readReply(*socket).value("type").toString(), QString("ok"));
+            socket->disconnectFromServer();
+        }
+        QVERIFY(pumpUntil([&tables] { return tables().value("pinentry_flows").toInteger() == 0 && tables().value("sessions").toInteger() == 0; }));
+    }
+
+    // A pinentry connection dropping at any point of its flow must release the flow,
+    // its session and its deadline right away, not when some timeout lapses
+    void SessionStressTest::pinentryDisconnectInEachState() {
+        const auto active = std::find_if(m_providers.begin(), m_providers.end(), [](const auto& provider) { return provider->isActive(); });
+        QVERIFY(active != m_providers.end());
+
+        const qint64 idleTimers = g_pAgent->tableSizes().value("timers").toInteger();
+        const auto   settled    = [idleTimers] {
+            const QJsonObject tables = g_pAgent->tableSizes();
+            return tables.value("pinentry_flows").toInteger() == 0 && tables.value("sessions").toInteger() == 0 && tables.value("timers").toInteger() == idleTimers;
+        };
+        const auto   readReply = [](QLocalSocket& socket) {
+            return pumpUntil([&socket] { return socket.canReadLine(); }) ? QJsonDocument::fromJson(socket.readLine()).object() : QJsonObject{};
+        };
+
+        const char* states[] = {"awaiting-input", "following", "awaiting-outcome", "retrying"};
+        for (const char* state : states) {
+            const QString keyinfo = QStringLiteral("n/DISCONNECT-%1").arg(state);
+            const QString cookie  = QStringLiteral("disconnect-%1").arg(state);
+
+            QLocalSocket  client;
+            QLocalSocket  leader; // only used to give the client a prompt to follow
+            for (QLocalSocket* socket : {&client, &leader}) {
+                socket->connectToServer(m_socketPath);
+                QVERIFY(socket->waitForConnected(harness::STEP_TIMEOUT_MS));
+            }
+
+            QJsonObject request{{"type", "pinentry_request"}, {"keyinfo", keyinfo}, {"prompt", "Passphrase:"}};
+            if (qstrcmp(state, "following") == 0) {
+                request["cookie"] = cookie + "-leader";
+                writeJson(&leader, request);
+                QVERIFY(pumpUntil([] { return g_pAgent->tableSizes().value("sessions").toInteger() == 1; }));
+            }
+
+            request["cookie"] = cookie;
+            writeJson(&client, request);
+            const qint64 flows = qstrcmp(state, "following") == 0 ? 2 : 1;
+            QVERIFY(pumpUntil([flows] { return g_pAgent->tableSizes().value("pinentry_flows").toInteger() == flows && g_pAgent->tableSizes().value("sessions").toInteger() == 1; }));
+
+            if (qstrcmp(state, "awaiting-outcome") == 0 || qstrcmp(state, "retrying") == 0) {
+                (*active)->send(QJsonObject{{"type", "session.respond"}, {"id", cookie}, {"response", PASSWORD}});
+                QCOMPARE(readReply(client).value("result").toString(), QString("ok"));
+            }
+            if (qstrcmp(state, "retrying") == 0) {
+                writeJson(&client, QJsonObject{{"type", "pinentry_result"}, {"id", cookie}, {"result", "retry"}});
+                QCOMPARE(readReply(client).value("type").toString(), QString("ok"));
+            }
+
+            client.abort();
+            if (qstrcmp(state, "following") == 0) {
+                // The leader's prompt stays up for it alone
+                QVERIFY(pumpUntil([] { return g_pAgent->tableSizes().value("pinentry_flows").toInteger() == 1; }));
+                QCOMPARE(g_pAgent->tableSizes().value("sessions").toInteger(), 1);
+                leader.abort();
+            }
+
+            QVERIFY2(pumpUntil(settled), qPrintable(QStringLiteral("%1 leaked: %2").arg(state, QString::fromUtf8(QJsonDocument(g_pAgent->tableSizes()).toJson(QJsonDocument::Compact)))));
+        }
+    }
+
+    void SessionStressTest::soak() {
+        const int rounds      = configuredRounds();
+        qint64    baselineRss = 0;
+
+        for (int round = 0; round < rounds; ++round) {
+            runRound(round);
+            if (QTest::currentTestFailed()) {
+                return;
+            }
+
+            // Let the first round warm up allocator pools and Qt's caches before taking the baseline
+            if (round == 0) {
+                baselineRss = residentKb();
+            }
+        }
+
+        const qint64 finalRss = residentKb();
+        for (std::size_t op = 0; op < OP_NAMES.size(); ++op) {
+            const metrics::LatencyHistogram& hist = m_ops[op];
+            qInfo("%-10s count=%llu p50=%lldus p99=%lldus max=%lldus", OP_NAMES[op], static_cast<unsigned long long>(hist.count()), hist.percentile(0.50) / 1000,
+                  hist.percentile(0.99) / 1000, hist.max() / 1000);
+        }
+
+        const metrics::LatencyHistogram& route = metrics::histogram(metrics::Stage::EventRoute);
+        qInfo("rounds=%d flows=%d rss_baseline=%lldkB rss_final=%lldkB event_route_p99=%lldus", rounds, rounds * FLOWS_PER_ROUND, baselineRss, finalRss,
+              route.percentile(0.99) / 1000);
+
+        QVERIFY2(m_ops[static_cast<std::size_t>(Op::Open)].percentile(0.99) < OPEN_P99_LIMIT_NS, "session.created p99 over limit");
+        QVERIFY2(route.percentile(0.99) < EVENT_ROUTE_P99_LIMIT_NS, "event.route p99 over limit");
+        if (baselineRss > 0 && rounds > 1) {
+            QVERIFY2(finalRss - baselineRss < RSS_GROWTH_LIMIT_KB, qPrintable(QStringLiteral("RSS grew by %1 kB").arg(finalRss - baselineRss)));
+        }
+    }
+
+    void SessionStressTest::runRound(int round) {
+        m_round    = round;
+        m_launched = 0;
+        m_finished = 0;
+        m_inFlight = 0;
+        m_flows.clear();
+        m_disconnected.clear();
+
+        launchFlows();
+        QVERIFY2(pumpUntil([this] { return m_finished == FLOWS_PER_ROUND; }, ROUND_TIMEOUT_MS), qPrintable(QStringLiteral("round %1: flows did not finish").arg(round)));
+
+        // Every client is gone; whatever the agent still holds must drain on its own
+        const qint64 settleStart = metrics::now();
+        QJsonObject  tables;
+        const bool   settled = pumpUntil(
+            [&tables] {
+                tables = g_pAgent->tableSizes();
+                for (auto it = tables.constBegin(); it != tables.constEnd(); ++it) {
+                    if (it.key() != "event_queue" && it.key() != "subscribers" && it.key() != "providers" && it.key() != "timers" && it.value().toInteger() != 0) {
+                        return false;
+                    }
+                }
+                return true;
+            },
+            SETTLE_TIMEOUT_MS);
+        record(Op::Settle, settleStart);
+
+        QVERIFY2(settled, qPrintable(QStringLiteral("round %1 leaked: %2").arg(round).arg(QString::fromUtf8(QJsonDocument(tables).toJson(QJsonDocument::Compact)))));
+        QCOMPARE(tables.value("providers").toInteger(), static_cast<qint64>(m_providers.size()));
+        QCOMPARE(tables.value("subscribers").toInteger(), static_cast<qint64>(m_providers.size()));
+        // Provider liveness deadlines and at most the fallback launch cooldown
+        QVERIFY(tables.value("timers").toInteger() <= static_cast<qint64>(m_providers.size()) + 1);
+        QVERIFY(tables.value("event_queue").toInteger() <= 256);
+    }
+
+    void SessionStressTest::launchFlows() {
+        while (m_inFlight < CONCURRENCY && m_launched < FLOWS_PER_ROUND) {
+            const int      index = m_launched++;
+            const FlowKind kind  = index % 2 == 0 ? FlowKind::Keyring : FlowKind::Pinentry;
+            const QString  tag   = kind == FlowKind::Keyring ? QStringLiteral("stress-keyring-%1-%2").arg(m_round).arg(index) : QStringLiteral("n/STRESS%1X%2").arg(m_round).arg(index);
+
+            Flow flow;
+            flow.kind      = kind;
+            flow.action    = pickAction(m_rng);
+            flow.startedAt = metrics::now();
+            m_flows.insert(tag, flow);
+            ++m_inFlight;
+
+            if (kind == FlowKind::Keyring) {
+                launchKeyring(tag);
+            } else {
+                launchPinentry(tag);
+            }
+        }
+    }
+
+    void SessionStressTest::finishFlow(const QString& tag) {
+        const auto it = m_flows.find(tag);
+        if (it == m_flows.end() || it->done) {
+            return;
+        }
+
+        it->done = true;
+        if (it->acted && it->action == Action::Respond) {
+            record(Op::Respond, it->actedAt);
+        } else if (it->acted && it->action == Action::Cancel) {
+            record(Op::Cancel, it->actedAt);
+        }
+
+        --m_inFlight;
+        ++m_finished;
+        QTimer::singleShot(0, this, [this] { launchFlows(); });
+    }
+
+    void SessionStressTest::record(Op op, qint64 startedAt) {
+        m_ops[static_cast<std::size_t>(op)].record(metrics::now() - startedAt);
+    }
+
+    void SessionStressTest::launchKeyring(const QString& tag) {
+        auto* client        = new QLocalSocket(this);
+        m_flows[tag].client = client;
+
+        connect(client, &QLocalSocket::connected, client, [client, tag] {
+            writeJson(client, QJsonObject{{"type", "keyring_request"}, {"cookie", tag}, {"title", "Unlock Keyring"}, {"message", "Stress keyring"}});
+        });
+        connect(client, &QLocalSocket::readyRead, client, [this, client, tag] {
+            if (!client->canReadLine()) {
+                return;
+            }
+            client->disconnect();
+            client->disconnectFromServer();
+            client->deleteLater();
+            finishFlow(tag);
+        });
+        connect(client, &QLocalSocket::disconnected, client, [this, client, tag] {
+            client->deleteLater();
+            finishFlow(tag);
+        });
+        connect(client, &QLocalSocket::errorOccurred, client, [this, client, tag] {
+            client->deleteLater();
+            finishFlow(tag);
+        });
+
+        client->connectToServer(m_socketPath);
+    }
+
+    // Same Assuan exchange gpg-agent would drive; a cancelled GETPIN still ends with BYE
+    void SessionStressTest::launchPinentry(const QString& tag) {
+        auto* process        = new QProcess(this);
+        m_flows[tag].process = process;
+
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        env.insert("XDG_RUNTIME_DIR", m_dir.path());
+        process->setProcessEnvironment(env);
+        process->setStandardErrorFile(QProcess::nullDevice());
+
+        connect(process, &QProcess::finished, process, [this, process, tag] {
+            process->deleteLater();
+            finishFlow(tag);
+        });
+        connect(process, &QProcess::errorOccurred, process, [this, process, tag](QProcess::ProcessError error) {
+            if (error == QProcess::FailedToStart) {
+                process->deleteLater();
+                finishFlow(tag);
+            }
+        });
+
+        process->start(QCoreApplication::applicationFilePath(), {PINENTRY_ARG});
+        harness::scriptPinentry(process, QStringLiteral("SETKEYINFO %1\nSETDESC Stress passphrase\nSETPROMPT Passphrase:\nGETPIN\n").arg(tag).toUtf8());
+    }
+
+} // namespace bb
+
+int main(int argc, char** argv) {
+    // Re-executed by the test as the pinentry under test
+    if (argc > 1 && std::strcmp(argv[1], bb::PINENTRY_ARG) == 0) {
+        return modes::runPinentry();
+    }
+
+    QCoreApplication      app(argc, argv);
+    bb::SessionStressTest test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "stress_sessions.moc"
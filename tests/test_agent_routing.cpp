@@ -1,17 +1,40 @@
+#include "../src/common/Constants.hpp"
+#include "../src/common/IpcClient.hpp"
+#include "../src/common/Paths.hpp"
+#include "../src/common/SecureMemory.hpp"
+#include "../src/common/TraceDump.hpp"
+#include "../src/common/TraceRing.hpp"
+#include "../src/core/BootstrapState.hpp"
+#include "../src/core/Metrics.hpp"
+#include "../src/core/TimerWheel.hpp"
 #include "../src/core/agent/EventQueue.hpp"
 #include "../src/core/agent/EventRouter.hpp"
+#include "../src/core/agent/MessageRouter.hpp"
 #include "../src/core/agent/ProviderRegistry.hpp"
+#include "../src/core/ipc/IpcServer.hpp"
+#include "../src/core/ipc/JsonMessage.hpp"
 
 #include <QtTest/QtTest>
 
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
 #include <QLocalServer>
 #include <QLocalSocket>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
 #include <QUuid>
 
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 #include <memory>
 #include <utility>
 #include <vector>
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
 
 namespace bb {
 
@@ -57,6 +80,53 @@ namespace bb {
             bool         m_isListening = false;
         };
 
+        // A raw client of IpcServer's SOCK_SEQPACKET endpoint
+        class PacketClient {
+          public:
+            explicit PacketClient(const QString& socketPath) {
+                const QByteArray path = QFile::encodeName(packetSocketPath(socketPath));
+                sockaddr_un      addr{};
+                addr.sun_family = AF_UNIX;
+                std::memcpy(addr.sun_path, path.constData(), std::min(static_cast<std::size_t>(path.size()), sizeof(addr.sun_path) - 1));
+
+                m_fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+                if (m_fd != -1 && ::connect(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+                    ::close(m_fd);
+                    m_fd = -1;
+                }
+            }
+            ~PacketClient() {
+                if (m_fd != -1) {
+                    ::close(m_fd);
+                }
+            }
+
+            bool isConnected() const {
+                return m_fd != -1;
+            }
+            bool send(QByteArrayView packet) {
+                return ::send(m_fd, packet.data(), static_cast<std::size_t>(packet.size()), MSG_NOSIGNAL) == packet.size();
+            }
+
+            // The packets that have arrived so far, one entry each; one over
+            // MAX_MESSAGE_SIZE comes back empty
+            QList<QByteArray> receive() {
+                QList<QByteArray> packets;
+                QByteArray        buffer(static_cast<qsizetype>(MAX_MESSAGE_SIZE), Qt::Uninitialized);
+                for (;;) {
+                    const auto got = ::recv(m_fd, buffer.data(), static_cast<std::size_t>(buffer.size()), MSG_DONTWAIT | MSG_TRUNC);
+                    if (got <= 0) {
+                        break;
+                    }
+                    packets << (got > buffer.size() ? QByteArray() : buffer.first(got));
+                }
+                return packets;
+            }
+
+          private:
+            int m_fd = -1;
+        };
+
         struct SentEvent {
             QLocalSocket* socket = nullptr;
             QString       type;
@@ -81,10 +151,37 @@ namespace bb {
         void eventQueue_dropsOldestAtCapacity();
         void eventQueue_drainsWaitersInFifoOrder();
         void eventQueue_removeWaiterPreventsSend();
+        void eventQueue_compactsPerSession();
+        void eventQueue_servesBatchPolls();
 
         void eventRouter_routesSessionEventsToActiveProviderOnly();
         void eventRouter_broadcastsSessionEventsWhenNoActiveProvider();
         void eventRouter_broadcastsNonSessionEventsEvenWithActiveProvider();
+        void eventRouter_sendsQueuedRepliesThroughReplyFn();
+
+        void messageRouter_dispatchesDecodedRequests();
+        void messageRouter_rejectsInvalidRequests();
+        void messageRouter_runsBatchInOrder();
+        void messageRouter_authorizesBatchEntriesAsTheyRun();
+        void ipcServer_keepsEventsOutOfBatchReplies();
+        void ipcServer_readsOneMessagePerPacket();
+        void ipcServer_queuesPacketsInOrderWhenSendBufferIsFull();
+        void ipcServer_splitsOversizedBatchIntoPackets();
+        void jsonMessage_readsTopLevelTypeOnly();
+        void jsonMessage_rejectsInvalidJson();
+        void jsonMessage_decodesFieldsOnDemand();
+        void jsonMessage_decodesSecretIntoWipedArena();
+        void secureMemory_freedBlocksHoldNoPassword();
+        void secureMemory_poolHoldsNoPasswordAfterExchange();
+
+        void metrics_histogramPercentilesWithinBucketError();
+        void metrics_snapshotReportsStagesAndCounters();
+
+        void traceDump_mergesRingsIntoFlows();
+
+        void timerWheel_firesDueEntriesAndSkipsCancelled();
+
+        void bootstrapState_reloadsOnlyWhenFileChanges();
     };
 
     void AgentRoutingTest::providerRegistry_selectsHighestPriority() {
@@ -311,6 +408,118 @@ namespace bb {
         QVERIFY(sent.empty());
     }
 
+    void AgentRoutingTest::eventQueue_compactsPerSession() {
+        const auto sessionEvent = [](const QString& type, const QString& id, qint64 revision) {
+            return QJsonObject{{"type", type}, {"id", id}, {"revision", revision}};
+        };
+        const auto describe = [](const QJsonObject& event) {
+            return event.value("type").toString() + "/" + event.value("id").toString() + "/" + QString::number(event.value("revision").toInteger());
+        };
+
+        agent::EventQueue queue(10);
+
+        // Later updates overwrite the queued one in place
+        queue.enqueue(sessionEvent("session.created", "s1", 1));
+        queue.enqueue(sessionEvent("session.updated", "s1", 2));
+        queue.enqueue(sessionEvent("session.created", "s2", 1));
+        queue.enqueue(sessionEvent("session.updated", "s1", 3));
+        queue.enqueue(sessionEvent("session.updated", "s1", 4));
+        QCOMPARE(queue.size(), 3);
+
+        QCOMPARE(describe(queue.takeNext()), QString("session.created/s1/1"));
+        QCOMPARE(describe(queue.takeNext()), QString("session.updated/s1/4"));
+
+        // Once the update has been read, the next one is queued afresh
+        queue.enqueue(sessionEvent("session.updated", "s1", 5));
+        QCOMPARE(queue.size(), 2);
+        QCOMPARE(describe(queue.takeNext()), QString("session.created/s2/1"));
+        QCOMPARE(describe(queue.takeNext()), QString("session.updated/s1/5"));
+        QVERIFY(queue.isEmpty());
+
+        // A close drops everything queued for that session only
+        queue.enqueue(sessionEvent("session.created", "s3", 1));
+        queue.enqueue(makeEvent("provider.changed"));
+        queue.enqueue(sessionEvent("session.updated", "s3", 2));
+        queue.enqueue(sessionEvent("session.created", "s4", 1));
+        queue.enqueue(sessionEvent("session.closed", "s3", 0));
+        QCOMPARE(queue.size(), 3);
+
+        QCOMPARE(queue.takeNext().value("type").toString(), QString("provider.changed"));
+        QCOMPARE(describe(queue.takeNext()), QString("session.created/s4/1"));
+        QCOMPARE(describe(queue.takeNext()), QString("session.closed/s3/0"));
+        QVERIFY(queue.takeNext().isEmpty());
+
+        // A session closed and reopened under the same id starts clean
+        queue.enqueue(sessionEvent("session.updated", "s3", 3));
+        queue.enqueue(sessionEvent("session.updated", "s3", 4));
+        QCOMPARE(queue.size(), 1);
+        QCOMPARE(describe(queue.takeNext()), QString("session.updated/s3/4"));
+    }
+
+    void AgentRoutingTest::eventQueue_servesBatchPolls() {
+        const auto decodeNext = [](const char* line, NextRequest& request, QString& error) {
+            const auto msg = JsonMessage::parse(line);
+            return msg && agent::decodeRequest(*msg, request, error);
+        };
+
+        QString     error;
+        NextRequest plain;
+        QVERIFY(decodeNext(R"({"type":"next"})", plain, error));
+        QCOMPARE(plain.max, 0);
+        QCOMPARE(plain.waitMs, -1);
+
+        NextRequest bounded;
+        QVERIFY(decodeNext(R"({"type":"next","max":2,"wait_ms":500})", bounded, error));
+        QCOMPARE(bounded.max, 2);
+        QCOMPARE(bounded.waitMs, 500);
+
+        NextRequest waitOnly;
+        QVERIFY(decodeNext(R"({"type":"next","wait_ms":0})", waitOnly, error));
+        QCOMPARE(waitOnly.max, NEXT_BATCH_MAX);
+        QCOMPARE(waitOnly.waitMs, 0);
+
+        NextRequest invalid;
+        QVERIFY(!decodeNext(R"({"type":"next","max":-1})", invalid, error));
+        QCOMPARE(error, QString("Invalid max"));
+        QVERIFY(!decodeNext(R"({"type":"next","wait_ms":"soon"})", invalid, error));
+        QCOMPARE(error, QString("Invalid wait_ms"));
+
+        LocalSocketFixture fixture;
+        QVERIFY(fixture.isListening());
+
+        ConnectedSocket batch = fixture.connect();
+        QVERIFY(batch.server != nullptr);
+        ConnectedSocket single = fixture.connect();
+        QVERIFY(single.server != nullptr);
+
+        agent::EventQueue queue(10);
+        QCOMPARE(queue.takeBatch(5).value("events").toArray().size(), 0);
+
+        queue.subscribeNext(batch.server.get(), 2);
+        queue.subscribeNext(single.server.get());
+        QVERIFY(queue.isWaiting(batch.server.get()));
+        QVERIFY(queue.isWaiting(single.server.get()));
+        queue.enqueue(makeEvent("e1"));
+        queue.enqueue(makeEvent("e2"));
+        queue.enqueue(makeEvent("e3"));
+
+        std::vector<std::pair<QLocalSocket*, QJsonObject>> sent;
+        queue.drainToWaiters([&sent](QLocalSocket* socket, const QJsonObject& reply) { sent.emplace_back(socket, reply); });
+
+        QCOMPARE(sent.size(), static_cast<size_t>(2));
+        QCOMPARE(sent[0].first, batch.server.get());
+        QCOMPARE(sent[0].second.value("type").toString(), QString("events"));
+        const QJsonArray events = sent[0].second.value("events").toArray();
+        QCOMPARE(events.size(), 2);
+        QCOMPARE(events[0].toObject().value("type").toString(), QString("e1"));
+        QCOMPARE(events[1].toObject().value("type").toString(), QString("e2"));
+        QCOMPARE(sent[1].first, single.server.get());
+        QCOMPARE(sent[1].second.value("type").toString(), QString("e3"));
+        QVERIFY(queue.isEmpty());
+        QCOMPARE(queue.waiterCount(), 0);
+        QVERIFY(!queue.isWaiting(batch.server.get()));
+    }
+
     void AgentRoutingTest::eventRouter_routesSessionEventsToActiveProviderOnly() {
         LocalSocketFixture fixture;
         QVERIFY(fixture.isListening());
@@ -427,6 +636,785 @@ namespace bb {
         QVERIFY(std::none_of(sent.begin(), sent.end(), [&](const SentEvent& e) { return e.socket == provider.server.get(); }));
     }
 
+    void AgentRoutingTest::eventRouter_sendsQueuedRepliesThroughReplyFn() {
+        LocalSocketFixture fixture;
+        QVERIFY(fixture.isListening());
+
+        agent::ProviderRegistry registry([] { return qint64(0); });
+        agent::EventQueue       queue(10);
+        agent::EventRouter      router(registry, queue);
+
+        ConnectedSocket         sub = fixture.connect();
+        QVERIFY(sub.server != nullptr);
+
+        ConnectedSocket waiter = fixture.connect();
+        QVERIFY(waiter.server != nullptr);
+
+        queue.subscribeNext(waiter.server.get(), 8);
+
+        std::vector<SentEvent>     sent;
+        std::vector<SentEvent>     replies;
+        const QList<QLocalSocket*> subscribers{sub.server.get()};
+        router.route(
+            makeEvent("session.created"), subscribers, [&sent](QLocalSocket* socket, const QJsonObject& event) { sent.push_back(SentEvent{socket, event.value("type").toString()}); },
+            [&replies](QLocalSocket* socket, const QJsonObject& reply) { replies.push_back(SentEvent{socket, reply.value("type").toString()}); });
+
+        // The subscriber gets the event itself; the waiter's batch reply goes only through replyFn
+        QCOMPARE(sent.size(), static_cast<size_t>(1));
+        QCOMPARE(sent[0].socket, sub.server.get());
+        QCOMPARE(sent[0].type, QString("session.created"));
+        QCOMPARE(replies.size(), static_cast<size_t>(1));
+        QCOMPARE(replies[0].socket, waiter.server.get());
+        QCOMPARE(replies[0].type, QString("events"));
+    }
+
+    void AgentRoutingTest::messageRouter_dispatchesDecodedRequests() {
+        agent::MessageRouter router;
+        QString              receivedId;
+        QByteArray           receivedResponse;
+        int                  pings = 0;
+        router.registerHandler<agent::MessageType::Ping>([&pings](QLocalSocket*, const EmptyRequest&) { ++pings; });
+        router.registerHandler<agent::MessageType::SessionRespond>([&](QLocalSocket*, const SessionRespondRequest& request) {
+            receivedId       = request.id;
+            receivedResponse = request.response.view().toByteArray();
+        });
+
+        QString    error;
+        const auto ping = JsonMessage::parse(R"({"type":"ping"})");
+        QVERIFY(ping);
+        QCOMPARE(router.dispatch(nullptr, *ping, error), agent::MessageRouter::DispatchStatus::Handled);
+        QCOMPARE(pings, 1);
+
+        const auto respond = JsonMessage::parse(R"({"type":"session.respond","id":"cookie-1","response":"secret"})");
+        QVERIFY(respond);
+        QCOMPARE(router.dispatch(nullptr, *respond, error), agent::MessageRouter::DispatchStatus::Handled);
+        QCOMPARE(receivedId, QString("cookie-1"));
+        QCOMPARE(receivedResponse, QByteArray("secret"));
+
+        // Known name without a registered handler, and an unknown name
+        const auto cancel = JsonMessage::parse(R"({"type":"session.cancel","id":"cookie-1"})");
+        const auto pong   = JsonMessage::parse(R"({"type":"pong"})");
+        QVERIFY(cancel && pong);
+        QCOMPARE(router.dispatch(nullptr, *cancel, error), agent::MessageRouter::DispatchStatus::UnknownType);
+        QCOMPARE(router.dispatch(nullptr, *pong, error), agent::MessageRouter::DispatchStatus::UnknownType);
+    }
+
+    void AgentRoutingTest::messageRouter_rejectsInvalidRequests() {
+        agent::MessageRouter router;
+        int                  calls = 0;
+        router.registerHandler<agent::MessageType::SessionCancel>([&calls](QLocalSocket*, const SessionCancelRequest&) { ++calls; });
+        router.registerHandler<agent::MessageType::SessionRespond>([&calls](QLocalSocket*, const SessionRespondRequest&) { ++calls; });
+
+        QString    error;
+        const auto missingId = JsonMessage::parse(R"({"type":"session.cancel"})");
+        QVERIFY(missingId);
+        QCOMPARE(router.dispatch(nullptr, *missingId, error), agent::MessageRouter::DispatchStatus::InvalidRequest);
+        QCOMPARE(error, QString("Missing id"));
+
+        const auto badResponse = JsonMessage::parse(R"({"type":"session.respond","id":"cookie-1","response":42})");
+        QVERIFY(badResponse);
+        QCOMPARE(router.dispatch(nullptr, *badResponse, error), agent::MessageRouter::DispatchStatus::InvalidRequest);
+        QCOMPARE(error, QString("Invalid response"));
+
+        QCOMPARE(calls, 0);
+
+        // The guard answers before the payload is decoded, so a refused peer learns nothing about its fields
+        agent::MessageRouter guarded;
+        bool                 authorized = false;
+        guarded.registerHandler<agent::MessageType::SessionRespond>(
+            [&authorized](QLocalSocket*, const JsonMessage&, QString& guardError) {
+                guardError = QStringLiteral("Not active UI provider");
+                return authorized;
+            },
+            [&calls](QLocalSocket*, const SessionRespondRequest&) { ++calls; });
+
+        const auto missingResponse = JsonMessage::parse(R"({"type":"session.respond"})");
+        QVERIFY(missingResponse);
+        QCOMPARE(guarded.dispatch(nullptr, *missingResponse, error), agent::MessageRouter::DispatchStatus::Unauthorized);
+        QCOMPARE(error, QString("Not active UI provider"));
+
+        std::vector<agent::MessageRouter::PreparedRequest> prepared;
+        QVERIFY(!guarded.prepareAll(nullptr, {*missingResponse}, prepared, error));
+        QCOMPARE(error, QString("requests[0]: Not active UI provider"));
+
+        authorized = true;
+        QCOMPARE(guarded.dispatch(nullptr, *missingResponse, error), agent::MessageRouter::DispatchStatus::InvalidRequest);
+        QCOMPARE(error, QString("Missing id"));
+
+        // A prepared request asks again when it runs
+        const QList<JsonMessage> respond = {*JsonMessage::parse(R"({"type":"session.respond","id":"cookie-1","response":"pw"})")};
+        QVERIFY(guarded.prepareAll(nullptr, respond, prepared, error));
+        authorized = false;
+        QVERIFY(!prepared.front()(nullptr, error));
+        QCOMPARE(error, QString("Not active UI provider"));
+        QCOMPARE(calls, 0);
+    }
+
+    void AgentRoutingTest::messageRouter_runsBatchInOrder() {
+        agent::MessageRouter router;
+        QStringList          log;
+        router.registerHandler<agent::MessageType::Ping>([&log](QLocalSocket*, const EmptyRequest&) { log << "ping"; });
+        router.registerHandler<agent::MessageType::SessionCancel>([&log](QLocalSocket*, const SessionCancelRequest& request) { log << "cancel " + request.id; });
+        router.registerHandler<agent::MessageType::Batch>([&](QLocalSocket* socket, const BatchRequest& request) {
+            std::vector<agent::MessageRouter::PreparedRequest> prepared;
+            QString                                            nestedError;
+            if (!router.prepareAll(socket, request.requests, prepared, nestedError)) {
+                log << "error " + nestedError;
+                return;
+            }
+            for (auto& run : prepared) {
+                if (!run(socket, nestedError)) {
+                    log << "error " + nestedError;
+                }
+            }
+        });
+
+        QString          error;
+        const QByteArray line  = R"({"type":"batch","requests":[{"type":"ping"}, {"type":"session.cancel","id":"a"},{"type":"session.cancel","id":"b"}]})";
+        const auto       batch = JsonMessage::parse(line);
+        QVERIFY(batch);
+        QCOMPARE(batch->elements("requests")->size(), 3);
+        QVERIFY(!batch->elements("type"));
+        QCOMPARE(router.dispatch(nullptr, *batch, error), agent::MessageRouter::DispatchStatus::Handled);
+        QCOMPARE(log, QStringList({"ping", "cancel a", "cancel b"}));
+
+        // A payload that fails to decode rejects the batch before any entry runs: "a" stays open
+        const char* undecodable[][2] = {
+            {R"({"type":"batch","requests":[{"type":"ping"},{"type":"session.cancel","id":"a"},{"type":"session.cancel"},{"type":"session.cancel","id":"b"}]})",
+             "error requests[2]: Missing id"},
+            {R"({"type":"batch","requests":[{"type":"session.cancel","id":"a"},{"type":"session.list"}]})", "error requests[1]: Unknown type"},
+        };
+        for (const auto& [request, expected] : undecodable) {
+            log.clear();
+            const auto msg = JsonMessage::parse(request);
+            QVERIFY2(msg, request);
+            QCOMPARE(router.dispatch(nullptr, *msg, error), agent::MessageRouter::DispatchStatus::Handled);
+            QCOMPARE(log, QStringList({expected}));
+            QVERIFY(!log.contains("cancel a"));
+        }
+
+        // Rejected whole by the batch decoder itself
+        log.clear();
+        const char* rejected[][2] = {
+            {R"({"type":"batch","requests":[]})", "Invalid requests"},
+            {R"({"type":"batch","requests":{"type":"ping"}})", "Invalid requests"},
+            {R"({"type":"batch","requests":[{"type":"ping"},1]})", "Invalid requests"},
+            {R"({"type":"batch","requests":[{"type":"ping"},{"type":"next"}]})", "Not allowed in batch: next"},
+            {R"({"type":"batch","requests":[{"type":"batch","requests":[{"type":"ping"}]}]})", "Not allowed in batch: batch"},
+        };
+        for (const auto& [request, expected] : rejected) {
+            const auto msg = JsonMessage::parse(request);
+            QVERIFY2(msg, request);
+            QCOMPARE(router.dispatch(nullptr, *msg, error), agent::MessageRouter::DispatchStatus::InvalidRequest);
+            QCOMPARE(error, QString(expected));
+        }
+        QVERIFY(log.isEmpty());
+    }
+
+    void AgentRoutingTest::messageRouter_authorizesBatchEntriesAsTheyRun() {
+        agent::MessageRouter router;
+        QStringList          log;
+        bool                 provider = false;
+        router.registerHandler<agent::MessageType::UiRegister>([&](QLocalSocket*, const QJsonObject&) {
+            provider = true;
+            log << "register";
+        });
+        router.registerHandler<agent::MessageType::UiUnregister>([&](QLocalSocket*, const EmptyRequest&) {
+            provider = false;
+            log << "unregister";
+        });
+        router.registerHandler<agent::MessageType::SessionRespond>(
+            [&provider](QLocalSocket*, const JsonMessage&, QString& guardError) {
+                if (provider) {
+                    return true;
+                }
+                guardError = QStringLiteral("Not active UI provider");
+                return false;
+            },
+            [&log](QLocalSocket*, const SessionRespondRequest& request) { log << "respond " + request.id; });
+
+        const auto runBatch = [&](const char* line) {
+            const auto batch = JsonMessage::parse(line);
+            QVERIFY2(batch, line);
+            BatchRequest request;
+            QString      error;
+            QVERIFY(agent::decodeRequest(*batch, request, error));
+
+            std::vector<agent::MessageRouter::PreparedRequest> prepared;
+            if (!router.prepareAll(nullptr, request.requests, prepared, error)) {
+                log << "error " + error;
+                return;
+            }
+            for (auto& run : prepared) {
+                if (!run(nullptr, error)) {
+                    log << "error " + error;
+                }
+            }
+        };
+
+        // Registering earlier in the batch authorizes what follows, as on separate lines
+        runBatch(R"({"type":"batch","requests":[{"type":"ui.register","name":"shell"},{"type":"session.respond","id":"a","response":"pw"}]})");
+        QCOMPARE(log, QStringList({"register", "respond a"}));
+
+        // Unregistering takes the rights away from the entries after it
+        log.clear();
+        runBatch(R"({"type":"batch","requests":[{"type":"ui.unregister"},{"type":"session.respond","id":"b","response":"pw"}]})");
+        QCOMPARE(log, QStringList({"unregister", "error Not active UI provider"}));
+        QVERIFY(!provider);
+
+        // A refused peer still learns nothing about the fields of a malformed entry
+        log.clear();
+        runBatch(R"({"type":"batch","requests":[{"type":"session.respond","id":"c"}]})");
+        QCOMPARE(log, QStringList({"error requests[0]: Not active UI provider"}));
+    }
+
+    void AgentRoutingTest::ipcServer_keepsEventsOutOfBatchReplies() {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString path = dir.filePath("bb-auth.sock");
+
+        IpcServer     server;
+        QLocalSocket* peer = nullptr;
+        connect(&server, &IpcServer::clientConnected, this, [&peer](QLocalSocket* socket) { peer = socket; });
+        QVERIFY(server.start(path));
+
+        QLocalSocket client;
+        client.connectToServer(path);
+        QVERIFY(client.waitForConnected(1000));
+        QTRY_VERIFY(peer != nullptr);
+
+        // As subscribe inside a batch: the snapshot goes out as events, the confirmation is a reply
+        server.beginBatch(peer);
+        server.sendEvent(peer, IpcServer::encodeJson(QJsonObject{{"type", "session.created"}, {"id", "a"}}));
+        server.sendJson(peer, QJsonObject{{"type", "subscribed"}});
+        server.sendEvent(peer, IpcServer::encodeJson(QJsonObject{{"type", "session.updated"}, {"id", "a"}}));
+        server.sendJson(peer, QJsonObject{{"type", "ok"}});
+        server.endBatch();
+
+        // Buffered writes are drained by the event loop, so it has to run for them to arrive
+        QList<QByteArray> lines;
+        QTRY_VERIFY([&client, &lines] {
+            while (client.canReadLine()) {
+                lines << client.readLine().trimmed();
+            }
+            return lines.size() >= 3;
+        }());
+        QCOMPARE(lines, QList<QByteArray>({R"({"id":"a","type":"session.created"})", R"({"id":"a","type":"session.updated"})",
+                                           R"({"type":"batch","replies":[{"type":"subscribed"},{"type":"ok"}]})"}));
+    }
+
+    void AgentRoutingTest::ipcServer_readsOneMessagePerPacket() {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString path = dir.filePath("bb-auth.sock");
+
+        IpcServer         server;
+        QList<QByteArray> types;
+        server.setMessageHandler([&types](QLocalSocket*, const JsonMessage& msg) { types << msg.type().toByteArray(); });
+        QVERIFY(server.start(path));
+
+        PacketClient client(path);
+        QVERIFY(client.isConnected());
+
+        // The packet frames the message: no newline needed, and one inside a packet does not split it
+        QVERIFY(client.send(R"({"type":"first"})"));
+        QVERIFY(client.send("{\"type\":\"second\"}\n"));
+        QVERIFY(client.send("{\"type\":\n\"third\"}\n"));
+        QTRY_COMPARE(types, (QList<QByteArray>{"first", "second", "third"}));
+    }
+
+    void AgentRoutingTest::ipcServer_queuesPacketsInOrderWhenSendBufferIsFull() {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString path = dir.filePath("bb-auth.sock");
+
+        IpcServer     server;
+        QLocalSocket* peer = nullptr;
+        connect(&server, &IpcServer::clientConnected, this, [&peer](QLocalSocket* socket) { peer = socket; });
+        QVERIFY(server.start(path));
+
+        PacketClient client(path);
+        QVERIFY(client.isConnected());
+        QTRY_VERIFY(peer != nullptr);
+
+        // Several times what the send buffer holds, written while the client reads nothing:
+        // the kernel refuses the rest with EAGAIN and those packets wait in order
+        constexpr int COUNT = 64;
+        const QString padding(8 * 1024, 'x');
+        for (int i = 0; i < COUNT; ++i) {
+            server.sendJson(peer, QJsonObject{{"type", "seq"}, {"n", i}, {"pad", padding}});
+        }
+        QCOMPARE(peer->state(), QLocalSocket::ConnectedState);
+
+        QList<QByteArray> packets;
+        QTRY_VERIFY_WITH_TIMEOUT(
+            [&client, &packets] {
+                packets << client.receive();
+                return packets.size() >= COUNT;
+            }(),
+            5000);
+        QCOMPARE(packets.size(), qsizetype(COUNT));
+        for (int i = 0; i < COUNT; ++i) {
+            const QJsonDocument doc = QJsonDocument::fromJson(packets[i]);
+            QVERIFY(doc.isObject());
+            QCOMPARE(doc.object().value("n").toInt(), i);
+        }
+    }
+
+    void AgentRoutingTest::ipcServer_splitsOversizedBatchIntoPackets() {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString path = dir.filePath("bb-auth.sock");
+
+        IpcServer     server;
+        QLocalSocket* peer = nullptr;
+        connect(&server, &IpcServer::clientConnected, this, [&peer](QLocalSocket* socket) { peer = socket; });
+        QVERIFY(server.start(path));
+
+        PacketClient client(path);
+        QVERIFY(client.isConnected());
+        QTRY_VERIFY(peer != nullptr);
+
+        // Replies adding up to more than one packet may carry
+        constexpr int REPLIES = 24;
+        const QString padding(4 * 1024, 'x');
+        server.beginBatch(peer);
+        for (int i = 0; i < REPLIES; ++i) {
+            server.sendJson(peer, QJsonObject{{"type", "reply"}, {"n", i}, {"pad", padding}});
+        }
+        server.endBatch();
+
+        QList<QByteArray> packets;
+        QTRY_VERIFY([&client, &packets] {
+            packets << client.receive();
+            return packets.size() >= REPLIES;
+        }());
+        QCOMPARE(packets.size(), qsizetype(REPLIES));
+        for (int i = 0; i < REPLIES; ++i) {
+            QVERIFY(packets[i].size() <= static_cast<qsizetype>(MAX_MESSAGE_SIZE));
+            const QJsonDocument doc = QJsonDocument::fromJson(packets[i]);
+            QVERIFY(doc.isObject());
+            QCOMPARE(doc.object().value("n").toInt(), i);
+        }
+    }
+
+    void AgentRoutingTest::jsonMessage_readsTopLevelTypeOnly() {
+        QCOMPARE(JsonMessage::parse(R"({"type":"ping"})")->type(), QByteArrayView("ping"));
+        QCOMPARE(JsonMessage::parse(R"( {"nested":{"type":"inner"},"list":[1,"x",null],"type":"next"} )")->type(), QByteArrayView("next"));
+        QCOMPARE(JsonMessage::parse(R"({"type":"a","type":"b"})")->type(), QByteArrayView("b"));
+        QCOMPARE(JsonMessage::parse(R"({"type":"p\u0069ng"})")->type(), QByteArrayView("ping"));
+
+        // Valid JSON without a usable type
+        QVERIFY(JsonMessage::parse(R"({"type":5})")->type().isEmpty());
+        QVERIFY(JsonMessage::parse(R"({})")->type().isEmpty());
+    }
+
+    void AgentRoutingTest::jsonMessage_rejectsInvalidJson() {
+        const char* invalid[] = {
+            R"({"type":"ping",})", R"({"type":"ping"} trailing)", R"([{"type":"ping"}])", R"({"type":"ping")", R"({"a":01})",
+            R"({"a":1.})",         R"({"a":tru})",                R"({"a":"\q"})",          R"({'a':1})",
+        };
+        for (const char* line : invalid) {
+            QVERIFY2(!JsonMessage::parse(line), line);
+        }
+
+        QVERIFY(!JsonMessage::parse(QByteArrayView("{\"a\":\"\xc3\"}")));
+    }
+
+    void AgentRoutingTest::jsonMessage_decodesFieldsOnDemand() {
+        const QByteArray line = R"({"type":"pinentry_request","cookie":"c\u00e9","flags":7,"ratio":1.5,"repeat":true,"nested":{"repeat":false}})";
+        const auto       msg  = JsonMessage::parse(line);
+        QVERIFY(msg);
+
+        QCOMPARE(msg->string("cookie"), QStringLiteral("c\u00e9"));
+        QCOMPARE(msg->integer("flags"), 7);
+        QCOMPARE(msg->integer("ratio", -1), -1);
+        QVERIFY(msg->boolean("repeat"));
+        QVERIFY(!msg->contains("missing"));
+        QCOMPARE(msg->kind("nested"), std::optional<JsonMessage::Kind>(JsonMessage::Kind::Object));
+        QCOMPARE(msg->object(), QJsonDocument::fromJson(line).object());
+    }
+
+    void AgentRoutingTest::jsonMessage_decodesSecretIntoWipedArena() {
+        auto&             arena  = SecureArena::instance();
+        const std::size_t before = arena.blocksInUse();
+
+        const auto        msg = JsonMessage::parse(R"({"type":"session.respond","id":"c1","response":"p\"w\u00e9\n"})");
+        QVERIFY(msg);
+        SecretString secret = msg->secret("response");
+        QCOMPARE(secret.view().toByteArray(), QByteArray("p\"w\xc3\xa9\n"));
+        QCOMPARE(arena.blocksInUse(), before + 1);
+
+        // Moving hands over the block; nothing is copied or allocated
+        SecretString moved = std::move(secret);
+        QVERIFY(secret.isEmpty());
+        QCOMPARE(arena.blocksInUse(), before + 1);
+
+        // Growth past the pool's largest block moves to a mapping of its own
+        moved.append(QByteArray(8192, 'x'));
+        QCOMPARE(moved.size(), std::size_t(8198));
+        QCOMPARE(arena.blocksInUse(), before + 1);
+
+        const char*       bytes = moved.data();
+        const std::size_t size  = moved.size();
+        moved.clear();
+        QVERIFY(std::all_of(bytes, bytes + size, [](char c) { return c == 0; }));
+
+        moved = SecretString();
+        QCOMPARE(arena.blocksInUse(), before);
+        QVERIFY(msg->secret("missing").isEmpty());
+
+        // Past the indexed members the secret is found by walking the line, not through object()
+        QByteArray padded = R"({"type":"session.respond","response":"first")";
+        for (int i = 0; i < 20; ++i) {
+            padded += QByteArray(",\"pad") + QByteArray::number(i) + "\":[{\"response\":\"nested\"}]";
+        }
+        padded += R"(,"resp\u006fnse":"p\tw","id":"c1"})";
+        const auto overflow = JsonMessage::parse(padded);
+        QVERIFY(overflow);
+        QCOMPARE(overflow->secret("response").view().toByteArray(), QByteArray("p\tw"));
+        QCOMPARE(overflow->string("id"), QString("c1"));
+        QVERIFY(overflow->secret("missing").isEmpty());
+    }
+
+    void AgentRoutingTest::secureMemory_freedBlocksHoldNoPassword() {
+        const QByteArray password = "correct horse battery staple";
+        struct Block {
+            const char* data;
+            std::size_t size;
+        };
+        std::vector<Block> blocks;
+        const auto         remember = [&blocks](const SecretString& secret) { blocks.push_back(Block{secret.data(), secret.capacity()}); };
+
+        // A reply line as IpcConnection receives it: two reads into spare room, then consumed
+        const QByteArray reply = QByteArray(R"({"type":"pinentry_response","id":"c1","result":"ok","password":"correct horse battery staple"})") + '\n';
+        SecretString     buffer;
+        std::memcpy(buffer.spare(20), reply.constData(), 20);
+        buffer.commit(20);
+        remember(buffer);
+        const auto rest = static_cast<std::size_t>(reply.size()) - 20;
+        std::memcpy(buffer.spare(rest), reply.constData() + 20, rest);
+        buffer.commit(rest);
+        remember(buffer);
+
+        // Decoded out of the line, grown into a larger block, and the line dropped
+        const auto msg = JsonMessage::parse(buffer.view().first(reply.size() - 1));
+        QVERIFY(msg);
+        SecretString secret = msg->secret("password");
+        QCOMPARE(secret.view().toByteArray(), password);
+        remember(secret);
+        buffer.removePrefix(static_cast<std::size_t>(reply.size()));
+        QVERIFY(buffer.isEmpty());
+        secret.append(QByteArray(200, '.'));
+        remember(secret);
+
+        buffer = SecretString();
+        secret = SecretString();
+
+        // Every block stays mapped in the arena after release, so it can be scanned
+        for (const Block& block : blocks) {
+            QVERIFY(block.size <= 4096);
+            const QByteArrayView freed(block.data, static_cast<qsizetype>(block.size));
+            QVERIFY(!freed.contains(QByteArrayView(password)));
+            QVERIFY(!freed.contains(QByteArrayView("correct")));
+        }
+    }
+
+    void AgentRoutingTest::secureMemory_poolHoldsNoPasswordAfterExchange() {
+        // Unique to this test, so whatever else lives in the pool cannot match
+        const QByteArray password = "exchange " + QUuid::createUuid().toByteArray();
+
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString path = dir.filePath("bb-auth.sock");
+
+        // The daemon side: the line is read into the connection buffer, the password
+        // decoded out of it and echoed back the way pinentry replies carry one
+        IpcServer server;
+        bool      received = false;
+        server.setMessageHandler([&](QLocalSocket* socket, const JsonMessage& msg) {
+            const SecretString response = msg.secret("response");
+            received                    = response.view() == QByteArrayView(password);
+            server.sendSecret(socket, QJsonObject{{"type", "pinentry_response"}, {"id", msg.string("id")}, {"result", "ok"}}, "password", response);
+        });
+        QVERIFY(server.start(path));
+
+        // The client side, as the pinentry mode reads it: waitLine() into the arena, then JsonMessage::secret()
+        {
+            IpcConnection connection(path);
+            QVERIFY(connection.open());
+            QVERIFY(connection.send(QJsonObject{{"type", "session.respond"}, {"id", "c1"}, {"response", QString::fromUtf8(password)}}));
+            QTRY_VERIFY(received);
+
+            const auto line = connection.waitLine(1000);
+            QVERIFY(line);
+            const auto reply = JsonMessage::parse(line->view());
+            QVERIFY(reply);
+            QCOMPARE(reply->secret("password").view(), QByteArrayView(password));
+        }
+        server.stop();
+
+        // Every arena block the exchange used has been released by now, and the pool
+        // keeps them mapped: the password must be nowhere in it. Only the pool is
+        // scanned; the heap copies listed in SecureMemory.hpp are not covered here.
+        const QByteArrayView pool = SecureArena::instance().pooled();
+        QVERIFY(!pool.isEmpty());
+        QVERIFY(!pool.contains(QByteArrayView(password)));
+    }
+
+    void AgentRoutingTest::metrics_histogramPercentilesWithinBucketError() {
+        using bb::metrics::LatencyHistogram;
+
+        // Every value lands in a bucket whose bound is >= the value and < the next value's bucket
+        for (qint64 value = 0; value < 100000; ++value) {
+            const std::size_t index = LatencyHistogram::bucketIndex(value);
+            QVERIFY(LatencyHistogram::bucketUpperBound(index) >= value);
+            QVERIFY(index == 0 || LatencyHistogram::bucketUpperBound(index - 1) < value);
+        }
+
+        auto histogram = std::make_unique<LatencyHistogram>();
+        QCOMPARE(histogram->percentile(0.5), qint64{0});
+
+        for (qint64 i = 1; i <= 1000; ++i) {
+            histogram->record(i * 1000);
+        }
+
+        QCOMPARE(histogram->count(), quint64{1000});
+        QCOMPARE(histogram->min(), qint64{1000});
+        QCOMPARE(histogram->max(), qint64{1000000});
+        QCOMPARE(histogram->mean(), 500500.0);
+
+        const auto withinBucketError = [](qint64 reported, qint64 exact) { return reported >= exact && reported <= exact + exact / 32; };
+        QVERIFY(withinBucketError(histogram->percentile(0.50), 500000));
+        QVERIFY(withinBucketError(histogram->percentile(0.90), 900000));
+        QVERIFY(withinBucketError(histogram->percentile(0.99), 990000));
+        QCOMPARE(histogram->percentile(1.0), qint64{1000000});
+
+        // Out-of-range values saturate instead of indexing past the buckets
+        histogram->record(-5);
+        histogram->record(LatencyHistogram::MAX_VALUE * 2);
+        QCOMPARE(histogram->min(), qint64{0});
+        QCOMPARE(histogram->max(), LatencyHistogram::MAX_VALUE);
+    }
+
+    void AgentRoutingTest::metrics_snapshotReportsStagesAndCounters() {
+        metrics::reset();
+
+        agent::ProviderRegistry registry;
+        agent::EventQueue       queue(10);
+        agent::EventRouter      router(registry, queue);
+        router.route(QJsonObject{{"type", "ui.active"}}, {}, [](QLocalSocket*, const QJsonObject&) {});
+        router.route(QJsonObject{{"type", "ui.active"}}, {}, [](QLocalSocket*, const QJsonObject&) {});
+        metrics::increment(metrics::Counter::BytesSent, 42);
+
+        QCOMPARE(metrics::counter(metrics::Counter::EventsRouted), quint64{2});
+        QCOMPARE(metrics::histogram(metrics::Stage::EventRoute).count(), quint64{2});
+
+        const QJsonObject snapshot = metrics::snapshot();
+        QCOMPARE(snapshot.value("unit").toString(), QStringLiteral("ns"));
+
+        const QJsonObject stages = snapshot.value("stages").toObject();
+        QCOMPARE(stages.size(), static_cast<qsizetype>(metrics::STAGE_COUNT));
+        QCOMPARE(stages.value("event.route").toObject().value("count").toInteger(), qint64{2});
+        QVERIFY(stages.value("event.route").toObject().contains("p999"));
+        QCOMPARE(stages.value("session.lifetime").toObject().value("count").toInteger(), qint64{0});
+
+        const QJsonObject counters = snapshot.value("counters").toObject();
+        QCOMPARE(counters.value("events_routed").toInteger(), qint64{2});
+        QCOMPARE(counters.value("bytes_sent").toInteger(), qint64{42});
+
+        metrics::reset();
+        QCOMPARE(metrics::counter(metrics::Counter::EventsRouted), quint64{0});
+    }
+
+    void AgentRoutingTest::traceDump_mergesRingsIntoFlows() {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+
+        struct Entry {
+            std::uint64_t timestampNs;
+            std::uint64_t durationNs;
+            char          phase;
+            const char*   name;
+            const char*   cookie;
+        };
+
+        // Same layout the writer maps; record 2 of the daemon ring is "mid-write" (sequence 0)
+        const auto writeRing = [&dir](const char* role, std::int32_t pid, std::initializer_list<Entry> entries, std::size_t unpublished) {
+            std::vector<char> bytes(trace::RING_BYTES, 0);
+            auto*             header = reinterpret_cast<trace::RingHeader*>(bytes.data());
+            std::memcpy(header->magic, trace::RING_MAGIC, sizeof(trace::RING_MAGIC));
+            header->version    = trace::RING_VERSION;
+            header->recordSize = sizeof(trace::Record);
+            header->capacity   = trace::RING_CAPACITY;
+            header->pid        = pid;
+            std::strncpy(header->role, role, sizeof(header->role) - 1);
+            header->head.store(entries.size());
+
+            auto*       records = reinterpret_cast<trace::Record*>(bytes.data() + sizeof(trace::RingHeader));
+            std::size_t index   = 0;
+            for (const Entry& entry : entries) {
+                trace::Record& rec = records[index];
+                rec.sequence.store(index == unpublished ? 0 : index + 1);
+                rec.timestampNs = entry.timestampNs;
+                rec.durationNs  = entry.durationNs;
+                rec.phase       = entry.phase;
+                rec.tid         = static_cast<std::uint32_t>(pid);
+                std::strncpy(rec.name, entry.name, sizeof(rec.name) - 1);
+                std::strncpy(rec.cookie, entry.cookie, sizeof(rec.cookie) - 1);
+                ++index;
+            }
+
+            QFile file(dir.filePath(QString("%1.%2.ring").arg(role).arg(pid)));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            QCOMPARE(file.write(bytes.data(), static_cast<qint64>(bytes.size())), static_cast<qint64>(bytes.size()));
+        };
+
+        writeRing("daemon", 100, {{5000, 2000, 'X', "polkit.initiate", "flow-a"}, {9000, 0, 'i', "agent.respond_polkit", "flow-a"}, {9500, 0, 'i', "torn", "flow-a"}},
+                  2);
+        writeRing("fallback", 200, {{6000, 0, 'i', "fallback.session_created", "flow-a"}, {7000, 0, 'i', "fallback.respond", "flow-b"}}, SIZE_MAX);
+
+        const QJsonArray all = trace::dumpChromeTrace({}, dir.path()).value("traceEvents").toArray();
+        QStringList      names;
+        int              flowBegins = 0;
+        for (const QJsonValue& value : all) {
+            const QJsonObject event = value.toObject();
+            if (event.value("ph").toString() == "b") {
+                ++flowBegins;
+            }
+            names << event.value("name").toString();
+        }
+        QVERIFY(!names.contains("torn"));
+        QCOMPARE(flowBegins, 2);
+
+        const QJsonArray flowA = trace::dumpChromeTrace("flow-a", dir.path()).value("traceEvents").toArray();
+        QJsonObject      initiate;
+        QJsonObject      begin;
+        QJsonObject      end;
+        for (const QJsonValue& value : flowA) {
+            const QJsonObject event = value.toObject();
+            QVERIFY(event.value("name").toString() != "fallback.respond");
+            if (event.value("name").toString() == "polkit.initiate") {
+                initiate = event;
+            } else if (event.value("ph").toString() == "b") {
+                begin = event;
+            } else if (event.value("ph").toString() == "e") {
+                end = event;
+            }
+        }
+
+        // Rebased on the flow's first record, in microseconds
+        QCOMPARE(initiate.value("ts").toDouble(), 0.0);
+        QCOMPARE(initiate.value("dur").toDouble(), 2.0);
+        QCOMPARE(initiate.value("pid").toInt(), 100);
+        QCOMPARE(begin.value("id").toString(), QStringLiteral("flow-a"));
+        QCOMPARE(end.value("ts").toDouble(), 4.0);
+    }
+
+    void AgentRoutingTest::timerWheel_firesDueEntriesAndSkipsCancelled() {
+        TimerWheel wheel(10);
+
+        QList<int>        fired;
+        TimerWheel::Entry early;
+        TimerWheel::Entry cancelled;
+        TimerWheel::Entry late;
+        TimerWheel::Entry rearmed;
+        auto              selfDestroying = std::make_unique<TimerWheel::Entry>();
+        early.setCallback([&fired] { fired.append(1); });
+        cancelled.setCallback([&fired] { fired.append(2); });
+        late.setCallback([&fired] { fired.append(3); });
+        rearmed.setCallback([&fired] { fired.append(5); });
+        selfDestroying->setCallback([&fired, &selfDestroying] {
+            fired.append(4);
+            selfDestroying.reset();
+        });
+
+        QElapsedTimer clock;
+        clock.start();
+        wheel.schedule(early, 20);
+        wheel.schedule(cancelled, 20);
+        wheel.schedule(*selfDestroying, 20);
+        // Beyond the first level: has to cascade down before it fires
+        const int lateMs = 10 * static_cast<int>(TimerWheel::SLOT_COUNT) + 50;
+        wheel.schedule(late, lateMs);
+        // Re-arming replaces the deadline
+        wheel.schedule(rearmed, 60 * 60 * 1000);
+        wheel.schedule(rearmed, 30);
+        QCOMPARE(wheel.armedCount(), std::size_t{5});
+
+        cancelled.cancel();
+        QVERIFY(!cancelled.isArmed());
+        QCOMPARE(wheel.armedCount(), std::size_t{4});
+
+        QTRY_COMPARE_WITH_TIMEOUT(fired.size(), 3, 1000);
+        QVERIFY(fired.contains(1));
+        QVERIFY(fired.contains(4));
+        QCOMPARE(fired.last(), 5);
+        QVERIFY(!selfDestroying);
+        QVERIFY(late.isArmed());
+
+        QTRY_COMPARE_WITH_TIMEOUT(fired.size(), 4, 5000);
+        QCOMPARE(fired.last(), 3);
+        QVERIFY(clock.elapsed() >= lateMs);
+        QCOMPARE(wheel.armedCount(), std::size_t{0});
+    }
+
+    void AgentRoutingTest::bootstrapState_reloadsOnlyWhenFileChanges() {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        qunsetenv("BB_AUTH_CONFLICT_MODE");
+
+        // The directory does not exist yet; watching waits for it without creating it
+        const QString path       = dir.filePath("bb-auth/bootstrap-state.env");
+        const auto    writeState = [&path](const QByteArray& contents) {
+            QFile file(path);
+            QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+            file.write(contents);
+        };
+
+        BootstrapState state;
+        int            changes = 0;
+        state.setOnChanged([&changes] { ++changes; });
+        state.watch(path);
+        QVERIFY(state.snapshot().isEmpty());
+        QCOMPARE(changes, 0);
+        QVERIFY(!QFileInfo::exists(dir.filePath("bb-auth")));
+
+        QVERIFY(QDir(dir.path()).mkdir("bb-auth"));
+        writeState("# written by bb-auth-bootstrap\ntimestamp=1700000000\nmode=session\n");
+        QTRY_COMPARE_WITH_TIMEOUT(changes, 1, 1000);
+        QCOMPARE(state.snapshot().value("mode").toString(), QString("session"));
+        QCOMPARE(state.snapshot().value("timestamp").toInteger(), 1700000000);
+
+        // Same contents: no new snapshot
+        writeState("timestamp=1700000000\nmode=session\n");
+        QTest::qWait(50);
+        QCOMPARE(changes, 1);
+
+        // Replaced by rename, as an atomic writer would
+        const QString staged = dir.filePath("bb-auth/staged.env");
+        {
+            QFile file(staged);
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write("mode=persistent\n");
+        }
+        QVERIFY(std::rename(QFile::encodeName(staged).constData(), QFile::encodeName(path).constData()) == 0);
+        QTRY_COMPARE_WITH_TIMEOUT(changes, 2, 1000);
+        QCOMPARE(state.snapshot().value("mode").toString(), QString("persistent"));
+
+        QVERIFY(QFile::remove(path));
+        QTRY_COMPARE_WITH_TIMEOUT(changes, 3, 1000);
+        QVERIFY(state.snapshot().isEmpty());
+
+        // The directory removed and made again: the watch falls back to the parent and moves back down
+        QVERIFY(QDir(dir.filePath("bb-auth")).removeRecursively());
+        QTest::qWait(50);
+        QVERIFY(QDir(dir.path()).mkdir("bb-auth"));
+        writeState("mode=warn\n");
+        QTRY_COMPARE_WITH_TIMEOUT(changes, 4, 1000);
+        QCOMPARE(state.snapshot().value("mode").toString(), QString("warn"));
+    }
+
 } // namespace bb
 
 int runAgentRoutingTests(int argc, char** argv) {
@@ -1,5 +1,7 @@
 #include "../src/fallback/prompt/PromptModelBuilder.hpp"
 #include "../src/fallback/prompt/PromptModel.hpp"
+#include "../src/fallback/prompt/PromptModelCache.hpp"
+#include "../src/fallback/prompt/TextNormalize.hpp"
 
 #include <QtTest/QtTest>
 
@@ -13,6 +15,9 @@ namespace bb {
         void securityKeyInfoClassifiesAsTouchAuth();
         void plainPolkitPromptRequiresPassword();
         void pinentryPromptRemainsPassphraseDriven();
+        void pinentryKeyDescriptionBecomesSummary();
+        void cachedViewSkipsReplayedRevisions();
+        void normalizationCollapsesWhitespaceAndFoldsCase();
 
       private:
         static QJsonObject makeEvent(const QString& source, const QString& message, const QString& info = QString());
@@ -68,6 +73,73 @@ namespace bb {
         QVERIFY(!model.allowEmptyResponse);
     }
 
+    void PromptModelBuilderTouchTest::pinentryKeyDescriptionBecomesSummary() {
+        const fallback::prompt::PromptModelBuilder builder;
+
+        const QString     description = "Please enter the passphrase to unlock the OpenPGP secret key:\n\"Alice Example <alice@example.org>\"\n"
+                                        "3072-bit RSA key, ID 0123456789ABCDEF,\ncreated 2021-04-05.";
+        const QJsonObject context{{"message", "Passphrase:"}, {"description", description}, {"requestor", QJsonObject{{"name", "gpg"}}}};
+        const QJsonObject event{{"type", "session.created"}, {"id", "session-3"}, {"source", "pinentry"}, {"context", context}};
+
+        const auto        model = builder.build(event);
+
+        QCOMPARE(model.intent, fallback::prompt::PromptIntent::OpenPgp);
+        QCOMPARE(model.summary, QString("Alice Example <alice@example.org>  •  0123456789ABCDEF  •  created 2021-04-05"));
+        QCOMPARE(model.details, QString("Please enter the passphrase to unlock the OpenPGP secret key:\n3072-bit RSA key, ID 0123456789ABCDEF,\ncreated 2021-04-05."));
+    }
+
+    void PromptModelBuilderTouchTest::cachedViewSkipsReplayedRevisions() {
+        fallback::prompt::PromptModelCache cache;
+        QJsonObject                        created = makeEvent("polkit", "Authentication is required");
+        created.insert("revision", 0);
+        const fallback::prompt::PromptView* view = &cache.created(created);
+        QCOMPARE(view->submitText, QString("Authenticate"));
+
+        QJsonObject updated{{"type", "session.updated"}, {"id", "session-1"}, {"prompt", "Password:"}, {"info", "Touch your security key"}, {"revision", 2}};
+        QCOMPARE(cache.updated(updated), view);
+        QCOMPARE(view->model.title, QString("Use Security Key"));
+        QCOMPARE(view->submitText, QString("Continue"));
+        QCOMPARE(view->status, QString("Touch your security key"));
+        QVERIFY(view->model.allowEmptyResponse);
+
+        // A resubscribe replays created and the same revision: the derived view stays as it was
+        created.insert("revision", 2);
+        QCOMPARE(&cache.created(created), view);
+        updated.insert("info", "stale");
+        cache.updated(updated);
+        QCOMPARE(view->status, QString("Touch your security key"));
+
+        updated.insert("revision", 3);
+        updated.insert("info", "");
+        updated.insert("error", "Authentication failed");
+        cache.updated(updated);
+        QCOMPARE(view->status, QString());
+        QCOMPARE(view->error, QString("Authentication failed"));
+        QCOMPARE(view->submitText, QString("Authenticate"));
+        QVERIFY(!view->model.allowEmptyResponse);
+
+        QVERIFY(cache.updated(QJsonObject{{"type", "session.updated"}, {"id", "unknown"}, {"revision", 1}}) == nullptr);
+        cache.remove("session-1");
+        QCOMPARE(cache.size(), 0);
+    }
+
+    void PromptModelBuilderTouchTest::normalizationCollapsesWhitespaceAndFoldsCase() {
+        using fallback::prompt::normalizeCompareText;
+        using fallback::prompt::normalizeDetailText;
+        using fallback::prompt::textEquivalent;
+
+        QCOMPARE(normalizeDetailText("  Unlock\tthe   key \r\n\r\n  for \"Alice\"  \n"), QString("Unlock the key\nfor \"Alice\""));
+        QCOMPARE(normalizeDetailText(QString::fromUtf8("a\u00a0\u00a0b\u3000")), QString("a b"));
+        QCOMPARE(normalizeDetailText(" \r\n\t"), QString());
+
+        QCOMPARE(normalizeCompareText("Unlock `Login`, \"NOW\".\nThanks."), QString("unlock login now thanks"));
+        QCOMPARE(normalizeCompareText(QString::fromUtf8("\u0130STANBUL \U00010400")), QString::fromUtf8("i\u0307stanbul \U00010428"));
+
+        QVERIFY(textEquivalent("Authentication is required.", "authentication   is REQUIRED to install software"));
+        QVERIFY(!textEquivalent("Authentication is required", "Authorization is required"));
+        QVERIFY(!textEquivalent(" .. ", "anything"));
+    }
+
 } // namespace bb
 
 int runFallbackWindowTouchModelTests(int argc, char** argv) {
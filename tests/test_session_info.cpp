@@ -1,7 +1,9 @@
 #include "../src/core/Session.hpp"
+#include "../src/core/agent/SessionStore.hpp"
 
 #include <QtTest/QtTest>
 #include <QApplication>
+#include <QJsonDocument>
 
 int runFallbackWindowTouchModelTests(int argc, char** argv);
 int runAgentRoutingTests(int argc, char** argv);
@@ -13,6 +15,8 @@ class SessionInfoTest : public QObject {
     void toUpdatedEventIncludesInfoAfterSetInfo();
     void setPromptClearsStaleInfo();
     void updatedEventCanContainErrorAndInfo();
+    void revisionAdvancesWithEachTransition();
+    void storeSnapshotTracksOpenSessions();
 
   private:
     static bb::Session makePolkitSession();
@@ -61,6 +65,72 @@ void SessionInfoTest::updatedEventCanContainErrorAndInfo() {
     QCOMPARE(event.value("info").toString(), QString("Touch your security key"));
 }
 
+void SessionInfoTest::revisionAdvancesWithEachTransition() {
+    bb::Session session = makePolkitSession();
+    QCOMPARE(session.toCreatedEvent().value("revision").toInteger(), 0);
+
+    session.setPrompt("Password:", false);
+    const qint64 prompted = session.toUpdatedEvent().value("revision").toInteger();
+    session.setInfo("Touch your security key");
+    const qint64 informed = session.toUpdatedEvent().value("revision").toInteger();
+    session.setError("Authentication failed");
+
+    QVERIFY(prompted > 0);
+    QVERIFY(informed > prompted);
+    QVERIFY(session.toUpdatedEvent().value("revision").toInteger() > informed);
+    QCOMPARE(session.toCreatedEvent().value("revision"), session.toUpdatedEvent().value("revision"));
+}
+
+void SessionInfoTest::storeSnapshotTracksOpenSessions() {
+    bb::agent::SessionStore store;
+    QVERIFY(store.encodedSnapshot().isEmpty());
+
+    bb::Session::Context context;
+    context.message = "Authenticate to continue";
+    store.createSession("session-1", bb::Session::Source::Polkit, context);
+    store.createSession("session-2", bb::Session::Source::Polkit, context);
+    store.updatePrompt("session-1", "Password:", false, true);
+
+    // One created and one updated line per session, each carrying the current revision
+    const auto linesFor = [&store](const QString& id) {
+        QList<QJsonObject> lines;
+        for (const QByteArray& line : store.encodedSnapshot().split('\n')) {
+            const QJsonObject event = QJsonDocument::fromJson(line).object();
+            if (event.value("id").toString() == id) {
+                lines << event;
+            }
+        }
+        return lines;
+    };
+
+    QList<QJsonObject> first = linesFor("session-1");
+    QCOMPARE(first.size(), 2);
+    QCOMPARE(first[0].value("type").toString(), QString("session.created"));
+    QCOMPARE(first[1].value("type").toString(), QString("session.updated"));
+    QCOMPARE(first[1].value("prompt").toString(), QString("Password:"));
+    QCOMPARE(first[1].value("revision"), QJsonValue(static_cast<qint64>(store.getSession("session-1")->revision())));
+    QCOMPARE(linesFor("session-2").size(), 2);
+
+    // Unchanged since the last call: the same image, not a rebuilt one
+    const quint64 sequence = store.sequence();
+    const char*   image    = store.encodedSnapshot().constData();
+    QVERIFY(store.encodedSnapshot().constData() == image);
+    QCOMPARE(store.sequence(), sequence);
+
+    store.updateError("session-1", "Authentication failed");
+    QVERIFY(store.sequence() > sequence);
+    QCOMPARE(linesFor("session-1")[1].value("error").toString(), QString("Authentication failed"));
+
+    store.closeSession("session-1", bb::Session::Result::Cancelled);
+    QVERIFY(linesFor("session-1").isEmpty());
+    QCOMPARE(linesFor("session-2").size(), 2);
+    QCOMPARE(store.tableSizes().value("session_snapshots").toInteger(), 1);
+
+    store.closeSession("session-2", bb::Session::Result::Cancelled);
+    QVERIFY(store.encodedSnapshot().isEmpty());
+    QCOMPARE(store.tableSizes().value("session_snapshots").toInteger(), 0);
+}
+
 int main(int argc, char** argv) {
     QApplication    app(argc, argv);
     SessionInfoTest sessionInfoTest;